@@ -33,6 +33,7 @@ static GeglOptions *opts_new (void)
   o->mode     = GEGL_RUN_MODE_DISPLAY;
   o->xml      = NULL;
   o->output   = NULL;
+  o->socket   = NULL;
   o->files    = NULL;
   o->file     = NULL;
   o->rest     = NULL;
@@ -70,6 +71,11 @@ _("usage: %s [options] <file | -- [op [op] ..]>\n"
 "\n"
 "     -X              output the XML that was read in\n"
 "\n"
+"     --server [socket]  keep running, processing jobs read from stdin or\n"
+"                     from connections to the named unix socket, one JSON\n"
+"                     object per line with input, xml, chain, output and\n"
+"                     scale members, replying with timings and statistics.\n"
+"\n"
 "     -v, --verbose   print diagnostics while running\n"
 "\n"
 "All parameters following -- are considered ops to be chained together\n"
@@ -129,6 +135,8 @@ print_opts (GeglOptions *o)
         mode_str = _("Output in a file"); break;
       case GEGL_RUN_MODE_HELP:
         mode_str = _("Display help information"); break;
+      case GEGL_RUN_MODE_SERVER:
+        mode_str = _("Process jobs as a server"); break;
       default:
         g_warning (_("Unknown GeglOption mode: %d"), o->mode);
         mode_str = _("unknown mode");
@@ -448,6 +456,12 @@ parse_args (int    argc,
             o->mode = GEGL_RUN_MODE_XML;
         }
 
+        else if (match ("--server")) {
+            o->mode = GEGL_RUN_MODE_SERVER;
+            if (curr[1] && curr[1][0] != '-')
+              get_string (o->socket);
+        }
+
         else if (match ("--")) {
             o->rest = curr + 1;
             break;
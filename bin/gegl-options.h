@@ -27,7 +27,8 @@ typedef enum
   GEGL_RUN_MODE_DISPLAY,
   GEGL_RUN_MODE_THUMBNAIl,
   GEGL_RUN_MODE_OUTPUT,
-  GEGL_RUN_MODE_XML
+  GEGL_RUN_MODE_XML,
+  GEGL_RUN_MODE_SERVER
 } GeglRunMode;
 
 typedef struct _GeglOptions GeglOptions;
@@ -39,6 +40,7 @@ struct _GeglOptions
   const gchar *file;
   const gchar *xml;
   const gchar *output;
+  const gchar *socket;
 
   GList       *files;
 
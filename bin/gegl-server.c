@@ -0,0 +1,682 @@
+/* This file is part of GEGL editor -- a gtk frontend for GEGL
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib/gi18n-lib.h>
+#include <gio/gio.h>
+#ifdef G_OS_UNIX
+#include <sys/stat.h>
+#include <gio/gunixsocketaddress.h>
+#endif
+#include <json-glib/json-glib.h>
+#include <gegl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gegl-server.h"
+
+#define STDIN_BUF_SIZE 4096
+
+/* the members of a job, see gegl-server.h */
+typedef struct
+{
+  JsonNode    *id;
+  const gchar *input;
+  const gchar *xml;
+  const gchar *chain;
+  const gchar *output;
+  const gchar *path_root;
+  gdouble      scale;
+} ServerJob;
+
+static gboolean verbose = FALSE;
+static gint     n_jobs  = 0;
+
+static const gchar *
+job_get_string (JsonObject  *object,
+                const gchar *member,
+                GError     **error)
+{
+  JsonNode *node = json_object_get_member (object, member);
+
+  if (! node || JSON_NODE_HOLDS_NULL (node) || (error && *error))
+    return NULL;
+
+  if (json_node_get_value_type (node) != G_TYPE_STRING)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "'%s' has to be a string", member);
+      return NULL;
+    }
+
+  return json_node_get_string (node);
+}
+
+static gboolean
+job_parse (JsonObject  *object,
+           ServerJob   *job,
+           GError     **error)
+{
+  GError *local_error = NULL;
+
+  job->id        = json_object_get_member (object, "id");
+  job->input     = job_get_string (object, "input",     &local_error);
+  job->xml       = job_get_string (object, "xml",       &local_error);
+  job->chain     = job_get_string (object, "chain",     &local_error);
+  job->output    = job_get_string (object, "output",    &local_error);
+  job->path_root = job_get_string (object, "path-root", &local_error);
+  job->scale     = 1.0;
+
+  if (json_object_has_member (object, "scale"))
+    {
+      JsonNode *node = json_object_get_member (object, "scale");
+
+      if (JSON_NODE_HOLDS_VALUE (node) &&
+          (json_node_get_value_type (node) == G_TYPE_DOUBLE ||
+           json_node_get_value_type (node) == G_TYPE_INT64))
+        job->scale = json_node_get_double (node);
+      else
+        job->scale = 0.0;
+    }
+
+  if (local_error)
+    {
+      g_propagate_error (error, local_error);
+      return FALSE;
+    }
+
+  if (! job->output)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "the job has no output");
+      return FALSE;
+    }
+
+  if (! job->input && ! job->xml && ! job->chain)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "the job has no input, xml or chain");
+      return FALSE;
+    }
+
+  if (job->scale <= 0.0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "the scale has to be a positive number");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* whether gegl:load fell back to rendering an error message */
+static gboolean
+job_load_failed (GeglNode *load)
+{
+  GSList   *children = gegl_node_get_children (load);
+  GSList   *iter;
+  gboolean  failed   = FALSE;
+
+  for (iter = children; iter; iter = iter->next)
+    {
+      if (! g_strcmp0 (gegl_node_get_operation (iter->data), "gegl:text"))
+        failed = TRUE;
+    }
+
+  g_slist_free (children);
+
+  return failed;
+}
+
+/* builds and processes the graph of a job, the same way the command line
+ * does: the chain is appended to the xml graph, or to the loaded input.
+ */
+static gboolean
+job_run (ServerJob  *job,
+         GError    **error)
+{
+  GeglNode      *gegl;
+  GeglNode      *proxy;
+  GeglNode      *iter;
+  GeglNode      *sink;
+  GeglRectangle  bounds;
+  gchar         *path_root;
+  gboolean       success;
+
+  if (job->path_root)
+    path_root = g_strdup (job->path_root);
+  else
+    path_root = g_get_current_dir ();
+
+  if (job->xml)
+    {
+      gegl = gegl_node_new_from_xml (job->xml, path_root);
+
+      if (! gegl)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "invalid xml");
+          g_free (path_root);
+          return FALSE;
+        }
+    }
+  else
+    {
+      gegl = gegl_node_new ();
+    }
+
+  proxy = gegl_node_get_output_proxy (gegl, "output");
+
+  if (job->input && ! job->xml)
+    {
+      gchar    *path = g_build_filename (path_root, job->input, NULL);
+      GeglNode *load;
+
+      if (g_path_is_absolute (job->input))
+        {
+          g_free (path);
+          path = g_strdup (job->input);
+        }
+
+      load = gegl_node_new_child (gegl,
+                                  "operation", "gegl:load",
+                                  "path",      path,
+                                  NULL);
+      gegl_node_link (load, proxy);
+
+      /* loaders report an empty extent for files they can't decode, and
+       * gegl:load renders a message instead of files it can't open.
+       */
+      bounds = gegl_node_get_bounding_box (load);
+
+      if (gegl_rectangle_is_empty (&bounds) || job_load_failed (load))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "failed to load '%s'", path);
+          g_object_unref (gegl);
+          g_free (path);
+          g_free (path_root);
+          return FALSE;
+        }
+
+      g_free (path);
+    }
+
+  iter = gegl_node_get_producer (proxy, "input", NULL);
+
+  if (job->chain)
+    {
+      GError *chain_error = NULL;
+
+      bounds = gegl_node_get_bounding_box (gegl);
+
+      gegl_create_chain (job->chain, iter, proxy, 0.0, bounds.height,
+                         path_root, &chain_error);
+
+      if (chain_error)
+        {
+          g_propagate_error (error, chain_error);
+          g_object_unref (gegl);
+          g_free (path_root);
+          return FALSE;
+        }
+    }
+
+  g_free (path_root);
+
+  bounds = gegl_node_get_bounding_box (gegl);
+
+  if (gegl_rectangle_is_empty (&bounds) ||
+      gegl_rectangle_is_infinite_plane (&bounds))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "the result has no finite extent");
+      g_object_unref (gegl);
+      return FALSE;
+    }
+
+  sink = gegl_node_new_child (gegl,
+                              "operation", "gegl:save",
+                              "path",      job->output,
+                              NULL);
+
+  if (job->scale != 1.0)
+    {
+      GeglNode *scale = gegl_node_new_child (gegl,
+                                             "operation", "gegl:scale-ratio",
+                                             "x",         job->scale,
+                                             "y",         job->scale,
+                                             NULL);
+
+      gegl_node_link_many (gegl, scale, sink, NULL);
+    }
+  else
+    {
+      gegl_node_link (gegl, sink);
+    }
+
+  success = gegl_node_process_save (sink, error);
+
+  g_object_unref (gegl);
+
+  return success;
+}
+
+static void
+add_stats (JsonBuilder *builder)
+{
+  GObject     *stats = G_OBJECT (gegl_stats ());
+  GParamSpec **pspecs;
+  guint        n_pspecs;
+  guint        i;
+
+  pspecs = g_object_class_list_properties (G_OBJECT_GET_CLASS (stats),
+                                           &n_pspecs);
+
+  json_builder_set_member_name (builder, "stats");
+  json_builder_begin_object (builder);
+
+  for (i = 0; i < n_pspecs; i++)
+    {
+      GValue value = G_VALUE_INIT;
+      GValue number = G_VALUE_INIT;
+
+      if (! (pspecs[i]->flags & G_PARAM_READABLE))
+        continue;
+
+      g_value_init (&value, pspecs[i]->value_type);
+      g_object_get_property (stats, pspecs[i]->name, &value);
+
+      if (G_VALUE_HOLDS_BOOLEAN (&value))
+        {
+          json_builder_set_member_name (builder, pspecs[i]->name);
+          json_builder_add_boolean_value (builder,
+                                          g_value_get_boolean (&value));
+        }
+      else if (g_value_type_transformable (G_VALUE_TYPE (&value),
+                                           G_TYPE_DOUBLE) &&
+               G_TYPE_IS_FUNDAMENTAL (G_VALUE_TYPE (&value)))
+        {
+          g_value_init (&number, G_TYPE_DOUBLE);
+          g_value_transform (&value, &number);
+
+          json_builder_set_member_name (builder, pspecs[i]->name);
+          json_builder_add_double_value (builder, g_value_get_double (&number));
+
+          g_value_unset (&number);
+        }
+
+      g_value_unset (&value);
+    }
+
+  json_builder_end_object (builder);
+
+  g_free (pspecs);
+}
+
+/* processes one line of input, returning the reply to it, or NULL when
+ * the server should quit.
+ */
+static gchar *
+server_process_line (const gchar *line)
+{
+  JsonParser    *parser;
+  JsonBuilder   *builder;
+  JsonGenerator *generator;
+  JsonNode      *root;
+  JsonObject    *object = NULL;
+  ServerJob      job    = {};
+  GError        *error  = NULL;
+  gint64         start;
+  gchar         *reply;
+
+  parser = json_parser_new ();
+
+  if (json_parser_load_from_data (parser, line, -1, &error))
+    {
+      root = json_parser_get_root (parser);
+
+      if (root && JSON_NODE_HOLDS_OBJECT (root))
+        object = json_node_get_object (root);
+      else
+        g_set_error (&error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "a job has to be a JSON object");
+    }
+
+  if (object && json_object_has_member (object, "command"))
+    {
+      const gchar *command = job_get_string (object, "command", NULL);
+
+      if (! g_strcmp0 (command, "quit"))
+        {
+          g_object_unref (parser);
+          return NULL;
+        }
+    }
+
+  n_jobs++;
+  start = g_get_monotonic_time ();
+
+  /* the tile cache stays warm between jobs, its counters don't */
+  gegl_reset_stats ();
+
+  if (object && job_parse (object, &job, &error))
+    job_run (&job, &error);
+
+  builder = json_builder_new ();
+  json_builder_begin_object (builder);
+
+  json_builder_set_member_name (builder, "id");
+  if (job.id)
+    json_builder_add_value (builder, json_node_copy (job.id));
+  else
+    json_builder_add_int_value (builder, n_jobs);
+
+  json_builder_set_member_name (builder, "status");
+  json_builder_add_string_value (builder, error ? "error" : "ok");
+
+  if (error)
+    {
+      json_builder_set_member_name (builder, "message");
+      json_builder_add_string_value (builder, error->message);
+    }
+
+  json_builder_set_member_name (builder, "seconds");
+  json_builder_add_double_value (builder,
+                                 (g_get_monotonic_time () - start) / 1000000.0);
+
+  add_stats (builder);
+
+  json_builder_end_object (builder);
+
+  generator = json_generator_new ();
+  root = json_builder_get_root (builder);
+  json_generator_set_root (generator, root);
+  reply = json_generator_to_data (generator, NULL);
+
+  if (verbose)
+    fprintf (stderr, "job %i: %s\n", n_jobs, reply);
+
+  json_node_free (root);
+  g_object_unref (generator);
+  g_object_unref (builder);
+  g_object_unref (parser);
+  g_clear_error (&error);
+
+  return reply;
+}
+
+/* returns FALSE once a quit command was received */
+static gboolean
+server_serve_stdin (void)
+{
+  gchar    buf[STDIN_BUF_SIZE];
+  GString *line = g_string_new ("");
+  gboolean keep_running = TRUE;
+
+  while (keep_running && fgets (buf, STDIN_BUF_SIZE, stdin))
+    {
+      gchar *reply;
+
+      g_string_append (line, buf);
+
+      if (line->len == 0 || line->str[line->len - 1] != '\n')
+        continue;
+
+      g_strstrip (line->str);
+
+      if (line->str[0])
+        {
+          reply = server_process_line (line->str);
+
+          if (reply)
+            {
+              fprintf (stdout, "%s\n", reply);
+              fflush (stdout);
+              g_free (reply);
+            }
+          else
+            {
+              keep_running = FALSE;
+            }
+        }
+
+      g_string_truncate (line, 0);
+    }
+
+  /* a last job without a newline */
+  g_strstrip (line->str);
+
+  if (keep_running && line->str[0])
+    {
+      gchar *reply = server_process_line (line->str);
+
+      if (reply)
+        fprintf (stdout, "%s\n", reply);
+      g_free (reply);
+    }
+
+  g_string_free (line, TRUE);
+
+  return keep_running;
+}
+
+#ifdef G_OS_UNIX
+/* returns FALSE once a quit command was received */
+static gboolean
+server_serve_connection (GSocketConnection *connection)
+{
+  GDataInputStream *input;
+  GOutputStream    *output;
+  gchar            *line;
+  GError           *error = NULL;
+  gboolean          keep_running = TRUE;
+
+  input  = g_data_input_stream_new (
+             g_io_stream_get_input_stream (G_IO_STREAM (connection)));
+  output = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+
+  while (keep_running &&
+         (line = g_data_input_stream_read_line_utf8 (input, NULL,
+                                                     NULL, &error)))
+    {
+      gchar *reply;
+
+      g_strstrip (line);
+
+      if (! line[0])
+        {
+          g_free (line);
+          continue;
+        }
+
+      reply = server_process_line (line);
+
+      if (reply)
+        {
+          if (! g_output_stream_write_all (output, reply, strlen (reply),
+                                           NULL, NULL, &error) ||
+              ! g_output_stream_write_all (output, "\n", 1,
+                                           NULL, NULL, &error))
+            {
+              g_free (reply);
+              g_free (line);
+              break;
+            }
+
+          g_free (reply);
+        }
+      else
+        {
+          keep_running = FALSE;
+        }
+
+      g_free (line);
+    }
+
+  if (error)
+    {
+      fprintf (stderr, "gegl server: %s\n", error->message);
+      g_clear_error (&error);
+    }
+
+  g_object_unref (input);
+
+  return keep_running;
+}
+
+/* removes a socket left behind by a previous server, which nothing listens
+ * on anymore; returns FALSE if the path is in use.
+ */
+static gboolean
+server_remove_stale_socket (const gchar    *socket_path,
+                            GSocketAddress *address)
+{
+  GSocketClient     *client;
+  GSocketConnection *connection;
+  GStatBuf           socket_stat;
+  GError            *error = NULL;
+
+  if (g_lstat (socket_path, &socket_stat))
+    return TRUE;
+
+  if (! S_ISSOCK (socket_stat.st_mode))
+    {
+      fprintf (stderr, "gegl server: %s exists, and is not a socket\n",
+               socket_path);
+      return FALSE;
+    }
+
+  client     = g_socket_client_new ();
+  connection = g_socket_client_connect (client,
+                                        G_SOCKET_CONNECTABLE (address),
+                                        NULL, &error);
+  g_object_unref (client);
+
+  if (connection)
+    {
+      fprintf (stderr, "gegl server: another server is listening on %s\n",
+               socket_path);
+      g_io_stream_close (G_IO_STREAM (connection), NULL, NULL);
+      g_object_unref (connection);
+      return FALSE;
+    }
+
+  if (! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_REFUSED))
+    {
+      fprintf (stderr, "gegl server: %s\n", error->message);
+      g_clear_error (&error);
+      return FALSE;
+    }
+
+  g_clear_error (&error);
+
+  if (g_unlink (socket_path))
+    {
+      fprintf (stderr, "gegl server: failed to remove %s\n", socket_path);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gint
+server_serve_socket (const gchar *socket_path)
+{
+  GSocketListener *listener;
+  GSocketAddress  *address;
+  GError          *error = NULL;
+  gboolean         keep_running = TRUE;
+
+  address = g_unix_socket_address_new (socket_path);
+
+  if (! server_remove_stale_socket (socket_path, address))
+    {
+      g_object_unref (address);
+      return 1;
+    }
+
+  listener = g_socket_listener_new ();
+
+  if (! g_socket_listener_add_address (listener, address,
+                                       G_SOCKET_TYPE_STREAM,
+                                       G_SOCKET_PROTOCOL_DEFAULT,
+                                       NULL, NULL, &error))
+    {
+      fprintf (stderr, "gegl server: %s\n", error->message);
+      g_clear_error (&error);
+      g_object_unref (address);
+      g_object_unref (listener);
+      return 1;
+    }
+
+  if (verbose)
+    fprintf (stderr, "gegl server: listening on %s\n", socket_path);
+
+  /* connections are served one at a time, each job using all threads */
+  while (keep_running)
+    {
+      GSocketConnection *connection;
+
+      connection = g_socket_listener_accept (listener, NULL, NULL, &error);
+
+      if (! connection)
+        {
+          fprintf (stderr, "gegl server: %s\n", error->message);
+          g_clear_error (&error);
+          break;
+        }
+
+      keep_running = server_serve_connection (connection);
+
+      g_io_stream_close (G_IO_STREAM (connection), NULL, NULL);
+      g_object_unref (connection);
+    }
+
+  g_socket_listener_close (listener);
+  g_object_unref (address);
+  g_object_unref (listener);
+
+  g_unlink (socket_path);
+
+  return 0;
+}
+#endif
+
+gint
+gegl_server_main (const gchar *socket_path,
+                  gboolean     server_verbose)
+{
+  verbose = server_verbose;
+
+  if (! socket_path)
+    {
+      server_serve_stdin ();
+      return 0;
+    }
+
+#ifdef G_OS_UNIX
+  return server_serve_socket (socket_path);
+#else
+  fprintf (stderr, _("gegl server: sockets are not supported on this "
+                     "platform, reading jobs from stdin instead\n"));
+  server_serve_stdin ();
+  return 0;
+#endif
+}
@@ -0,0 +1,37 @@
+/* This file is part of GEGL editor -- a gtk frontend for GEGL
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GEGL_SERVER
+#define GEGL_SERVER
+
+#include <glib.h>
+
+/* processes jobs read from stdin, or from connections to a unix socket at
+ * socket_path when it isn't NULL, until the input ends or a quit command is
+ * received.  each job is a JSON object on a line of its own:
+ *
+ *   {"id": 1, "input": "in.jpg", "chain": "gegl:gaussian-blur std-dev-x=4",
+ *    "output": "out.png", "scale": 0.25}
+ *
+ * where "xml" can be given instead of, or in addition to "input", and
+ * "chain" follows the syntax of gegl_create_chain().  each job is answered
+ * with a line holding its id, status, processing time and a snapshot of
+ * gegl_stats().
+ */
+gint gegl_server_main (const gchar *socket_path,
+                       gboolean     verbose);
+
+#endif
@@ -30,6 +30,7 @@
 #endif
 
 #include "gegl-options.h"
+#include "gegl-server.h"
 #ifdef HAVE_SPIRO
 #include "gegl-path-spiro.h"
 #endif
@@ -93,6 +94,185 @@ static gboolean is_xml_fragment (const char *data)
   return FALSE;
 }
 
+/* the number of frames in flight while rendering video: one being encoded,
+ * one being rendered, and one rendered frame waiting in between.
+ */
+#define VIDEO_QUEUE_LENGTH 3
+
+typedef struct
+{
+  guchar            *pixels; /* NULL marks the end of the video */
+  GeglAudioFragment *audio;
+  gint               frame_no;
+} VideoFrame;
+
+typedef struct
+{
+  GeglNode      *output;
+  GeglBuffer    *buffer;
+  GeglRectangle  bounds;
+  gint           duration;
+  GAsyncQueue   *rendered; /* frames waiting to be encoded */
+  GAsyncQueue   *free;     /* frames available for rendering */
+} VideoPipeline;
+
+/* ff-load reuses its audio fragment for every frame, so rendered frames
+ * carry a copy of it.
+ */
+static GeglAudioFragment *
+video_audio_copy (GeglAudioFragment *audio)
+{
+  GeglAudioFragment *copy;
+  gint               channels;
+  gint               sample_count;
+  gint               c;
+
+  channels     = gegl_audio_fragment_get_channels (audio);
+  sample_count = gegl_audio_fragment_get_sample_count (audio);
+
+  copy = gegl_audio_fragment_new (gegl_audio_fragment_get_sample_rate (audio),
+                                  channels,
+                                  gegl_audio_fragment_get_channel_layout (audio),
+                                  MAX (sample_count, 1));
+  gegl_audio_fragment_set_sample_count (copy, sample_count);
+  gegl_audio_fragment_set_pos (copy, gegl_audio_fragment_get_pos (audio));
+
+  for (c = 0; c < channels; c++)
+    memcpy (copy->data[c], audio->data[c], sample_count * sizeof (gfloat));
+
+  return copy;
+}
+
+static gpointer
+video_encode_thread (VideoPipeline *pipeline)
+{
+  while (TRUE)
+    {
+      VideoFrame *frame = g_async_queue_pop (pipeline->rendered);
+
+      if (! frame->pixels)
+        break;
+
+      gegl_buffer_set (pipeline->buffer, &pipeline->bounds, 0,
+                       babl_format ("R'G'B'A u8"),
+                       frame->pixels, GEGL_AUTO_ROWSTRIDE);
+
+      if (frame->audio)
+        gegl_node_set (pipeline->output, "audio", frame->audio, NULL);
+      fprintf (stderr, "\r%i/%i %p",
+               frame->frame_no, pipeline->duration - 1, frame->audio);
+
+      gegl_node_process (pipeline->output);
+
+      g_clear_object (&frame->audio);
+      g_async_queue_push (pipeline->free, frame);
+    }
+
+  return NULL;
+}
+
+/* renders the frames of the video loaded by the first node of the chain,
+ * encoding each frame on a separate thread while the next one is being
+ * decoded and rendered.
+ */
+static void
+render_video (GeglNode    *gegl,
+              const gchar *path,
+              gdouble      scale)
+{
+  VideoPipeline  pipeline;
+  VideoFrame     frames[VIDEO_QUEUE_LENGTH] = {};
+  VideoFrame     end                        = {};
+  GeglNode      *encoder;
+  GeglNode      *source;
+  GeglNode      *iter;
+  GThread       *thread;
+  gint           frame_no = 0;
+  gint           i;
+
+  pipeline.bounds = gegl_node_get_bounding_box (gegl);
+  pipeline.bounds.x      *= scale;
+  pipeline.bounds.y      *= scale;
+  pipeline.bounds.width  *= scale;
+  pipeline.bounds.height *= scale;
+
+  pipeline.buffer = gegl_buffer_new (&pipeline.bounds,
+                                     babl_format ("R'G'B'A u8"));
+
+  /* the encoding nodes live in their own graph, so that they can be
+   * processed while the main graph renders.
+   */
+  encoder = gegl_node_new ();
+  source = gegl_node_new_child (encoder, "operation", "gegl:buffer-source",
+                                         "buffer", pipeline.buffer,
+                                         NULL);
+  pipeline.output = gegl_node_new_child (encoder,
+                                         "operation", "gegl:ff-save",
+                                         "path", path,
+                                         "video-bit-rate", 4000,
+                                         NULL);
+  gegl_node_connect (source, "output", pipeline.output, "input");
+
+  iter = gegl_node_get_output_proxy (gegl, "output");
+
+  while (gegl_node_get_producer (iter, "input", NULL))
+    iter = (gegl_node_get_producer (iter, "input", NULL));
+
+  pipeline.duration = 0;
+  gegl_node_get (iter, "frames", &pipeline.duration, NULL);
+
+  pipeline.rendered = g_async_queue_new ();
+  pipeline.free     = g_async_queue_new ();
+
+  for (i = 0; i < VIDEO_QUEUE_LENGTH; i++)
+    {
+      frames[i].pixels = gegl_malloc (pipeline.bounds.width *
+                                      pipeline.bounds.height * 4);
+      g_async_queue_push (pipeline.free, &frames[i]);
+    }
+
+  thread = g_thread_new ("video-encode",
+                         (GThreadFunc) video_encode_thread, &pipeline);
+
+  while (frame_no < pipeline.duration)
+    {
+      VideoFrame        *frame = g_async_queue_pop (pipeline.free);
+      GeglAudioFragment *audio = NULL;
+
+      gegl_node_blit (gegl, scale, &pipeline.bounds,
+                      babl_format ("R'G'B'A u8"), frame->pixels,
+                      GEGL_AUTO_ROWSTRIDE,
+                      GEGL_BLIT_DEFAULT);
+
+      gegl_node_get (iter, "audio", &audio, NULL);
+      if (audio)
+        {
+          frame->audio = video_audio_copy (audio);
+          g_object_unref (audio);
+        }
+      frame->frame_no = frame_no;
+
+      g_async_queue_push (pipeline.rendered, frame);
+
+      frame_no ++;
+      gegl_node_set (iter, "frame", frame_no, NULL);
+    }
+
+  g_async_queue_push (pipeline.rendered, &end);
+  g_thread_join (thread);
+  fprintf (stderr, "\n");
+
+  for (i = 0; i < VIDEO_QUEUE_LENGTH; i++)
+    gegl_free (frames[i].pixels);
+
+  g_async_queue_unref (pipeline.rendered);
+  g_async_queue_unref (pipeline.free);
+
+  /* finalizing ff-save flushes the encoders */
+  g_object_unref (encoder);
+  g_object_unref (pipeline.buffer);
+}
+
 int mrg_ui_main (int argc, char **argv, char **ops);
 
 gint
@@ -134,6 +314,16 @@ main (gint    argc,
       gegl_enable_fatal_warnings ();
     }
 
+  if (o->mode == GEGL_RUN_MODE_SERVER)
+    {
+      gint status = gegl_server_main (o->socket, o->verbose);
+
+      g_list_free_full (o->files, g_free);
+      g_free (o);
+      gegl_exit ();
+      return status;
+    }
+
   if (o->xml)
     {
       path_root = g_get_current_dir ();
@@ -277,67 +467,7 @@ main (gint    argc,
       case GEGL_RUN_MODE_OUTPUT:
       if (gegl_str_has_video_suffix ((void*)o->output))
         {
-          GeglNode *output = gegl_node_new_child (gegl,
-                                                  "operation", "gegl:ff-save",
-                                                  "path", o->output,
-                                                  "video-bit-rate", 4000,
-                                                  NULL);
-          {
-            GeglRectangle bounds = gegl_node_get_bounding_box (gegl);
-            GeglBuffer *tempb;
-            GeglNode *n0;
-            GeglNode *iter;
-            GeglAudioFragment *audio = NULL;
-            int frame_no = 0;
-            guchar *temp;
-
-            bounds.x *= o->scale;
-            bounds.y *= o->scale;
-            bounds.width *= o->scale;
-            bounds.height *= o->scale;
-            temp = gegl_malloc (bounds.width * bounds.height * 4);
-            tempb = gegl_buffer_new (&bounds, babl_format("R'G'B'A u8"));
-
-            n0 = gegl_node_new_child (gegl, "operation", "gegl:buffer-source",
-                                            "buffer", tempb,
-                                            NULL);
-            gegl_node_connect (n0, "output", output, "input");
-
-            iter = gegl_node_get_output_proxy (gegl, "output");
-
-            while (gegl_node_get_producer (iter, "input", NULL))
-              iter = (gegl_node_get_producer (iter, "input", NULL));
-            {
-              int duration = 0;
-              gegl_node_get (iter, "frames", &duration, NULL);
-
-              while (frame_no < duration)
-              {
-                gegl_node_blit (gegl, o->scale, &bounds,
-                                babl_format("R'G'B'A u8"), temp,
-                                GEGL_AUTO_ROWSTRIDE,
-                                GEGL_BLIT_DEFAULT);
-
-                gegl_buffer_set (tempb, &bounds, 0.0, babl_format ("R'G'B'A u8"),
-                                 temp, GEGL_AUTO_ROWSTRIDE);
-
-                gegl_node_get (iter, "audio", &audio, NULL);
-                if (audio)
-                  gegl_node_set (output, "audio", audio, NULL);
-                fprintf (stderr, "\r%i/%i %p", frame_no, duration-1, audio);
-
-                gegl_node_process (output);
-
-                frame_no ++;
-                gegl_node_set (iter, "frame", frame_no, NULL);
-              }
-              fprintf (stderr, "\n");
-            }
-            gegl_free (temp);
-            g_object_unref (tempb);
-            g_object_unref (output);
-          }
-
+          render_video (gegl, o->output, o->scale);
         }
       else
         {
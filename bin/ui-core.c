@@ -2327,6 +2327,12 @@ static GList *gegl_operations (void)
   if (!operations)
     {
       GHashTable *categories_ht = NULL;
+
+      /* operations of modules listed in a manifest are only registered as
+       * types once looked up
+       */
+      gegl_load_deferred_operations ();
+
       operations = gegl_operations_build (NULL, GEGL_TYPE_OPERATION);
       operations = g_list_sort (operations, compare_operation_names);
 
@@ -59,6 +59,7 @@ static inline void *align_16 (unsigned char *ret)
 extern uint16_t gegl_lut_u8_to_u16[256];
 extern float    gegl_lut_u8_to_u16f[256];
 extern uint8_t  gegl_lut_u16_to_u8[65536/GEGL_ALGORITHMS_LUT_DIVISOR];
+extern float    gegl_lut_u8_to_float[256];
 
 
 static void
@@ -1184,6 +1185,158 @@ gegl_downscale_2x2_generic2 (const Babl *format,
    }
 }
 
+static inline guint8
+_gegl_float_to_u8 (gfloat val)
+{
+  if (val <= 0.0f)
+    return 0;
+  if (val >= 1.0f)
+    return 255;
+  return val * 255.0f + 0.5f;
+}
+
+static inline guint8
+_gegl_linear_float_to_nl_u8 (gfloat val)
+{
+  const gint last = 65536/GEGL_ALGORITHMS_LUT_DIVISOR-1;
+
+  if (val <= 0.0f)
+    return gegl_lut_u16_to_u8[0];
+  if (val >= 1.0f)
+    return gegl_lut_u16_to_u8[last];
+  /* values just below 1.0 round up past the last entry */
+  return gegl_lut_u16_to_u8[MIN ((gint) (val * (65535.0f / GEGL_ALGORITHMS_LUT_DIVISOR) + 0.5f),
+                                 last)];
+}
+
+/* RGBA float -> R'G'B'A u8 */
+#define FUSED_BOXFILTER_FUNCNAME   gegl_resample_boxfilter_rgba_float_to_rgba_u8
+#define FUSED_BILINEAR_FUNCNAME    gegl_resample_bilinear_rgba_float_to_rgba_u8
+#define FUSED_SRC_TYPE             gfloat
+#define FUSED_DST_TYPE             guint8
+#define FUSED_COMPONENTS           4
+#define FUSED_HAS_ALPHA            1
+#define FUSED_LOAD(val)            (val)
+#define FUSED_STORE(val)           _gegl_linear_float_to_nl_u8 (val)
+#define FUSED_LOAD_ALPHA(val)      (val)
+#define FUSED_STORE_ALPHA(val)     _gegl_float_to_u8 (val)
+#include "gegl-algorithms-fused.inc"
+#undef FUSED_BOXFILTER_FUNCNAME
+#undef FUSED_BILINEAR_FUNCNAME
+#undef FUSED_SRC_TYPE
+#undef FUSED_DST_TYPE
+#undef FUSED_COMPONENTS
+#undef FUSED_HAS_ALPHA
+#undef FUSED_LOAD
+#undef FUSED_STORE
+#undef FUSED_LOAD_ALPHA
+#undef FUSED_STORE_ALPHA
+
+/* R'G'B'A u8 -> RGBA float */
+#define FUSED_BOXFILTER_FUNCNAME   gegl_resample_boxfilter_rgba_u8_to_rgba_float
+#define FUSED_BILINEAR_FUNCNAME    gegl_resample_bilinear_rgba_u8_to_rgba_float
+#define FUSED_SRC_TYPE             guint8
+#define FUSED_DST_TYPE             gfloat
+#define FUSED_COMPONENTS           4
+#define FUSED_HAS_ALPHA            1
+#define FUSED_LOAD(val)            gegl_lut_u8_to_float[(val)]
+#define FUSED_STORE(val)           (val)
+#define FUSED_LOAD_ALPHA(val)      (val)
+#define FUSED_STORE_ALPHA(val)     ((val) * (1.0f / 255.0f))
+#include "gegl-algorithms-fused.inc"
+#undef FUSED_BOXFILTER_FUNCNAME
+#undef FUSED_BILINEAR_FUNCNAME
+#undef FUSED_SRC_TYPE
+#undef FUSED_DST_TYPE
+#undef FUSED_COMPONENTS
+#undef FUSED_HAS_ALPHA
+#undef FUSED_LOAD
+#undef FUSED_STORE
+#undef FUSED_LOAD_ALPHA
+#undef FUSED_STORE_ALPHA
+
+/* Y float -> Y u8 */
+#define FUSED_BOXFILTER_FUNCNAME   gegl_resample_boxfilter_y_float_to_y_u8
+#define FUSED_BILINEAR_FUNCNAME    gegl_resample_bilinear_y_float_to_y_u8
+#define FUSED_SRC_TYPE             gfloat
+#define FUSED_DST_TYPE             guint8
+#define FUSED_COMPONENTS           1
+#define FUSED_HAS_ALPHA            0
+#define FUSED_LOAD(val)            (val)
+#define FUSED_STORE(val)           _gegl_float_to_u8 (val)
+#include "gegl-algorithms-fused.inc"
+#undef FUSED_BOXFILTER_FUNCNAME
+#undef FUSED_BILINEAR_FUNCNAME
+#undef FUSED_SRC_TYPE
+#undef FUSED_DST_TYPE
+#undef FUSED_COMPONENTS
+#undef FUSED_HAS_ALPHA
+#undef FUSED_LOAD
+#undef FUSED_STORE
+
+/* Y u8 -> Y float */
+#define FUSED_BOXFILTER_FUNCNAME   gegl_resample_boxfilter_y_u8_to_y_float
+#define FUSED_BILINEAR_FUNCNAME    gegl_resample_bilinear_y_u8_to_y_float
+#define FUSED_SRC_TYPE             guint8
+#define FUSED_DST_TYPE             gfloat
+#define FUSED_COMPONENTS           1
+#define FUSED_HAS_ALPHA            0
+#define FUSED_LOAD(val)            (val)
+#define FUSED_STORE(val)           ((val) * (1.0f / 255.0f))
+#include "gegl-algorithms-fused.inc"
+#undef FUSED_BOXFILTER_FUNCNAME
+#undef FUSED_BILINEAR_FUNCNAME
+#undef FUSED_SRC_TYPE
+#undef FUSED_DST_TYPE
+#undef FUSED_COMPONENTS
+#undef FUSED_HAS_ALPHA
+#undef FUSED_LOAD
+#undef FUSED_STORE
+
+GeglResampleFusedFun
+GEGL_SIMD_SUFFIX(gegl_resample_get_fused_fun) (const Babl *src_format,
+                                               const Babl *dst_format,
+                                               gint        filter)
+{
+  if (filter != GEGL_BUFFER_FILTER_BOX &&
+      filter != GEGL_BUFFER_FILTER_BILINEAR)
+    return NULL;
+
+  /* only the sRGB variants of the formats are matched - the lookup tables
+   * used for the non-linear conversions are built for the sRGB TRC
+   */
+  if (src_format == gegl_babl_rgba_linear_float () &&
+      dst_format == gegl_babl_rgba_u8 ())
+    {
+      return filter == GEGL_BUFFER_FILTER_BOX ?
+               gegl_resample_boxfilter_rgba_float_to_rgba_u8 :
+               gegl_resample_bilinear_rgba_float_to_rgba_u8;
+    }
+  else if (src_format == gegl_babl_rgba_u8 () &&
+           dst_format == gegl_babl_rgba_linear_float ())
+    {
+      return filter == GEGL_BUFFER_FILTER_BOX ?
+               gegl_resample_boxfilter_rgba_u8_to_rgba_float :
+               gegl_resample_bilinear_rgba_u8_to_rgba_float;
+    }
+  else if (src_format == gegl_babl_ya_linear_float () &&
+           dst_format == gegl_babl_y_linear_u8 ())
+    {
+      return filter == GEGL_BUFFER_FILTER_BOX ?
+               gegl_resample_boxfilter_y_float_to_y_u8 :
+               gegl_resample_bilinear_y_float_to_y_u8;
+    }
+  else if (src_format == gegl_babl_y_linear_u8 () &&
+           dst_format == gegl_babl_ya_linear_float ())
+    {
+      return filter == GEGL_BUFFER_FILTER_BOX ?
+               gegl_resample_boxfilter_y_u8_to_y_float :
+               gegl_resample_bilinear_y_u8_to_y_float;
+    }
+
+  return NULL;
+}
+
 GeglDownscale2x2Fun GEGL_SIMD_SUFFIX(gegl_downscale_2x2_get_fun) (const Babl *format)
 {
   const Babl *comp_type = babl_format_get_type (format, 0);
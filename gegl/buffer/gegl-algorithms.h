@@ -102,6 +102,29 @@ void GEGL_SIMD_SUFFIX(gegl_resample_nearest) (guchar              *dst,
 
 GeglDownscale2x2Fun GEGL_SIMD_SUFFIX(gegl_downscale_2x2_get_fun) (const Babl *format);
 
+typedef void (*GeglResampleFusedFun) (guchar              *dest_buf,
+                                      const guchar        *source_buf,
+                                      const GeglRectangle *dst_rect,
+                                      const GeglRectangle *src_rect,
+                                      gint                 s_rowstride,
+                                      gdouble              scale,
+                                      gint                 d_rowstride);
+
+/* Returns a resampler for #filter that reads #src_format and writes
+ * #dst_format in a single pass, or NULL if no fused implementation
+ * exists for the pair.
+ */
+GeglResampleFusedFun GEGL_SIMD_SUFFIX(gegl_resample_get_fused_fun) (const Babl *src_format,
+                                                                    const Babl *dst_format,
+                                                                    gint        filter);
+
+/* dispatches to the best variant for the running CPU, set up by
+ * _gegl_init_buffer ()
+ */
+extern GeglResampleFusedFun (*gegl_resample_get_fused_fun) (const Babl *src_format,
+                                                            const Babl *dst_format,
+                                                            gint        filter);
+
 #ifdef ARCH_X86_64
 GeglDownscale2x2Fun gegl_downscale_2x2_get_fun_x86_64_v2 (const Babl *format);
 GeglDownscale2x2Fun gegl_downscale_2x2_get_fun_x86_64_v3 (const Babl *format);
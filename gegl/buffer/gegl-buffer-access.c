@@ -129,16 +129,21 @@ gegl_buffer_get_pixel (GeglBuffer     *buffer,
           tile->x == indice_x &&
           tile->y == indice_y))
       {
-        g_rec_mutex_lock (&buffer->tile_storage->mutex);
-
         if (tile)
           gegl_tile_unref (tile);
 
-        tile = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
-                                          indice_x, indice_y,
-                                          0);
+        tile = _gegl_buffer_get_cached_tile (buffer, indice_x, indice_y, 0);
 
-        g_rec_mutex_unlock (&buffer->tile_storage->mutex);
+        if (! tile)
+          {
+            g_rec_mutex_lock (&buffer->tile_storage->mutex);
+
+            tile = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
+                                              indice_x, indice_y,
+                                              0);
+
+            g_rec_mutex_unlock (&buffer->tile_storage->mutex);
+          }
       }
 
     if (tile)
@@ -992,12 +997,20 @@ gegl_buffer_iterate_read_simple (GeglBuffer          *buffer,
           else
             pixels = tile_width - offsetx;
 
-          g_rec_mutex_lock (&buffer->tile_storage->mutex);
-          tile = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
-                                          gegl_tile_indice (tiledx, tile_width),
-                                          gegl_tile_indice (tiledy, tile_height),
-                                          level);
-          g_rec_mutex_unlock (&buffer->tile_storage->mutex);
+          tile = _gegl_buffer_get_cached_tile (buffer,
+                                               gegl_tile_indice (tiledx, tile_width),
+                                               gegl_tile_indice (tiledy, tile_height),
+                                               level);
+
+          if (! tile)
+            {
+              g_rec_mutex_lock (&buffer->tile_storage->mutex);
+              tile = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
+                                              gegl_tile_indice (tiledx, tile_width),
+                                              gegl_tile_indice (tiledy, tile_height),
+                                              level);
+              g_rec_mutex_unlock (&buffer->tile_storage->mutex);
+            }
 
           if (!tile)
             {
@@ -2103,6 +2116,9 @@ _gegl_buffer_get_unlocked (GeglBuffer          *buffer,
     int     allocated         = 0;
     gint interpolation = (flags & GEGL_BUFFER_FILTER_ALL);
     gint    factor = 1;
+    const Babl *sample_format = format;
+    gint    sample_bpp        = bpp;
+    GeglResampleFusedFun fused = NULL;
 
     while (scale <= 0.5)
       {
@@ -2145,8 +2161,6 @@ _gegl_buffer_get_unlocked (GeglBuffer          *buffer,
       chunk_height = rect2.height;
     }
 
-    allocated = max_bytes_per_row * ((chunk_height+1) * 2);
-
     if (interpolation == GEGL_BUFFER_FILTER_AUTO)
     {
       /* with no specified interpolation we aim for a trade-off where
@@ -2163,6 +2177,22 @@ _gegl_buffer_get_unlocked (GeglBuffer          *buffer,
         interpolation = GEGL_BUFFER_FILTER_BILINEAR;
     }
 
+    /* when a resampler exists that converts from the storage format while
+     * filtering, sample in the storage format - sparing a babl pass over
+     * the source region, which is larger than the destination.
+     */
+    if (format != buffer->soft_format)
+      fused = gegl_resample_get_fused_fun (buffer->soft_format, format,
+                                           interpolation);
+    if (fused)
+      {
+        sample_format = buffer->soft_format;
+        sample_bpp    = babl_format_get_bytes_per_pixel (sample_format);
+      }
+
+    allocated = (max_bytes_per_row / bpp) * MAX (bpp, sample_bpp) *
+                ((chunk_height+1) * 2);
+
     sample_buf = gegl_scratch_alloc (allocated);
 
     while (rect2.width > 0 && rect2.height > 0)
@@ -2233,32 +2263,41 @@ _gegl_buffer_get_unlocked (GeglBuffer          *buffer,
 
               for (y = 0; y < buf_height - 1; y++)
                 {
-                  memset (p + (buf_width - 1) * bpp, 0, bpp);
+                  memset (p + (buf_width - 1) * sample_bpp, 0, sample_bpp);
 
-                  p += buf_width * bpp;
+                  p += buf_width * sample_bpp;
                 }
 
-              memset (p, 0, buf_width * bpp);
+              memset (p, 0, buf_width * sample_bpp);
             }
 
             gegl_buffer_iterate_read_dispatch (buffer, &sample_rect,
                                        (guchar*)sample_buf,
-                                        buf_width * bpp,
-                                        format, level, repeat_mode);
+                                        buf_width * sample_bpp,
+                                        sample_format, level, repeat_mode);
 
             sample_rect.x      = x1;
             sample_rect.y      = y1;
             sample_rect.width  = x2 - x1 + 1;
             sample_rect.height = y2 - y1 + 1;
 
-            gegl_resample_bilinear (dest_buf,
-                                    sample_buf,
-                                    &rect2,
-                                    &sample_rect,
-                                    buf_width * bpp,
-                                    scale,
-                                    format,
-                                    rowstride);
+            if (fused)
+              fused (dest_buf,
+                     sample_buf,
+                     &rect2,
+                     &sample_rect,
+                     buf_width * sample_bpp,
+                     scale,
+                     rowstride);
+            else
+              gegl_resample_bilinear (dest_buf,
+                                      sample_buf,
+                                      &rect2,
+                                      &sample_rect,
+                                      buf_width * bpp,
+                                      scale,
+                                      format,
+                                      rowstride);
             break;
           case GEGL_BUFFER_FILTER_BOX:
           default:
@@ -2266,7 +2305,7 @@ _gegl_buffer_get_unlocked (GeglBuffer          *buffer,
               gint offset;
               buf_width  += 2;
               buf_height += 2;
-              offset = (buf_width + 1) * bpp;
+              offset = (buf_width + 1) * sample_bpp;
 
               /* fill the regions of the buffer outside the sampled area with
                * zeros, since they may be involved in the arithmetic.  even
@@ -2278,36 +2317,45 @@ _gegl_buffer_get_unlocked (GeglBuffer          *buffer,
                 guchar *p = sample_buf;
                 gint    y;
 
-                memset (p, 0, (buf_width - 1) * bpp);
+                memset (p, 0, (buf_width - 1) * sample_bpp);
 
                 for (y = 0; y < buf_height - 1; y++)
                   {
-                    memset (p + (buf_width - 1) * bpp, 0, 2 * bpp);
+                    memset (p + (buf_width - 1) * sample_bpp, 0, 2 * sample_bpp);
 
-                    p += buf_width * bpp;
+                    p += buf_width * sample_bpp;
                   }
 
-                memset (p + bpp, 0, (buf_width - 1) * bpp);
+                memset (p + sample_bpp, 0, (buf_width - 1) * sample_bpp);
               }
 
               gegl_buffer_iterate_read_dispatch (buffer, &sample_rect,
                                          (guchar*)sample_buf + offset,
-                                          buf_width * bpp,
-                                          format, level, repeat_mode);
+                                          buf_width * sample_bpp,
+                                          sample_format, level, repeat_mode);
 
               sample_rect.x      = x1 - 1;
               sample_rect.y      = y1 - 1;
               sample_rect.width  = x2 - x1 + 2;
               sample_rect.height = y2 - y1 + 2;
 
-              gegl_resample_boxfilter (dest_buf,
-                                       sample_buf,
-                                       &rect2,
-                                       &sample_rect,
-                                       buf_width * bpp,
-                                       scale,
-                                       format,
-                                       rowstride);
+              if (fused)
+                fused (dest_buf,
+                       sample_buf,
+                       &rect2,
+                       &sample_rect,
+                       buf_width * sample_bpp,
+                       scale,
+                       rowstride);
+              else
+                gegl_resample_boxfilter (dest_buf,
+                                         sample_buf,
+                                         &rect2,
+                                         &sample_rect,
+                                         buf_width * bpp,
+                                         scale,
+                                         format,
+                                         rowstride);
             }
             break;
       }
@@ -0,0 +1,655 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <math.h>
+
+#include <glib-object.h>
+
+#include "gegl-buffer.h"
+#include "gegl-buffer-convolve.h"
+#include "gegl-rectangle.h"
+#include "gegl-scratch.h"
+#include "gegl-parallel.h"
+
+/* the smallest block size; blocks are at least twice the kernel size, so
+ * that at least half of each block produces output.
+ */
+#define MIN_BLOCK_SIZE 64
+
+#define THREAD_COST    16.0
+
+/* the maximal amount of scratch memory used by blocks processed at the same
+ * time; blocks for large kernels take hundreds of megabytes each, so fewer
+ * of them are processed in parallel.
+ */
+#define MAX_SCRATCH_SIZE (512 << 20)
+
+/* an in-place radix-2 complex FFT of a fixed size */
+typedef struct
+{
+  gint     size;
+  gint    *reverse;  /* bit-reversal permutation */
+  gdouble *twiddles; /* exp (-2 pi i k / size), for k < size / 2 */
+} Fft;
+
+/* a block of real data, transformed to a half spectrum of
+ * height x (width / 2 + 1) complex values
+ */
+typedef struct
+{
+  const Fft     *row_fft;
+  const Fft     *column_fft;
+
+  /* the real input; values outside of src_width x src_height are zero */
+  const gfloat  *src;
+  gint           src_width;
+  gint           src_height;
+  gint           src_rowstride;
+  gint           src_stride;
+
+  gdouble       *spectrum;
+  gint           spectrum_width;
+
+  /* the kernel spectrum to multiply by, or NULL to only transform */
+  const gdouble *kernel_spectrum;
+
+  /* the real output, taken from rows and columns starting at dst_offset_x
+   * and dst_offset_y
+   */
+  gfloat        *dst;
+  gint           dst_width;
+  gint           dst_height;
+  gint           dst_offset_x;
+  gint           dst_offset_y;
+  gint           dst_rowstride;
+  gint           dst_stride;
+} Block;
+
+typedef struct
+{
+  GeglBuffer          *input;
+  GeglBuffer          *output;
+  const GeglRectangle *roi;
+  const Babl          *format;
+  gint                 components;
+  const GeglRectangle *kernel_rect;
+  gdouble * const     *kernel_spectra;
+  gint                 kernel_components;
+  GeglAbyssPolicy      repeat_mode;
+  gint                 level;
+
+  const Fft           *row_fft;
+  const Fft           *column_fft;
+  gint                 tile_width;
+  gint                 tile_height;
+  gint                 n_columns;
+  gint                 n_tiles;
+} ConvolveData;
+
+
+static gint
+next_power_of_two (gint n)
+{
+  gint size = 1;
+
+  while (size < n)
+    size <<= 1;
+
+  return size;
+}
+
+static Fft *
+fft_new (gint size)
+{
+  Fft  *fft = g_slice_new (Fft);
+  gint  bits;
+  gint  i;
+
+  fft->size     = size;
+  fft->reverse  = g_new (gint, size);
+  fft->twiddles = g_new (gdouble, MAX (size, 2));
+
+  for (bits = 0; (1 << bits) < size; bits++);
+
+  for (i = 0; i < size; i++)
+    {
+      gint r = 0;
+      gint b;
+
+      for (b = 0; b < bits; b++)
+        r |= ((i >> b) & 1) << (bits - 1 - b);
+
+      fft->reverse[i] = r;
+    }
+
+  for (i = 0; i < size / 2; i++)
+    {
+      gdouble angle = -2.0 * G_PI * i / size;
+
+      fft->twiddles[2 * i]     = cos (angle);
+      fft->twiddles[2 * i + 1] = sin (angle);
+    }
+
+  return fft;
+}
+
+static void
+fft_free (Fft *fft)
+{
+  g_free (fft->reverse);
+  g_free (fft->twiddles);
+
+  g_slice_free (Fft, fft);
+}
+
+/* transforms @size interleaved complex values in place.  the inverse
+ * transform is not normalized.
+ */
+static void
+fft_transform (const Fft *fft,
+               gdouble   *data,
+               gboolean   inverse)
+{
+  gint    size = fft->size;
+  gdouble sign = inverse ? -1.0 : 1.0;
+  gint    half;
+  gint    i;
+
+  for (i = 0; i < size; i++)
+    {
+      gint r = fft->reverse[i];
+
+      if (r > i)
+        {
+          gdouble re = data[2 * i];
+          gdouble im = data[2 * i + 1];
+
+          data[2 * i]     = data[2 * r];
+          data[2 * i + 1] = data[2 * r + 1];
+          data[2 * r]     = re;
+          data[2 * r + 1] = im;
+        }
+    }
+
+  for (half = 1; half < size; half <<= 1)
+    {
+      gint step = size / (2 * half);
+      gint start;
+
+      for (start = 0; start < size; start += 2 * half)
+        {
+          gdouble *a = data + 2 * start;
+          gdouble *b = a + 2 * half;
+          gint     k;
+
+          for (k = 0; k < half; k++)
+            {
+              gdouble w_re = fft->twiddles[2 * k * step];
+              gdouble w_im = fft->twiddles[2 * k * step + 1] * sign;
+              gdouble t_re = b[2 * k] * w_re - b[2 * k + 1] * w_im;
+              gdouble t_im = b[2 * k] * w_im + b[2 * k + 1] * w_re;
+
+              b[2 * k]     = a[2 * k]     - t_re;
+              b[2 * k + 1] = a[2 * k + 1] - t_im;
+              a[2 * k]     += t_re;
+              a[2 * k + 1] += t_im;
+            }
+        }
+    }
+}
+
+/* transforms pairs of real rows as single complex rows, and separates their
+ * half spectra using their hermitian symmetry.
+ */
+static void
+block_forward_rows_range (gsize  first_pair,
+                          gsize  n_pairs,
+                          Block *block)
+{
+  gint     width = block->row_fft->size;
+  gdouble *z     = gegl_scratch_new (gdouble, 2 * width);
+  gint     pair;
+
+  for (pair = first_pair; pair < (gint) (first_pair + n_pairs); pair++)
+    {
+      gint     row = 2 * pair;
+      gdouble *a   = block->spectrum + (gsize) row * 2 * block->spectrum_width;
+      gdouble *b   = a + 2 * block->spectrum_width;
+      gint     i, k;
+
+      memset (z, 0, 2 * width * sizeof (gdouble));
+
+      for (i = 0; i < 2; i++)
+        {
+          const gfloat *src;
+          gint          x;
+
+          if (row + i >= block->src_height)
+            break;
+
+          src = block->src + (gsize) (row + i) * block->src_rowstride;
+
+          for (x = 0; x < block->src_width; x++)
+            z[2 * x + i] = src[x * block->src_stride];
+        }
+
+      fft_transform (block->row_fft, z, FALSE);
+
+      for (k = 0; k <= width / 2; k++)
+        {
+          gint    m    = (width - k) & (width - 1);
+          gdouble s_re = z[2 * k]     + z[2 * m];
+          gdouble s_im = z[2 * k + 1] - z[2 * m + 1];
+          gdouble d_re = z[2 * k]     - z[2 * m];
+          gdouble d_im = z[2 * k + 1] + z[2 * m + 1];
+
+          a[2 * k]     = 0.5 * s_re;
+          a[2 * k + 1] = 0.5 * s_im;
+          b[2 * k]     = 0.5 * d_im;
+          b[2 * k + 1] = -0.5 * d_re;
+        }
+    }
+
+  gegl_scratch_free (z);
+}
+
+/* transforms each column of the half spectrum; when multiplying by a kernel
+ * spectrum, transforms it back right away.
+ */
+static void
+block_columns_range (gsize  first_column,
+                     gsize  n_columns,
+                     Block *block)
+{
+  gint     height    = block->column_fft->size;
+  gint     rowstride = 2 * block->spectrum_width;
+  gdouble *z         = gegl_scratch_new (gdouble, 2 * height);
+  gint     column;
+
+  for (column = first_column;
+       column < (gint) (first_column + n_columns);
+       column++)
+    {
+      gdouble *data = block->spectrum + 2 * column;
+      gint     y;
+
+      for (y = 0; y < height; y++)
+        {
+          z[2 * y]     = data[(gsize) y * rowstride];
+          z[2 * y + 1] = data[(gsize) y * rowstride + 1];
+        }
+
+      fft_transform (block->column_fft, z, FALSE);
+
+      if (block->kernel_spectrum)
+        {
+          const gdouble *kernel = block->kernel_spectrum + 2 * column;
+
+          for (y = 0; y < height; y++)
+            {
+              gdouble k_re = kernel[(gsize) y * rowstride];
+              gdouble k_im = kernel[(gsize) y * rowstride + 1];
+              gdouble re   = z[2 * y];
+              gdouble im   = z[2 * y + 1];
+
+              z[2 * y]     = re * k_re - im * k_im;
+              z[2 * y + 1] = re * k_im + im * k_re;
+            }
+
+          fft_transform (block->column_fft, z, TRUE);
+        }
+
+      for (y = 0; y < height; y++)
+        {
+          data[(gsize) y * rowstride]     = z[2 * y];
+          data[(gsize) y * rowstride + 1] = z[2 * y + 1];
+        }
+    }
+
+  gegl_scratch_free (z);
+}
+
+/* rebuilds the full spectra of pairs of rows from their half spectra, and
+ * transforms them back as single complex rows.
+ */
+static void
+block_inverse_rows_range (gsize  first_pair,
+                          gsize  n_pairs,
+                          Block *block)
+{
+  gint     width = block->row_fft->size;
+  gdouble *z     = gegl_scratch_new (gdouble, 2 * width);
+  gint     pair;
+
+  for (pair = first_pair; pair < (gint) (first_pair + n_pairs); pair++)
+    {
+      gint           row = 2 * pair;
+      const gdouble *a   = block->spectrum +
+                           (gsize) row * 2 * block->spectrum_width;
+      const gdouble *b   = a + 2 * block->spectrum_width;
+      gint           i, k;
+
+      for (k = 0; k < width; k++)
+        {
+          gdouble a_re, a_im;
+          gdouble b_re, b_im;
+
+          if (k <= width / 2)
+            {
+              a_re = a[2 * k];
+              a_im = a[2 * k + 1];
+              b_re = b[2 * k];
+              b_im = b[2 * k + 1];
+            }
+          else
+            {
+              a_re =  a[2 * (width - k)];
+              a_im = -a[2 * (width - k) + 1];
+              b_re =  b[2 * (width - k)];
+              b_im = -b[2 * (width - k) + 1];
+            }
+
+          z[2 * k]     = a_re - b_im;
+          z[2 * k + 1] = a_im + b_re;
+        }
+
+      fft_transform (block->row_fft, z, TRUE);
+
+      for (i = 0; i < 2; i++)
+        {
+          gint    y = row + i - block->dst_offset_y;
+          gfloat *dst;
+          gint    x;
+
+          if (y < 0 || y >= block->dst_height)
+            continue;
+
+          dst = block->dst + (gsize) y * block->dst_rowstride;
+
+          for (x = 0; x < block->dst_width; x++)
+            {
+              dst[x * block->dst_stride] =
+                z[2 * (x + block->dst_offset_x) + i];
+            }
+        }
+    }
+
+  gegl_scratch_free (z);
+}
+
+static void
+block_forward (Block *block)
+{
+  gint n_pairs = block->column_fft->size / 2;
+
+  gegl_parallel_distribute_range (
+    n_pairs, THREAD_COST,
+    (GeglParallelDistributeRangeFunc) block_forward_rows_range,
+    block);
+
+  gegl_parallel_distribute_range (
+    block->spectrum_width, THREAD_COST,
+    (GeglParallelDistributeRangeFunc) block_columns_range,
+    block);
+}
+
+static void
+block_inverse (Block *block)
+{
+  gint n_pairs = block->column_fft->size / 2;
+
+  gegl_parallel_distribute_range (
+    n_pairs, THREAD_COST,
+    (GeglParallelDistributeRangeFunc) block_inverse_rows_range,
+    block);
+}
+
+static void
+convolve_tiles_range (gsize         first_tile,
+                      gsize         n_tiles,
+                      ConvolveData *data)
+{
+  const GeglRectangle *roi         = data->roi;
+  const GeglRectangle *kernel_rect = data->kernel_rect;
+  gint                 components  = data->components;
+  gint                 width       = data->row_fft->size;
+  gint                 height      = data->column_fft->size;
+  gfloat              *src;
+  gfloat              *dst;
+  Block                block       = {};
+  gint                 tile;
+
+  src = gegl_scratch_new (gfloat, (gsize) width * height * components);
+  dst = gegl_scratch_new (gfloat, (gsize) data->tile_width *
+                                  data->tile_height * components);
+
+  block.row_fft        = data->row_fft;
+  block.column_fft     = data->column_fft;
+  block.spectrum_width = width / 2 + 1;
+  block.spectrum       = gegl_scratch_new (gdouble, (gsize) height * 2 *
+                                                    block.spectrum_width);
+
+  for (tile = first_tile; tile < (gint) (first_tile + n_tiles); tile++)
+    {
+      GeglRectangle dst_rect;
+      GeglRectangle src_rect;
+      gint          c;
+
+      gegl_rectangle_set (&dst_rect,
+                          roi->x + (tile % data->n_columns) * data->tile_width,
+                          roi->y + (tile / data->n_columns) * data->tile_height,
+                          data->tile_width,
+                          data->tile_height);
+      gegl_rectangle_intersect (&dst_rect, &dst_rect, roi);
+
+      /* output pixel p reads input pixels p - kernel_rect.x - width + 1
+       * through p - kernel_rect.x; the first kernel_rect.width - 1 values of
+       * each block are only used as input, and only the rest is free of
+       * wrap-around.
+       */
+      gegl_rectangle_set (&src_rect,
+                          dst_rect.x - kernel_rect->x - kernel_rect->width + 1,
+                          dst_rect.y - kernel_rect->y - kernel_rect->height + 1,
+                          dst_rect.width  + kernel_rect->width  - 1,
+                          dst_rect.height + kernel_rect->height - 1);
+
+      gegl_buffer_get (data->input, &src_rect, 1.0 / (1 << data->level),
+                       data->format, src,
+                       GEGL_AUTO_ROWSTRIDE, data->repeat_mode);
+
+      block.src_width     = src_rect.width;
+      block.src_height    = src_rect.height;
+      block.src_rowstride = src_rect.width * components;
+      block.src_stride    = components;
+
+      block.dst_width     = dst_rect.width;
+      block.dst_height    = dst_rect.height;
+      block.dst_offset_x  = kernel_rect->width  - 1;
+      block.dst_offset_y  = kernel_rect->height - 1;
+      block.dst_rowstride = dst_rect.width * components;
+      block.dst_stride    = components;
+
+      for (c = 0; c < components; c++)
+        {
+          block.src             = src + c;
+          block.dst             = dst + c;
+          block.kernel_spectrum =
+            data->kernel_spectra[data->kernel_components > 1 ? c : 0];
+
+          block_forward (&block);
+          block_inverse (&block);
+        }
+
+      gegl_buffer_set (data->output, &dst_rect, data->level, data->format,
+                       dst, GEGL_AUTO_ROWSTRIDE);
+    }
+
+  gegl_scratch_free (block.spectrum);
+  gegl_scratch_free (dst);
+  gegl_scratch_free (src);
+}
+
+static void
+convolve_tiles_thread (gint          i,
+                       gint          n,
+                       ConvolveData *data)
+{
+  gsize first = (gsize) data->n_tiles * i       / n;
+  gsize last  = (gsize) data->n_tiles * (i + 1) / n;
+
+  convolve_tiles_range (first, last - first, data);
+}
+
+void
+gegl_buffer_convolve (GeglBuffer          *input,
+                      GeglBuffer          *output,
+                      const GeglRectangle *roi,
+                      const Babl          *format,
+                      const gfloat        *kernel,
+                      const GeglRectangle *kernel_rect,
+                      gint                 kernel_components,
+                      GeglAbyssPolicy      repeat_mode,
+                      gint                 level)
+{
+  ConvolveData  data;
+  gdouble      *kernel_spectra[4];
+  gdouble     **spectra = kernel_spectra;
+  Fft          *row_fft;
+  Fft          *column_fft;
+  gint          components;
+  gint          width;
+  gint          height;
+  gint          n_rows;
+  gsize         block_size;
+  gint          max_n;
+  gint          c;
+
+  g_return_if_fail (GEGL_IS_BUFFER (input));
+  g_return_if_fail (GEGL_IS_BUFFER (output));
+  g_return_if_fail (roi != NULL);
+  g_return_if_fail (format != NULL);
+  g_return_if_fail (babl_format_get_type (format, 0) == babl_type ("float"));
+  g_return_if_fail (kernel != NULL);
+  g_return_if_fail (kernel_rect != NULL &&
+                    ! gegl_rectangle_is_empty (kernel_rect));
+  g_return_if_fail (level >= 0);
+
+  components = babl_format_get_n_components (format);
+
+  g_return_if_fail (kernel_components == 1 ||
+                    kernel_components == components);
+
+  if (gegl_rectangle_is_empty (roi))
+    return;
+
+  /* use blocks of at least twice the kernel size, unless the whole roi
+   * fits in a smaller one.
+   */
+  width  = next_power_of_two (MAX (2 * kernel_rect->width, MIN_BLOCK_SIZE));
+  width  = MIN (width, next_power_of_two (roi->width + kernel_rect->width - 1));
+  width  = MAX (width, 2);
+  height = next_power_of_two (MAX (2 * kernel_rect->height, MIN_BLOCK_SIZE));
+  height = MIN (height, next_power_of_two (roi->height + kernel_rect->height - 1));
+  height = MAX (height, 2);
+
+  row_fft    = fft_new (width);
+  column_fft = fft_new (height);
+
+  if (kernel_components > (gint) G_N_ELEMENTS (kernel_spectra))
+    spectra = g_new (gdouble *, kernel_components);
+
+  /* transform the kernel, folding in the normalization of the inverse
+   * transforms.
+   */
+  for (c = 0; c < kernel_components; c++)
+    {
+      Block block = {};
+      gsize n     = (gsize) height * 2 * (width / 2 + 1);
+      gsize i;
+
+      block.row_fft        = row_fft;
+      block.column_fft     = column_fft;
+      block.src            = kernel + c;
+      block.src_width      = kernel_rect->width;
+      block.src_height     = kernel_rect->height;
+      block.src_rowstride  = kernel_rect->width * kernel_components;
+      block.src_stride     = kernel_components;
+      block.spectrum_width = width / 2 + 1;
+      block.spectrum       = g_new (gdouble, n);
+
+      block_forward (&block);
+
+      for (i = 0; i < n; i++)
+        block.spectrum[i] /= (gdouble) width * height;
+
+      spectra[c] = block.spectrum;
+    }
+
+  data.input             = input;
+  data.output            = output;
+  data.roi               = roi;
+  data.format            = format;
+  data.components        = components;
+  data.kernel_rect       = kernel_rect;
+  data.kernel_spectra    = spectra;
+  data.kernel_components = kernel_components;
+  data.repeat_mode       = repeat_mode;
+  data.level             = level;
+  data.row_fft           = row_fft;
+  data.column_fft        = column_fft;
+  data.tile_width        = width  - kernel_rect->width  + 1;
+  data.tile_height       = height - kernel_rect->height + 1;
+  data.n_columns         = (roi->width  + data.tile_width  - 1) /
+                           data.tile_width;
+  n_rows                 = (roi->height + data.tile_height - 1) /
+                           data.tile_height;
+  data.n_tiles           = data.n_columns * n_rows;
+
+  /* the scratch memory of convolve_tiles_range() */
+  block_size = (gsize) width * height * components * sizeof (gfloat)     +
+               (gsize) data.tile_width * data.tile_height * components *
+               sizeof (gfloat)                                            +
+               (gsize) height * 2 * (width / 2 + 1) * sizeof (gdouble);
+
+  max_n = MIN (MAX_SCRATCH_SIZE / block_size, (gsize) data.n_tiles);
+
+  /* the blocks are distributed over as many threads as their memory allows.
+   * when there's only a single thread, the passes over each block are
+   * distributed instead; otherwise, they run serially within each thread.
+   */
+  if (max_n > 1)
+    {
+      gegl_parallel_distribute (
+        max_n,
+        (GeglParallelDistributeFunc) convolve_tiles_thread,
+        &data);
+    }
+  else
+    {
+      convolve_tiles_range (0, data.n_tiles, &data);
+    }
+
+  for (c = 0; c < kernel_components; c++)
+    g_free (spectra[c]);
+
+  if (spectra != kernel_spectra)
+    g_free (spectra);
+
+  fft_free (column_fft);
+  fft_free (row_fft);
+}
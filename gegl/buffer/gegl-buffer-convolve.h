@@ -0,0 +1,64 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_BUFFER_CONVOLVE_H__
+#define __GEGL_BUFFER_CONVOLVE_H__
+
+#include "gegl-buffer.h"
+
+G_BEGIN_DECLS
+
+/**
+ * gegl_buffer_convolve: (skip)
+ * @input: the buffer to convolve
+ * @output: the buffer to write the result to
+ * @roi: the area of @output to compute
+ * @format: a format with float components, used for both buffers
+ * @kernel: the kernel values, row by row
+ * @kernel_rect: the offsets covered by @kernel
+ * @kernel_components: 1 to apply the same kernel to all components, or the
+ * number of components of @format
+ * @repeat_mode: how to sample @input outside of its abyss
+ * @level: the mipmap level to read @input from and write @output to
+ *
+ * Convolves @input with @kernel, writing the result to @roi of @output:
+ * each output pixel p is the sum of kernel(d) * input(p - d) over all
+ * offsets d in @kernel_rect, where kernel(d) is the kernel value at row
+ * d.y - kernel_rect.y and column d.x - kernel_rect.x.  A kernel centered
+ * on its origin thus has a @kernel_rect of
+ * {-width / 2, -height / 2, width, height}.
+ *
+ * At a @level above 0, @roi and @kernel_rect are in the coordinates of
+ * that level, and @kernel has to be scaled accordingly by the caller.
+ *
+ * The convolution is computed in the frequency domain, using real-to-complex
+ * FFTs over overlapping blocks of the input (overlap-save), so its cost per
+ * pixel grows only logarithmically with the kernel size.  The blocks are
+ * processed in parallel, as far as the scratch memory they need allows.
+ */
+void   gegl_buffer_convolve (GeglBuffer          *input,
+                             GeglBuffer          *output,
+                             const GeglRectangle *roi,
+                             const Babl          *format,
+                             const gfloat        *kernel,
+                             const GeglRectangle *kernel_rect,
+                             gint                 kernel_components,
+                             GeglAbyssPolicy      repeat_mode,
+                             gint                 level);
+
+G_END_DECLS
+
+#endif /* __GEGL_BUFFER_CONVOLVE_H__ */
@@ -59,6 +59,7 @@ GEGL_CACHED_BABL(format, ya_float, "Y'A float")
 GEGL_CACHED_BABL(format, yA_float, "Y'aA float")
 GEGL_CACHED_BABL(format, ya_linear_float, "Y float")
 GEGL_CACHED_BABL(format, yA_linear_float, "YaA float")
+GEGL_CACHED_BABL(format, y_linear_u8, "Y u8")
 
 
 #ifdef G_OS_WIN32
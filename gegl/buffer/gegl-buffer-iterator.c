@@ -376,15 +376,28 @@ get_tile (GeglBufferIterator *iter,
       sub->real_roi.width  = tile_width;
       sub->real_roi.height = tile_height;
 
-      g_rec_mutex_lock (&buf->tile_storage->mutex);
+      sub->current_tile = NULL;
 
-      sub->current_tile = gegl_tile_handler_get_tile (
-        (GeglTileHandler *) buf,
-        tile_x, tile_y, sub->level,
-        ! (sub->can_discard_data &&
-           gegl_rectangle_contains (&sub->full_rect, &sub->real_roi)));
+      /* cached tiles can be read without taking the storage mutex */
+      if (! (sub->access_mode & GEGL_ACCESS_WRITE))
+        {
+          sub->current_tile = _gegl_buffer_get_cached_tile (buf,
+                                                            tile_x, tile_y,
+                                                            sub->level);
+        }
 
-      g_rec_mutex_unlock (&buf->tile_storage->mutex);
+      if (! sub->current_tile)
+        {
+          g_rec_mutex_lock (&buf->tile_storage->mutex);
+
+          sub->current_tile = gegl_tile_handler_get_tile (
+            (GeglTileHandler *) buf,
+            tile_x, tile_y, sub->level,
+            ! (sub->can_discard_data &&
+               gegl_rectangle_contains (&sub->full_rect, &sub->real_roi)));
+
+          g_rec_mutex_unlock (&buf->tile_storage->mutex);
+        }
 
       if (sub->access_mode & GEGL_ACCESS_WRITE)
         gegl_tile_lock (sub->current_tile);
@@ -89,6 +89,7 @@ void              gegl_tile_cache_init    (void);
 void              gegl_tile_cache_destroy (void);
 
 void              gegl_tile_backend_swap_cleanup (void);
+void              gegl_tile_backend_swap_update_queued_max (void);
 
 GeglTileBackend * gegl_buffer_backend     (GeglBuffer *buffer);
 GeglTileBackend * gegl_buffer_backend2    (GeglBuffer *buffer); /* non-cached */
@@ -170,6 +171,10 @@ struct _GeglTile
   guint            keep_identity:1;  /* maintain data pointer identity, rather
                                       * than data content only
                                       */
+  guint            borrowed:1;       /* whether the tile data is memory owned
+                                      * by the caller of the buffer, which
+                                      * doesn't count toward the cache size
+                                      */
 
   gint             clone_state; /* tile clone/unclone state & spinlock */
   gint            *n_clones;    /* an array of two atomic counters, shared
@@ -185,6 +190,11 @@ struct _GeglTile
 
   guint64          damage;
 
+  gint             fast_hit;     /* whether the tile was found by a lock-free
+                                  * cache lookup since the cache last moved it
+                                  * to the front of its queue
+                                  */
+
   /* called when the tile is about to be destroyed */
   GDestroyNotify   destroy_notify;
   gpointer         destroy_notify_data;
@@ -196,13 +206,24 @@ struct _GeglTile
   gpointer         unlock_notify_data;
 };
 
-gboolean gegl_tile_needs_store    (GeglTile *tile);
-void     gegl_tile_unlock_no_void (GeglTile *tile);
-gboolean gegl_tile_damage         (GeglTile *tile,
-                                   guint64   damage);
+GeglTile *gegl_tile_try_ref        (GeglTile *tile);
+gboolean  gegl_tile_needs_store    (GeglTile *tile);
+void      gegl_tile_unlock_no_void (GeglTile *tile);
+gboolean  gegl_tile_damage         (GeglTile *tile,
+                                    guint64   damage);
 
 void _gegl_buffer_drop_hot_tile (GeglBuffer *buffer);
 
+/* returns a reference to the tile at the given storage coordinates if it is
+ * already cached, without taking the tile-storage mutex, or NULL otherwise
+ * (in which case the tile should be fetched the usual way).  only suitable
+ * for read access.
+ */
+GeglTile * _gegl_buffer_get_cached_tile (GeglBuffer *buffer,
+                                         gint        x,
+                                         gint        y,
+                                         gint        z);
+
 GeglRectangle _gegl_get_required_for_scale (const GeglRectangle *roi,
                                             gdouble              scale);
 
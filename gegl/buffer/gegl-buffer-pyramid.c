@@ -0,0 +1,196 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include <glib-object.h>
+
+#include "gegl-buffer.h"
+#include "gegl-buffer-types.h"
+#include "gegl-buffer-pyramid.h"
+#include "gegl-rectangle.h"
+#include "gegl-scratch.h"
+#include "gegl-parallel.h"
+
+/* tiles are usually encoded and written by the callback, so even a few of
+ * them are worth a thread.
+ */
+#define THREAD_COST 0.5
+
+typedef struct
+{
+  GeglBuffer          *buffer;
+  const GeglRectangle *level_rect;
+  gint                 level;
+  gint                 columns;
+  gint                 tile_size;
+  gint                 overlap;
+  const Babl          *format;
+  GeglPyramidTileFunc  func;
+  gpointer             user_data;
+  gint                 stop;
+} PyramidData;
+
+static inline gint
+floor_div (gint a,
+           gint b)
+{
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+gint
+gegl_buffer_pyramid_get_n_levels (const GeglRectangle *roi,
+                                  gint                 tile_size)
+{
+  GeglRectangle level_rect;
+  gint          n_levels = 1;
+
+  g_return_val_if_fail (roi != NULL, 0);
+  g_return_val_if_fail (tile_size > 0, 0);
+
+  level_rect = *roi;
+
+  while (level_rect.width > tile_size || level_rect.height > tile_size)
+    gegl_buffer_pyramid_get_level_rect (roi, n_levels++, &level_rect);
+
+  return n_levels;
+}
+
+void
+gegl_buffer_pyramid_get_level_rect (const GeglRectangle *roi,
+                                    gint                 level,
+                                    GeglRectangle       *level_rect)
+{
+  gint factor;
+  gint x1, y1, x2, y2;
+
+  g_return_if_fail (roi != NULL);
+  g_return_if_fail (level >= 0 && level < 31);
+  g_return_if_fail (level_rect != NULL);
+
+  factor = 1 << level;
+
+  x1 = floor_div (roi->x, factor);
+  y1 = floor_div (roi->y, factor);
+  x2 = -floor_div (-(roi->x + roi->width),  factor);
+  y2 = -floor_div (-(roi->y + roi->height), factor);
+
+  gegl_rectangle_set (level_rect, x1, y1, x2 - x1, y2 - y1);
+}
+
+static void
+pyramid_tiles_range (gsize        first,
+                     gsize        n,
+                     PyramidData *data)
+{
+  const GeglRectangle *level_rect = data->level_rect;
+  gint                 bpp        = babl_format_get_bytes_per_pixel (data->format);
+  gint                 max_size   = data->tile_size + 2 * data->overlap;
+  GeglPyramidTile      tile;
+  gsize                i;
+
+  tile.level  = data->level;
+  tile.format = data->format;
+  tile.data   = gegl_scratch_alloc ((gsize) max_size * max_size * bpp);
+
+  for (i = first; i < first + n && ! g_atomic_int_get (&data->stop); i++)
+    {
+      GeglRectangle tile_rect;
+
+      tile.column = i % data->columns;
+      tile.row    = i / data->columns;
+
+      gegl_rectangle_set (&tile_rect,
+                          level_rect->x + tile.column * data->tile_size -
+                          data->overlap,
+                          level_rect->y + tile.row * data->tile_size -
+                          data->overlap,
+                          max_size, max_size);
+
+      gegl_rectangle_intersect (&tile.rect, &tile_rect, level_rect);
+
+      tile.rowstride = tile.rect.width * bpp;
+
+      gegl_buffer_get (data->buffer, &tile.rect, 1.0 / (1 << data->level),
+                       data->format, tile.data, tile.rowstride,
+                       GEGL_ABYSS_NONE);
+
+      if (! data->func (&tile, data->user_data))
+        g_atomic_int_set (&data->stop, TRUE);
+    }
+
+  gegl_scratch_free (tile.data);
+}
+
+gboolean
+gegl_buffer_pyramid_foreach (GeglBuffer          *buffer,
+                             const GeglRectangle *roi,
+                             gint                 first_level,
+                             gint                 n_levels,
+                             gint                 tile_size,
+                             gint                 overlap,
+                             const Babl          *format,
+                             GeglPyramidTileFunc  func,
+                             gpointer             user_data)
+{
+  PyramidData data;
+  gint        level;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), FALSE);
+  g_return_val_if_fail (roi != NULL, FALSE);
+  g_return_val_if_fail (first_level >= 0, FALSE);
+  g_return_val_if_fail (tile_size > 0, FALSE);
+  g_return_val_if_fail (overlap >= 0, FALSE);
+  g_return_val_if_fail (format != NULL, FALSE);
+  g_return_val_if_fail (func != NULL, FALSE);
+
+  data.buffer    = buffer;
+  data.tile_size = tile_size;
+  data.overlap   = overlap;
+  data.format    = format;
+  data.func      = func;
+  data.user_data = user_data;
+  data.stop      = FALSE;
+
+  /* the tiles of a level are computed from the ones of the previous level,
+   * which are still cached, so levels go from the full resolution down.
+   */
+  for (level = first_level;
+       level < first_level + n_levels && ! data.stop;
+       level++)
+    {
+      GeglRectangle level_rect;
+      gint          rows;
+
+      gegl_buffer_pyramid_get_level_rect (roi, level, &level_rect);
+
+      if (gegl_rectangle_is_empty (&level_rect))
+        break;
+
+      data.level      = level;
+      data.level_rect = &level_rect;
+      data.columns    = (level_rect.width  + tile_size - 1) / tile_size;
+      rows            = (level_rect.height + tile_size - 1) / tile_size;
+
+      gegl_parallel_distribute_range (
+        data.columns * rows, THREAD_COST,
+        (GeglParallelDistributeRangeFunc) pyramid_tiles_range,
+        &data);
+    }
+
+  return ! data.stop;
+}
@@ -0,0 +1,119 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_BUFFER_PYRAMID_H__
+#define __GEGL_BUFFER_PYRAMID_H__
+
+#include "gegl-buffer.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GeglPyramidTile GeglPyramidTile;
+
+/***
+ * GeglPyramidTile:
+ *
+ * A tile of one level of a resolution pyramid, as passed to a
+ * #GeglPyramidTileFunc.  Level 0 is the full resolution, and each following
+ * level halves the dimensions of the previous one, rounding up.
+ *
+ * @rect is in the coordinates of the level, and includes the overlap with
+ * neighbouring tiles; tiles at the right and bottom edges are clipped to
+ * the level, and can thus be smaller than the others.
+ *
+ * All fields are read-only, and only valid during the callback.
+ */
+struct _GeglPyramidTile
+{
+  gint           level;
+  gint           column;
+  gint           row;
+  GeglRectangle  rect;
+  const Babl    *format;
+  guchar        *data;      /* the pixels of rect, in format */
+  gint           rowstride;
+};
+
+/**
+ * GeglPyramidTileFunc: (skip)
+ * @tile: the tile to process
+ * @user_data: the data passed to gegl_buffer_pyramid_foreach()
+ *
+ * Called, possibly concurrently from several threads, for each tile of a
+ * pyramid.
+ *
+ * Returns: %FALSE to stop the iteration.
+ */
+typedef gboolean (*GeglPyramidTileFunc) (const GeglPyramidTile *tile,
+                                         gpointer               user_data);
+
+/**
+ * gegl_buffer_pyramid_get_n_levels: (skip)
+ * @roi: the full resolution area of the pyramid
+ * @tile_size: the size the last level has to fit in
+ *
+ * Returns: the number of levels of a pyramid of @roi, down to the first
+ * level that fits in a single tile of @tile_size; pass 1 to get all levels
+ * down to a single pixel, as Deep Zoom uses.
+ */
+gint     gegl_buffer_pyramid_get_n_levels  (const GeglRectangle *roi,
+                                            gint                 tile_size);
+
+/**
+ * gegl_buffer_pyramid_get_level_rect: (skip)
+ * @roi: the full resolution area of the pyramid
+ * @level: a level of the pyramid
+ * @level_rect: (out): return location for the area of @level
+ *
+ * Computes the area @roi covers at @level, in the coordinates of @level.
+ */
+void     gegl_buffer_pyramid_get_level_rect (const GeglRectangle *roi,
+                                             gint                 level,
+                                             GeglRectangle       *level_rect);
+
+/**
+ * gegl_buffer_pyramid_foreach: (skip)
+ * @buffer: the buffer to read from
+ * @roi: the full resolution area of the pyramid
+ * @first_level: the first level to visit
+ * @n_levels: the number of levels to visit
+ * @tile_size: the width and height of tiles, without overlap
+ * @overlap: the number of pixels tiles extend into their neighbours
+ * @format: the format to pass tile data in
+ * @func: the function to call for each tile
+ * @user_data: data to pass to @func
+ *
+ * Reads a resolution pyramid of @roi from the mipmap levels of @buffer, and
+ * calls @func for each of its tiles.  Levels are visited in order, one
+ * after the other, and the tiles of each level are fetched and passed to
+ * @func in parallel.  Since the reduced levels are computed from the
+ * previous ones, each pixel of @buffer is read only once.
+ *
+ * Returns: %FALSE if @func stopped the iteration.
+ */
+gboolean gegl_buffer_pyramid_foreach        (GeglBuffer          *buffer,
+                                             const GeglRectangle *roi,
+                                             gint                 first_level,
+                                             gint                 n_levels,
+                                             gint                 tile_size,
+                                             gint                 overlap,
+                                             const Babl          *format,
+                                             GeglPyramidTileFunc  func,
+                                             gpointer             user_data);
+
+G_END_DECLS
+
+#endif /* __GEGL_BUFFER_PYRAMID_H__ */
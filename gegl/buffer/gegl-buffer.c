@@ -43,6 +43,7 @@
 #include "gegl-tile-backend-file.h"
 #include "gegl-tile-backend-swap.h"
 #include "gegl-tile-backend-ram.h"
+#include "gegl-tile-backend-borrowed.h"
 #include "gegl-buffer-formats.h"
 #include "gegl-algorithms.h"
 
@@ -1055,6 +1056,50 @@ gegl_buffer_new_for_backend (const GeglRectangle *extent,
                        NULL);
 }
 
+GeglBuffer *
+gegl_buffer_new_for_data (gpointer             data,
+                          const Babl          *format,
+                          const GeglRectangle *extent,
+                          gint                 rowstride,
+                          GDestroyNotify       destroy_fn,
+                          gpointer             destroy_fn_data)
+{
+  GeglTileBackend *backend;
+  GeglBuffer      *buffer;
+
+  g_return_val_if_fail (data != NULL, NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+  g_return_val_if_fail (extent != NULL && ! gegl_rectangle_is_empty (extent),
+                        NULL);
+
+  if (rowstride == 0)
+    rowstride = extent->width * babl_format_get_bytes_per_pixel (format);
+
+  backend = gegl_tile_backend_borrowed_new (data, format,
+                                            extent->width, extent->height,
+                                            rowstride,
+                                            destroy_fn, destroy_fn_data);
+
+  if (! backend)
+    return NULL;
+
+  /* the tile grid starts at the first pixel of data */
+  buffer = g_object_new (GEGL_TYPE_BUFFER,
+                         "x",       extent->x,
+                         "y",       extent->y,
+                         "shift-x", -extent->x,
+                         "shift-y", -extent->y,
+                         "width",   extent->width,
+                         "height",  extent->height,
+                         "format",  format,
+                         "backend", backend,
+                         NULL);
+
+  g_object_unref (backend);
+
+  return buffer;
+}
+
 void
 gegl_buffer_add_handler (GeglBuffer *buffer,
                          gpointer    handler)
@@ -1301,6 +1346,27 @@ gegl_buffer_get_tile (GeglBuffer *buffer,
   return tile;
 }
 
+GeglTile *
+_gegl_buffer_get_cached_tile (GeglBuffer *buffer,
+                              gint        x,
+                              gint        y,
+                              gint        z)
+{
+  GeglTileStorage *tile_storage = buffer->tile_storage;
+
+  /* user handlers, and external cache flushing, have to see every tile
+   * request, which needs the full handler chain
+   */
+  if (tile_storage->n_user_handlers     ||
+      gegl_tile_handler_cache_ext_flush ||
+      ! tile_storage->cache)
+    {
+      return NULL;
+    }
+
+  return gegl_tile_handler_cache_lookup_fast (tile_storage->cache, x, y, z);
+}
+
 void (*gegl_tile_handler_cache_ext_flush) (void *cache, const GeglRectangle *rect)=NULL;
 void (*gegl_buffer_ext_flush) (GeglBuffer *buffer, const GeglRectangle *rect)=NULL;
 void (*gegl_buffer_ext_invalidate) (GeglBuffer *buffer, const GeglRectangle *rect)=NULL;
@@ -1346,6 +1412,11 @@ void (*gegl_downscale_2x2) (const Babl *format,
                             gint        dst_rowstride) =
       gegl_downscale_2x2_generic;
 
+GeglResampleFusedFun (*gegl_resample_get_fused_fun) (const Babl *src_format,
+                                                     const Babl *dst_format,
+                                                     gint        filter) =
+      gegl_resample_get_fused_fun_generic;
+
 
 #define GEGL_VARIANTS(variant) \
 void gegl_resample_nearest_##variant   (guchar              *dest_buf,     \
@@ -1378,7 +1449,11 @@ void gegl_downscale_2x2_##variant      (const Babl          *format,       \
                                         guchar              *src_data,     \
                                         gint                 src_rowstride,\
                                         guchar              *dst_data,     \
-                                        gint                 dst_rowstride);
+                                        gint                 dst_rowstride);\
+GeglResampleFusedFun                                                       \
+     gegl_resample_get_fused_fun_##variant (const Babl      *src_format,   \
+                                            const Babl      *dst_format,   \
+                                            gint             filter);
 
 #include "gegl-variants.inc"
 //GEGL_VARIANTS(generic)
@@ -1387,6 +1462,7 @@ void gegl_downscale_2x2_##variant      (const Babl          *format,       \
 guint16 gegl_lut_u8_to_u16[256];
 gfloat  gegl_lut_u8_to_u16f[256];
 guint8  gegl_lut_u16_to_u8[65536/GEGL_ALGORITHMS_LUT_DIVISOR];
+gfloat  gegl_lut_u8_to_float[256];
 
 
 void _gegl_init_buffer (int variant);
@@ -1415,6 +1491,9 @@ void _gegl_init_buffer (int variant)
   babl_process (babl_fish (babl_format ("Y u16"), babl_format("Y' u8")),
                 &u16_ramp[0], &gegl_lut_u16_to_u8[0],
                 65536/GEGL_ALGORITHMS_LUT_DIVISOR);
+  babl_process (babl_fish (babl_format ("Y' u8"), babl_format("Y float")),
+                &u8_ramp[0], &gegl_lut_u8_to_float[0],
+                256);
 #ifdef ARCH_ARM
   if (variant)
   {
@@ -1422,6 +1501,7 @@ void _gegl_init_buffer (int variant)
     gegl_resample_boxfilter = gegl_resample_boxfilter_arm_neon;
     gegl_resample_nearest   = gegl_resample_nearest_arm_neon;
     gegl_downscale_2x2      = gegl_downscale_2x2_arm_neon;
+    gegl_resample_get_fused_fun = gegl_resample_get_fused_fun_arm_neon;
   }
 #endif
 #ifdef ARCH_X86_64
@@ -1434,12 +1514,14 @@ void _gegl_init_buffer (int variant)
       gegl_resample_boxfilter = gegl_resample_boxfilter_x86_64_v2;
       gegl_resample_nearest   = gegl_resample_nearest_x86_64_v2;
       gegl_downscale_2x2      = gegl_downscale_2x2_x86_64_v2;
+      gegl_resample_get_fused_fun = gegl_resample_get_fused_fun_x86_64_v2;
       break;
     case 3:
       gegl_resample_bilinear  = gegl_resample_bilinear_x86_64_v3;
       gegl_resample_boxfilter = gegl_resample_boxfilter_x86_64_v3;
       gegl_resample_nearest   = gegl_resample_nearest_x86_64_v3;
       gegl_downscale_2x2      = gegl_downscale_2x2_x86_64_v3;
+      gegl_resample_get_fused_fun = gegl_resample_get_fused_fun_x86_64_v3;
       break;
   }
 #endif
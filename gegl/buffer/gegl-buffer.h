@@ -82,6 +82,40 @@ GeglBuffer *    gegl_buffer_new               (const GeglRectangle *extent,
 GeglBuffer *   gegl_buffer_new_for_backend    (const GeglRectangle *extent,
                                                GeglTileBackend     *backend);
 
+/**
+ * gegl_buffer_new_for_data: (skip)
+ * @data: a pointer to the first pixel of an image in memory.
+ * @format: the format of the pixels of @data.
+ * @extent: the geometry of the buffer; its origin is the first pixel.
+ * @rowstride: the number of bytes between the starts of rows, or 0 for
+ *             rows packed without padding.
+ * @destroy_fn: (nullable): function to call when the buffer no longer uses
+ *              @data.
+ * @destroy_fn_data: argument to pass to @destroy_fn.
+ *
+ * Creates a tiled GeglBuffer whose pixels are the ones of @data, which
+ * remains owned by the caller, like shared memory or a mapped file.
+ * Reading the buffer reads @data, and writing it writes @data.
+ *
+ * When @rowstride is an even number of pixels and @data is aligned to the
+ * size of a component of @format, the tiles of the buffer span whole rows
+ * and point straight into @data, without copying.  Each tile holds an even
+ * number of rows, at least two, and about as many pixels as the tiles of
+ * the buffer configuration, so this holds for frames of any width that
+ * are at least as tall as a tile.  Otherwise, and for the rows past the
+ * last whole tile, tiles are copies of @data that are written back whenever
+ * they change; changes made to @data behind GEGL's back are only seen in
+ * those rows once the buffer's cache drops them.
+ *
+ * Returns: a GeglBuffer that can be used as any other GeglBuffer.
+ */
+GeglBuffer *   gegl_buffer_new_for_data       (gpointer             data,
+                                               const Babl          *format,
+                                               const GeglRectangle *extent,
+                                               gint                 rowstride,
+                                               GDestroyNotify       destroy_fn,
+                                               gpointer             destroy_fn_data);
+
 /**
  * gegl_buffer_add_handler:
  * @buffer: a #GeglBuffer
@@ -18,6 +18,13 @@
 
 #include "config.h"
 
+#ifdef HAVE_GETCPU
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#endif
+
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,6 +33,10 @@
 #include <malloc.h>
 #endif
 
+#ifdef HAVE_MADVISE
+#include <sys/mman.h>
+#endif
+
 #include <glib-object.h>
 
 #include "gegl-buffer-config.h"
@@ -45,6 +56,9 @@
 #define GEGL_TILE_BLOCK_MAX_BUFFERS   1024
 #define GEGL_TILE_BLOCKS_PER_TRIM     10
 #define GEGL_TILE_SENTINEL_BLOCK      ((GeglTileBlock *) ~(guintptr) 0)
+#define GEGL_TILE_MAX_NODES           16
+#define GEGL_TILE_HUGE_PAGE_SIZE      (2 << 20)
+#define GEGL_TILE_PAGE_SIZE           4096
 
 
 /*  private types  */
@@ -64,6 +78,8 @@ struct _GeglTileBlock
 {
   GeglTileBlock * volatile *block_ptr;
   guintptr                  size;
+  gint                      node;
+  gboolean                  mapped;
 
   GeglTileBuffer           *head;
   gint                      n_allocated;
@@ -78,7 +94,9 @@ struct _GeglTileBlock
 static gint                    gegl_tile_log2i            (guint                      n);
 
 static GeglTileBlock         * gegl_tile_block_new        (GeglTileBlock * volatile  *block_ptr,
-                                                           gsize                      size);
+                                                           gsize                      size,
+                                                           gint                       node);
+static GeglTileBlock         * gegl_tile_block_alloc_mem  (gsize                     *block_size);
 static void                    gegl_tile_block_free       (GeglTileBlock             *block,
                                                            GeglTileBlock            **head_block);
 static void                    gegl_tile_block_free_mem   (GeglTileBlock             *block);
@@ -88,17 +106,23 @@ static inline GeglTileBuffer * gegl_tile_buffer_from_data (gpointer
 
 static gpointer                gegl_tile_alloc_fallback   (gsize                      size);
 
+static gboolean                gegl_tile_alloc_huge_pages (void);
+static gint                    gegl_tile_alloc_get_node   (void);
+
 
 /*  local variables  */
 
 static const gint     gegl_tile_divisors[] = {1, 3, 5};
-static GeglTileBlock *gegl_tile_blocks[G_N_ELEMENTS (gegl_tile_divisors)]
+static GeglTileBlock *gegl_tile_blocks[GEGL_TILE_MAX_NODES]
+                                      [G_N_ELEMENTS (gegl_tile_divisors)]
                                       [GEGL_TILE_MAX_SIZE_LOG2];
 static GeglTileBlock *gegl_tile_empty_block;
 static gint           gegl_tile_n_blocks;
 static gint           gegl_tile_max_n_blocks;
 
 static guintptr       gegl_tile_alloc_total;
+static guintptr       gegl_tile_alloc_node_total[GEGL_TILE_MAX_NODES];
+static gint           gegl_tile_alloc_n_nodes = 1;
 
 
 /*  private functions  */
@@ -136,9 +160,30 @@ gegl_tile_log2i (guint n)
 
 #endif /* HAVE___BUILTIN_CLZ */
 
+/* writes to every page of a new block from the allocating thread, so that,
+ * with first-touch placement, all of its pages end up on the node of that
+ * thread, rather than on the node of whichever thread first writes to each
+ * tile.
+ */
+static void
+gegl_tile_block_touch_pages (GeglTileBlock *block,
+                             gsize          block_size)
+{
+  volatile guint8 *mem = (guint8 *) block;
+  gsize            offset;
+
+  for (offset = GEGL_TILE_BLOCK_BUFFER_OFFSET;
+       offset < block_size;
+       offset += GEGL_TILE_PAGE_SIZE)
+    {
+      mem[offset] = 0;
+    }
+}
+
 static GeglTileBlock *
 gegl_tile_block_new (GeglTileBlock * volatile *block_ptr,
-                     gsize                     size)
+                     gsize                     size,
+                     gint                      node)
 {
   GeglTileBlock *block;
   gsize          block_size;
@@ -156,7 +201,11 @@ gegl_tile_block_new (GeglTileBlock * volatile *block_ptr,
          ! g_atomic_pointer_compare_and_exchange (&gegl_tile_empty_block,
                                                   block, NULL));
 
-  if (block && block->size - GEGL_TILE_BLOCK_BUFFER_OFFSET < buffer_size)
+  /* only reuse the empty block if it's big enough, and resides on the
+   * same node, since its pages have already been placed
+   */
+  if (block && (block->size - GEGL_TILE_BLOCK_BUFFER_OFFSET < buffer_size ||
+                block->node != node))
     {
       gegl_tile_block_free_mem (block);
 
@@ -188,11 +237,22 @@ gegl_tile_block_new (GeglTileBlock * volatile *block_ptr,
 
       block_size = GEGL_TILE_BLOCK_BUFFER_OFFSET + n_buffers * buffer_size;
 
-      block = gegl_try_malloc (block_size);
+      block = gegl_tile_block_alloc_mem (&block_size);
 
       if (! block)
         return NULL;
 
+      /* the block might have been rounded up to whole huge pages */
+      n_buffers = (block_size - GEGL_TILE_BLOCK_BUFFER_OFFSET) / buffer_size;
+      n_buffers = MIN (n_buffers, GEGL_TILE_BLOCK_MAX_BUFFERS);
+
+      if (gegl_tile_alloc_n_nodes > 1)
+        gegl_tile_block_touch_pages (block, block_size);
+
+      block->node = node;
+
+      g_atomic_pointer_add (&gegl_tile_alloc_node_total[node], +block_size);
+
       n_blocks = g_atomic_int_add (&gegl_tile_n_blocks, +1) + 1;
 
       if (n_blocks % GEGL_TILE_BLOCKS_PER_TRIM == 0)
@@ -264,17 +324,80 @@ gegl_tile_block_free (GeglTileBlock  *block,
   gegl_tile_block_free_mem (block);
 }
 
+static GeglTileBlock *
+gegl_tile_block_alloc_mem (gsize *block_size)
+{
+  GeglTileBlock *block;
+
+#ifdef HAVE_MADVISE
+  if (gegl_tile_alloc_huge_pages ())
+    {
+      guint8 *mem;
+      gsize   size;
+      gsize   head;
+
+      size = (*block_size + GEGL_TILE_HUGE_PAGE_SIZE - 1) /
+             GEGL_TILE_HUGE_PAGE_SIZE * GEGL_TILE_HUGE_PAGE_SIZE;
+
+      /* over-allocate by a huge page, so that the block can be aligned to
+       * a huge-page boundary, and unmap the excess
+       */
+      mem = mmap (NULL, size + GEGL_TILE_HUGE_PAGE_SIZE,
+                  PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                  -1, 0);
+
+      if (mem != MAP_FAILED)
+        {
+          head = (GEGL_TILE_HUGE_PAGE_SIZE -
+                  (guintptr) mem % GEGL_TILE_HUGE_PAGE_SIZE) %
+                 GEGL_TILE_HUGE_PAGE_SIZE;
+
+          if (head)
+            munmap (mem, head);
+          munmap (mem + head + size, GEGL_TILE_HUGE_PAGE_SIZE - head);
+
+          mem += head;
+
+#ifdef MADV_HUGEPAGE
+          madvise (mem, size, MADV_HUGEPAGE);
+#endif
+
+          block         = (GeglTileBlock *) mem;
+          block->mapped = TRUE;
+
+          *block_size = size;
+
+          return block;
+        }
+    }
+#endif
+
+  block = gegl_try_malloc (*block_size);
+
+  if (block)
+    block->mapped = FALSE;
+
+  return block;
+}
+
 static void
 gegl_tile_block_free_mem (GeglTileBlock *block)
 {
   guintptr block_size = block->size;
+  gint     node       = block->node;
   gint     n_blocks;
 
-  gegl_free (block);
+#ifdef HAVE_MADVISE
+  if (block->mapped)
+    munmap (block, block_size);
+  else
+#endif
+    gegl_free (block);
 
   n_blocks = g_atomic_int_add (&gegl_tile_n_blocks, -1) - 1;
 
   g_atomic_pointer_add (&gegl_tile_alloc_total, -block_size);
+  g_atomic_pointer_add (&gegl_tile_alloc_node_total[node], -block_size);
 
 #ifdef HAVE_MALLOC_TRIM
   if (gegl_tile_max_n_blocks - n_blocks >= GEGL_TILE_BLOCKS_PER_TRIM)
@@ -326,12 +449,90 @@ gegl_tile_alloc_enabled (void)
   return enabled;
 }
 
+static gboolean
+gegl_tile_alloc_huge_pages (void)
+{
+  static gint enabled = -1;
+
+  if (enabled < 0)
+    {
+      if (g_getenv ("GEGL_TILE_ALLOC_HUGE_PAGES"))
+        enabled = atoi (g_getenv ("GEGL_TILE_ALLOC_HUGE_PAGES")) ? TRUE : FALSE;
+      else
+        enabled = FALSE;
+    }
+
+  return enabled;
+}
+
+static gboolean
+gegl_tile_alloc_numa (void)
+{
+  static gint enabled = -1;
+
+  if (enabled < 0)
+    {
+      if (g_getenv ("GEGL_TILE_ALLOC_NUMA"))
+        enabled = atoi (g_getenv ("GEGL_TILE_ALLOC_NUMA")) ? TRUE : FALSE;
+      else
+        enabled = FALSE;
+    }
+
+  return enabled;
+}
+
+/* returns the NUMA node of the calling thread, when per-node allocation
+ * is enabled, or 0 otherwise.
+ */
+static gint
+gegl_tile_alloc_get_node (void)
+{
+#ifdef HAVE_GETCPU
+  if (gegl_tile_alloc_n_nodes > 1)
+    {
+      guint cpu;
+      guint node;
+
+      if (getcpu (&cpu, &node) == 0)
+        return node % GEGL_TILE_MAX_NODES;
+    }
+#endif
+
+  return 0;
+}
+
+static gint
+gegl_tile_alloc_count_nodes (void)
+{
+  gint n_nodes = 0;
+
+  while (n_nodes < GEGL_TILE_MAX_NODES)
+    {
+      gchar    *path;
+      gboolean  exists;
+
+      path   = g_strdup_printf ("/sys/devices/system/node/node%d", n_nodes);
+      exists = g_file_test (path, G_FILE_TEST_IS_DIR);
+
+      g_free (path);
+
+      if (! exists)
+        break;
+
+      n_nodes++;
+    }
+
+  return MAX (n_nodes, 1);
+}
+
 
 /*  public functions  */
 
 void
 gegl_tile_alloc_init (void)
 {
+  if (gegl_tile_alloc_numa ())
+    gegl_tile_alloc_n_nodes = gegl_tile_alloc_count_nodes ();
 }
 
 void
@@ -358,6 +559,7 @@ gegl_tile_alloc (gsize size)
   GeglTileBlock             *block;
   GeglTileBuffer            *buffer;
   GeglTileBuffer           **next_buffer;
+  gint                       node;
   gint                       n;
   gint                       i;
   gint                       j;
@@ -384,7 +586,9 @@ gegl_tile_alloc (gsize size)
 
   j = gegl_tile_log2i (n);
 
-  block_ptr = &gegl_tile_blocks[i][j];
+  node = gegl_tile_alloc_get_node ();
+
+  block_ptr = &gegl_tile_blocks[node][i][j];
 
   do
     {
@@ -397,7 +601,7 @@ gegl_tile_alloc (gsize size)
 
   if (! block)
     {
-      block = gegl_tile_block_new (block_ptr, size);
+      block = gegl_tile_block_new (block_ptr, size, node);
 
       if (! block)
         {
@@ -502,3 +706,17 @@ gegl_tile_alloc_get_total (void)
 {
   return gegl_tile_alloc_total;
 }
+
+gint
+gegl_tile_alloc_get_n_nodes (void)
+{
+  return gegl_tile_alloc_n_nodes;
+}
+
+guint64
+gegl_tile_alloc_get_node_total (gint node)
+{
+  g_return_val_if_fail (node >= 0 && node < GEGL_TILE_MAX_NODES, 0);
+
+  return gegl_tile_alloc_node_total[node];
+}
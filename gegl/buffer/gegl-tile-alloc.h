@@ -20,18 +20,20 @@
 #define __GEGL_TILE_ALLOC_H__
 
 
-void       gegl_tile_alloc_init      (void);
-void       gegl_tile_alloc_cleanup   (void);
+void       gegl_tile_alloc_init           (void);
+void       gegl_tile_alloc_cleanup        (void);
 
 /* the buffer returned by gegl_tile_alloc() and gegl_tile_alloc0() is
  * guaranteed to have room for two `int`s in front of the buffer.
  */
 
-gpointer   gegl_tile_alloc           (gsize    size) G_GNUC_MALLOC;
-gpointer   gegl_tile_alloc0          (gsize    size) G_GNUC_MALLOC;
-void       gegl_tile_free            (gpointer ptr);
+gpointer   gegl_tile_alloc                (gsize    size) G_GNUC_MALLOC;
+gpointer   gegl_tile_alloc0               (gsize    size) G_GNUC_MALLOC;
+void       gegl_tile_free                 (gpointer ptr);
 
-guint64    gegl_tile_alloc_get_total (void);
+guint64    gegl_tile_alloc_get_total      (void);
+gint       gegl_tile_alloc_get_n_nodes    (void);
+guint64    gegl_tile_alloc_get_node_total (gint     node);
 
 
 #endif /* __GEGL_TILE_ALLOC_H__ */
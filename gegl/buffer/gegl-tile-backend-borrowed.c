@@ -0,0 +1,374 @@
+/* This file is part of GEGL.
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib-object.h>
+
+#include "gegl-buffer.h"
+#include "gegl-buffer-backend.h"
+#include "gegl-buffer-config.h"
+#include "gegl-tile-backend.h"
+#include "gegl-tile-backend-borrowed.h"
+
+/* We need the private header to keep the identity of borrowed tiles, to
+ * flag them, and to address copied tiles when writing them back.
+ */
+#include "gegl-buffer-private.h"
+
+G_DEFINE_TYPE (GeglTileBackendBorrowed, gegl_tile_backend_borrowed, GEGL_TYPE_TILE_BACKEND)
+#define parent_class gegl_tile_backend_borrowed_parent_class
+
+
+/* computes the part of the image covered by a tile, in pixels */
+static gboolean
+get_tile_rect (GeglTileBackendBorrowed *self,
+               gint                     x,
+               gint                     y,
+               GeglRectangle           *rect)
+{
+  GeglTileBackend *backend     = GEGL_TILE_BACKEND (self);
+  gint             tile_width  = gegl_tile_backend_get_tile_width (backend);
+  gint             tile_height = gegl_tile_backend_get_tile_height (backend);
+  GeglRectangle    image       = {0, 0, self->width, self->height};
+  GeglRectangle    tile_rect   = {x * tile_width, y * tile_height,
+                                  tile_width, tile_height};
+
+  return gegl_rectangle_intersect (rect, &tile_rect, &image);
+}
+
+static guchar *
+get_tile_pointer (GeglTileBackendBorrowed *self,
+                  const GeglRectangle     *rect)
+{
+  gint bpp = babl_format_get_bytes_per_pixel (
+    gegl_tile_backend_get_format (GEGL_TILE_BACKEND (self)));
+
+  return self->data + (gsize) rect->y * self->rowstride + rect->x * bpp;
+}
+
+/* whether a tile can point straight into the image, which requires that
+ * all of its bytes, including the ones past the width of its last row, are
+ * part of the image.
+ */
+static gboolean
+is_zero_copy_tile (GeglTileBackendBorrowed *self,
+                   gint                     x,
+                   gint                     y)
+{
+  GeglTileBackend *backend     = GEGL_TILE_BACKEND (self);
+  gint             tile_height = gegl_tile_backend_get_tile_height (backend);
+  gint             bpp;
+
+  if (! self->zero_copy || x != 0)
+    return FALSE;
+
+  bpp = babl_format_get_bytes_per_pixel (
+    gegl_tile_backend_get_format (backend));
+
+  return (gsize) (y + 1) * tile_height * self->rowstride <=
+         (gsize) (self->height - 1) * self->rowstride +
+         (gsize) self->width * bpp;
+}
+
+static void
+write_back (GeglTileBackendBorrowed *self,
+            GeglTile                *tile,
+            gint                     x,
+            gint                     y)
+{
+  GeglTileBackend *backend = GEGL_TILE_BACKEND (self);
+  gint             bpp;
+  gint             tile_rowstride;
+  GeglRectangle    rect;
+  const guchar    *src;
+  guchar          *dst;
+  gint             row;
+
+  if (! get_tile_rect (self, x, y, &rect))
+    return;
+
+  src = gegl_tile_get_data (tile);
+  dst = get_tile_pointer (self, &rect);
+
+  if (src == dst)
+    return;
+
+  bpp            = babl_format_get_bytes_per_pixel (
+                     gegl_tile_backend_get_format (backend));
+  tile_rowstride = gegl_tile_backend_get_tile_width (backend) * bpp;
+
+  for (row = 0; row < rect.height; row++)
+    {
+      memcpy (dst, src, (gsize) rect.width * bpp);
+
+      src += tile_rowstride;
+      dst += self->rowstride;
+    }
+}
+
+static void
+tile_unlocked (GeglTile                *tile,
+               GeglTileBackendBorrowed *self)
+{
+  if (tile->z == 0)
+    write_back (self, tile, tile->x, tile->y);
+}
+
+static GeglTile *
+get_tile (GeglTileSource *tile_store,
+          gint            x,
+          gint            y,
+          gint            z)
+{
+  GeglTileBackendBorrowed *self    = GEGL_TILE_BACKEND_BORROWED (tile_store);
+  GeglTileBackend         *backend = GEGL_TILE_BACKEND (tile_store);
+  gint                     size    = gegl_tile_backend_get_tile_size (backend);
+  GeglTile                *tile;
+  GeglRectangle            rect;
+
+  /* reduced levels are left to the zoom handler */
+  if (z != 0 || ! get_tile_rect (self, x, y, &rect))
+    return NULL;
+
+  if (is_zero_copy_tile (self, x, y))
+    {
+      tile = gegl_tile_new_bare ();
+
+      /* writes must keep going to the image, so the tile is copied rather
+       * than cloned, and never uncloned.
+       */
+      tile->keep_identity = TRUE;
+      tile->borrowed      = TRUE;
+
+      gegl_tile_set_data_full (tile, get_tile_pointer (self, &rect), size,
+                               NULL, NULL);
+    }
+  else
+    {
+      gint          bpp;
+      gint          tile_rowstride;
+      const guchar *src;
+      guchar       *dst;
+      gint          row;
+
+      bpp            = babl_format_get_bytes_per_pixel (
+                         gegl_tile_backend_get_format (backend));
+      tile_rowstride = gegl_tile_backend_get_tile_width (backend) * bpp;
+
+      tile = gegl_tile_new (size);
+      dst  = gegl_tile_get_data (tile);
+      src  = get_tile_pointer (self, &rect);
+
+      if (rect.width  < gegl_tile_backend_get_tile_width (backend) ||
+          rect.height < gegl_tile_backend_get_tile_height (backend))
+        memset (dst, 0, size);
+
+      for (row = 0; row < rect.height; row++)
+        {
+          memcpy (dst, src, (gsize) rect.width * bpp);
+
+          src += self->rowstride;
+          dst += tile_rowstride;
+        }
+
+      gegl_tile_set_unlock_notify (tile, (GeglTileCallback) tile_unlocked,
+                                   self);
+    }
+
+  /* the coordinates are needed by tile_unlocked(), which can run before
+   * the buffer sets them.
+   */
+  tile->x = x;
+  tile->y = y;
+  tile->z = z;
+
+  gegl_tile_mark_as_stored (tile);
+
+  return tile;
+}
+
+static gboolean
+set_tile (GeglTileSource *store,
+          GeglTile       *tile,
+          gint            x,
+          gint            y,
+          gint            z)
+{
+  GeglTileBackendBorrowed *self = GEGL_TILE_BACKEND_BORROWED (store);
+
+  if (G_UNLIKELY (z != 0))
+    return FALSE;
+
+  write_back (self, tile, x, y);
+
+  gegl_tile_mark_as_stored (tile);
+
+  return TRUE;
+}
+
+static gboolean
+exist_tile (GeglTileSource *store,
+            GeglTile       *tile,
+            gint            x,
+            gint            y,
+            gint            z)
+{
+  GeglTileBackendBorrowed *self = GEGL_TILE_BACKEND_BORROWED (store);
+  GeglRectangle            rect;
+
+  if (G_UNLIKELY (z != 0))
+    return FALSE;
+
+  return get_tile_rect (self, x, y, &rect);
+}
+
+static gpointer
+gegl_tile_backend_borrowed_command (GeglTileSource  *tile_store,
+                                    GeglTileCommand  command,
+                                    gint             x,
+                                    gint             y,
+                                    gint             z,
+                                    gpointer         data)
+{
+  switch (command)
+    {
+      case GEGL_TILE_GET:
+        return get_tile (tile_store, x, y, z);
+
+      case GEGL_TILE_SET:
+        set_tile (tile_store, data, x, y, z);
+        return NULL;
+
+      case GEGL_TILE_IDLE:
+        return NULL;
+
+      /* the image belongs to the caller, and isn't discarded */
+      case GEGL_TILE_VOID:
+        return NULL;
+
+      case GEGL_TILE_EXIST:
+        return GINT_TO_POINTER (exist_tile (tile_store, data, x, y, z));
+
+      default:
+        break;
+    }
+
+  return gegl_tile_backend_command (GEGL_TILE_BACKEND (tile_store),
+                                    command, x, y, z, data);
+}
+
+static void
+gegl_tile_backend_borrowed_finalize (GObject *object)
+{
+  GeglTileBackendBorrowed *self = GEGL_TILE_BACKEND_BORROWED (object);
+
+  if (self->destroy_fn)
+    self->destroy_fn (self->destroy_fn_data);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gegl_tile_backend_borrowed_class_init (GeglTileBackendBorrowedClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gegl_tile_backend_borrowed_finalize;
+}
+
+static void
+gegl_tile_backend_borrowed_init (GeglTileBackendBorrowed *self)
+{
+  GEGL_TILE_SOURCE (self)->command = gegl_tile_backend_borrowed_command;
+}
+
+GeglTileBackend *
+gegl_tile_backend_borrowed_new (gpointer        data,
+                                const Babl     *format,
+                                gint            width,
+                                gint            height,
+                                gint            rowstride,
+                                GDestroyNotify  destroy_fn,
+                                gpointer        destroy_fn_data)
+{
+  GeglTileBackendBorrowed *self;
+  GeglRectangle            extent = {0, 0, width, height};
+  gint                     bpp;
+  gint                     bytes_per_sample;
+  gint                     tile_width;
+  gint                     tile_height;
+  gboolean                 zero_copy;
+
+  g_return_val_if_fail (data != NULL, NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+  g_return_val_if_fail (width > 0 && height > 0, NULL);
+
+  bpp              = babl_format_get_bytes_per_pixel (format);
+  bytes_per_sample = bpp / babl_format_get_n_components (format);
+
+  g_return_val_if_fail (rowstride >= width * bpp, NULL);
+
+  /* tiles can only point into the image when each row of a tile starts
+   * where the previous one ends, that is, when tiles span whole rows, and
+   * the rowstride is a whole number of aligned pixels.
+   */
+  zero_copy = rowstride % bpp == 0 &&
+              (guintptr) data % bytes_per_sample == 0;
+
+  if (zero_copy)
+    {
+      GeglBufferConfig *config = gegl_buffer_config ();
+
+      /* rows as wide as the rowstride, and about as many pixels as the
+       * configured tiles, but at least two rows.
+       */
+      tile_width  = rowstride / bpp;
+      tile_height = config->tile_width * config->tile_height / tile_width;
+      tile_height = MAX (tile_height - tile_height % 2, 2);
+
+      /* the zoom handler builds each tile of a level from the halves of
+       * tiles of the level below, so tiles have to be of even dimensions.
+       */
+      zero_copy = tile_width % 2 == 0 && tile_height <= height;
+    }
+
+  if (! zero_copy)
+    {
+      tile_width  = gegl_buffer_config ()->tile_width;
+      tile_height = gegl_buffer_config ()->tile_height;
+    }
+
+  self = g_object_new (GEGL_TYPE_TILE_BACKEND_BORROWED,
+                       "tile-width",  tile_width,
+                       "tile-height", tile_height,
+                       "format",      format,
+                       NULL);
+
+  self->data            = data;
+  self->width           = width;
+  self->height          = height;
+  self->rowstride       = rowstride;
+  self->zero_copy       = zero_copy;
+  self->destroy_fn      = destroy_fn;
+  self->destroy_fn_data = destroy_fn_data;
+
+  gegl_tile_backend_set_extent (GEGL_TILE_BACKEND (self), &extent);
+
+  return GEGL_TILE_BACKEND (self);
+}
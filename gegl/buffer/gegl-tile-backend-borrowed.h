@@ -0,0 +1,77 @@
+/* This file is part of GEGL.
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_TILE_BACKEND_BORROWED_H__
+#define __GEGL_TILE_BACKEND_BORROWED_H__
+
+#include "gegl-tile-backend.h"
+
+/***
+ * GeglTileBackendBorrowed is a GeglTileBackend whose tiles are the rows of
+ * a strided image in memory owned by the caller.  When the rowstride is a
+ * whole, even number of pixels, the image is aligned to the size of a
+ * component, and it is at least as tall as a tile, tiles span the full
+ * rowstride and point straight into the image.  They hold an even number
+ * of rows, at least two, and about as many pixels as the configured tile
+ * size.  Tiles that would extend past the last row of the image are copies
+ * that are written back whenever they change; for other images, all tiles
+ * are copies, of the configured tile size.
+ */
+
+G_BEGIN_DECLS
+
+#define GEGL_TYPE_TILE_BACKEND_BORROWED            (gegl_tile_backend_borrowed_get_type ())
+#define GEGL_TILE_BACKEND_BORROWED(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GEGL_TYPE_TILE_BACKEND_BORROWED, GeglTileBackendBorrowed))
+#define GEGL_TILE_BACKEND_BORROWED_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  GEGL_TYPE_TILE_BACKEND_BORROWED, GeglTileBackendBorrowedClass))
+#define GEGL_IS_TILE_BACKEND_BORROWED(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GEGL_TYPE_TILE_BACKEND_BORROWED))
+#define GEGL_IS_TILE_BACKEND_BORROWED_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  GEGL_TYPE_TILE_BACKEND_BORROWED))
+#define GEGL_TILE_BACKEND_BORROWED_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  GEGL_TYPE_TILE_BACKEND_BORROWED, GeglTileBackendBorrowedClass))
+
+typedef struct _GeglTileBackendBorrowed      GeglTileBackendBorrowed;
+typedef struct _GeglTileBackendBorrowedClass GeglTileBackendBorrowedClass;
+
+struct _GeglTileBackendBorrowed
+{
+  GeglTileBackend  parent_instance;
+
+  guchar          *data;
+  gint             width;
+  gint             height;
+  gint             rowstride;
+  gboolean         zero_copy;
+
+  GDestroyNotify   destroy_fn;
+  gpointer         destroy_fn_data;
+};
+
+struct _GeglTileBackendBorrowedClass
+{
+  GeglTileBackendClass parent_class;
+};
+
+GType             gegl_tile_backend_borrowed_get_type (void) G_GNUC_CONST;
+
+GeglTileBackend * gegl_tile_backend_borrowed_new      (gpointer        data,
+                                                       const Babl     *format,
+                                                       gint            width,
+                                                       gint            height,
+                                                       gint            rowstride,
+                                                       GDestroyNotify  destroy_fn,
+                                                       gpointer        destroy_fn_data);
+
+G_END_DECLS
+
+#endif
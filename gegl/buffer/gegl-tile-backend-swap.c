@@ -40,6 +40,7 @@
 #include "gegl-tile-alloc.h"
 #include "gegl-tile-backend.h"
 #include "gegl-tile-backend-swap.h"
+#include "gegl-tile-handler-cache.h"
 #include "gegl-tile-handler-empty.h"
 #include "gegl-debug.h"
 #include "gegl-buffer-config.h"
@@ -66,6 +67,11 @@
  */
 #define QUEUED_MAX_RATIO 0.1
 
+/* under memory pressure, the queue limit ratio is reduced proportionally to
+ * the pressure, down to this ratio.
+ */
+#define QUEUED_MIN_RATIO 0.02
+
 /* maximal tile-data compression ratio, above which we use the uncompressed
  * tile, to avoid decompression overhead.
  */
@@ -1458,13 +1464,24 @@ gegl_tile_backend_swap_tile_cache_size_notify (GObject    *config,
                                                GParamSpec *pspec,
                                                gpointer    data)
 {
-  g_mutex_lock (&queue_mutex);
+  gegl_tile_backend_swap_update_queued_max ();
+}
 
-  g_object_get (config,
-                "tile-cache-size", &queued_max,
-                NULL);
+/* the queue limit follows the effective tile-cache budget, which differs
+ * from tile-cache-size in adaptive mode.
+ */
+void
+gegl_tile_backend_swap_update_queued_max (void)
+{
+  gdouble pressure = gegl_tile_handler_cache_get_pressure ();
+  gdouble ratio;
+
+  ratio = QUEUED_MAX_RATIO * (1.0 - CLAMP (pressure, 0.0, 100.0) / 100.0);
+  ratio = MAX (ratio, QUEUED_MIN_RATIO);
+
+  g_mutex_lock (&queue_mutex);
 
-  queued_max *= QUEUED_MAX_RATIO;
+  queued_max = gegl_tile_handler_cache_get_budget () * ratio;
 
   g_cond_broadcast (&push_cond);
 
@@ -18,6 +18,9 @@
 
 #include "config.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <glib.h>
 #include <glib-object.h>
 
@@ -38,6 +41,17 @@
 #define GEGL_CACHE_TRIM_RATIO_MAX  0.50
 #define GEGL_CACHE_TRIM_RATIO_RATE 2.0
 
+#define GEGL_CACHE_BUDGET_INTERVAL      500000    /* microseconds */
+#define GEGL_CACHE_BUDGET_MIN           (32 << 20)
+#define GEGL_CACHE_BUDGET_RESERVE       0.125     /* fraction of the cgroup
+                                                   * limit kept free
+                                                   */
+#define GEGL_CACHE_BUDGET_PRESSURE_HIGH 10.0      /* PSI "some avg10" */
+
+#define GEGL_CACHE_FAST_TILES      256    /* size of the lock-free lookup
+                                           * table; a power of two
+                                           */
+
 typedef struct CacheItem
 {
   GeglTile *tile; /* The tile */
@@ -54,6 +68,66 @@ typedef struct CacheItem
 #define LINK_GET_ITEM(l) \
         ((CacheItem *) ((guchar *) l - G_STRUCT_OFFSET (CacheItem, link)))
 
+/* besides the hash table, which may only be accessed while holding the
+ * storage mutex, the most recently inserted or fetched tile of each slot of
+ * the direct-mapped fast_tiles table can be looked up without any locking,
+ * by gegl_tile_handler_cache_lookup_fast().  the table is only modified while
+ * holding the storage mutex; removing a tile from the cache is bracketed by
+ * incrementing fast_seq, seqlock-style, so that lock-free lookups racing
+ * with a removal can detect it and back off.
+ */
+static inline GeglTile **
+fast_tile_slot (GeglTileHandlerCache *cache,
+                gint                  x,
+                gint                  y,
+                gint                  z)
+{
+  guint hash = ((guint) x * 73856093u) ^
+               ((guint) y * 19349663u) ^
+               ((guint) z * 83492791u);
+
+  return &cache->fast_tiles[hash & (GEGL_CACHE_FAST_TILES - 1)];
+}
+
+static inline void
+fast_tile_set (GeglTileHandlerCache *cache,
+               CacheItem            *item)
+{
+  g_atomic_pointer_set (fast_tile_slot (cache, item->x, item->y, item->z),
+                        item->tile);
+}
+
+static inline void
+fast_tile_unset (GeglTileHandlerCache *cache,
+                 CacheItem            *item)
+{
+  g_atomic_pointer_compare_and_exchange (
+    fast_tile_slot (cache, item->x, item->y, item->z),
+    item->tile, NULL);
+}
+
+static inline void
+fast_tile_begin_remove (GeglTileHandlerCache *cache)
+{
+  g_atomic_int_inc (&cache->fast_seq);
+}
+
+static inline void
+fast_tile_end_remove (GeglTileHandlerCache *cache)
+{
+  g_atomic_int_inc (&cache->fast_seq);
+}
+
+/* the number of bytes a tile counts toward the cache size.  borrowed tiles
+ * point into memory the cache doesn't own, and can't evict, so they don't
+ * count.
+ */
+static inline gint
+cache_tile_size (GeglTile *tile)
+{
+  return tile->borrowed ? 0 : tile->size;
+}
+
 
 static gboolean   gegl_tile_handler_cache_equalfunc  (gconstpointer             a,
                                                       gconstpointer             b);
@@ -86,6 +160,9 @@ static gboolean   gegl_tile_handler_cache_copy       (GeglTileHandlerCache     *
                                                       const GeglTileCopyParams *params);
 
 
+static gpointer   gegl_tile_handler_cache_budget_thread (gpointer ignored);
+
+
 static GMutex             mutex                 = { 0, };
 static GQueue             cache_queue           = G_QUEUE_INIT;
 static gint               cache_wash_percentage = 20;
@@ -95,6 +172,13 @@ static volatile guintptr  cache_total_uncloned  = 0; /* approximate amount of un
 static gint               cache_hits            = 0;
 static gint               cache_misses          = 0;
 static guintptr           cache_time            = 0;
+static GMutex             budget_mutex          = { 0, };
+static GCond              budget_cond;
+static GThread           *budget_thread         = NULL;
+static gboolean           budget_exit_thread    = FALSE;
+static guintptr           cache_budget          = 0; /* adaptive budget, or 0 */
+static gdouble            cache_pressure        = 0.0;
+static gchar             *cgroup_dir            = NULL;
 
 
 G_DEFINE_TYPE (GeglTileHandlerCache, gegl_tile_handler_cache, GEGL_TYPE_TILE_HANDLER)
@@ -114,6 +198,7 @@ gegl_tile_handler_cache_init (GeglTileHandlerCache *cache)
   ((GeglTileSource*)cache)->command = gegl_tile_handler_cache_command;
   cache->items = g_hash_table_new (gegl_tile_handler_cache_hashfunc, gegl_tile_handler_cache_equalfunc);
   g_queue_init (&cache->queue);
+  cache->fast_tiles = g_new0 (GeglTile *, GEGL_CACHE_FAST_TILES);
 
   gegl_tile_handler_cache_connect (cache);
 }
@@ -137,6 +222,12 @@ gegl_tile_handler_cache_reinit (GeglTileHandlerCache *cache)
 {
   CacheItem *item;
   GList     *link;
+  gint       i;
+
+  fast_tile_begin_remove (cache);
+
+  for (i = 0; i < GEGL_CACHE_FAST_TILES; i++)
+    g_atomic_pointer_set (&cache->fast_tiles[i], NULL);
 
   cache->time = cache->stamp = 0;
 
@@ -154,8 +245,8 @@ gegl_tile_handler_cache_reinit (GeglTileHandlerCache *cache)
       if (item->tile)
         {
           if (g_atomic_int_dec_and_test (gegl_tile_n_cached_clones (item->tile)))
-            g_atomic_pointer_add (&cache_total, -item->tile->size);
-          g_atomic_pointer_add (&cache_total_uncloned, -item->tile->size);
+            g_atomic_pointer_add (&cache_total, -cache_tile_size (item->tile));
+          g_atomic_pointer_add (&cache_total_uncloned, -cache_tile_size (item->tile));
           drop_hot_tile (item->tile);
           gegl_tile_mark_as_stored (item->tile); // to avoid saving
           item->tile->tile_storage = NULL;
@@ -163,6 +254,8 @@ gegl_tile_handler_cache_reinit (GeglTileHandlerCache *cache)
         }
       g_slice_free (CacheItem, item);
     }
+
+  fast_tile_end_remove (cache);
 }
 
 static void
@@ -175,6 +268,7 @@ gegl_tile_handler_cache_dispose (GObject *object)
   gegl_tile_handler_cache_reinit (cache);
 
   g_hash_table_destroy (cache->items);
+  g_clear_pointer (&cache->fast_tiles, g_free);
   G_OBJECT_CLASS (gegl_tile_handler_cache_parent_class)->dispose (object);
 }
 
@@ -486,12 +580,75 @@ gegl_tile_handler_cache_get_tile (GeglTileHandlerCache *cache,
                 result->tile);
         return NULL;
       }
+      fast_tile_set (cache, result);
       gegl_tile_ref (result->tile);
       return result->tile;
     }
   return NULL;
 }
 
+/* returns the requested tile if it is in the cache, and can be found without
+ * locking, NULL otherwise.  unlike gegl_tile_handler_cache_get_tile(), this
+ * function may be called without holding the storage mutex.
+ *
+ * the tile's position in the cache queue can't be updated without the lock,
+ * so the tile is only flagged, and gegl_tile_handler_cache_trim() moves
+ * flagged tiles to the front of the queue instead of trimming them.  the
+ * lookup isn't counted toward the cache statistics.
+ */
+GeglTile *
+gegl_tile_handler_cache_lookup_fast (GeglTileHandlerCache *cache,
+                                     gint                  x,
+                                     gint                  y,
+                                     gint                  z)
+{
+  GeglTile **slot;
+  GeglTile  *tile;
+  gint       seq;
+
+  seq = g_atomic_int_get (&cache->fast_seq);
+
+  /* a tile is being removed */
+  if (seq & 1)
+    return NULL;
+
+  slot = fast_tile_slot (cache, x, y, z);
+  tile = g_atomic_pointer_get (slot);
+
+  if (! tile || ! gegl_tile_try_ref (tile))
+    return NULL;
+
+  /* now that we hold a reference, make sure the tile is still the one we're
+   * looking for, and that it hasn't been removed from the cache in the
+   * meantime.
+   */
+  if (tile->x != x || tile->y != y || tile->z != z   ||
+      tile->tile_storage != cache->tile_storage       ||
+      g_atomic_pointer_get (slot) != tile             ||
+      g_atomic_int_get (&cache->fast_seq) != seq)
+    {
+      gegl_tile_unref (tile);
+
+      return NULL;
+    }
+
+  /* damaged mipmap tiles have to be re-rendered by the zoom handler, which
+   * only the full handler chain reaches.
+   */
+  if (z > 0 && tile->damage)
+    {
+      gegl_tile_unref (tile);
+
+      return NULL;
+    }
+
+  /* avoid writing the flag when it's already set */
+  if (! g_atomic_int_get (&tile->fast_hit))
+    g_atomic_int_set (&tile->fast_hit, TRUE);
+
+  return tile;
+}
+
 static gboolean
 gegl_tile_handler_cache_has_tile (GeglTileHandlerCache *cache,
                                   gint                  x,
@@ -524,7 +681,7 @@ gegl_tile_handler_cache_trim (GeglTileHandlerCache *cache)
 
   g_mutex_lock (&mutex);
 
-  target_size = gegl_buffer_config ()->tile_cache_size;
+  target_size = gegl_tile_handler_cache_get_budget ();
 
   if ((guintptr) g_atomic_pointer_get (&cache_total) <= target_size)
     {
@@ -590,11 +747,26 @@ gegl_tile_handler_cache_trim (GeglTileHandlerCache *cache)
           link = g_queue_peek_tail_link (&cache->queue);
         }
 
-      for (; link; link = g_list_previous (link))
+      for (; link; link = prev_link)
         {
+          prev_link     = g_list_previous (link);
           last_writable = LINK_GET_ITEM (link);
           tile          = last_writable->tile;
 
+          /* tiles found by lock-free lookups are moved to the front of the
+           * queue now, as a locked lookup would have done.
+           */
+          if (g_atomic_int_get (&tile->fast_hit))
+            {
+              g_atomic_int_set (&tile->fast_hit, FALSE);
+
+              g_queue_unlink (&cache->queue, link);
+              g_queue_push_head_link (&cache->queue, link);
+              cache->time = ++cache_time;
+
+              continue;
+            }
+
           /* if the tile's ref-count is greater than one, then someone is still
            * using the tile, and we must keep it in the cache, so that we can
            * return the same tile object upon request; otherwise, we would end
@@ -635,14 +807,29 @@ gegl_tile_handler_cache_trim (GeglTileHandlerCache *cache)
       if (! link)
         continue;
 
-      prev_link = g_list_previous (link);
+      fast_tile_begin_remove (cache);
+      fast_tile_unset (cache, last_writable);
+
+      /* a lock-free lookup might have referenced the tile before it was
+       * unpublished above; afterwards, lookups see the changed sequence
+       * number, and drop their reference.
+       */
+      if (g_atomic_int_get (&tile->ref_count) > 1)
+        {
+          fast_tile_set (cache, last_writable);
+          fast_tile_end_remove (cache);
+
+          link = prev_link;
+          continue;
+        }
+
       g_queue_unlink (&cache->queue, link);
       g_hash_table_remove (cache->items, last_writable);
       if (g_queue_is_empty (&cache->queue))
         cache->time = cache->stamp = 0;
       if (g_atomic_int_dec_and_test (gegl_tile_n_cached_clones (tile)))
-        g_atomic_pointer_add (&cache_total, -tile->size);
-      g_atomic_pointer_add (&cache_total_uncloned, -tile->size);
+        g_atomic_pointer_add (&cache_total, -cache_tile_size (tile));
+      g_atomic_pointer_add (&cache_total_uncloned, -cache_tile_size (tile));
       /* drop_hot_tile (tile); */ /* XXX:  no use in trying to drop the hot
                                    * tile, since this tile can't be it --
                                    * the hot tile will have a ref-count of
@@ -652,6 +839,8 @@ gegl_tile_handler_cache_trim (GeglTileHandlerCache *cache)
       tile->tile_storage = NULL;
       gegl_tile_unref (tile);
 
+      fast_tile_end_remove (cache);
+
       g_slice_free (CacheItem, last_writable);
       link = prev_link;
     }
@@ -679,9 +868,12 @@ gegl_tile_handler_cache_invalidate (GeglTileHandlerCache *cache,
   item = cache_lookup (cache, x, y, z);
   if (item)
     {
+      fast_tile_begin_remove (cache);
+      fast_tile_unset (cache, item);
+
       if (g_atomic_int_dec_and_test (gegl_tile_n_cached_clones (item->tile)))
-        g_atomic_pointer_add (&cache_total, -item->tile->size);
-      g_atomic_pointer_add (&cache_total_uncloned, -item->tile->size);
+        g_atomic_pointer_add (&cache_total, -cache_tile_size (item->tile));
+      g_atomic_pointer_add (&cache_total_uncloned, -cache_tile_size (item->tile));
 
       g_queue_unlink (&cache->queue, &item->link);
       g_hash_table_remove (cache->items, item);
@@ -694,6 +886,8 @@ gegl_tile_handler_cache_invalidate (GeglTileHandlerCache *cache,
       item->tile->tile_storage = NULL;
       gegl_tile_unref (item->tile);
 
+      fast_tile_end_remove (cache);
+
       g_slice_free (CacheItem, item);
     }
 }
@@ -809,9 +1003,12 @@ static void
 gegl_tile_handler_cache_remove_item (GeglTileHandlerCache *cache,
                                      CacheItem            *item)
 {
+  fast_tile_begin_remove (cache);
+  fast_tile_unset (cache, item);
+
   if (g_atomic_int_dec_and_test (gegl_tile_n_cached_clones (item->tile)))
-    g_atomic_pointer_add (&cache_total, -item->tile->size);
-  g_atomic_pointer_add (&cache_total_uncloned, -item->tile->size);
+    g_atomic_pointer_add (&cache_total, -cache_tile_size (item->tile));
+  g_atomic_pointer_add (&cache_total_uncloned, -cache_tile_size (item->tile));
 
   g_queue_unlink (&cache->queue, &item->link);
   g_hash_table_remove (cache->items, item);
@@ -822,6 +1019,8 @@ gegl_tile_handler_cache_remove_item (GeglTileHandlerCache *cache,
   item->tile->tile_storage = NULL;
   gegl_tile_unref (item->tile);
 
+  fast_tile_end_remove (cache);
+
   g_slice_free (CacheItem, item);
 }
 
@@ -898,14 +1097,16 @@ gegl_tile_handler_cache_insert (GeglTileHandlerCache *cache,
   cache->time = ++cache_time;
 
   if (g_atomic_int_add (gegl_tile_n_cached_clones (tile), 1) == 0)
-    total = g_atomic_pointer_add (&cache_total, tile->size) + tile->size;
+    total = g_atomic_pointer_add (&cache_total, cache_tile_size (tile)) +
+            cache_tile_size (tile);
   else
     total = (guintptr) g_atomic_pointer_get (&cache_total);
-  g_atomic_pointer_add (&cache_total_uncloned, tile->size);
+  g_atomic_pointer_add (&cache_total_uncloned, cache_tile_size (tile));
   g_hash_table_add (cache->items, item);
   g_queue_push_head_link (&cache->queue, &item->link);
+  fast_tile_set (cache, item);
 
-  if (total > gegl_buffer_config ()->tile_cache_size)
+  if (total > gegl_tile_handler_cache_get_budget ())
     gegl_tile_handler_cache_trim (cache);
 
   /* there's a race between this assignment, and the one at the bottom of
@@ -922,10 +1123,11 @@ gegl_tile_handler_cache_tile_uncloned (GeglTileHandlerCache *cache,
 {
   guintptr total;
 
-  total = (guintptr) g_atomic_pointer_add (&cache_total, tile->size) +
-          tile->size;
+  total = (guintptr) g_atomic_pointer_add (&cache_total,
+                                           cache_tile_size (tile)) +
+          cache_tile_size (tile);
 
-  if (total > gegl_buffer_config ()->tile_cache_size)
+  if (total > gegl_tile_handler_cache_get_budget ())
     gegl_tile_handler_cache_trim (cache);
 
   cache_total_max = MAX (cache_total_max, total);
@@ -1007,6 +1209,236 @@ gegl_tile_handler_cache_reset_stats (void)
   cache_misses    = 0;
 }
 
+static gboolean
+gegl_tile_handler_cache_adaptive (void)
+{
+  static gint enabled = -1;
+
+  if (enabled < 0)
+    {
+      if (g_getenv ("GEGL_TILE_CACHE_ADAPTIVE"))
+        enabled = atoi (g_getenv ("GEGL_TILE_CACHE_ADAPTIVE")) ? TRUE : FALSE;
+      else
+        enabled = FALSE;
+    }
+
+  return enabled;
+}
+
+/* returns the cgroup-v2 directory of the process, or an empty string if it's
+ * not in a (unified hierarchy) cgroup.
+ */
+static const gchar *
+gegl_tile_handler_cache_get_cgroup_dir (void)
+{
+  if (! cgroup_dir)
+    {
+      gchar *contents = NULL;
+
+      cgroup_dir = g_strdup ("");
+
+      if (g_file_get_contents ("/proc/self/cgroup", &contents, NULL, NULL))
+        {
+          gchar **lines = g_strsplit (contents, "\n", -1);
+          gint    i;
+
+          for (i = 0; lines[i]; i++)
+            {
+              if (g_str_has_prefix (lines[i], "0::"))
+                {
+                  g_free (cgroup_dir);
+                  cgroup_dir = g_build_filename ("/sys/fs/cgroup",
+                                                 lines[i] + strlen ("0::"),
+                                                 NULL);
+                  break;
+                }
+            }
+
+          g_strfreev (lines);
+          g_free (contents);
+        }
+    }
+
+  return cgroup_dir;
+}
+
+/* reads a cgroup memory counter; returns FALSE if it can't be read, or if
+ * it's unlimited.
+ */
+static gboolean
+gegl_tile_handler_cache_read_cgroup_value (const gchar *name,
+                                           guint64     *value)
+{
+  gchar    *path;
+  gchar    *contents = NULL;
+  gchar    *end;
+  gboolean  success  = FALSE;
+
+  if (! *gegl_tile_handler_cache_get_cgroup_dir ())
+    return FALSE;
+
+  path = g_build_filename (gegl_tile_handler_cache_get_cgroup_dir (), name,
+                           NULL);
+
+  if (g_file_get_contents (path, &contents, NULL, NULL))
+    {
+      *value = g_ascii_strtoull (contents, &end, 10);
+
+      success = end != contents;
+
+      g_free (contents);
+    }
+
+  g_free (path);
+
+  return success;
+}
+
+/* returns the "some avg10" memory pressure of our cgroup, or of the system,
+ * as a percentage, or a negative value if PSI isn't available.
+ */
+static gdouble
+gegl_tile_handler_cache_read_pressure (void)
+{
+  gchar   *contents = NULL;
+  gdouble  pressure = -1.0;
+
+  if (*gegl_tile_handler_cache_get_cgroup_dir ())
+    {
+      gchar *path = g_build_filename (gegl_tile_handler_cache_get_cgroup_dir (),
+                                      "memory.pressure", NULL);
+
+      g_file_get_contents (path, &contents, NULL, NULL);
+
+      g_free (path);
+    }
+
+  if (! contents)
+    g_file_get_contents ("/proc/pressure/memory", &contents, NULL, NULL);
+
+  if (contents)
+    {
+      const gchar *avg10 = NULL;
+
+      if (g_str_has_prefix (contents, "some "))
+        avg10 = strstr (contents, "avg10=");
+
+      if (avg10)
+        pressure = g_ascii_strtod (avg10 + strlen ("avg10="), NULL);
+
+      g_free (contents);
+    }
+
+  return pressure;
+}
+
+/* in adaptive mode, recalculates the effective cache budget.  the budget
+ * is derived from tile-cache-size every time, rather than from its previous
+ * value, so that it recovers as soon as memory frees up: it's limited by the
+ * memory left in our cgroup (keeping a reserve for the rest of the process
+ * and its neighbours), and reduced in proportion to the memory pressure,
+ * whose 10s average decays gradually once the pressure is gone.
+ */
+static void
+gegl_tile_handler_cache_update_budget (void)
+{
+  guint64  size;
+  guint64  budget;
+  guint64  current;
+  guint64  max;
+  gdouble  pressure;
+  gboolean changed;
+
+  size     = gegl_buffer_config ()->tile_cache_size;
+  budget   = size;
+  pressure = gegl_tile_handler_cache_read_pressure ();
+
+  if (pressure >= GEGL_CACHE_BUDGET_PRESSURE_HIGH)
+    budget -= budget * MIN (pressure, 50.0) / 100.0;
+
+  if (gegl_tile_handler_cache_read_cgroup_value ("memory.current", &current) &&
+      gegl_tile_handler_cache_read_cgroup_value ("memory.max",     &max))
+    {
+      /* the cache may keep what it has, plus whatever is left in the cgroup
+       * beyond the reserve; negative if we're already past the reserve.
+       */
+      gint64 available = (gint64) max - (gint64) current -
+                         (gint64) (max * GEGL_CACHE_BUDGET_RESERVE);
+      gint64 limit     = (gint64) g_atomic_pointer_get (&cache_total) +
+                         available;
+
+      budget = MIN (budget, (guint64) MAX (limit, 0));
+    }
+
+  budget = MAX (budget, MIN (GEGL_CACHE_BUDGET_MIN, size));
+
+  changed = budget != (guintptr) g_atomic_pointer_get (&cache_budget) ||
+            (pressure >= GEGL_CACHE_BUDGET_PRESSURE_HIGH) !=
+            (cache_pressure >= GEGL_CACHE_BUDGET_PRESSURE_HIGH);
+
+  g_atomic_pointer_set (&cache_budget, budget);
+  cache_pressure = MAX (pressure, 0.0);
+
+  if (changed)
+    gegl_tile_backend_swap_update_queued_max ();
+
+  /* insertions only trim the cache down to the budget when they happen, so
+   * catch up with a reduced budget here.
+   */
+  if ((guintptr) g_atomic_pointer_get (&cache_total) > budget)
+    gegl_tile_handler_cache_trim (NULL);
+}
+
+/* updates the budget every GEGL_CACHE_BUDGET_INTERVAL, away from the tile
+ * operations, since it involves reading a few files.
+ */
+static gpointer
+gegl_tile_handler_cache_budget_thread (gpointer ignored)
+{
+  g_mutex_lock (&budget_mutex);
+
+  while (! budget_exit_thread)
+    {
+      gint64 end_time;
+
+      g_mutex_unlock (&budget_mutex);
+
+      gegl_tile_handler_cache_update_budget ();
+
+      end_time = g_get_monotonic_time () + GEGL_CACHE_BUDGET_INTERVAL;
+
+      g_mutex_lock (&budget_mutex);
+
+      while (! budget_exit_thread &&
+             g_cond_wait_until (&budget_cond, &budget_mutex, end_time));
+    }
+
+  g_mutex_unlock (&budget_mutex);
+
+  return NULL;
+}
+
+/* the effective tile-cache size: tile-cache-size, possibly reduced by the
+ * adaptive budget.
+ */
+guint64
+gegl_tile_handler_cache_get_budget (void)
+{
+  guint64 size   = gegl_buffer_config ()->tile_cache_size;
+  guint64 budget = (guintptr) g_atomic_pointer_get (&cache_budget);
+
+  if (budget)
+    return MIN (budget, size);
+
+  return size;
+}
+
+gdouble
+gegl_tile_handler_cache_get_pressure (void)
+{
+  return cache_pressure;
+}
+
 
 static guint
 gegl_tile_handler_cache_hashfunc (gconstpointer key)
@@ -1054,7 +1486,7 @@ gegl_buffer_config_tile_cache_size_notify (GObject    *gobject,
                                            gpointer    user_data)
 {
   if ((guintptr) g_atomic_pointer_get (&cache_total) >
-      gegl_buffer_config () ->tile_cache_size)
+      gegl_tile_handler_cache_get_budget ())
     {
       gegl_tile_handler_cache_trim (NULL);
     }
@@ -1065,16 +1497,36 @@ gegl_tile_cache_init (void)
 {
   g_signal_connect (gegl_buffer_config (), "notify::tile-cache-size",
                     G_CALLBACK (gegl_buffer_config_tile_cache_size_notify), NULL);
+
+  if (gegl_tile_handler_cache_adaptive ())
+    {
+      budget_exit_thread = FALSE;
+      budget_thread      = g_thread_new ("tile-cache budget",
+                                         gegl_tile_handler_cache_budget_thread,
+                                         NULL);
+    }
 }
 
 void
 gegl_tile_cache_destroy (void)
 {
+  if (budget_thread)
+    {
+      g_mutex_lock (&budget_mutex);
+      budget_exit_thread = TRUE;
+      g_cond_signal (&budget_cond);
+      g_mutex_unlock (&budget_mutex);
+      g_thread_join (budget_thread);
+      budget_thread = NULL;
+    }
+
   g_signal_handlers_disconnect_by_func (gegl_buffer_config(),
                                         gegl_buffer_config_tile_cache_size_notify,
                                         NULL);
   g_warn_if_fail (g_queue_is_empty (&cache_queue));
 
+  g_clear_pointer (&cgroup_dir, g_free);
+
 
   if (g_queue_is_empty (&cache_queue))
     {
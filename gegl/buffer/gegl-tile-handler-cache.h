@@ -45,6 +45,10 @@ struct _GeglTileHandlerCache
   GQueue           queue;
   guintptr         time;
   guintptr         stamp;
+  GeglTile       **fast_tiles; /* direct-mapped table of cached tiles, for
+                                * lock-free lookups
+                                */
+  gint             fast_seq;   /* odd while a tile is being removed */
 };
 
 struct _GeglTileHandlerCacheClass
@@ -72,6 +76,10 @@ GeglTile        * gegl_tile_handler_cache_get_tile           (GeglTileHandlerCac
                                                               gint                  x,
                                                               gint                  y,
                                                               gint                  z);
+GeglTile        * gegl_tile_handler_cache_lookup_fast        (GeglTileHandlerCache *cache,
+                                                              gint                  x,
+                                                              gint                  y,
+                                                              gint                  z);
 void              gegl_tile_handler_cache_tile_uncloned      (GeglTileHandlerCache *cache,
                                                               GeglTile             *tile);
 
@@ -80,6 +88,8 @@ gsize             gegl_tile_handler_cache_get_total_max          (void);
 gsize             gegl_tile_handler_cache_get_total_uncompressed (void);
 gint              gegl_tile_handler_cache_get_hits               (void);
 gint              gegl_tile_handler_cache_get_misses             (void);
+guint64           gegl_tile_handler_cache_get_budget             (void);
+gdouble           gegl_tile_handler_cache_get_pressure           (void);
 
 void              gegl_tile_handler_cache_reset_stats            (void);
 
@@ -44,12 +44,156 @@ enum
   CLONE_STATE_UNCLONING
 };
 
+/* tile structs are recycled through a free-list of their own, instead of
+ * being returned to the slice allocator, so that a pointer to a destroyed
+ * tile still points to a GeglTile, whose ref_count is 0 until it's reused.
+ * this is what makes gegl_tile_try_ref() safe to call on a tile that might
+ * be concurrently destroyed.  the free-lists are linked through the data
+ * pointer, so that ref_count is left untouched.
+ *
+ * each thread keeps a free-list of its own, and only takes the global lock
+ * to exchange a batch of tiles with the global free-list, when its own list
+ * runs empty or grows too long, and when the thread exits.
+ */
+#define TILE_FREE_LIST_BATCH 64
+
+typedef struct
+{
+  GeglTile *head;
+  gint      n_tiles;
+} TileFreeList;
+
+static void tile_free_list_local_free (TileFreeList *local);
+
+static GMutex       tile_free_list_mutex;
+static TileFreeList tile_free_list;
+static GPrivate     tile_free_list_local =
+  G_PRIVATE_INIT ((GDestroyNotify) tile_free_list_local_free);
+
+/* moves up to n tiles from the head of src to the head of dest */
+static void
+tile_free_list_move (TileFreeList *dest,
+                     TileFreeList *src,
+                     gint          n)
+{
+  while (n-- && src->head)
+    {
+      GeglTile *tile = src->head;
+
+      src->head  = (GeglTile *) tile->data;
+      tile->data = (guchar *) dest->head;
+      dest->head = tile;
+
+      src->n_tiles--;
+      dest->n_tiles++;
+    }
+}
+
+static void
+tile_free_list_local_free (TileFreeList *local)
+{
+  g_mutex_lock (&tile_free_list_mutex);
+
+  tile_free_list_move (&tile_free_list, local, local->n_tiles);
+
+  g_mutex_unlock (&tile_free_list_mutex);
+
+  g_free (local);
+}
+
+static inline TileFreeList *
+tile_free_list_get_local (void)
+{
+  TileFreeList *local = g_private_get (&tile_free_list_local);
+
+  if (G_UNLIKELY (! local))
+    {
+      local = g_new0 (TileFreeList, 1);
+
+      g_private_set (&tile_free_list_local, local);
+    }
+
+  return local;
+}
+
+static inline GeglTile *
+gegl_tile_struct_new (void)
+{
+  TileFreeList *local = tile_free_list_get_local ();
+  GeglTile     *tile;
+
+  if (! local->head)
+    {
+      g_mutex_lock (&tile_free_list_mutex);
+
+      tile_free_list_move (local, &tile_free_list, TILE_FREE_LIST_BATCH);
+
+      g_mutex_unlock (&tile_free_list_mutex);
+    }
+
+  tile = local->head;
+
+  if (! tile)
+    return g_slice_new0 (GeglTile);
+
+  local->head = (GeglTile *) tile->data;
+  local->n_tiles--;
+
+  /* everything but the ref-count, which might be concurrently read by
+   * gegl_tile_try_ref()
+   */
+  memset ((guchar *) tile + G_STRUCT_OFFSET (GeglTile, data), 0,
+          sizeof (GeglTile) - G_STRUCT_OFFSET (GeglTile, data));
+
+  return tile;
+}
+
+static inline void
+gegl_tile_struct_free (GeglTile *tile)
+{
+  TileFreeList *local = tile_free_list_get_local ();
+
+  tile->data  = (guchar *) local->head;
+  local->head = tile;
+  local->n_tiles++;
+
+  if (local->n_tiles > 2 * TILE_FREE_LIST_BATCH)
+    {
+      g_mutex_lock (&tile_free_list_mutex);
+
+      tile_free_list_move (&tile_free_list, local, TILE_FREE_LIST_BATCH);
+
+      g_mutex_unlock (&tile_free_list_mutex);
+    }
+}
+
 GeglTile *gegl_tile_ref (GeglTile *tile)
 {
   g_atomic_int_inc (&tile->ref_count);
   return tile;
 }
 
+/* like gegl_tile_ref(), but fails, returning NULL, if the tile has already
+ * been destroyed.  the caller has to verify that the tile is still the tile
+ * it was looking for afterwards, since it might have been reused.
+ */
+GeglTile *gegl_tile_try_ref (GeglTile *tile)
+{
+  gint ref_count;
+
+  do
+    {
+      ref_count = g_atomic_int_get (&tile->ref_count);
+
+      if (ref_count == 0)
+        return NULL;
+    }
+  while (! g_atomic_int_compare_and_exchange (&tile->ref_count,
+                                              ref_count, ref_count + 1));
+
+  return tile;
+}
+
 static const gint free_data_directly;
 
 void gegl_tile_unref (GeglTile *tile)
@@ -82,14 +226,13 @@ void gegl_tile_unref (GeglTile *tile)
         }
     }
 
-  g_slice_free (GeglTile, tile);
+  gegl_tile_struct_free (tile);
 }
 
 static inline GeglTile *
 gegl_tile_new_bare_internal (void)
 {
-  GeglTile *tile        = g_slice_new0 (GeglTile);
-  tile->ref_count       = 1;
+  GeglTile *tile        = gegl_tile_struct_new ();
   tile->tile_storage    = NULL;
   tile->stored_rev      = 1;
   tile->rev             = 1;
@@ -98,6 +241,8 @@ gegl_tile_new_bare_internal (void)
   tile->clone_state     = CLONE_STATE_UNCLONED;
   tile->data            = NULL;
 
+  g_atomic_int_set (&tile->ref_count, 1);
+
   return tile;
 }
 
@@ -66,6 +66,17 @@ gchar        **gegl_list_operations         (guint *n_operations_p);
 
 gboolean       gegl_has_operation           (const gchar *operation_type);
 
+/**
+ * gegl_load_deferred_operations:
+ *
+ * Loads the modules of all operations that are listed in a module manifest
+ * but haven't been used yet, so that all operation types are registered.
+ * Only needed by code that walks the #GeglOperation type tree, or the
+ * classes of all operations; gegl_list_operations(), gegl_has_operation()
+ * and gegl_operation_get_key() don't require it.
+ */
+void           gegl_load_deferred_operations (void);
+
 /**
  * gegl_operation_list_properties:
  * @operation_type: the name of the operation type we want to query to properties of.
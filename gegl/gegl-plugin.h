@@ -33,6 +33,8 @@
 #include <gegl-types.h>
 #include <gegl-paramspecs.h>
 #include <gegl-audio-fragment.h>
+#include <gegl-buffer-convolve.h>
+#include <gegl-buffer-pyramid.h>
 
 G_BEGIN_DECLS
 
@@ -37,6 +37,7 @@ enum
   PROP_0,
   PROP_TILE_CACHE_TOTAL,
   PROP_TILE_CACHE_TOTAL_MAX,
+  PROP_TILE_CACHE_BUDGET,
   PROP_TILE_CACHE_TOTAL_UNCOMPRESSED,
   PROP_TILE_CACHE_HITS,
   PROP_TILE_CACHE_MISSES,
@@ -53,6 +54,7 @@ enum
   PROP_SWAP_WRITE_TOTAL,
   PROP_ZOOM_TOTAL,
   PROP_TILE_ALLOC_TOTAL,
+  PROP_TILE_ALLOC_NODE_TOTALS,
   PROP_SCRATCH_TOTAL,
   PROP_ASSIGNED_THREADS,
   PROP_ACTIVE_THREADS
@@ -94,6 +96,14 @@ gegl_stats_class_init (GeglStatsClass *klass)
                                                         0, G_MAXUINT64, 0,
                                                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_TILE_CACHE_BUDGET,
+                                   g_param_spec_uint64 ("tile-cache-budget",
+                                                        "Tile Cache budget",
+                                                        "Effective maximal size of the tile cache in bytes, "
+                                                        "which may be below tile-cache-size in adaptive mode",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (object_class, PROP_TILE_CACHE_TOTAL_UNCOMPRESSED,
                                    g_param_spec_uint64 ("tile-cache-total-uncompressed",
                                                         "Tile Cache total uncompressed size",
@@ -211,6 +221,14 @@ gegl_stats_class_init (GeglStatsClass *klass)
                                                         0, G_MAXUINT64, 0,
                                                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_TILE_ALLOC_NODE_TOTALS,
+                                   g_param_spec_variant ("tile-alloc-node-totals",
+                                                         "Tile allocator per-node totals",
+                                                         "Size of tile-allocator memory on each NUMA node, "
+                                                         "as an array of uint64",
+                                                         G_VARIANT_TYPE ("at"), NULL,
+                                                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (object_class, PROP_SCRATCH_TOTAL,
                                    g_param_spec_uint64 ("scratch-total",
                                                         "Scratch total",
@@ -268,6 +286,10 @@ gegl_stats_get_property (GObject    *object,
         g_value_set_uint64 (value, gegl_tile_handler_cache_get_total_max ());
         break;
 
+      case PROP_TILE_CACHE_BUDGET:
+        g_value_set_uint64 (value, gegl_tile_handler_cache_get_budget ());
+        break;
+
       case PROP_TILE_CACHE_TOTAL_UNCOMPRESSED:
         g_value_set_uint64 (value, gegl_tile_handler_cache_get_total_uncompressed ());
         break;
@@ -332,6 +354,24 @@ gegl_stats_get_property (GObject    *object,
         g_value_set_uint64 (value, gegl_tile_alloc_get_total ());
         break;
 
+      case PROP_TILE_ALLOC_NODE_TOTALS:
+        {
+          GVariantBuilder builder;
+          gint            n_nodes = gegl_tile_alloc_get_n_nodes ();
+          gint            i;
+
+          g_variant_builder_init (&builder, G_VARIANT_TYPE ("at"));
+
+          for (i = 0; i < n_nodes; i++)
+            {
+              g_variant_builder_add (&builder, "t",
+                                     gegl_tile_alloc_get_node_total (i));
+            }
+
+          g_value_take_variant (value, g_variant_builder_end (&builder));
+        }
+        break;
+
       case PROP_SCRATCH_TOTAL:
         g_value_set_uint64 (value, gegl_scratch_get_total ());
         break;
@@ -38,7 +38,8 @@ typedef enum
 {
   GEGL_BLIT_DEFAULT  = 0,
   GEGL_BLIT_CACHE    = 1 << 0,
-  GEGL_BLIT_DIRTY    = 1 << 1
+  GEGL_BLIT_DIRTY    = 1 << 1,
+  GEGL_BLIT_TILED    = 1 << 2
 } GeglBlitFlags;
 
 typedef enum
@@ -39,6 +39,7 @@
 #include <gegl-random.h>
 #include <gegl-parallel.h>
 #include <gegl-node.h>
+#include <gegl-graph-template.h>
 #include <gegl-processor.h>
 #include <gegl-apply.h>
 
@@ -0,0 +1,785 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib-object.h>
+
+#include "gegl-types-internal.h"
+
+#include "gegl.h"
+#include "gegl-node-private.h"
+#include "gegl-pad.h"
+#include "gegl-graph-template.h"
+
+#include "operation/gegl-operation.h"
+
+
+#define PROXY_PREFIX "proxynop-"
+
+typedef struct
+{
+  GParamSpec *pspec;
+  GValue      value;
+} TemplateProperty;
+
+typedef struct
+{
+  gint   source;     /* index of the source node among its siblings */
+  gchar *source_pad;
+  gchar *sink_pad;
+} TemplateConnection;
+
+typedef struct _TemplateNode TemplateNode;
+
+struct _TemplateNode
+{
+  gchar     *name;
+  GType      operation;      /* 0 for graphs and proxies */
+  gpointer   operation_class; /* keeps the class and its pspecs around */
+  gboolean   passthrough;
+  GArray    *properties;     /* TemplateProperty, differing from defaults */
+  GArray    *connections;    /* TemplateConnection, to the node's inputs */
+
+  gchar     *proxy;          /* the pad of the parent a proxy stands for */
+  gboolean   proxy_is_input;
+
+  GPtrArray *children;       /* TemplateNode, in the order of the parent's
+                              * list of children
+                              */
+};
+
+struct _GeglGraphTemplate
+{
+  GObject       parent_instance;
+
+  TemplateNode *root;
+};
+
+
+G_DEFINE_TYPE (GeglGraphTemplate, gegl_graph_template, G_TYPE_OBJECT)
+
+G_DEFINE_QUARK (gegl-graph-template-error-quark, gegl_graph_template_error)
+
+
+/* colors, curves and paths are mutable, and commonly changed in place by
+ * their users, so each instance gets its own copy.
+ */
+static void
+template_value_copy (const GValue *src,
+                     GValue       *dest)
+{
+  GObject *object;
+
+  g_value_init (dest, G_VALUE_TYPE (src));
+
+  if (! G_VALUE_HOLDS_OBJECT (src) || ! g_value_get_object (src))
+    {
+      g_value_copy (src, dest);
+      return;
+    }
+
+  object = g_value_get_object (src);
+
+  if (GEGL_IS_COLOR (object))
+    {
+      g_value_take_object (dest, gegl_color_duplicate (GEGL_COLOR (object)));
+    }
+  else if (GEGL_IS_CURVE (object))
+    {
+      g_value_take_object (dest, gegl_curve_duplicate (GEGL_CURVE (object)));
+    }
+  else if (GEGL_IS_PATH (object))
+    {
+      gchar *string = gegl_path_to_string (GEGL_PATH (object));
+
+      g_value_take_object (dest, gegl_path_new_from_string (string));
+      g_free (string);
+    }
+  else
+    {
+      g_value_copy (src, dest);
+    }
+}
+
+static gboolean
+template_pspec_is_settable (GParamSpec *pspec)
+{
+  return (pspec->flags & G_PARAM_READWRITE) == G_PARAM_READWRITE &&
+         ! (pspec->flags & G_PARAM_CONSTRUCT_ONLY);
+}
+
+static void
+template_node_free (TemplateNode *tnode)
+{
+  guint i;
+
+  if (tnode->properties)
+    {
+      for (i = 0; i < tnode->properties->len; i++)
+        {
+          TemplateProperty *property;
+
+          property = &g_array_index (tnode->properties, TemplateProperty, i);
+
+          g_value_unset (&property->value);
+          g_param_spec_unref (property->pspec);
+        }
+
+      g_array_free (tnode->properties, TRUE);
+    }
+
+  if (tnode->connections)
+    {
+      for (i = 0; i < tnode->connections->len; i++)
+        {
+          TemplateConnection *connection;
+
+          connection = &g_array_index (tnode->connections,
+                                       TemplateConnection, i);
+
+          g_free (connection->source_pad);
+          g_free (connection->sink_pad);
+        }
+
+      g_array_free (tnode->connections, TRUE);
+    }
+
+  if (tnode->children)
+    g_ptr_array_unref (tnode->children);
+
+  if (tnode->operation_class)
+    g_type_class_unref (tnode->operation_class);
+
+  g_free (tnode->name);
+  g_free (tnode->proxy);
+
+  g_slice_free (TemplateNode, tnode);
+}
+
+static TemplateNode *
+template_node_new (void)
+{
+  TemplateNode *tnode = g_slice_new0 (TemplateNode);
+
+  tnode->connections = g_array_new (FALSE, FALSE, sizeof (TemplateConnection));
+
+  return tnode;
+}
+
+static void
+template_capture_properties (TemplateNode  *tnode,
+                             GeglOperation *operation)
+{
+  GParamSpec **pspecs;
+  guint        n_pspecs;
+  guint        i;
+
+  tnode->properties = g_array_new (FALSE, FALSE, sizeof (TemplateProperty));
+
+  pspecs = g_object_class_list_properties (G_OBJECT_GET_CLASS (operation),
+                                           &n_pspecs);
+
+  for (i = 0; i < n_pspecs; i++)
+    {
+      TemplateProperty property = { pspecs[i], G_VALUE_INIT };
+      GValue           value    = G_VALUE_INIT;
+
+      if (! template_pspec_is_settable (pspecs[i]))
+        continue;
+
+      g_value_init (&value, pspecs[i]->value_type);
+      g_object_get_property (G_OBJECT (operation), pspecs[i]->name, &value);
+
+      if (! g_param_value_defaults (pspecs[i], &value))
+        {
+          template_value_copy (&value, &property.value);
+          g_param_spec_ref (property.pspec);
+
+          g_array_append_val (tnode->properties, property);
+        }
+
+      g_value_unset (&value);
+    }
+
+  g_free (pspecs);
+}
+
+static gboolean template_capture_children (TemplateNode  *tnode,
+                                           GeglNode      *graph,
+                                           GError       **error);
+
+static TemplateNode *
+template_capture_node (GeglNode  *node,
+                       GeglNode  *graph,
+                       GError   **error)
+{
+  TemplateNode *tnode = template_node_new ();
+  const gchar  *name  = gegl_node_get_name (node);
+
+  if (name && g_str_has_prefix (name, PROXY_PREFIX) &&
+      g_object_get_data (G_OBJECT (node), "graph") == graph)
+    {
+      GeglPad *pad;
+
+      tnode->proxy = g_strdup (name + strlen (PROXY_PREFIX));
+
+      pad = gegl_node_get_pad (graph, tnode->proxy);
+
+      tnode->proxy_is_input = pad && gegl_pad_is_input (pad);
+
+      return tnode;
+    }
+
+  tnode->name        = g_strdup (name);
+  tnode->passthrough = gegl_node_get_passthrough (node);
+
+  if (node->operation)
+    {
+      tnode->operation       = G_OBJECT_TYPE (node->operation);
+      tnode->operation_class = g_type_class_ref (tnode->operation);
+
+      template_capture_properties (tnode, node->operation);
+    }
+  else if (! template_capture_children (tnode, node, error))
+    {
+      template_node_free (tnode);
+
+      return NULL;
+    }
+
+  return tnode;
+}
+
+static gboolean
+template_capture_children (TemplateNode  *tnode,
+                           GeglNode      *graph,
+                           GError       **error)
+{
+  GSList *children = gegl_node_get_children (graph);
+  GSList *list;
+  gint    i;
+
+  tnode->children = g_ptr_array_new_with_free_func (
+    (GDestroyNotify) template_node_free);
+
+  for (list = children; list; list = g_slist_next (list))
+    {
+      TemplateNode *child = template_capture_node (list->data, graph, error);
+
+      if (! child)
+        {
+          g_slist_free (children);
+
+          return FALSE;
+        }
+
+      g_ptr_array_add (tnode->children, child);
+    }
+
+  for (list = children, i = 0; list; list = g_slist_next (list), i++)
+    {
+      GeglNode      *node   = list->data;
+      TemplateNode  *child  = g_ptr_array_index (tnode->children, i);
+      gchar        **pads;
+      gint           j;
+
+      /* the producers of input proxies are outside of the graph */
+      if (child->proxy && child->proxy_is_input)
+        continue;
+
+      pads = gegl_node_list_input_pads (node);
+
+      for (j = 0; pads && pads[j]; j++)
+        {
+          TemplateConnection  connection;
+          GeglNode           *producer;
+          gchar              *source_pad = NULL;
+
+          producer = gegl_node_get_producer (node, pads[j], &source_pad);
+
+          if (! producer)
+            continue;
+
+          connection.source = g_slist_index (children, producer);
+
+          if (connection.source < 0)
+            {
+              g_set_error (error, GEGL_GRAPH_TEMPLATE_ERROR,
+                           GEGL_GRAPH_TEMPLATE_ERROR_EXTERNAL_CONNECTION,
+                           "pad '%s' of '%s' is connected to a node outside "
+                           "of its graph",
+                           pads[j], gegl_node_get_debug_name (node));
+
+              g_free (source_pad);
+              g_strfreev (pads);
+              g_slist_free (children);
+
+              return FALSE;
+            }
+
+          connection.source_pad = source_pad;
+          connection.sink_pad   = g_strdup (pads[j]);
+
+          g_array_append_val (child->connections, connection);
+        }
+
+      g_strfreev (pads);
+    }
+
+  g_slist_free (children);
+
+  return TRUE;
+}
+
+static GeglNode *
+template_instantiate_node (TemplateNode *tnode,
+                           GeglNode     *graph);
+
+static void
+template_instantiate_children (TemplateNode *tnode,
+                               GeglNode     *graph)
+{
+  GeglNode **nodes;
+  gint       n_children = tnode->children->len;
+  gint       i;
+  guint      j;
+
+  nodes = g_new (GeglNode *, n_children);
+
+  /* children are prepended to their parent's list, so creating them in
+   * reverse order reproduces the order of the template, which
+   * gegl_graph_template_reset() relies on.  all of them, proxies included,
+   * are created before connecting them, as connecting to a graph creates
+   * missing proxies.
+   */
+  for (i = n_children - 1; i >= 0; i--)
+    nodes[i] = template_instantiate_node (g_ptr_array_index (tnode->children,
+                                                             i),
+                                          graph);
+
+  for (i = 0; i < n_children; i++)
+    {
+      TemplateNode *child = g_ptr_array_index (tnode->children, i);
+
+      for (j = 0; j < child->connections->len; j++)
+        {
+          TemplateConnection *connection;
+
+          connection = &g_array_index (child->connections,
+                                       TemplateConnection, j);
+
+          gegl_node_connect (nodes[connection->source],
+                             connection->source_pad,
+                             nodes[i],
+                             connection->sink_pad);
+        }
+    }
+
+  g_free (nodes);
+}
+
+static GeglNode *
+template_instantiate_node (TemplateNode *tnode,
+                           GeglNode     *graph)
+{
+  GeglNode *node;
+
+  if (tnode->proxy)
+    {
+      if (tnode->proxy_is_input)
+        return gegl_node_get_input_proxy (graph, tnode->proxy);
+      else
+        return gegl_node_get_output_proxy (graph, tnode->proxy);
+    }
+
+  if (graph)
+    node = gegl_node_new_child (graph, NULL, NULL);
+  else
+    node = gegl_node_new ();
+
+  if (tnode->name)
+    gegl_node_set_name (node, tnode->name);
+
+  if (tnode->operation)
+    {
+      GeglOperation *operation;
+      guint          i;
+
+      /* the type is known, so the operation is created directly, rather
+       * than looked up by name.
+       */
+      operation = g_object_new (tnode->operation, NULL);
+
+      g_object_set (node, "gegl-operation", operation, NULL);
+
+      g_object_freeze_notify (G_OBJECT (operation));
+
+      for (i = 0; i < tnode->properties->len; i++)
+        {
+          TemplateProperty *property;
+          GValue            value = G_VALUE_INIT;
+
+          property = &g_array_index (tnode->properties, TemplateProperty, i);
+
+          template_value_copy (&property->value, &value);
+          g_object_set_property (G_OBJECT (operation),
+                                 property->pspec->name, &value);
+          g_value_unset (&value);
+        }
+
+      g_object_thaw_notify (G_OBJECT (operation));
+      g_object_unref (operation);
+    }
+  else
+    {
+      template_instantiate_children (tnode, node);
+    }
+
+  if (tnode->passthrough)
+    gegl_node_set_passthrough (node, TRUE);
+
+  return node;
+}
+
+static gboolean
+template_reset_properties (TemplateNode  *tnode,
+                           GeglOperation *operation)
+{
+  GParamSpec **pspecs;
+  guint        n_pspecs;
+  guint        i;
+  guint        j = 0;
+
+  pspecs = g_object_class_list_properties (G_OBJECT_GET_CLASS (operation),
+                                           &n_pspecs);
+
+  g_object_freeze_notify (G_OBJECT (operation));
+
+  /* the template's properties were captured in the same order */
+  for (i = 0; i < n_pspecs; i++)
+    {
+      TemplateProperty *property = NULL;
+      GValue            value    = G_VALUE_INIT;
+      GValue            target   = G_VALUE_INIT;
+
+      if (! template_pspec_is_settable (pspecs[i]))
+        continue;
+
+      if (j < tnode->properties->len &&
+          g_array_index (tnode->properties, TemplateProperty,
+                         j).pspec == pspecs[i])
+        {
+          property = &g_array_index (tnode->properties, TemplateProperty, j);
+          j++;
+        }
+
+      g_value_init (&value, pspecs[i]->value_type);
+      g_object_get_property (G_OBJECT (operation), pspecs[i]->name, &value);
+
+      if (property)
+        {
+          if (g_param_values_cmp (pspecs[i], &value, &property->value))
+            {
+              template_value_copy (&property->value, &target);
+              g_object_set_property (G_OBJECT (operation),
+                                     pspecs[i]->name, &target);
+              g_value_unset (&target);
+            }
+        }
+      else if (! g_param_value_defaults (pspecs[i], &value))
+        {
+          g_value_init (&target, pspecs[i]->value_type);
+          g_param_value_set_default (pspecs[i], &target);
+          g_object_set_property (G_OBJECT (operation),
+                                 pspecs[i]->name, &target);
+          g_value_unset (&target);
+        }
+
+      g_value_unset (&value);
+    }
+
+  g_object_thaw_notify (G_OBJECT (operation));
+
+  g_free (pspecs);
+
+  return j == tnode->properties->len;
+}
+
+static gboolean
+template_node_is_proxy (TemplateNode *tnode,
+                        GeglNode     *node,
+                        GeglNode     *graph)
+{
+  const gchar *name = gegl_node_get_name (node);
+
+  return name                                             &&
+         g_str_has_prefix (name, PROXY_PREFIX)             &&
+         ! strcmp (name + strlen (PROXY_PREFIX), tnode->proxy) &&
+         g_object_get_data (G_OBJECT (node), "graph") == graph;
+}
+
+/* checks that the inputs of @node are connected like the ones of @tnode,
+ * which were captured in the order of the node's input pads.
+ */
+static gboolean
+template_check_connections (TemplateNode *tnode,
+                            GeglNode     *node,
+                            GSList       *children)
+{
+  gchar    **pads;
+  gboolean   success = TRUE;
+  guint      n       = 0;
+  gint       i;
+
+  if (tnode->proxy && tnode->proxy_is_input)
+    return TRUE;
+
+  pads = gegl_node_list_input_pads (node);
+
+  for (i = 0; success && pads && pads[i]; i++)
+    {
+      TemplateConnection *connection;
+      GeglNode           *producer;
+      gchar              *source_pad = NULL;
+
+      producer = gegl_node_get_producer (node, pads[i], &source_pad);
+
+      if (! producer)
+        continue;
+
+      if (n < tnode->connections->len)
+        {
+          connection = &g_array_index (tnode->connections,
+                                       TemplateConnection, n);
+
+          success = ! strcmp (connection->sink_pad, pads[i])              &&
+                    ! g_strcmp0 (connection->source_pad, source_pad)      &&
+                    g_slist_nth_data (children,
+                                      connection->source) == producer;
+        }
+      else
+        {
+          success = FALSE;
+        }
+
+      n++;
+
+      g_free (source_pad);
+    }
+
+  g_strfreev (pads);
+
+  return success && n == tnode->connections->len;
+}
+
+static gboolean
+template_reset_children (TemplateNode *tnode,
+                         GeglNode     *graph)
+{
+  GSList   *children = gegl_node_get_children (graph);
+  GSList   *list;
+  gboolean  success;
+  guint     i;
+
+  success = g_slist_length (children) == tnode->children->len;
+
+  for (list = children, i = 0; success && list; list = g_slist_next (list), i++)
+    {
+      TemplateNode *child = g_ptr_array_index (tnode->children, i);
+      GeglNode     *node  = list->data;
+
+      if (! template_check_connections (child, node, children))
+        {
+          success = FALSE;
+        }
+      else if (child->proxy)
+        {
+          success = template_node_is_proxy (child, node, graph);
+        }
+      else if (child->operation)
+        {
+          success = node->operation &&
+                    G_OBJECT_TYPE (node->operation) == child->operation &&
+                    template_reset_properties (child, node->operation);
+        }
+      else
+        {
+          success = ! node->operation &&
+                    template_reset_children (child, node);
+        }
+
+      if (success && ! child->proxy &&
+          gegl_node_get_passthrough (node) != child->passthrough)
+        {
+          gegl_node_set_passthrough (node, child->passthrough);
+        }
+    }
+
+  g_slist_free (children);
+
+  return success;
+}
+
+
+static void
+gegl_graph_template_finalize (GObject *object)
+{
+  GeglGraphTemplate *graph_template = GEGL_GRAPH_TEMPLATE (object);
+
+  g_clear_pointer (&graph_template->root, template_node_free);
+
+  G_OBJECT_CLASS (gegl_graph_template_parent_class)->finalize (object);
+}
+
+static void
+gegl_graph_template_class_init (GeglGraphTemplateClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gegl_graph_template_finalize;
+}
+
+static void
+gegl_graph_template_init (GeglGraphTemplate *graph_template)
+{
+}
+
+GeglGraphTemplate *
+gegl_graph_template_new_from_node (GeglNode  *graph,
+                                   GError   **error)
+{
+  GeglGraphTemplate *graph_template;
+  TemplateNode      *root;
+
+  g_return_val_if_fail (GEGL_IS_NODE (graph), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  if (graph->operation)
+    {
+      g_set_error (error, GEGL_GRAPH_TEMPLATE_ERROR,
+                   GEGL_GRAPH_TEMPLATE_ERROR_INVALID_GRAPH,
+                   "'%s' isn't a graph", gegl_node_get_debug_name (graph));
+
+      return NULL;
+    }
+
+  root = template_node_new ();
+
+  root->name = g_strdup (gegl_node_get_name (graph));
+
+  if (! template_capture_children (root, graph, error))
+    {
+      template_node_free (root);
+
+      return NULL;
+    }
+
+  graph_template = g_object_new (GEGL_TYPE_GRAPH_TEMPLATE, NULL);
+
+  graph_template->root = root;
+
+  return graph_template;
+}
+
+GeglGraphTemplate *
+gegl_graph_template_new_from_xml (const gchar  *xmldata,
+                                  const gchar  *path_root,
+                                  GError      **error)
+{
+  GeglGraphTemplate *graph_template;
+  GeglNode          *graph;
+
+  g_return_val_if_fail (xmldata != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  graph = gegl_node_new_from_xml (xmldata, path_root);
+
+  if (! graph)
+    {
+      g_set_error (error, GEGL_GRAPH_TEMPLATE_ERROR,
+                   GEGL_GRAPH_TEMPLATE_ERROR_INVALID_GRAPH,
+                   "invalid graph");
+
+      return NULL;
+    }
+
+  graph_template = gegl_graph_template_new_from_node (graph, error);
+
+  g_object_unref (graph);
+
+  return graph_template;
+}
+
+GeglGraphTemplate *
+gegl_graph_template_new_from_chain (const gchar  *chain,
+                                    gint          rel_dim,
+                                    const gchar  *path_root,
+                                    GError      **error)
+{
+  GeglGraphTemplate *graph_template;
+  GeglNode          *graph;
+  GeglNode          *input;
+  GeglNode          *output;
+  GError            *chain_error = NULL;
+
+  g_return_val_if_fail (chain != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  graph  = gegl_node_new ();
+  input  = gegl_node_get_input_proxy (graph, "input");
+  output = gegl_node_get_output_proxy (graph, "output");
+
+  gegl_node_link (input, output);
+
+  gegl_create_chain (chain, input, output, 0.0, rel_dim, path_root,
+                     &chain_error);
+
+  if (chain_error)
+    {
+      g_propagate_error (error, chain_error);
+      g_object_unref (graph);
+
+      return NULL;
+    }
+
+  graph_template = gegl_graph_template_new_from_node (graph, error);
+
+  g_object_unref (graph);
+
+  return graph_template;
+}
+
+GeglNode *
+gegl_graph_template_instantiate (GeglGraphTemplate *graph_template)
+{
+  g_return_val_if_fail (GEGL_IS_GRAPH_TEMPLATE (graph_template), NULL);
+
+  return template_instantiate_node (graph_template->root, NULL);
+}
+
+gboolean
+gegl_graph_template_reset (GeglGraphTemplate *graph_template,
+                           GeglNode          *graph)
+{
+  g_return_val_if_fail (GEGL_IS_GRAPH_TEMPLATE (graph_template), FALSE);
+  g_return_val_if_fail (GEGL_IS_NODE (graph), FALSE);
+
+  return ! graph->operation &&
+         template_reset_children (graph_template->root, graph);
+}
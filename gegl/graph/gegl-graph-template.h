@@ -0,0 +1,147 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_GRAPH_TEMPLATE_H__
+#define __GEGL_GRAPH_TEMPLATE_H__
+
+G_BEGIN_DECLS
+
+#define GEGL_TYPE_GRAPH_TEMPLATE gegl_graph_template_get_type ()
+G_DECLARE_FINAL_TYPE (GeglGraphTemplate, gegl_graph_template,
+                      GEGL, GRAPH_TEMPLATE, GObject)
+
+/**
+ * GEGL_GRAPH_TEMPLATE_ERROR:
+ *
+ * The error domain of #GeglGraphTemplate.
+ */
+#define GEGL_GRAPH_TEMPLATE_ERROR (gegl_graph_template_error_quark ())
+
+/**
+ * GeglGraphTemplateError:
+ * @GEGL_GRAPH_TEMPLATE_ERROR_INVALID_GRAPH: the graph couldn't be parsed,
+ * or isn't a graph
+ * @GEGL_GRAPH_TEMPLATE_ERROR_EXTERNAL_CONNECTION: a node of the graph is
+ * connected to a node outside of it
+ */
+typedef enum
+{
+  GEGL_GRAPH_TEMPLATE_ERROR_INVALID_GRAPH,
+  GEGL_GRAPH_TEMPLATE_ERROR_EXTERNAL_CONNECTION
+} GeglGraphTemplateError;
+
+GQuark              gegl_graph_template_error_quark    (void);
+
+/***
+ * GeglGraphTemplate:
+ *
+ * A graph template is a compiled form of a graph: the operation types,
+ * non-default property values and connections of its nodes.  Parsing a
+ * graph description resolves operation names and converts property values
+ * from strings; a template does this once, so that the same graph can be
+ * instantiated repeatedly at the cost of creating its nodes.
+ *
+ * Object-valued properties, other than colors, curves and paths which are
+ * duplicated, are shared by all instances.
+ *
+ * ---
+ * GeglGraphTemplate *blur;
+ * GeglNode          *graph;
+ *
+ * blur  = gegl_graph_template_new_from_chain ("gegl:gaussian-blur "
+ *                                             "std-dev-x=4 std-dev-y=4",
+ *                                             0, NULL, NULL);
+ * graph = gegl_graph_template_instantiate (blur);
+ */
+
+/**
+ * gegl_graph_template_new_from_node:
+ * @graph: a #GeglNode containing other nodes
+ * @error: return location for an error, or %NULL
+ *
+ * Creates a template from the current state of @graph.  Connections from
+ * the nodes of @graph to nodes outside of it aren't supported.
+ *
+ * Return value: (transfer full) (nullable): a new #GeglGraphTemplate, or
+ * %NULL on error.
+ */
+GeglGraphTemplate * gegl_graph_template_new_from_node  (GeglNode     *graph,
+                                                        GError      **error);
+
+/**
+ * gegl_graph_template_new_from_xml:
+ * @xmldata: a graph in XML format, like gegl_node_new_from_xml() takes
+ * @path_root: the path relative paths in @xmldata are resolved against
+ * @error: return location for an error, or %NULL
+ *
+ * Return value: (transfer full) (nullable): a new #GeglGraphTemplate, or
+ * %NULL on error.
+ */
+GeglGraphTemplate * gegl_graph_template_new_from_xml   (const gchar  *xmldata,
+                                                        const gchar  *path_root,
+                                                        GError      **error);
+
+/**
+ * gegl_graph_template_new_from_chain:
+ * @chain: a chain of operations, like gegl_create_chain() takes
+ * @rel_dim: the dimension values with a rel suffix are relative to
+ * @path_root: the path relative paths in @chain are resolved against
+ * @error: return location for an error, or %NULL
+ *
+ * Creates a template of a graph whose "input" pad feeds the first
+ * operation of @chain, and whose "output" pad is the output of the last.
+ *
+ * Return value: (transfer full) (nullable): a new #GeglGraphTemplate, or
+ * %NULL on error.
+ */
+GeglGraphTemplate * gegl_graph_template_new_from_chain (const gchar  *chain,
+                                                        gint          rel_dim,
+                                                        const gchar  *path_root,
+                                                        GError      **error);
+
+/**
+ * gegl_graph_template_instantiate:
+ * @graph_template: a #GeglGraphTemplate
+ *
+ * Return value: (transfer full): a new graph built from @graph_template,
+ * to be unreferenced with g_object_unref().
+ */
+GeglNode          * gegl_graph_template_instantiate    (GeglGraphTemplate *graph_template);
+
+/**
+ * gegl_graph_template_reset:
+ * @graph_template: a #GeglGraphTemplate
+ * @graph: a graph created by gegl_graph_template_instantiate() from
+ * @graph_template
+ *
+ * Restores the property values and pass-through state of the nodes of
+ * @graph to the ones of @graph_template, so that the graph can be reused
+ * instead of instantiating a new one.  Only the properties that changed
+ * are set.
+ *
+ * Nodes, proxies and connections aren't restored, only compared: if any of
+ * them was added, removed or changed, @graph is left partially reset, and
+ * should be replaced by a new instance.
+ *
+ * Return value: %FALSE if the nodes or connections of @graph no longer
+ * match @graph_template.
+ */
+gboolean            gegl_graph_template_reset          (GeglGraphTemplate *graph_template,
+                                                        GeglNode          *graph);
+
+G_END_DECLS
+
+#endif /* __GEGL_GRAPH_TEMPLATE_H__ */
@@ -20,9 +20,11 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <string.h>
 
 #include <glib-object.h>
+#include <glib/gstdio.h>
 #include <gobject/gvaluecollector.h>
 
 #include "gegl-types-internal.h"
@@ -34,6 +36,7 @@
 #include "gegl-pad.h"
 #include "gegl-visitable.h"
 #include "gegl-config.h"
+#include "gegl-buffer-private.h"
 
 #include "gegl-region.h"
 
@@ -1184,6 +1187,87 @@ static inline gboolean gegl_mipmap_rendering_enabled (void)
   return gegl_config()->mipmap_rendering;
 }
 
+/* renders roi band by band, each band being a whole number of tile rows of
+ * about chunk-size pixels, fetched into the destination as soon as it's
+ * rendered.  without scaling, the destination is wrapped in a buffer, so
+ * that bands are written to it directly.
+ */
+static void
+gegl_node_blit_tiled (GeglNode            *self,
+                      gdouble              scale,
+                      const GeglRectangle *roi,
+                      const Babl          *format,
+                      guchar              *destination_buf,
+                      gint                 rowstride,
+                      gint                 interpolation)
+{
+  GeglBuffer *destination = NULL;
+  gint        tile_height = gegl_config ()->tile_height;
+  gint        band_height;
+  gint        level = 0;
+  gint        y;
+
+  band_height = MAX (gegl_config ()->chunk_size / MAX (roi->width, 1), 1);
+  band_height = MAX (band_height / tile_height, 1) * tile_height;
+
+  if (scale != 1.0 && gegl_mipmap_rendering_enabled ())
+    level = gegl_level_from_scale (scale);
+
+  if (scale == 1.0 && format)
+    destination = gegl_buffer_new_for_data (destination_buf, format, roi,
+                                            rowstride, NULL, NULL);
+
+  for (y = roi->y; y < roi->y + roi->height; )
+    {
+      GeglRectangle  band;
+      GeglBuffer    *buffer;
+      gint           band_end;
+
+      /* keep bands aligned to the tile grid */
+      band_end = (y >= 0 ? y / band_height + 1
+                         : -((-y - 1) / band_height)) * band_height;
+      band_end = MIN (band_end, roi->y + roi->height);
+
+      gegl_rectangle_set (&band, roi->x, y, roi->width, band_end - y);
+
+      if (destination)
+        {
+          gegl_node_blit_buffer (self, destination, &band, 0,
+                                 GEGL_ABYSS_NONE);
+
+          y = band_end;
+          continue;
+        }
+
+      if (scale != 1.0)
+        {
+          const GeglRectangle unscaled_band = _gegl_get_required_for_scale (&band, scale);
+
+          buffer = gegl_node_apply_roi (self, &unscaled_band, level);
+        }
+      else
+        {
+          buffer = gegl_node_apply_roi (self, &band, 0);
+        }
+
+      if (buffer)
+        gegl_buffer_get (buffer, &band, scale, format,
+                         destination_buf + (gsize) (y - roi->y) * rowstride,
+                         rowstride, GEGL_ABYSS_NONE | interpolation);
+
+      g_clear_object (&buffer);
+
+      y = band_end;
+    }
+
+  /* copied tiles are written back to the destination when they're stored */
+  if (destination)
+    {
+      gegl_buffer_flush (destination);
+      g_object_unref (destination);
+    }
+}
+
 void
 gegl_node_blit (GeglNode            *self,
                 gdouble              scale,
@@ -1202,7 +1286,12 @@ gegl_node_blit (GeglNode            *self,
   if (rowstride == GEGL_AUTO_ROWSTRIDE && format)
     rowstride = babl_format_get_bytes_per_pixel (format) * roi->width;
 
-  if (flags == 0) // DEFAULT, just render, caching only if graph is explicitly caching itself
+  if (flags == GEGL_BLIT_TILED && destination_buf)
+    {
+      gegl_node_blit_tiled (self, scale, roi, format, destination_buf,
+                            rowstride, interpolation);
+    }
+  else if ((flags & ~GEGL_BLIT_TILED) == 0) // DEFAULT, just render, caching only if graph is explicitly caching itself
     {
       GeglBuffer *buffer;
 
@@ -1895,6 +1984,96 @@ gegl_node_process (GeglNode *self) /* XXX: add level argument?  */
   g_object_unref (processor);
 }
 
+/* returns a path that doesn't exist yet, next to @path and ending in its
+ * name, so that the same saver handles both.
+ */
+static gchar *
+gegl_node_temp_save_path (const gchar *path)
+{
+  gchar *dirname   = g_path_get_dirname (path);
+  gchar *basename  = g_path_get_basename (path);
+  gchar *temp_path = NULL;
+
+  do
+    {
+      gchar *name = g_strdup_printf (".gegl-%08x-%s",
+                                     g_random_int (), basename);
+
+      g_free (temp_path);
+      temp_path = g_build_filename (dirname, name, NULL);
+      g_free (name);
+    }
+  while (g_file_test (temp_path, G_FILE_TEST_EXISTS));
+
+  g_free (basename);
+  g_free (dirname);
+
+  return temp_path;
+}
+
+gboolean
+gegl_node_process_save (GeglNode  *save_node,
+                        GError   **error)
+{
+  GParamSpec *pspec = NULL;
+  GStatBuf    info;
+  gchar      *path  = NULL;
+  gchar      *temp_path;
+  gboolean    success;
+
+  g_return_val_if_fail (GEGL_IS_NODE (save_node), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (save_node->operation)
+    pspec = g_object_class_find_property (
+              G_OBJECT_GET_CLASS (save_node->operation), "path");
+
+  if (pspec && pspec->value_type == G_TYPE_STRING)
+    gegl_node_get (save_node, "path", &path, NULL);
+
+  if (! path || ! path[0])
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "'%s' has no path to save to",
+                   gegl_node_get_debug_name (save_node));
+      g_free (path);
+
+      return FALSE;
+    }
+
+  temp_path = gegl_node_temp_save_path (path);
+
+  gegl_node_set (save_node, "path", temp_path, NULL);
+  gegl_node_process (save_node);
+  gegl_node_set (save_node, "path", path, NULL);
+
+  success = g_stat (temp_path, &info) == 0 && info.st_size > 0;
+
+  if (! success)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                   "failed to write '%s'", path);
+    }
+  else if (g_rename (temp_path, path))
+    {
+      gint saved_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                   "failed to replace '%s': %s",
+                   path, g_strerror (saved_errno));
+
+      success = FALSE;
+    }
+
+  if (! success)
+    g_unlink (temp_path);
+
+  g_free (temp_path);
+  g_free (path);
+
+  return success;
+}
+
 GeglNode *
 gegl_node_detect (GeglNode *root,
                   gint      x,
@@ -2074,6 +2253,8 @@ gegl_node_get_cache (GeglNode *node)
   GeglPad    *pad;
   GeglNode   *real_node;
   const Babl *format = NULL;
+  gint        tile_width;
+  gint        tile_height;
   g_return_val_if_fail (GEGL_IS_NODE (node), NULL);
 
   pad = gegl_node_get_pad (node, "output");
@@ -2093,9 +2274,25 @@ gegl_node_get_cache (GeglNode *node)
       format = babl_format ("RGBA float");
     }
 
+  if (node->operation)
+    {
+      gegl_operation_get_tile_size (node->operation, &tile_width, &tile_height);
+    }
+  else
+    {
+      tile_width  = gegl_config ()->tile_width;
+      tile_height = gegl_config ()->tile_height;
+    }
+
   if (node->cache && gegl_buffer_get_format ((GeglBuffer *)(node->cache)) != format)
     g_clear_object (&node->cache);
 
+  /* the cache follows the tile geometry preferred by the producer */
+  if (node->cache &&
+      (GEGL_BUFFER (node->cache)->tile_width  != tile_width ||
+       GEGL_BUFFER (node->cache)->tile_height != tile_height))
+    g_clear_object (&node->cache);
+
   if (node->cache)
     return node->cache;
 
@@ -2110,6 +2307,8 @@ gegl_node_get_cache (GeglNode *node)
       cache = g_object_new (
         GEGL_TYPE_CACHE,
         "format",      format,
+        "tile-width",  tile_width,
+        "tile-height", tile_height,
         "initialized", gegl_operation_context_get_init_output (),
         NULL);
 
@@ -293,7 +293,10 @@ void          gegl_node_get_valist       (GeglNode      *node,
  * GEGL_BLIT_DIRTY. if cache is enabled, a cache will be set up for subsequent
  * requests of image data from this node. By passing in GEGL_BLIT_DIRTY the
  * function will return with the latest rendered results in the cache without
- * regard to wheter the regions has been rendered or not.
+ * regard to wheter the regions has been rendered or not.  GEGL_BLIT_TILED,
+ * without a cache, renders @roi in bands of tile rows, each fetched into
+ * @destination_buf as soon as it is rendered, so that no intermediate buffer
+ * of the size of @roi is needed.
  *
  * Render a rectangular region from a node.
  */
@@ -359,6 +362,22 @@ void          gegl_node_blit_buffer      (GeglNode            *node,
  */
 void          gegl_node_process          (GeglNode      *sink_node);
 
+/**
+ * gegl_node_process_save:
+ * @save_node: a node with a saver operation, which has a "path" property
+ * @error: return location for an error, or %NULL
+ *
+ * Like #gegl_node_process, but for savers, which don't report errors
+ * themselves. The node writes a new file next to its path, with the same
+ * extension, which then replaces the file at the path. A file that is
+ * missing or empty once processed is reported as an error, and leaves an
+ * earlier file at the path untouched.
+ *
+ * Return value: %TRUE if the file was written.
+ */
+gboolean      gegl_node_process_save     (GeglNode      *save_node,
+                                          GError       **error);
+
 
 /***
  * Reparenting:
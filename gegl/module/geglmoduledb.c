@@ -15,15 +15,19 @@
  */
 
 #include "config.h"
+#include <locale.h>
 #include <string.h>
 
 #include <glib-object.h>
+#include <glib/gstdio.h>
 #include "gegl-plugin.h"
 #include "geglmodule.h"
 #include "geglmoduledb.h"
 #include "gegldatafiles.h"
 #include "gegl-cpuaccel.h"
 #include "gegl-config.h"
+#include "operation/gegl-operations.h"
+#include "operation/gegl-operation-handlers-private.h"
 
 
 #ifdef ARCH_X86_64
@@ -39,6 +43,38 @@
 #define MODULE_SUFFIX G_MODULE_SUFFIX
 #endif
 
+/* the suffixes of modules built for specific instruction set levels, which
+ * replace the baseline module of the same name when supported.
+ */
+#ifdef ARCH_X86_64
+static const gchar * const variant_suffixes[] =
+{
+  "-x86_64-v2." MODULE_SUFFIX,
+  "-x86_64-v3." MODULE_SUFFIX,
+  NULL
+};
+#endif
+#ifdef ARCH_ARM
+static const gchar * const variant_suffixes[] =
+{
+  "-arm-neon." MODULE_SUFFIX,
+  NULL
+};
+#endif
+
+/* the name of the manifest listing the operations implemented by the modules
+ * in a directory, see gegl_module_db_write_manifest().
+ */
+#define MANIFEST_NAME "gegl-modules.manifest"
+
+typedef struct
+{
+  gchar      *directory;
+  GKeyFile   *key_file;
+  gint64      mtime;
+  GHashTable *modules; /* module path, relative to directory -> operations */
+} Manifest;
+
 enum
 {
   ADD,
@@ -181,8 +217,8 @@ is_in_inhibit_list (const gchar *filename,
 #ifdef ARCH_SIMD
 
 static gboolean
-gegl_str_has_one_of_suffixes (const char *str,
-                              char **suffixes)
+gegl_str_has_one_of_suffixes (const char         *str,
+                              const gchar * const *suffixes)
 {
   for (int i = 0; suffixes[i]; i++)
   {
@@ -197,7 +233,7 @@ gegl_module_db_remove_duplicates (GeglModuleDB *db)
 {
 #ifdef ARCH_X86_64
 
-  char *suffix_list[] = {"-x86_64-v2." MODULE_SUFFIX,"-x86_64-v3." MODULE_SUFFIX, NULL};
+  const gchar * const *suffix_list = variant_suffixes;
 
   GList *suffix_entries = NULL;
   int preferred = -1;
@@ -207,7 +243,7 @@ gegl_module_db_remove_duplicates (GeglModuleDB *db)
 
 #endif
 #ifdef ARCH_ARM
-  char *suffix_list[] = {"-arm-neon." MODULE_SUFFIX, NULL};
+  const gchar * const *suffix_list = variant_suffixes;
 
   GList *suffix_entries = NULL;
   int preferred = -1;
@@ -265,6 +301,327 @@ gegl_module_db_remove_duplicates (GeglModuleDB *db)
 }
 #endif
 
+/* returns the path of the baseline module a module path refers to, which
+ * is what the manifest lists.
+ */
+static gchar *
+module_base_name (const gchar *filename)
+{
+#ifdef ARCH_SIMD
+  gint i;
+
+  for (i = 0; variant_suffixes[i]; i++)
+    {
+      if (g_str_has_suffix (filename, variant_suffixes[i]))
+        {
+          return g_strdup_printf ("%.*s." MODULE_SUFFIX,
+                                  (gint) (strlen (filename) -
+                                          strlen (variant_suffixes[i])),
+                                  filename);
+        }
+    }
+#endif
+
+  return g_strdup (filename);
+}
+
+/* returns the part of filename following directory, or NULL if filename
+ * isn't in directory.
+ */
+static const gchar *
+relative_module_path (const gchar *directory,
+                      const gchar *filename)
+{
+  gsize length = strlen (directory);
+
+  while (length > 0 && G_IS_DIR_SEPARATOR (directory[length - 1]))
+    length--;
+
+  if (length == 0                            ||
+      strncmp (filename, directory, length)  ||
+      ! G_IS_DIR_SEPARATOR (filename[length]))
+    {
+      return NULL;
+    }
+
+  filename += length;
+
+  while (G_IS_DIR_SEPARATOR (*filename))
+    filename++;
+
+  return filename;
+}
+
+static void
+manifest_free (Manifest *manifest)
+{
+  g_free (manifest->directory);
+  g_key_file_free (manifest->key_file);
+  g_hash_table_unref (manifest->modules);
+
+  g_slice_free (Manifest, manifest);
+}
+
+static Manifest *
+manifest_load (GeglModuleDB *db,
+               const gchar  *directory)
+{
+  Manifest  *manifest = NULL;
+  GKeyFile  *key_file;
+  GStatBuf   st;
+  gchar     *filename;
+  gchar    **groups;
+  GError    *error = NULL;
+  gint       i;
+
+  filename = g_build_filename (directory, MANIFEST_NAME, NULL);
+
+  if (g_stat (filename, &st))
+    {
+      g_free (filename);
+
+      return NULL;
+    }
+
+  key_file = g_key_file_new ();
+
+  if (! g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE,
+                                   &error) ||
+      g_key_file_get_integer (key_file, "manifest", "abi-version",
+                              NULL) != GEGL_MODULE_ABI_VERSION)
+    {
+      if (db->verbose)
+        g_print ("Ignoring manifest '%s': %s\n",
+                 filename, error ? error->message : "ABI version mismatch");
+
+      g_clear_error (&error);
+      g_key_file_free (key_file);
+      g_free (filename);
+
+      return NULL;
+    }
+
+  manifest = g_slice_new0 (Manifest);
+
+  manifest->directory = g_strdup (directory);
+  manifest->key_file  = key_file;
+  manifest->mtime     = st.st_mtime;
+  manifest->modules   = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                               g_free,
+                                               (GDestroyNotify) g_ptr_array_unref);
+
+  groups = g_key_file_get_groups (key_file, NULL);
+
+  for (i = 0; groups[i]; i++)
+    {
+      GPtrArray *operations;
+      gchar     *module;
+
+      if (! g_str_has_prefix (groups[i], "operation "))
+        continue;
+
+      module = g_key_file_get_string (key_file, groups[i], "module", NULL);
+
+      if (! module)
+        continue;
+
+      operations = g_hash_table_lookup (manifest->modules, module);
+
+      if (! operations)
+        {
+          operations = g_ptr_array_new_with_free_func (g_free);
+
+          g_hash_table_insert (manifest->modules, module, operations);
+        }
+      else
+        {
+          g_free (module);
+        }
+
+      g_ptr_array_add (operations,
+                       g_strdup (groups[i] + strlen ("operation ")));
+    }
+
+  g_strfreev (groups);
+  g_free (filename);
+
+  return manifest;
+}
+
+static GList *
+manifests_load (GeglModuleDB *db,
+                const gchar  *module_path)
+{
+  GList  *manifests = NULL;
+  gchar **directories;
+  gint    i;
+
+  directories = g_strsplit (module_path, G_SEARCHPATH_SEPARATOR_S, 0);
+
+  for (i = 0; directories[i]; i++)
+    {
+      Manifest *manifest;
+
+      if (! *directories[i])
+        continue;
+
+      manifest = manifest_load (db, directories[i]);
+
+      if (manifest)
+        manifests = g_list_prepend (manifests, manifest);
+    }
+
+  g_strfreev (directories);
+
+  return g_list_reverse (manifests);
+}
+
+static GeglModule *
+gegl_module_db_find_module (GeglModuleDB *db,
+                            const gchar  *filename)
+{
+  GList *list;
+
+  for (list = db->modules; list; list = g_list_next (list))
+    {
+      GeglModule *module = list->data;
+
+      if (! strcmp (module->filename, filename))
+        return module;
+    }
+
+  return NULL;
+}
+
+static void
+gegl_module_db_add_module (GeglModuleDB *db,
+                           GeglModule   *module)
+{
+  g_signal_connect (module, "modified",
+                    G_CALLBACK (gegl_module_db_module_modified),
+                    db);
+
+  db->modules = g_list_append (db->modules, module);
+  g_signal_emit (db, db_signals[ADD], 0, module);
+}
+
+/* creates a module whose operations, as listed by a manifest, are registered
+ * without loading it; it's only loaded once one of them is looked up.
+ * returns NULL if no up-to-date manifest lists the module.
+ */
+static GeglModule *
+gegl_module_db_defer_module (GeglModuleDB *db,
+                             const gchar  *filename,
+                             GList        *manifests)
+{
+  Manifest   *manifest = NULL;
+  GPtrArray  *operations = NULL;
+  GeglModule *module;
+  GStatBuf    st;
+  GList      *list;
+  guint       i;
+
+  for (list = manifests; list && ! operations; list = g_list_next (list))
+    {
+      const gchar *relative;
+      gchar       *name;
+
+      manifest = list->data;
+      relative = relative_module_path (manifest->directory, filename);
+
+      if (! relative)
+        continue;
+
+      name       = module_base_name (relative);
+      operations = g_hash_table_lookup (manifest->modules, name);
+
+      g_free (name);
+    }
+
+  if (! operations)
+    return NULL;
+
+  /* the module was rebuilt after the manifest was written */
+  if (g_stat (filename, &st) || st.st_mtime > manifest->mtime)
+    {
+      if (db->verbose)
+        g_print ("Module '%s' is newer than its manifest\n", filename);
+
+      return NULL;
+    }
+
+  module = g_object_new (GEGL_TYPE_MODULE, NULL);
+
+  module->filename = g_strdup (filename);
+  module->verbose  = db->verbose;
+  module->on_disk  = TRUE;
+  module->state    = GEGL_MODULE_STATE_NOT_LOADED;
+
+  if (db->verbose)
+    g_print ("Deferring module '%s'\n", filename);
+
+  for (i = 0; i < operations->len; i++)
+    {
+      const gchar  *name = g_ptr_array_index (operations, i);
+      GKeyFile     *key_file = manifest->key_file;
+      GHashTable   *keys;
+      gchar        *group;
+      gchar        *keys_group;
+      gchar       **strv;
+      gboolean      dynamic;
+      gint          j;
+
+      group      = g_strconcat ("operation ", name, NULL);
+      keys_group = g_strconcat ("keys ", name, NULL);
+
+      keys = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+      strv = g_key_file_get_keys (key_file, keys_group, NULL, NULL);
+
+      for (j = 0; strv && strv[j]; j++)
+        {
+          gchar *value = g_key_file_get_string (key_file, keys_group, strv[j],
+                                                NULL);
+
+          if (value)
+            g_hash_table_insert (keys, g_strdup (strv[j]), value);
+        }
+
+      g_strfreev (strv);
+
+      dynamic = g_key_file_get_boolean (key_file, group, "dynamic", NULL);
+
+      gegl_operation_gtype_add_deferred (name, G_TYPE_MODULE (module),
+                                         keys, dynamic);
+
+      g_hash_table_unref (keys);
+
+      /* the content types the operation handles are registered by its
+       * class, which we don't initialize until it's used.
+       */
+      strv = g_key_file_get_string_list (key_file, group, "loaders",
+                                         NULL, NULL);
+
+      for (j = 0; strv && strv[j]; j++)
+        gegl_operation_handlers_register_loader (strv[j], name);
+
+      g_strfreev (strv);
+
+      strv = g_key_file_get_string_list (key_file, group, "savers",
+                                         NULL, NULL);
+
+      for (j = 0; strv && strv[j]; j++)
+        gegl_operation_handlers_register_saver (strv[j], name);
+
+      g_strfreev (strv);
+
+      g_free (keys_group);
+      g_free (group);
+    }
+
+  return module;
+}
+
 /**
  * gegl_module_db_load:
  * @db:          A #GeglModuleDB.
@@ -274,6 +631,11 @@ gegl_module_db_remove_duplicates (GeglModuleDB *db)
  * Scans the directories contained in @module_path using
  * gegl_datafiles_read_directories() and creates a #GeglModule
  * instance for every loadable module contained in the directories.
+ *
+ * Modules listed by an up-to-date manifest in one of the directories, as
+ * written by gegl_module_db_write_manifest(), aren't loaded right away:
+ * their operations are registered from the manifest, and each module is
+ * loaded when one of its operations is first looked up.
  **/
 void
 gegl_module_db_load (GeglModuleDB *db,
@@ -286,6 +648,7 @@ gegl_module_db_load (GeglModuleDB *db,
   {
     GeglModule   *module;
     gboolean load_inhibit;
+    GList    *manifests;
 
     gegl_datafiles_read_directories (module_path,
                                      G_FILE_TEST_EXISTS,
@@ -294,25 +657,40 @@ gegl_module_db_load (GeglModuleDB *db,
 #ifdef ARCH_SIMD
     gegl_module_db_remove_duplicates (db);
 #endif
+    manifests = manifests_load (db, module_path);
+
     while (db->to_load)
     {
       char *filename = db->to_load->data;
       load_inhibit = is_in_inhibit_list (filename,
                                          db->load_inhibit);
+      module = NULL;
+
+      if (manifests && ! load_inhibit)
+        {
+          /* the operations of a module listed twice are already registered */
+          if (gegl_module_db_find_module (db, filename))
+            {
+              db->to_load = g_list_remove (db->to_load, filename);
+              g_free (filename);
+              continue;
+            }
+
+          module = gegl_module_db_defer_module (db, filename, manifests);
+        }
 
-      module = gegl_module_new (filename,
-                                load_inhibit,
-                                db->verbose);
+      if (! module)
+        module = gegl_module_new (filename,
+                                  load_inhibit,
+                                  db->verbose);
 
-      g_signal_connect (module, "modified",
-                        G_CALLBACK (gegl_module_db_module_modified),
-                        db);
+      gegl_module_db_add_module (db, module);
 
-      db->modules = g_list_append (db->modules, module);
-      g_signal_emit (db, db_signals[ADD], 0, module);
       db->to_load = g_list_remove (db->to_load, filename);
       g_free (filename);
     }
+
+    g_list_free_full (manifests, (GDestroyNotify) manifest_free);
   }
 
 }
@@ -369,3 +747,271 @@ gegl_module_db_module_modified (GeglModule   *module,
 {
   g_signal_emit (db, db_signals[MODULE_MODIFIED], 0, module);
 }
+
+static void
+gegl_module_db_manifest_search (const GeglDatafileData *file_data,
+                                gpointer                user_data)
+{
+  GList **files = user_data;
+
+  if (! valid_module_name (file_data->filename))
+    return;
+
+#ifdef ARCH_SIMD
+  /* variants implement the same operations as their baseline module */
+  if (gegl_str_has_one_of_suffixes (file_data->filename, variant_suffixes))
+    return;
+#endif
+
+  *files = g_list_prepend (*files, g_strdup (file_data->filename));
+}
+
+static gboolean
+valid_manifest_key (const gchar *key)
+{
+  if (! *key                               ||
+      g_ascii_isspace (key[0])             ||
+      g_ascii_isspace (key[strlen (key) - 1]))
+    {
+      return FALSE;
+    }
+
+  return ! strpbrk (key, "=[]\n\r");
+}
+
+static void
+add_handler (const gchar *content_type,
+             const gchar *handler,
+             GHashTable  *handlers)
+{
+  GPtrArray *content_types = g_hash_table_lookup (handlers, handler);
+
+  if (! content_types)
+    {
+      content_types = g_ptr_array_new ();
+
+      g_hash_table_insert (handlers, (gpointer) handler, content_types);
+    }
+
+  g_ptr_array_add (content_types, (gpointer) content_type);
+}
+
+static void
+write_handlers (GKeyFile    *key_file,
+                GHashTable  *handlers,
+                const gchar *group,
+                const gchar *name,
+                const gchar *key)
+{
+  GPtrArray *content_types = g_hash_table_lookup (handlers, name);
+
+  if (content_types)
+    {
+      g_ptr_array_sort (content_types, (GCompareFunc) g_strcmp0);
+
+      g_key_file_set_string_list (key_file, group, key,
+                                  (const gchar * const *) content_types->pdata,
+                                  content_types->len);
+    }
+}
+
+static void
+gegl_module_db_manifest_add_operations (GKeyFile    *key_file,
+                                        GPtrArray   *names,
+                                        GType        type,
+                                        GeglModule  *module,
+                                        const gchar *module_name)
+{
+  GType *types;
+  guint  n_types;
+  guint  i;
+
+  types = g_type_children (type, &n_types);
+
+  for (i = 0; i < n_types; i++)
+    {
+      if (g_type_get_plugin (types[i]) == G_TYPE_PLUGIN (module) &&
+          ! G_TYPE_IS_ABSTRACT (types[i]))
+        {
+          GeglOperationClass *klass = g_type_class_ref (types[i]);
+          const gchar        *name;
+
+          name = gegl_operation_class_get_key (klass, "name");
+
+          if (name)
+            {
+              gchar *group      = g_strconcat ("operation ", name, NULL);
+              gchar *keys_group = g_strconcat ("keys ", name, NULL);
+              GList *keys;
+              GList *list;
+
+              g_key_file_set_string (key_file, group, "module", module_name);
+              g_key_file_set_boolean (key_file, group, "dynamic",
+                                      klass->is_available != NULL);
+
+              keys = klass->keys ? g_hash_table_get_keys (klass->keys) : NULL;
+              keys = g_list_sort (keys, (GCompareFunc) strcmp);
+
+              for (list = keys; list; list = g_list_next (list))
+                {
+                  const gchar *key = list->data;
+
+                  if (! strcmp (key, "operation-class") ||
+                      ! valid_manifest_key (key))
+                    {
+                      continue;
+                    }
+
+                  g_key_file_set_string (key_file, keys_group, key,
+                                         gegl_operation_class_get_key (klass,
+                                                                       key));
+                }
+
+              g_list_free (keys);
+
+              g_ptr_array_add (names, g_strdup (name));
+
+              g_free (keys_group);
+              g_free (group);
+            }
+
+          g_type_class_unref (klass);
+        }
+
+      gegl_module_db_manifest_add_operations (key_file, names, types[i],
+                                              module, module_name);
+    }
+
+  g_free (types);
+}
+
+/**
+ * gegl_module_db_write_manifest:
+ * @db: A #GeglModuleDB.
+ * @directory: A directory containing modules.
+ * @error: Return location for errors.
+ *
+ * Loads the modules contained in @directory and its subdirectories, and
+ * writes a manifest of the operations they implement to @directory.
+ * gegl_module_db_load() registers the operations of modules listed in the
+ * manifest without loading them, as long as they're older than it.
+ *
+ * The modules are loaded in the C locale, so that the keys of their
+ * operations are stored untranslated; gegl_operation_get_key() translates
+ * them on lookup.  Operation classes initialized before the call keep the
+ * keys of the locale they were initialized in.
+ *
+ * Return value: %TRUE on success.
+ **/
+gboolean
+gegl_module_db_write_manifest (GeglModuleDB  *db,
+                               const gchar   *directory,
+                               GError       **error)
+{
+  GKeyFile   *key_file;
+  GPtrArray  *names;
+  GHashTable *loaders;
+  GHashTable *savers;
+  GList      *files = NULL;
+  GList      *list;
+  gchar      *filename;
+  gchar      *old_locale;
+  gboolean    success;
+  guint       i;
+
+  g_return_val_if_fail (GEGL_IS_MODULE_DB (db), FALSE);
+  g_return_val_if_fail (directory != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  old_locale = g_strdup (setlocale (LC_ALL, NULL));
+  setlocale (LC_ALL, "C");
+
+  key_file = g_key_file_new ();
+  names    = g_ptr_array_new_with_free_func (g_free);
+
+  g_key_file_set_integer (key_file, "manifest", "abi-version",
+                          GEGL_MODULE_ABI_VERSION);
+
+  if (g_module_supported ())
+    {
+      gegl_datafiles_read_directories (directory,
+                                       G_FILE_TEST_EXISTS,
+                                       gegl_module_db_manifest_search,
+                                       &files);
+
+      files = g_list_sort (files, (GCompareFunc) strcmp);
+    }
+
+  for (list = files; list; list = g_list_next (list))
+    {
+      const gchar *module_name;
+      GeglModule  *module;
+
+      module_name = relative_module_path (directory, list->data);
+
+      if (! module_name)
+        continue;
+
+      module = gegl_module_db_find_module (db, list->data);
+
+      if (! module)
+        {
+          module = gegl_module_new (list->data, FALSE, db->verbose);
+
+          gegl_module_db_add_module (db, module);
+        }
+
+      if (module->state == GEGL_MODULE_STATE_ERROR ||
+          module->state == GEGL_MODULE_STATE_LOAD_FAILED)
+        {
+          continue;
+        }
+
+      gegl_module_db_manifest_add_operations (key_file, names,
+                                              GEGL_TYPE_OPERATION,
+                                              module, module_name);
+    }
+
+  g_list_free_full (files, g_free);
+
+  /* content-type handlers are registered by the classes of the operations */
+  loaders = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                   (GDestroyNotify) g_ptr_array_unref);
+  savers  = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                   (GDestroyNotify) g_ptr_array_unref);
+
+  gegl_operation_handlers_foreach_loader ((GHFunc) add_handler, loaders);
+  gegl_operation_handlers_foreach_saver  ((GHFunc) add_handler, savers);
+
+  for (i = 0; i < names->len; i++)
+    {
+      const gchar *name  = g_ptr_array_index (names, i);
+      gchar       *group = g_strconcat ("operation ", name, NULL);
+
+      write_handlers (key_file, loaders, group, name, "loaders");
+      write_handlers (key_file, savers,  group, name, "savers");
+
+      g_free (group);
+    }
+
+  g_hash_table_unref (savers);
+  g_hash_table_unref (loaders);
+
+  filename = g_build_filename (directory, MANIFEST_NAME, NULL);
+
+  success = g_key_file_save_to_file (key_file, filename, error);
+
+  if (success && db->verbose)
+    g_print ("Wrote manifest '%s' listing %u operations\n",
+             filename, names->len);
+
+  g_free (filename);
+  g_ptr_array_unref (names);
+  g_key_file_free (key_file);
+
+  if (old_locale)
+    setlocale (LC_ALL, old_locale);
+  g_free (old_locale);
+
+  return success;
+}
@@ -68,6 +68,10 @@ GeglModuleDB * gegl_module_db_new              (gboolean      verbose);
 void           gegl_module_db_load             (GeglModuleDB *db,
                                                 const gchar  *module_path);
 
+gboolean       gegl_module_db_write_manifest   (GeglModuleDB  *db,
+                                                const gchar   *directory,
+                                                GError       **error);
+
 
 G_END_DECLS
 
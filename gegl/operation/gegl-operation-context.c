@@ -308,6 +308,8 @@ gegl_operation_context_get_target (GeglOperationContext *context,
   const Babl          *format;
   GeglNode            *node;
   GeglOperation       *operation;
+  gint                 tile_width;
+  gint                 tile_height;
   static gint          linear_buffers = -1;
 
 #if 0
@@ -355,6 +357,8 @@ gegl_operation_context_get_target (GeglOperationContext *context,
         }
       else
         {
+          gegl_operation_get_tile_size (operation, &tile_width, &tile_height);
+
           output = g_object_new (
             GEGL_TYPE_BUFFER,
             "x",           result->x,
@@ -362,6 +366,8 @@ gegl_operation_context_get_target (GeglOperationContext *context,
             "width",       result->width,
             "height",      result->height,
             "format",      format,
+            "tile-width",  tile_width,
+            "tile-height", tile_height,
             "initialized", gegl_operation_context_get_init_output (),
             NULL);
         }
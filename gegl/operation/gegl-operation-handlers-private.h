@@ -19,6 +19,12 @@
 #ifndef __GEGL_EXTENSION_HANDLER_PRIVATE_H__
 #define __GEGL_EXTENSION_HANDLER_PRIVATE_H__
 
+/* calls func with each registered content type and its handler */
+void          gegl_operation_handlers_foreach_loader  (GHFunc   func,
+                                                       gpointer user_data);
+void          gegl_operation_handlers_foreach_saver   (GHFunc   func,
+                                                       gpointer user_data);
+
 void          gegl_operation_handlers_cleanup         (void);
 
 #endif
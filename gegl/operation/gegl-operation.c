@@ -48,6 +48,8 @@ struct _GeglOperationPrivate
 {
   gdouble  pixel_time;
   gboolean attached;
+  gint     tile_width;
+  gint     tile_height;
 };
 
 
@@ -572,6 +574,54 @@ gegl_operation_get_format (GeglOperation *self,
   return pad->format;
 }
 
+void
+gegl_operation_set_tile_size (GeglOperation *self,
+                              gint           tile_width,
+                              gint           tile_height)
+{
+  GeglOperationPrivate *priv;
+
+  g_return_if_fail (GEGL_IS_OPERATION (self));
+  g_return_if_fail (tile_width >= 0 && tile_height >= 0);
+
+  priv = gegl_operation_get_instance_private (self);
+
+  if (tile_width == 0 || tile_height == 0)
+    tile_width = tile_height = 0;
+
+  priv->tile_width  = tile_width;
+  priv->tile_height = tile_height;
+}
+
+gboolean
+gegl_operation_get_tile_size (GeglOperation *self,
+                              gint          *tile_width,
+                              gint          *tile_height)
+{
+  GeglOperationPrivate *priv;
+
+  g_return_val_if_fail (GEGL_IS_OPERATION (self), FALSE);
+
+  priv = gegl_operation_get_instance_private (self);
+
+  if (priv->tile_width > 0)
+    {
+      if (tile_width)
+        *tile_width  = priv->tile_width;
+      if (tile_height)
+        *tile_height = priv->tile_height;
+
+      return TRUE;
+    }
+
+  if (tile_width)
+    *tile_width  = gegl_config ()->tile_width;
+  if (tile_height)
+    *tile_height = gegl_config ()->tile_height;
+
+  return FALSE;
+}
+
 const gchar *
 gegl_operation_get_name (GeglOperation *operation)
 {
@@ -698,7 +748,26 @@ gegl_operation_list_keys (const gchar *operation_name,
   gchar              **ret;
   int                  count;
   int                  i;
+  GHashTable          *keys;
   g_return_val_if_fail (operation_name != NULL, NULL);
+
+  /* avoid loading the module of an operation only to list its keys */
+  keys = gegl_operation_gtype_get_deferred_keys (operation_name);
+  if (keys)
+    {
+      count = g_hash_table_size (keys);
+      ret = g_malloc0 (sizeof (gpointer) * (count + 1));
+      list = g_hash_table_get_keys (keys);
+      for (i = 0, l = list; l; l = l->next, i++)
+        {
+          ret[i] = l->data;
+        }
+      g_list_free (list);
+      if (n_keys)
+        *n_keys = count;
+      return ret;
+    }
+
   type = gegl_operation_gtype_from_name (operation_name);
   if (!type)
     {
@@ -836,6 +905,20 @@ gegl_operation_class_get_key (GeglOperationClass *klass,
   return g_hash_table_lookup (klass->keys, key_name);
 }
 
+/* the manifest is written in the C locale, translate the keys operations
+ * translate when they're looked up instead.
+ */
+static const gchar *
+gegl_operation_translate_deferred_key (const gchar *key_name,
+                                       const gchar *value)
+{
+  if (value && *value &&
+      (! strcmp (key_name, "title") || ! strcmp (key_name, "description")))
+    return g_dgettext (GETTEXT_PACKAGE, value);
+
+  return value;
+}
+
 const gchar *
 gegl_operation_get_key (const gchar *operation_name,
                         const gchar *key_name)
@@ -843,6 +926,13 @@ gegl_operation_get_key (const gchar *operation_name,
   GType         type;
   GObjectClass *klass;
   const gchar  *ret = NULL;
+  GHashTable   *keys;
+
+  keys = gegl_operation_gtype_get_deferred_keys (operation_name);
+  if (keys)
+    return gegl_operation_translate_deferred_key (
+             key_name, g_hash_table_lookup (keys, key_name));
+
   type = gegl_operation_gtype_from_name (operation_name);
   if (!type)
     {
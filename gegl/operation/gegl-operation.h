@@ -224,6 +224,23 @@ const Babl *    gegl_operation_get_format    (GeglOperation *operation,
 
 const gchar *   gegl_operation_get_name      (GeglOperation *operation);
 
+/* specify the tile dimensions to use for buffers holding the output of this
+ * operation, including its cache; operations accessing their output mostly
+ * along rows or columns can request wide or tall tiles from their prepare
+ * method. Passing 0 reverts to the configured default tile size.
+ */
+void            gegl_operation_set_tile_size (GeglOperation *operation,
+                                              gint           tile_width,
+                                              gint           tile_height);
+
+/* retrieves the tile dimensions for output buffers of this operation,
+ * returns TRUE if the operation requested a tile size, FALSE if the
+ * configured default tile size is used.
+ */
+gboolean        gegl_operation_get_tile_size (GeglOperation *operation,
+                                              gint          *tile_width,
+                                              gint          *tile_height);
+
 
 /* checks the incoming Babl format on a given pad, can be used in the prepare
  * stage to make format dependent decisions
@@ -30,9 +30,22 @@
 #include "gegl-operations.h"
 #include "gegl-operation-context.h"
 
+/* an operation listed in a module manifest, whose module hasn't been loaded
+ * yet.
+ */
+typedef struct
+{
+  GTypeModule *module;
+  GHashTable  *keys;
+  gboolean     is_compat;
+  gboolean     dynamic;
+  gboolean     loaded;
+} DeferredOperation;
+
 static gchar     **accepted_licenses       = NULL;
 static GHashTable *known_operation_names   = NULL;
 static GHashTable *visible_operation_names = NULL;
+static GHashTable *deferred_operations     = NULL;
 static GSList     *operations_list         = NULL;
 static guint       gtype_hash_serial       = 0;
 
@@ -197,6 +210,23 @@ gegl_operations_check_license (const gchar *operation_license)
   return FALSE;
 }
 
+static gboolean
+gegl_operations_is_deferred (const gchar       *name,
+                             DeferredOperation *deferred)
+{
+  const gchar *license;
+
+  if (deferred->loaded || deferred->dynamic ||
+      g_hash_table_contains (known_operation_names, name))
+    {
+      return FALSE;
+    }
+
+  license = g_hash_table_lookup (deferred->keys, "license");
+
+  return ! license || gegl_operations_check_license (license);
+}
+
 static void
 gegl_operations_update_visible (void)
 {
@@ -250,6 +280,132 @@ gegl_operations_update_visible (void)
 
       g_type_class_unref (object_class);
     }
+
+  /* operations whose module isn't loaded yet are listed based on their
+   * manifest keys.
+   */
+  if (deferred_operations)
+    {
+      DeferredOperation *deferred;
+
+      g_hash_table_iter_init (&iter, deferred_operations);
+
+      while (g_hash_table_iter_next (&iter, (gpointer) &iter_key, (gpointer) &deferred))
+        {
+          if (! deferred->is_compat &&
+              gegl_operations_is_deferred (iter_key, deferred))
+            {
+              operations_list = g_slist_insert_sorted (operations_list, (gpointer) iter_key,
+                                                       (GCompareFunc) strcmp);
+            }
+        }
+    }
+}
+
+/* must be called with the operations cache locked for writing */
+static void
+gegl_operations_update (void)
+{
+  guint latest_serial;
+
+  /* If any new modules have been loaded, scan for GeglOperations */
+  latest_serial = g_type_get_type_registration_serial ();
+  if (gtype_hash_serial != latest_serial)
+    {
+      add_operations (GEGL_TYPE_OPERATION);
+
+      gtype_hash_serial = latest_serial;
+
+      gegl_operations_update_visible ();
+    }
+}
+
+/* loads the module of a deferred operation, which registers its types.
+ * must be called with the operations cache locked for writing.
+ */
+static void
+gegl_operations_load_deferred (DeferredOperation *deferred)
+{
+  GTypeModule       *module = deferred->module;
+  GHashTableIter     iter;
+  DeferredOperation *other;
+
+  g_hash_table_iter_init (&iter, deferred_operations);
+
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer) &other))
+    {
+      if (other->module == module)
+        other->loaded = TRUE;
+    }
+
+  /* like gegl_module_new(), register the types and unload the module
+   * again, until they're used.
+   */
+  if (g_type_module_use (module))
+    g_type_module_unuse (module);
+}
+
+static void
+deferred_operation_free (DeferredOperation *deferred)
+{
+  g_hash_table_unref (deferred->keys);
+
+  g_slice_free (DeferredOperation, deferred);
+}
+
+void
+gegl_operation_gtype_add_deferred (const gchar *name,
+                                   GTypeModule *module,
+                                   GHashTable  *keys,
+                                   gboolean     dynamic)
+{
+  const gchar *names[3];
+  gint         i;
+
+  g_return_if_fail (name != NULL);
+  g_return_if_fail (G_IS_TYPE_MODULE (module));
+  g_return_if_fail (keys != NULL);
+
+  names[0] = name;
+  names[1] = g_hash_table_lookup (keys, "compat-name");
+  names[2] = NULL;
+
+  lock_operations_cache (TRUE);
+
+  for (i = 0; names[i]; i++)
+    {
+      DeferredOperation *deferred = g_slice_new0 (DeferredOperation);
+
+      deferred->module    = module;
+      deferred->keys      = g_hash_table_ref (keys);
+      deferred->is_compat = i > 0;
+      deferred->dynamic   = dynamic;
+
+      g_hash_table_insert (deferred_operations, g_strdup (names[i]), deferred);
+    }
+
+  /* make the next lookup update the list of visible operations */
+  gtype_hash_serial = 0;
+
+  unlock_operations_cache (TRUE);
+}
+
+GHashTable *
+gegl_operation_gtype_get_deferred_keys (const gchar *name)
+{
+  DeferredOperation *deferred;
+  GHashTable        *keys = NULL;
+
+  lock_operations_cache (FALSE);
+
+  deferred = g_hash_table_lookup (deferred_operations, name);
+
+  if (deferred && gegl_operations_is_deferred (name, deferred))
+    keys = deferred->keys;
+
+  unlock_operations_cache (FALSE);
+
+  return keys;
 }
 
 void
@@ -270,27 +426,17 @@ gegl_operations_set_licenses_from_string (const gchar *license_str)
 GType
 gegl_operation_gtype_from_name (const gchar *name)
 {
-  guint latest_serial;
-  GType type;
+  GType              type;
+  DeferredOperation *deferred;
 
   lock_operations_cache (FALSE);
 
-  /* If any new modules have been loaded, scan for GeglOperations */
-  latest_serial = g_type_get_type_registration_serial ();
-  if (gtype_hash_serial != latest_serial)
+  if (gtype_hash_serial != g_type_get_type_registration_serial ())
     {
       unlock_operations_cache (FALSE);
       lock_operations_cache (TRUE);
 
-      latest_serial = g_type_get_type_registration_serial ();
-      if (gtype_hash_serial != latest_serial)
-        {
-          add_operations (GEGL_TYPE_OPERATION);
-
-          gtype_hash_serial = latest_serial;
-
-          gegl_operations_update_visible ();
-        }
+      gegl_operations_update ();
 
       type = (GType) g_hash_table_lookup (visible_operation_names, name);
 
@@ -303,6 +449,36 @@ gegl_operation_gtype_from_name (const gchar *name)
       unlock_operations_cache (FALSE);
     }
 
+  if (type)
+    return type;
+
+  lock_operations_cache (FALSE);
+
+  deferred = g_hash_table_lookup (deferred_operations, name);
+  if (deferred && deferred->loaded)
+    deferred = NULL;
+
+  unlock_operations_cache (FALSE);
+
+  if (! deferred)
+    return 0;
+
+  /* load the module of the operation on first use */
+  lock_operations_cache (TRUE);
+
+  deferred = g_hash_table_lookup (deferred_operations, name);
+
+  if (deferred && ! deferred->loaded)
+    {
+      gegl_operations_load_deferred (deferred);
+
+      gegl_operations_update ();
+    }
+
+  type = (GType) g_hash_table_lookup (visible_operation_names, name);
+
+  unlock_operations_cache (TRUE);
+
   return type;
 }
 
@@ -312,6 +488,30 @@ gegl_has_operation (const gchar *operation_type)
   return gegl_operation_gtype_from_name (operation_type) != 0;
 }
 
+void
+gegl_load_deferred_operations (void)
+{
+  GHashTableIter     iter;
+  DeferredOperation *deferred;
+
+  lock_operations_cache (TRUE);
+
+  if (deferred_operations)
+    {
+      g_hash_table_iter_init (&iter, deferred_operations);
+
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer) &deferred))
+        {
+          if (! deferred->loaded)
+            gegl_operations_load_deferred (deferred);
+        }
+    }
+
+  gegl_operations_update ();
+
+  unlock_operations_cache (TRUE);
+}
+
 gchar **gegl_list_operations (guint *n_operations_p)
 {
   gchar **pasp = NULL;
@@ -321,20 +521,36 @@ gchar **gegl_list_operations (guint *n_operations_p)
   gint    pasp_size = 0;
   gint    pasp_pos;
 
-  if (!operations_list)
+  lock_operations_cache (TRUE);
+
+  /* the availability of some operations can only be determined by their
+   * class, so their modules have to be loaded.
+   */
+  if (deferred_operations)
     {
-      gegl_operation_gtype_from_name ("");
+      GHashTableIter     iter;
+      DeferredOperation *deferred;
 
-      /* should only happen if no operations are found */
-      if (!operations_list)
+      g_hash_table_iter_init (&iter, deferred_operations);
+
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer) &deferred))
         {
-          if (n_operations_p)
-            *n_operations_p = 0;
-          return NULL;
+          if (deferred->dynamic && ! deferred->loaded)
+            gegl_operations_load_deferred (deferred);
         }
     }
 
-  lock_operations_cache (FALSE);
+  gegl_operations_update ();
+
+  /* should only happen if no operations are found */
+  if (!operations_list)
+    {
+      unlock_operations_cache (TRUE);
+
+      if (n_operations_p)
+        *n_operations_p = 0;
+      return NULL;
+    }
 
   n_operations = g_slist_length (operations_list);
   pasp_size   += (n_operations + 1) * sizeof (gchar *);
@@ -356,7 +572,7 @@ gchar **gegl_list_operations (guint *n_operations_p)
   if (n_operations_p)
     *n_operations_p = n_operations;
 
-  unlock_operations_cache (FALSE);
+  unlock_operations_cache (TRUE);
 
   return pasp;
 }
@@ -372,6 +588,10 @@ gegl_operation_gtype_init (void)
   if (!visible_operation_names)
     visible_operation_names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
+  if (!deferred_operations)
+    deferred_operations = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                 (GDestroyNotify) deferred_operation_free);
+
   unlock_operations_cache (TRUE);
 }
 
@@ -387,6 +607,9 @@ gegl_operation_gtype_cleanup (void)
       g_hash_table_destroy (visible_operation_names);
       visible_operation_names = NULL;
 
+      g_hash_table_destroy (deferred_operations);
+      deferred_operations = NULL;
+
       g_slist_free (operations_list);
       operations_list = NULL;
     }
@@ -36,4 +36,19 @@ void       gegl_operation_class_register_name (GeglOperationClass *klass,
 
 void       gegl_operations_set_licenses_from_string (const gchar *license_str);
 
+/* Registers an operation listed in a module manifest, whose module is only
+ * loaded once the operation is looked up.  @keys maps the operation's keys
+ * to their values; @dynamic is TRUE if the operation class has an
+ * is_available() function, which requires loading the module to list it.
+ */
+void       gegl_operation_gtype_add_deferred (const gchar *name,
+                                              GTypeModule *module,
+                                              GHashTable  *keys,
+                                              gboolean     dynamic);
+
+/* Returns the manifest keys of a visible operation whose module isn't
+ * loaded yet, or NULL.
+ */
+GHashTable * gegl_operation_gtype_get_deferred_keys (const gchar *name);
+
 #endif
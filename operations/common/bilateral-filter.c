@@ -18,11 +18,18 @@
  */
 
 #include "config.h"
+#include <string.h>
 #include <glib/gi18n-lib.h>
 
 
 #ifdef GEGL_PROPERTIES
 
+enum_start (gegl_bilateral_filter_mode)
+  enum_value (GEGL_BILATERAL_FILTER_AUTO,  "auto",  N_("Automatic"))
+  enum_value (GEGL_BILATERAL_FILTER_EXACT, "exact", N_("Exact"))
+  enum_value (GEGL_BILATERAL_FILTER_FAST,  "fast",  N_("Fast"))
+enum_end (GeglBilateralFilterMode)
+
 property_double (blur_radius, _("Blur radius"), 4.0)
   description(_("Radius of square pixel region, (width and height will be radius*2+1)."))
   value_range   (0.0, 1000.0)
@@ -33,6 +40,15 @@ property_double (edge_preservation, _("Edge preservation"), 8.0)
   description   (_("Amount of edge preservation"))
   value_range   (0.0, 100.0)
 
+property_enum (mode, _("Mode"),
+               GeglBilateralFilterMode, gegl_bilateral_filter_mode,
+               GEGL_BILATERAL_FILTER_AUTO)
+  description   (_("Whether to compute the exact filter, or a faster "
+                   "bilateral-grid approximation, whose cost doesn't "
+                   "depend on the radius, and which compares each color "
+                   "channel separately; the automatic mode uses the "
+                   "approximation for large radii"))
+
 #else
 
 #define GEGL_OP_AREA_FILTER
@@ -41,6 +57,11 @@ property_double (edge_preservation, _("Edge preservation"), 8.0)
 
 #include "gegl-op.h"
 
+/* the smallest radius for which the automatic mode uses the bilateral
+ * grid; below it, the exact filter is cheap enough.
+ */
+#define AUTO_FAST_MIN_RADIUS 16.0
+
 static void
 bilateral_filter (GeglBuffer          *src,
                   const GeglRectangle *src_rect,
@@ -50,231 +71,123 @@ bilateral_filter (GeglBuffer          *src,
                   gdouble              preserve,
                   const Babl          *format);
 
-#include <stdio.h>
-
-static void prepare (GeglOperation *operation)
-{
-  const Babl *space = gegl_operation_get_source_space (operation, "input");
-  const Babl *format = babl_format_with_space ("RGBA float", space);
-  GeglOperationAreaFilter *area = GEGL_OPERATION_AREA_FILTER (operation);
-  GeglProperties              *o = GEGL_PROPERTIES (operation);
-
-  area->left = area->right = area->top = area->bottom = ceil (o->blur_radius);
-  gegl_operation_set_format (operation, "input", format);
-  gegl_operation_set_format (operation, "output", format);
-}
-
-#include "opencl/gegl-cl.h"
-#include "gegl-buffer-cl-iterator.h"
-
-#include "opencl/bilateral-filter.cl.h"
-
-static GeglClRunData *cl_data = NULL;
-
-static gboolean
-cl_bilateral_filter (cl_mem                in_tex,
-                     cl_mem                out_tex,
-                     size_t                global_worksize,
-                     const GeglRectangle  *roi,
-                     gfloat                radius,
-                     gfloat                preserve)
-{
-  cl_int cl_err = 0;
-  size_t global_ws[2];
-
-  if (!cl_data)
-    {
-      const char *kernel_name[] = {"bilateral_filter", NULL};
-      cl_data = gegl_cl_compile_and_build (bilateral_filter_cl_source, kernel_name);
-    }
-  if (!cl_data) return TRUE;
-
-  global_ws[0] = roi->width;
-  global_ws[1] = roi->height;
-
-  cl_err = gegl_clSetKernelArg(cl_data->kernel[0], 0, sizeof(cl_mem),   (void*)&in_tex);
-  CL_CHECK;
-  cl_err = gegl_clSetKernelArg(cl_data->kernel[0], 1, sizeof(cl_mem),   (void*)&out_tex);
-  CL_CHECK;
-  cl_err = gegl_clSetKernelArg(cl_data->kernel[0], 2, sizeof(cl_float), (void*)&radius);
-  CL_CHECK;
-  cl_err = gegl_clSetKernelArg(cl_data->kernel[0], 3, sizeof(cl_float), (void*)&preserve);
-  CL_CHECK;
-
-  cl_err = gegl_clEnqueueNDRangeKernel(gegl_cl_get_command_queue (),
-                                       cl_data->kernel[0], 2,
-                                       NULL, global_ws, NULL,
-                                       0, NULL, NULL);
-  CL_CHECK;
-
-  return FALSE;
-
-error:
-  return TRUE;
-}
-
-static gboolean
-cl_process (GeglOperation       *operation,
-            GeglBuffer          *input,
-            GeglBuffer          *output,
-            const GeglRectangle *result)
+static void
+bilateral_filter_fast (GeglOperation       *operation,
+                       GeglBuffer          *src,
+                       const GeglRectangle *src_rect,
+                       GeglBuffer          *dst,
+                       const GeglRectangle *dst_rect,
+                       gdouble              radius,
+                       gdouble              preserve,
+                       const Babl          *format)
 {
-  const Babl *in_format  = gegl_operation_get_format (operation, "input");
-  const Babl *out_format = gegl_operation_get_format (operation, "output");
-  gint err;
-
-  GeglOperationAreaFilter *op_area = GEGL_OPERATION_AREA_FILTER (operation);
-  GeglProperties *o = GEGL_PROPERTIES (operation);
-
-  GeglBufferClIterator *i = gegl_buffer_cl_iterator_new (output,
-                                                         result,
-                                                         out_format,
-                                                         GEGL_CL_BUFFER_WRITE);
-
-  gint read = gegl_buffer_cl_iterator_add_2 (i,
-                                             input,
-                                             result,
-                                             in_format,
-                                             GEGL_CL_BUFFER_READ,
-                                             op_area->left,
-                                             op_area->right,
-                                             op_area->top,
-                                             op_area->bottom,
-                                             GEGL_ABYSS_NONE);
-
-  while (gegl_buffer_cl_iterator_next (i, &err))
-    {
-      if (err) return FALSE;
-
-      err = cl_bilateral_filter(i->tex[read],
-                                i->tex[0],
-                                i->size[0],
-                                &i->roi[0],
-                                ceil(o->blur_radius),
-                                o->edge_preservation);
-
-      if (err) return FALSE;
-    }
+  FastData  data;
+  gfloat   *src_buf;
+  gfloat   *dst_buf;
+  gdouble   pixels_per_thread;
+  gsize     n_pixels;
+  gsize     n_cells;
+  gint      channel;
 
-  return TRUE;
-}
+  n_pixels = (gsize) src_rect->width * src_rect->height;
 
-static gboolean
-process (GeglOperation       *operation,
-         GeglBuffer          *input,
-         GeglBuffer          *output,
-         const GeglRectangle *result,
-         gint                 level)
-{
-  GeglProperties *o = GEGL_PROPERTIES (operation);
-  GeglRectangle compute;
-  const Babl *format = gegl_operation_get_format (operation, "output");
+  src_buf = g_new  (gfloat, n_pixels * 4);
+  dst_buf = g_new0 (gfloat, (gsize) dst_rect->width * dst_rect->height * 4);
 
-  if (o->blur_radius >= 1.0 && gegl_operation_use_opencl (operation))
-    if (cl_process (operation, input, output, result))
-      return TRUE;
+  gegl_buffer_get (src, src_rect, 1.0, format, src_buf, GEGL_AUTO_ROWSTRIDE,
+                   GEGL_ABYSS_NONE);
 
-  compute = gegl_operation_get_required_for_output (operation, "input",result);
+  /* the exact filter uses exp (-0.5 * d^2 / radius) as the spatial weight,
+   * and exp (-|rgb difference|^2 * preserve) as the range weight, which,
+   * for a difference in a single channel, has a standard deviation of
+   * 1 / sqrt (2 * preserve).  without edge preservation, all values share
+   * a single range cell.
+   */
+  data.spatial_step = sqrt (radius);
 
-  if (o->blur_radius < 1.0)
-    {
-      gegl_buffer_copy (input, result, GEGL_ABYSS_NONE,
-                        output, result);
-    }
+  if (preserve > 0.0)
+    data.range_step = 1.0 / sqrt (2.0 * preserve);
   else
+    data.range_step = GRID_RANGE_MAX - GRID_RANGE_MIN;
+
+  /* align the grid to absolute coordinates and values, so that adjacent
+   * chunks produce the same cells.
+   */
+  data.spatial_x0 = GRID_PADDING + src_rect->x / data.spatial_step -
+                    floor (src_rect->x / data.spatial_step);
+  data.spatial_y0 = GRID_PADDING + src_rect->y / data.spatial_step -
+                    floor (src_rect->y / data.spatial_step);
+  data.range_z0   = GRID_PADDING - floor (GRID_RANGE_MIN / data.range_step);
+
+  data.grid_width  = (gint) fast_cell_x (&data, src_rect->width  - 1) + 2 +
+                     GRID_PADDING;
+  data.grid_height = (gint) fast_cell_y (&data, src_rect->height - 1) + 2 +
+                     GRID_PADDING;
+  data.grid_depth  = (gint) fast_cell_z (&data, GRID_RANGE_MAX) + 2 +
+                     GRID_PADDING;
+
+  n_cells = (gsize) data.grid_width * data.grid_height * data.grid_depth;
+
+  data.src_buf    = src_buf;
+  data.src_width  = src_rect->width;
+  data.src_height = src_rect->height;
+  data.dst_buf    = dst_buf;
+  data.dst_width  = dst_rect->width;
+  data.dst_x      = dst_rect->x - src_rect->x;
+  data.dst_y      = dst_rect->y - src_rect->y;
+  data.grid       = g_new (gfloat, n_cells * GRID_COMPONENTS);
+  data.tmp        = g_new (gfloat, n_cells * GRID_COMPONENTS);
+
+  pixels_per_thread = gegl_operation_get_pixels_per_thread (operation);
+
+  for (channel = 0; channel < 3; channel++)
     {
-      bilateral_filter (input, &compute, output, result, o->blur_radius, o->edge_preservation, format);
+      gint axis;
+
+      data.channel = channel;
+
+      memset (data.grid, 0, n_cells * GRID_COMPONENTS * sizeof (gfloat));
+
+      gegl_parallel_distribute_range (
+        data.grid_height,
+        pixels_per_thread / (data.src_height / (gdouble) data.grid_height *
+                             data.src_width),
+        (GeglParallelDistributeRangeFunc) fast_splat,
+        &data);
+
+      for (axis = 0; axis < 3; axis++)
+        {
+          gfloat *tmp;
+
+          data.blur_src  = data.grid;
+          data.blur_dst  = data.tmp;
+          data.blur_axis = axis;
+
+          gegl_parallel_distribute_range (
+            (gsize) data.grid_height * data.grid_depth,
+            pixels_per_thread / (data.grid_width * GRID_COMPONENTS),
+            (GeglParallelDistributeRangeFunc) fast_blur,
+            &data);
+
+          tmp       = data.grid;
+          data.grid = data.tmp;
+          data.tmp  = tmp;
+        }
+
+      gegl_parallel_distribute_range (
+        dst_rect->height, pixels_per_thread / dst_rect->width,
+        (GeglParallelDistributeRangeFunc) fast_slice,
+        &data);
     }
 
-  return  TRUE;
-}
+  gegl_buffer_set (dst, dst_rect, 0, format, dst_buf, GEGL_AUTO_ROWSTRIDE);
 
-static void
-bilateral_filter (GeglBuffer          *src,
-                  const GeglRectangle *src_rect,
-                  GeglBuffer          *dst,
-                  const GeglRectangle *dst_rect,
-                  gdouble              radius,
-                  gdouble              preserve,
-                  const Babl          *format)
-{
-  gfloat *gauss;
-  gint x,y;
-  gint offset;
-  gfloat *src_buf;
-  gfloat *dst_buf;
-  gint width = (gint) radius * 2 + 1;
-  gint iradius = radius;
-  gint src_width = src_rect->width;
-  gint src_height = src_rect->height;
-
-  gauss = g_newa (gfloat, width * width);
-  src_buf = g_new0 (gfloat, src_rect->width * src_rect->height * 4);
-  dst_buf = g_new0 (gfloat, dst_rect->width * dst_rect->height * 4);
-
-  gegl_buffer_get (src, src_rect, 1.0, format, src_buf, GEGL_AUTO_ROWSTRIDE,
-                   GEGL_ABYSS_NONE);
-
-  offset = 0;
-
-#define POW2(a) ((a)*(a))
-  for (y=-iradius;y<=iradius;y++)
-    for (x=-iradius;x<=iradius;x++)
-      {
-        gauss[x+(int)radius + (y+(int)radius)*width] = exp(- 0.5*(POW2(x)+POW2(y))/radius   );
-      }
-
-  for (y=0; y<dst_rect->height; y++)
-    for (x=0; x<dst_rect->width; x++)
-      {
-        gint u,v;
-        gfloat *center_pix = src_buf + ((x+iradius)+((y+iradius) * src_width)) * 4;
-        gfloat  accumulated[4]={0,0,0,0};
-        gfloat  count=0.0;
-
-        for (v=-iradius;v<=iradius;v++)
-          for (u=-iradius;u<=iradius;u++)
-            {
-              gint i,j;
-              i = x + radius + u;
-              j = y + radius + v;
-              if (i >= 0 && i < src_width &&
-                  j >= 0 && j < src_height)
-                {
-                  gint c;
-
-                  gfloat *src_pix = src_buf + (i + j * src_width) * 4;
-
-                  gfloat diff_map   = exp (- (POW2(center_pix[0] - src_pix[0])+
-                                              POW2(center_pix[1] - src_pix[1])+
-                                              POW2(center_pix[2] - src_pix[2])) * preserve
-                                          );
-                  gfloat gaussian_weight;
-                  gfloat weight;
-
-                  gaussian_weight = gauss[u+(int)radius+(v+(int)radius)*width];
-
-                  weight = diff_map * gaussian_weight;
-
-                  for (c=0;c<4;c++)
-                    {
-                      accumulated[c] += src_pix[c] * weight;
-                    }
-                  count += weight;
-                }
-            }
-
-        for (u=0; u<4;u++)
-          dst_buf[offset*4+u] = accumulated[u]/count;
-        offset++;
-      }
-  gegl_buffer_set (dst, dst_rect, 0, format, dst_buf,
-                   GEGL_AUTO_ROWSTRIDE);
+  g_free (data.grid);
+  g_free (data.tmp);
   g_free (src_buf);
   g_free (dst_buf);
 }
 
-
 static void
 gegl_op_class_init (GeglOpClass *klass)
 {
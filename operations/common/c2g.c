@@ -48,6 +48,13 @@ property_int (iterations, _("Iterations"), 10)
 property_boolean (enhance_shadows, _("Enhance Shadows"), FALSE)
     description(_("When enabled details in shadows are boosted at the expense of noise"))
 
+property_int (subsampling, _("Subsampling"), 1)
+  description(_("Compute the envelopes for one in this many pixels along "
+                "each axis only, interpolating in between; faster, at "
+                "the cost of detail"))
+  value_range (1, 16)
+  ui_range    (1, 8)
+
 /*
 property_double (rgamma, _("Radial Gamma"), 0.0, 8.0, 2.0,
                 _("Gamma applied to radial distribution"))
@@ -72,6 +79,7 @@ static void c2g (GeglOperation       *op,
                  gint                 radius,
                  gint                 samples,
                  gint                 iterations,
+                 gint                 subsampling,
                  gdouble              rgamma,
                  gint                 level)
 {
@@ -84,123 +92,79 @@ static void c2g (GeglOperation       *op,
      */
     GeglBufferIterator *i = gegl_buffer_iterator_new (dst, dst_rect, 0, babl_format_with_space ("YA float", space),
                                                       GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE, 1);
-    GeglSampler *sampler = gegl_buffer_sampler_new_at_level (src, format, GEGL_SAMPLER_NEAREST, level);
-    GeglSamplerGetFun getfun = gegl_sampler_get_fun (sampler);
+    gboolean  enhance_shadows = GEGL_PROPERTIES(op)->enhance_shadows;
+    Envelopes envelopes;
+    gfloat   *min = NULL;
+    gfloat   *max = NULL;
+    gfloat   *pixels = NULL;
+    gint      n_pixels = 0;
 #if 0
     float total_pix = dst_rect->width * dst_rect->height;
 #endif
 
+    envelopes_init (&envelopes, src, src_rect, level,
+                    radius, samples, iterations, rgamma, format);
+
     while (gegl_buffer_iterator_next (i))
     {
-      gint x,y;
-      gint    dst_offset=0;
+      gint    n;
       gfloat *dst_buf = i->items[0].data;
+      GeglRectangle roi = i->items[0].roi;
+
+      if (roi.width * roi.height > n_pixels)
+        {
+          n_pixels = roi.width * roi.height;
+          min    = g_renew (gfloat, min,    n_pixels * 4);
+          max    = g_renew (gfloat, max,    n_pixels * 4);
+          pixels = g_renew (gfloat, pixels, n_pixels * 4);
+        }
+
+      envelopes_get_area (&envelopes, &roi, subsampling,
+                          enhance_shadows ? min : NULL, max, pixels);
 
-      if (GEGL_PROPERTIES(op)->enhance_shadows)
-      {
-         GeglRectangle roi = i->items[0].roi;
-      for (y=roi.y; y < roi.y + roi.height; y++)
+      for (n = 0; n < roi.width * roi.height; n++)
         {
-          for (x=roi.x; x < roi.x + roi.width; x++)
+          gfloat *pixel = pixels + n * 4;
+
+          /* this should be replaced with a better/faster projection of
+           * pixel onto the vector spanned by min -> max, currently
+           * computed by comparing the distance to min with the sum
+           * of the distance to min/max.
+           */
+
+          gfloat nominator = 0;
+          gfloat denominator = 0;
+          gint c;
+          for (c=0; c<3; c++)
             {
-              gfloat  min[4];
-              gfloat  max[4];
-              gfloat  pixel[4];
-
-              compute_envelopes (src, sampler, getfun,
-                                 x, y,
-                                 radius, samples,
-                                 iterations,
-                                 FALSE, /* same spray */
-                                 rgamma,
-                                 min, max, pixel, format);
-              {
-                /* this should be replaced with a better/faster projection of
-                 * pixel onto the vector spanned by min -> max, currently
-                 * computed by comparing the distance to min with the sum
-                 * of the distance to min/max.
-                 */
-
-                gfloat nominator = 0;
-                gfloat denominator = 0;
-                gint c;
-                for (c=0; c<3; c++)
-                  {
-                    nominator   += (pixel[c] - min[c]) * (pixel[c] - min[c]);
-                    denominator += (pixel[c] - max[c]) * (pixel[c] - max[c]);
-                  }
-
-                nominator = sqrtf (nominator);
-                denominator = sqrtf (denominator);
-                denominator = nominator + denominator;
-
-                if (denominator>0.000)
-                  {
-                    dst_buf[dst_offset+0] = nominator/denominator;
-                  }
-                else
-                  {
-                    /* shouldn't happen */
-                    dst_buf[dst_offset+0] = 0.5;
-                  }
-                dst_buf[dst_offset+1] = pixel[3];
-                dst_offset+=2;
-              }
+              if (enhance_shadows)
+                nominator += (pixel[c] - min[n * 4 + c]) * (pixel[c] - min[n * 4 + c]);
+              else
+                nominator += pixel[c] * pixel[c];
+              denominator += (pixel[c] - max[n * 4 + c]) * (pixel[c] - max[n * 4 + c]);
             }
-          }
-      }
-      else
-      {
-         GeglRectangle roi = i->items[0].roi;
-        for (y=roi.y; y < roi.y + roi.height; y++)
-          for (x=roi.x; x < roi.x + roi.width; x++)
+
+          nominator = sqrtf (nominator);
+          denominator = sqrtf (denominator);
+          denominator = nominator + denominator;
+
+          if (denominator>0.000)
+            {
+              dst_buf[n * 2 + 0] = nominator/denominator;
+            }
+          else
             {
-              gfloat  max[4];
-              gfloat  pixel[4];
-
-              compute_envelopes (src, sampler, getfun,
-                                 x, y,
-                                 radius, samples,
-                                 iterations,
-                                 FALSE, /* same spray */
-                                 rgamma,
-                                 NULL, max, pixel, format);
-              {
-                /* this should be replaced with a better/faster projection of
-                 * pixel onto the vector spanned by min -> max, currently
-                 * computed by comparing the distance to min with the sum
-                 * of the distance to min/max.
-                 */
-
-                gfloat nominator = 0;
-                gfloat denominator = 0;
-                gint c;
-                for (c=0; c<3; c++)
-                  {
-                    nominator   += pixel[c] * pixel[c];
-                    denominator += (pixel[c] - max[c]) * (pixel[c] - max[c]);
-                  }
-
-                nominator = sqrtf (nominator);
-                denominator = sqrtf (denominator);
-                denominator = nominator + denominator;
-
-                if (denominator>0.000)
-                  {
-                    dst_buf[dst_offset+0] = nominator/denominator;
-                  }
-                else
-                  {
-                    /* shouldn't happen */
-                    dst_buf[dst_offset+0] = 0.5;
-                  }
-                dst_buf[dst_offset+1] = pixel[3];
-                dst_offset+=2;
-              }
+              /* shouldn't happen */
+              dst_buf[n * 2 + 0] = 0.5;
             }
-          }
-      }
-    g_object_unref (sampler);
+          dst_buf[n * 2 + 1] = pixel[3];
+        }
+    }
+
+    g_free (min);
+    g_free (max);
+    g_free (pixels);
+    envelopes_cleanup (&envelopes);
   }
 }
 
@@ -211,8 +175,10 @@ static void prepare (GeglOperation *operation)
   const Babl *format_ya = babl_format_with_space ("YA float", space);
 
   GeglOperationAreaFilter *area = GEGL_OPERATION_AREA_FILTER (operation);
+  /* the envelope grid of subsampling reaches further out */
   area->left = area->right = area->top = area->bottom =
-      ceil (GEGL_PROPERTIES (operation)->radius);
+      ceil (GEGL_PROPERTIES (operation)->radius) +
+      GEGL_PROPERTIES (operation)->subsampling;
 
   gegl_operation_set_format (operation, "input", format_rgba);
   gegl_operation_set_format (operation, "output", format_ya);
@@ -393,7 +359,8 @@ process (GeglOperation       *operation,
   GeglRectangle compute;
   compute = gegl_operation_get_required_for_output (operation, "input",result);
 
-  if (o->radius < 500 && gegl_operation_use_opencl (operation))
+  if (o->radius < 500 && o->subsampling == 1 &&
+      gegl_operation_use_opencl (operation))
     if(cl_process(operation, input, output, result))
       return TRUE;
 
@@ -401,6 +368,7 @@ process (GeglOperation       *operation,
        o->radius,
        o->samples,
        o->iterations,
+       o->subsampling,
        /*o->rgamma*/RGAMMA,
        level);
 
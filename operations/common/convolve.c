@@ -0,0 +1,308 @@
+/* This file is an image processing operation for GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#ifdef GEGL_PROPERTIES
+
+property_boolean (normalize, _("Normalize"), TRUE)
+    description (_("Scale the kernel so that its values add up to 1"))
+
+property_boolean (center, _("Center kernel"), TRUE)
+    description (_("Center the kernel on each pixel, instead of using its "
+                   "coordinates as offsets"))
+
+property_enum (border, _("Border"),
+               GeglAbyssPolicy, gegl_abyss_policy,
+               GEGL_ABYSS_CLAMP)
+
+#else
+
+#define GEGL_OP_COMPOSER
+#define GEGL_OP_NAME     convolve
+#define GEGL_OP_C_SOURCE convolve.c
+
+#include "gegl-op.h"
+
+/* the maximal kernel width and height; larger kernels are cropped around
+ * their center.  the blocks the convolution is computed in are at least
+ * twice as large, and take over a hundred megabytes each at this size.
+ */
+#define MAX_KERNEL_SIZE 1024
+
+static void
+prepare (GeglOperation *operation)
+{
+  const Babl *space  = gegl_operation_get_source_space (operation, "input");
+  const Babl *format = babl_format_with_space ("RaGaBaA float", space);
+
+  gegl_operation_set_format (operation, "input",  format);
+  gegl_operation_set_format (operation, "aux",    babl_format ("YaA float"));
+  gegl_operation_set_format (operation, "output", format);
+}
+
+/* computes the area of the aux buffer used as the kernel, and the offsets
+ * it corresponds to.  returns FALSE when there's no usable kernel.
+ */
+static gboolean
+get_kernel_rect (GeglOperation *operation,
+                 GeglRectangle *aux_rect,
+                 GeglRectangle *kernel_rect)
+{
+  GeglProperties *o = GEGL_PROPERTIES (operation);
+  GeglRectangle  *rect;
+
+  rect = gegl_operation_source_get_bounding_box (operation, "aux");
+
+  if (! rect                              ||
+      gegl_rectangle_is_empty (rect)      ||
+      gegl_rectangle_is_infinite_plane (rect))
+    {
+      return FALSE;
+    }
+
+  *aux_rect = *rect;
+
+  if (aux_rect->width > MAX_KERNEL_SIZE)
+    {
+      aux_rect->x     += (aux_rect->width - MAX_KERNEL_SIZE) / 2;
+      aux_rect->width  = MAX_KERNEL_SIZE;
+    }
+
+  if (aux_rect->height > MAX_KERNEL_SIZE)
+    {
+      aux_rect->y      += (aux_rect->height - MAX_KERNEL_SIZE) / 2;
+      aux_rect->height  = MAX_KERNEL_SIZE;
+    }
+
+  *kernel_rect = *aux_rect;
+
+  if (o->center)
+    {
+      kernel_rect->x = -(aux_rect->width  / 2);
+      kernel_rect->y = -(aux_rect->height / 2);
+    }
+
+  return TRUE;
+}
+
+static GeglRectangle
+get_bounding_box (GeglOperation *operation)
+{
+  GeglRectangle  result = {};
+  GeglRectangle *in_rect;
+
+  in_rect = gegl_operation_source_get_bounding_box (operation, "input");
+
+  if (in_rect)
+    result = *in_rect;
+
+  return result;
+}
+
+static GeglRectangle
+get_required_for_output (GeglOperation       *operation,
+                         const gchar         *input_pad,
+                         const GeglRectangle *roi)
+{
+  GeglRectangle aux_rect;
+  GeglRectangle kernel_rect;
+  GeglRectangle result = *roi;
+
+  if (! get_kernel_rect (operation, &aux_rect, &kernel_rect))
+    return result;
+
+  if (! strcmp (input_pad, "aux"))
+    return aux_rect;
+
+  /* output pixel p reads input pixels p - d, for each offset d */
+  result.x      -= kernel_rect.x + kernel_rect.width  - 1;
+  result.y      -= kernel_rect.y + kernel_rect.height - 1;
+  result.width  += kernel_rect.width  - 1;
+  result.height += kernel_rect.height - 1;
+
+  return result;
+}
+
+static GeglRectangle
+get_invalidated_by_change (GeglOperation       *operation,
+                           const gchar         *input_pad,
+                           const GeglRectangle *input_region)
+{
+  GeglRectangle aux_rect;
+  GeglRectangle kernel_rect;
+  GeglRectangle result = *input_region;
+
+  if (! strcmp (input_pad, "aux"))
+    return gegl_operation_get_bounding_box (operation);
+
+  if (! get_kernel_rect (operation, &aux_rect, &kernel_rect))
+    return result;
+
+  result.x      += kernel_rect.x;
+  result.y      += kernel_rect.y;
+  result.width  += kernel_rect.width  - 1;
+  result.height += kernel_rect.height - 1;
+
+  return result;
+}
+
+/* converts a rectangle to the coordinates of a mipmap level, rounding
+ * outward.
+ */
+static void
+get_level_rect (const GeglRectangle *rect,
+                gint                 level,
+                GeglRectangle       *level_rect)
+{
+  gint factor = 1 << level;
+  gint x1     = (gint) floor ((gdouble) rect->x / factor);
+  gint y1     = (gint) floor ((gdouble) rect->y / factor);
+  gint x2     = (gint) ceil ((gdouble) (rect->x + rect->width)  / factor);
+  gint y2     = (gint) ceil ((gdouble) (rect->y + rect->height) / factor);
+
+  gegl_rectangle_set (level_rect, x1, y1, x2 - x1, y2 - y1);
+}
+
+static gboolean
+process (GeglOperation       *operation,
+         GeglBuffer          *input,
+         GeglBuffer          *aux,
+         GeglBuffer          *output,
+         const GeglRectangle *result,
+         gint                 level)
+{
+  GeglProperties *o      = GEGL_PROPERTIES (operation);
+  const Babl     *format = gegl_operation_get_format (operation, "output");
+  GeglRectangle   aux_rect;
+  GeglRectangle   kernel_rect;
+  GeglRectangle   roi;
+  gfloat         *kernel;
+  gdouble         factor = 1 << level;
+  gint            n_values;
+  gint            i;
+
+  if (! input)
+    return TRUE;
+
+  if (! aux || ! get_kernel_rect (operation, &aux_rect, &kernel_rect))
+    {
+      if (input != output)
+        gegl_buffer_copy (input, result, GEGL_ABYSS_NONE, output, result);
+
+      return TRUE;
+    }
+
+  /* at reduced levels, the input pixels are averages of factor x factor
+   * pixels, so the kernel is reduced the same way, and each of its values
+   * stands for factor x factor of the original ones.
+   */
+  roi = *result;
+
+  if (level)
+    {
+      get_level_rect (result, level, &roi);
+      get_level_rect (&aux_rect, level, &aux_rect);
+
+      if (o->center)
+        {
+          kernel_rect.x = -(aux_rect.width  / 2);
+          kernel_rect.y = -(aux_rect.height / 2);
+        }
+      else
+        {
+          kernel_rect.x = aux_rect.x;
+          kernel_rect.y = aux_rect.y;
+        }
+
+      kernel_rect.width  = aux_rect.width;
+      kernel_rect.height = aux_rect.height;
+    }
+
+  n_values = aux_rect.width * aux_rect.height;
+  kernel   = g_new (gfloat, 2 * n_values);
+
+  gegl_buffer_get (aux, &aux_rect, 1.0 / factor, babl_format ("YaA float"),
+                   kernel, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  /* use the premultiplied luminance, so that transparent areas don't
+   * contribute.
+   */
+  for (i = 0; i < n_values; i++)
+    kernel[i] = kernel[2 * i] * factor * factor;
+
+  if (o->normalize)
+    {
+      gdouble sum = 0.0;
+
+      for (i = 0; i < n_values; i++)
+        sum += kernel[i];
+
+      if (fabs (sum) > 1e-6)
+        {
+          for (i = 0; i < n_values; i++)
+            kernel[i] /= sum;
+        }
+    }
+
+  /* blocks read input around their own output, so we can't process the
+   * buffer in place.
+   */
+  if (input == output)
+    input = gegl_buffer_dup (input);
+  else
+    g_object_ref (input);
+
+  gegl_buffer_convolve (input, output, &roi, format,
+                        kernel, &kernel_rect, 1,
+                        o->border, level);
+
+  g_object_unref (input);
+  g_free (kernel);
+
+  return TRUE;
+}
+
+static void
+gegl_op_class_init (GeglOpClass *klass)
+{
+  GeglOperationClass         *operation_class;
+  GeglOperationComposerClass *composer_class;
+
+  operation_class = GEGL_OPERATION_CLASS (klass);
+  composer_class  = GEGL_OPERATION_COMPOSER_CLASS (klass);
+
+  composer_class->process                    = process;
+  operation_class->prepare                   = prepare;
+  operation_class->get_bounding_box          = get_bounding_box;
+  operation_class->get_required_for_output   = get_required_for_output;
+  operation_class->get_invalidated_by_change = get_invalidated_by_change;
+  /* gegl_buffer_convolve() distributes the work itself */
+  operation_class->threaded                  = FALSE;
+
+  gegl_operation_class_set_keys (operation_class,
+    "name",        "gegl:convolve",
+    "title",       _("Convolve"),
+    "categories",  "generic:blur",
+    "description", _("Convolve the input with a kernel image connected to "
+                     "the aux pad, computed in the frequency domain so "
+                     "that large kernels, such as lens-blur shapes, "
+                     "remain fast"),
+    NULL);
+}
+
+#endif
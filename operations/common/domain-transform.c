@@ -54,7 +54,7 @@ property_double (edge_preservation, _("Edge preservation"),  0.8)
 #define RF_TABLE_SIZE 768
 #define SQRT3 1.7320508075f
 #define SQRT2 1.4142135623f
-#define BLOCK_STRIDE 1
+#define COLUMN_BUNDLE 16  /* number of adjacent columns filtered together */
 #define REPORT_PROGRESS_TIME 0.5  /* time to report gegl_operation_progress */
 
 static gint16
@@ -83,11 +83,173 @@ report_progress (GeglOperation  *operation,
     gegl_operation_progress (operation, progress, "");
 }
 
+typedef struct
+{
+  gint           width;
+  gint           height;
+  const guint8  *rgb;
+  gfloat        *image;
+  guint16       *h_transforms;
+  guint16       *v_transforms;
+  const gfloat  *rf_table;
+} DomainTransformData;
+
+static inline guint16
+channels_difference (const guint8 *current,
+                     const guint8 *last)
+{
+  /* @NOTE: 'd' should be 1.0f + s_s / s_r * sum_diff
+   * However, we will store just sum_diff.
+   * 1.0f + s_s / s_r will be calculated later when calculating
+   * the RF table. This is done this way because the sum_diff is
+   * perfect to be used as the index of the RF table.
+   * d = 1.0f + (vdt_information->spatial_factor /
+   *   vdt_information->range_factor) * sum_channels_difference;
+   */
+  return absolute ((gint16) current[0] - last[0]) +
+         absolute ((gint16) current[1] - last[1]) +
+         absolute ((gint16) current[2] - last[2]);
+}
+
+/* computes the horizontal and vertical domain transforms of the rows
+ * [offset, offset + size); they don't change between iterations.
+ */
+static void
+domain_transform_transforms (gsize                offset,
+                             gsize                size,
+                             DomainTransformData *data)
+{
+  const gint width = data->width;
+  gint       i, k;
+
+  for (i = offset; i < offset + size; ++i)
+    {
+      const guint8 *row   = data->rgb + (gsize) i * width * 3;
+      const guint8 *above = (i > 0) ? row - width * 3 : row;
+      guint16      *h     = data->h_transforms + (gsize) i * width;
+      guint16      *v     = data->v_transforms + (gsize) i * width;
+
+      h[0] = 0;
+
+      for (k = 1; k < width; ++k)
+        h[k] = channels_difference (row + k * 3, row + (k - 1) * 3);
+
+      for (k = 0; k < width; ++k)
+        v[k] = channels_difference (row + k * 3, above + k * 3);
+    }
+}
+
+/* filters the rows [offset, offset + size), left-right and then
+ * right-left.
+ */
+static void
+domain_transform_horizontal (gsize                offset,
+                             gsize                size,
+                             DomainTransformData *data)
+{
+  const gint    width    = data->width;
+  const gfloat *rf_table = data->rf_table;
+  gint          i, k, c;
+
+  for (i = offset; i < offset + size; ++i)
+    {
+      gfloat        *row        = data->image + (gsize) i * width * 4;
+      const guint16 *transforms = data->h_transforms + (gsize) i * width;
+      gfloat         lastf[4];
+
+      for (c = 0; c < 4; ++c)
+        lastf[c] = row[c];
+
+      for (k = 0; k < width; ++k)
+        {
+          const gfloat w = rf_table[transforms[k]];
+
+          for (c = 0; c < 4; ++c)
+            {
+              lastf[c] = ((1 - w) * row[k * 4 + c] + w * lastf[c]);
+              row[k * 4 + c] = lastf[c];
+            }
+        }
+
+      for (k = width - 1; k >= 0; --k)
+        {
+          const gint   d_x_position = (k < width - 1) ? k + 1 : k;
+          const gfloat w            = rf_table[transforms[d_x_position]];
+
+          for (c = 0; c < 4; ++c)
+            {
+              lastf[c] = ((1 - w) * row[k * 4 + c] + w * lastf[c]);
+              row[k * 4 + c] = lastf[c];
+            }
+        }
+    }
+}
+
+/* filters the column bundles [offset, offset + size), top-down and then
+ * bottom-up.  the columns of a bundle are adjacent in memory, so they are
+ * filtered together, one row at a time.
+ */
+static void
+domain_transform_vertical (gsize                offset,
+                           gsize                size,
+                           DomainTransformData *data)
+{
+  const gint    width    = data->width;
+  const gint    height   = data->height;
+  const gfloat *rf_table = data->rf_table;
+  gsize         bundle;
+
+  for (bundle = offset; bundle < offset + size; ++bundle)
+    {
+      const gint x0 = bundle * COLUMN_BUNDLE;
+      const gint n  = MIN (COLUMN_BUNDLE, width - x0);
+      gfloat     lastf[COLUMN_BUNDLE * 4];
+      gfloat     w[COLUMN_BUNDLE];
+      gint       k, j;
+
+      memcpy (lastf, data->image + x0 * 4, n * 4 * sizeof (gfloat));
+
+      for (k = 0; k < height; ++k)
+        {
+          gfloat        *row        = data->image +
+                                      ((gsize) k * width + x0) * 4;
+          const guint16 *transforms = data->v_transforms +
+                                      (gsize) k * width + x0;
+
+          for (j = 0; j < n; ++j)
+            w[j] = rf_table[transforms[j]];
+
+          for (j = 0; j < n * 4; ++j)
+            {
+              lastf[j] = ((1 - w[j / 4]) * row[j] + w[j / 4] * lastf[j]);
+              row[j] = lastf[j];
+            }
+        }
+
+      for (k = height - 1; k >= 0; --k)
+        {
+          const gint     d_y_position = (k < height - 1) ? k + 1 : k;
+          gfloat        *row          = data->image +
+                                        ((gsize) k * width + x0) * 4;
+          const guint16 *transforms   = data->v_transforms +
+                                        (gsize) d_y_position * width + x0;
+
+          for (j = 0; j < n; ++j)
+            w[j] = rf_table[transforms[j]];
+
+          for (j = 0; j < n * 4; ++j)
+            {
+              lastf[j] = ((1 - w[j / 4]) * row[j] + w[j / 4] * lastf[j]);
+              row[j] = lastf[j];
+            }
+        }
+    }
+}
+
 static gint
 domain_transform (GeglOperation  *operation,
                   gint            width,
                   gint            height,
-                  gint            n_chan,
                   gfloat          spatial_factor,
                   gfloat          range_factor,
                   gint            n_iterations,
@@ -97,27 +259,31 @@ domain_transform (GeglOperation  *operation,
   const Babl *space    = gegl_operation_get_source_space (operation, "input");
   const Babl *formatu8 = babl_format_with_space ("R'G'B' u8", space);
   const Babl *format   = babl_format_with_space ("R'G'B'A float", space);
+  DomainTransformData data;
   gfloat  **rf_table;
-  guint16  *transforms_buffer;
-  gfloat   *buffer;
-
-  gint16    last[3];
-  gint16    current[3];
-  gfloat    lastf[4];
-  gfloat    currentf[4];
-  gfloat    sum_channels_difference, a, w, sdt_dev;
-  gint      i, j, k, n;
-  gint      real_stride, d_x_position, d_y_position, biggest_dimension;
-  guint16   d;
+  guint8   *rgb;
+  gfloat    a, sdt_dev;
+  gdouble   pixels_per_thread;
+  gint      i, j, n;
+  gint      n_bundles;
   GeglRectangle rect;
   GTimer  *timer;
 
   timer = g_timer_new ();
 
+  rect.x      = 0;
+  rect.y      = 0;
+  rect.width  = width;
+  rect.height = height;
+
   /* PRE-ALLOC MEMORY */
-  biggest_dimension = (width > height) ? width : height;
-  buffer            = g_new (gfloat, BLOCK_STRIDE * biggest_dimension * n_chan);
-  transforms_buffer = g_new (guint16, BLOCK_STRIDE * biggest_dimension);
+  rgb                 = g_new (guint8, (gsize) width * height * 3);
+  data.image          = g_new (gfloat, (gsize) width * height * 4);
+  data.h_transforms   = g_new (guint16, (gsize) width * height);
+  data.v_transforms   = g_new (guint16, (gsize) width * height);
+  data.rgb            = rgb;
+  data.width          = width;
+  data.height         = height;
 
   rf_table = g_new (gfloat *, n_iterations);
 
@@ -148,248 +314,48 @@ domain_transform (GeglOperation  *operation,
         }
     }
 
+  pixels_per_thread = gegl_operation_get_pixels_per_thread (operation);
+  n_bundles         = (width + COLUMN_BUNDLE - 1) / COLUMN_BUNDLE;
+
+  gegl_buffer_get (input, &rect, 1.0, formatu8, rgb,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
+  gegl_buffer_get (input, &rect, 1.0, format, data.image,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
+
+  /* Domain Transform */
+  gegl_parallel_distribute_range (
+    height, pixels_per_thread / width,
+    (GeglParallelDistributeRangeFunc) domain_transform_transforms,
+    &data);
+
   /* Filter Iterations */
   for (n = 0; n < n_iterations; ++n)
     {
+      data.rf_table = rf_table[n];
+
       /* Horizontal Pass */
-      for (i = 0; i < height; i += BLOCK_STRIDE)
-        {
-          real_stride = (i + BLOCK_STRIDE > height) ? height - i : BLOCK_STRIDE;
-    
-          rect.x = 0;
-          rect.y = i;
-          rect.width = width;
-          rect.height = real_stride;
-    
-          gegl_buffer_get (input, &rect, 1.0, formatu8, buffer,
-                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
-    
-          /* Domain Transform */
-          for (j = 0; j < rect.height; ++j)
-            {
-              last[0] = ((guint8*) buffer)[j * rect.width * 3];
-              last[1] = ((guint8*) buffer)[j * rect.width * 3 + 1];
-              last[2] = ((guint8*) buffer)[j * rect.width * 3 + 2];
-      
-              for (k = 0; k < rect.width; ++k)
-                {
-                  current[0] = ((guint8*) buffer)[j * rect.width * 3 + k * 3];
-                  current[1] = ((guint8*) buffer)[j * rect.width * 3 + k * 3 + 1];
-                  current[2] = ((guint8*) buffer)[j * rect.width * 3 + k * 3 + 2];
-        
-                  sum_channels_difference = absolute (current[0] - last[0]) +
-                                            absolute (current[1] - last[1]) +
-                                            absolute (current[2] - last[2]);
-        
-                  /* @NOTE: 'd' should be 1.0f + s_s / s_r * sum_diff
-                   * However, we will store just sum_diff.
-                   * 1.0f + s_s / s_r will be calculated later when calculating
-                   * the RF table. This is done this way because the sum_diff is
-                   * perfect to be used as the index of the RF table.
-                   * d = 1.0f + (vdt_information->spatial_factor /
-                   *   vdt_information->range_factor) * sum_channels_difference;
-                   */
-                  transforms_buffer[j * rect.width + k] = sum_channels_difference;
-        
-                  last[0] = current[0];
-                  last[1] = current[1];
-                  last[2] = current[2];
-                }
-            }
-    
-          if (n == 0)
-            gegl_buffer_get (input, &rect, 1.0, format, buffer,
-                             GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
-          else
-            gegl_buffer_get (output, &rect, 1.0, format, buffer,
-                             GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
-    
-          /* Horizontal Filter (Left-Right) */
-          for (j = 0; j < rect.height; ++j)
-            {
-              lastf[0] = buffer[j * rect.width * n_chan];
-              lastf[1] = buffer[j * rect.width * n_chan + 1];
-              lastf[2] = buffer[j * rect.width * n_chan + 2];
-              lastf[3] = buffer[j * rect.width * n_chan + 3];
-      
-              for (k = 0; k < rect.width; ++k)
-                {
-                  d = transforms_buffer[j * rect.width + k];
-                  w = rf_table[n][d];
-        
-                  currentf[0] = buffer[j * rect.width * n_chan + k * n_chan];
-                  currentf[1] = buffer[j * rect.width * n_chan + k * n_chan + 1];
-                  currentf[2] = buffer[j * rect.width * n_chan + k * n_chan + 2];
-                  currentf[3] = buffer[j * rect.width * n_chan + k * n_chan + 3];
-        
-                  lastf[0] = ((1 - w) * currentf[0] + w * lastf[0]);
-                  lastf[1] = ((1 - w) * currentf[1] + w * lastf[1]);
-                  lastf[2] = ((1 - w) * currentf[2] + w * lastf[2]);
-                  lastf[3] = ((1 - w) * currentf[3] + w * lastf[3]);
-        
-                  buffer[j * rect.width * n_chan + k * n_chan]     = lastf[0];
-                  buffer[j * rect.width * n_chan + k * n_chan + 1] = lastf[1];
-                  buffer[j * rect.width * n_chan + k * n_chan + 2] = lastf[2];
-                  buffer[j * rect.width * n_chan + k * n_chan + 3] = lastf[3];
-                }
-            }
-    
-          /* Horizontal Filter (Right-Left) */
-          for (j = 0; j < rect.height; ++j)
-            {
-              lastf[0] = buffer[j * rect.width * n_chan + (rect.width - 1) * n_chan];
-              lastf[1] = buffer[j * rect.width * n_chan + (rect.width - 1) * n_chan + 1];
-              lastf[2] = buffer[j * rect.width * n_chan + (rect.width - 1) * n_chan + 2];
-              lastf[3] = buffer[j * rect.width * n_chan + (rect.width - 1) * n_chan + 3];
-              
-              for (k = rect.width - 1; k >= 0; --k)
-                {
-                  d_x_position = (k < rect.width - 1) ? k + 1 : k;
-                  d = transforms_buffer[j * rect.width + d_x_position];
-                  w = rf_table[n][d];
-        
-                  currentf[0] = buffer[j * rect.width * n_chan + k * n_chan];
-                  currentf[1] = buffer[j * rect.width * n_chan + k * n_chan + 1];
-                  currentf[2] = buffer[j * rect.width * n_chan + k * n_chan + 2];
-                  currentf[3] = buffer[j * rect.width * n_chan + k * n_chan + 3];
-        
-                  lastf[0] = ((1 - w) * currentf[0] + w * lastf[0]);
-                  lastf[1] = ((1 - w) * currentf[1] + w * lastf[1]);
-                  lastf[2] = ((1 - w) * currentf[2] + w * lastf[2]);
-                  lastf[3] = ((1 - w) * currentf[3] + w * lastf[3]);
-        
-                  buffer[j * rect.width * n_chan + k * n_chan] = lastf[0];
-                  buffer[j * rect.width * n_chan + k * n_chan + 1] = lastf[1];
-                  buffer[j * rect.width * n_chan + k * n_chan + 2] = lastf[2];
-                  buffer[j * rect.width * n_chan + k * n_chan + 3] = lastf[3];
-                }
-            }
-    
-          gegl_buffer_set (output, &rect, 0, format, buffer,
-                           GEGL_AUTO_ROWSTRIDE);
-        }
-  
+      gegl_parallel_distribute_range (
+        height, pixels_per_thread / (2 * width),
+        (GeglParallelDistributeRangeFunc) domain_transform_horizontal,
+        &data);
+
       report_progress (operation, (2.0 * n + 1.0) / (2.0 * n_iterations), timer);
-  
+
       /* Vertical Pass */
-      for (i = 0; i < width; i += BLOCK_STRIDE)
-        {
-          real_stride = (i + BLOCK_STRIDE > width) ? width - i : BLOCK_STRIDE;
-    
-          rect.x = i;
-          rect.y = 0;
-          rect.width = real_stride;
-          rect.height = height;
-    
-          gegl_buffer_get (input, &rect, 1.0, formatu8, buffer,
-                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
-    
-          /* Domain Transform */
-          for (j = 0; j < rect.width; ++j)
-            {
-              last[0] = ((guint8*) buffer)[j * 3];
-              last[1] = ((guint8*) buffer)[j * 3 + 1];
-              last[2] = ((guint8*) buffer)[j * 3 + 2];
-      
-              for (k = 0; k < rect.height; ++k)
-                {
-                  current[0] = ((guint8*) buffer)[k * rect.width * 3 + j * 3];
-                  current[1] = ((guint8*) buffer)[k * rect.width * 3 + j * 3 + 1];
-                  current[2] = ((guint8*) buffer)[k * rect.width * 3 + j * 3 + 2];
-        
-                  sum_channels_difference = absolute (current[0] - last[0]) +
-                                            absolute (current[1] - last[1]) +
-                                            absolute (current[2] - last[2]);
-        
-                  /* @NOTE: 'd' should be 1.0f + s_s / s_r * sum_diff
-                   * However, we will store just sum_diff.
-                   * 1.0f + s_s / s_r will be calculated later when calculating
-                   * the RF table. This is done this way because the sum_diff is
-                   * perfect to be used as the index of the RF table.
-                   * d = 1.0f + (vdt_information->spatial_factor /
-                   *   vdt_information->range_factor) * sum_channels_difference;
-                   */
-                  transforms_buffer[k * rect.width + j] = sum_channels_difference;
-        
-                  last[0] = current[0];
-                  last[1] = current[1];
-                  last[2] = current[2];
-                }
-            }
-    
-          gegl_buffer_get (output, &rect, 1.0, format, buffer,
-                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
-    
-          /* Vertical Filter (Top-Down) */
-          for (j = 0; j < rect.width; ++j)
-            {
-              lastf[0] = buffer[j * n_chan];
-              lastf[1] = buffer[j * n_chan + 1];
-              lastf[2] = buffer[j * n_chan + 2];
-              lastf[3] = buffer[j * n_chan + 3];
-      
-              for (k = 0; k < rect.height; ++k)
-                {
-                  d = transforms_buffer[k * rect.width + j];
-                  w = rf_table[n][d];
-                  
-                  currentf[0] = buffer[k * rect.width * n_chan + j * n_chan];
-                  currentf[1] = buffer[k * rect.width * n_chan + j * n_chan + 1];
-                  currentf[2] = buffer[k * rect.width * n_chan + j * n_chan + 2];
-                  currentf[3] = buffer[k * rect.width * n_chan + j * n_chan + 3];
-        
-                  lastf[0] = ((1 - w) * currentf[0] + w * lastf[0]);
-                  lastf[1] = ((1 - w) * currentf[1] + w * lastf[1]);
-                  lastf[2] = ((1 - w) * currentf[2] + w * lastf[2]);
-                  lastf[3] = ((1 - w) * currentf[3] + w * lastf[3]);
-        
-                  buffer[k * rect.width * n_chan + j * n_chan]     = lastf[0];
-                  buffer[k * rect.width * n_chan + j * n_chan + 1] = lastf[1];
-                  buffer[k * rect.width * n_chan + j * n_chan + 2] = lastf[2];
-                  buffer[k * rect.width * n_chan + j * n_chan + 3] = lastf[3];
-                }
-            }
-    
-          /* Vertical Filter (Bottom-Up) */
-          for (j = 0; j < rect.width; ++j)
-            {
-              lastf[0] = buffer[(rect.height - 1) * rect.width * n_chan + j * n_chan];
-              lastf[1] = buffer[(rect.height - 1) * rect.width * n_chan + j * n_chan + 1];
-              lastf[2] = buffer[(rect.height - 1) * rect.width * n_chan + j * n_chan + 2];
-              lastf[3] = buffer[(rect.height - 1) * rect.width * n_chan + j * n_chan + 3];
-              
-              for (k = rect.height - 1; k >= 0; --k)
-                {
-                  d_y_position = (k < rect.height - 1) ? k + 1 : k;
-                  d = transforms_buffer[d_y_position * rect.width + j];
-                  w = rf_table[n][d];
-        
-                  currentf[0] = buffer[k * rect.width * n_chan + j * n_chan];
-                  currentf[1] = buffer[k * rect.width * n_chan + j * n_chan + 1];
-                  currentf[2] = buffer[k * rect.width * n_chan + j * n_chan + 2];
-                  currentf[3] = buffer[k * rect.width * n_chan + j * n_chan + 3];
-        
-                  lastf[0] = ((1 - w) * currentf[0] + w * lastf[0]);
-                  lastf[1] = ((1 - w) * currentf[1] + w * lastf[1]);
-                  lastf[2] = ((1 - w) * currentf[2] + w * lastf[2]);
-                  lastf[3] = ((1 - w) * currentf[3] + w * lastf[3]);
-        
-                  buffer[k * rect.width * n_chan + j * n_chan]     = lastf[0];
-                  buffer[k * rect.width * n_chan + j * n_chan + 1] = lastf[1];
-                  buffer[k * rect.width * n_chan + j * n_chan + 2] = lastf[2];
-                  buffer[k * rect.width * n_chan + j * n_chan + 3] = lastf[3];
-                }
-            }
-    
-          gegl_buffer_set (output, &rect, 0, format, buffer,
-                           GEGL_AUTO_ROWSTRIDE);
-        }
-  
+      gegl_parallel_distribute_range (
+        n_bundles, pixels_per_thread / (2 * COLUMN_BUNDLE * height),
+        (GeglParallelDistributeRangeFunc) domain_transform_vertical,
+        &data);
+
       report_progress (operation, (2.0 * n + 2.0) / (2.0 * n_iterations), timer);
     }
 
-  g_free (transforms_buffer);
-  g_free (buffer);
+  gegl_buffer_set (output, &rect, 0, format, data.image, GEGL_AUTO_ROWSTRIDE);
+
+  g_free (data.h_transforms);
+  g_free (data.v_transforms);
+  g_free (data.image);
+  g_free (rgb);
 
   for (i = 0; i < n_iterations; ++i)
     g_free (rf_table[i]);
@@ -457,7 +423,6 @@ process (GeglOperation       *operation,
   domain_transform (operation,
                     result->width,
                     result->height,
-                    4,
                     o->spatial_factor,
                     range_factor,
                     o->n_iterations,
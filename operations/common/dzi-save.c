@@ -0,0 +1,247 @@
+/* This file is an image processing operation for GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
+
+
+#ifdef GEGL_PROPERTIES
+
+property_file_path (path, _("File"), "")
+    description (_("Path of the .dzi descriptor to write; the tiles are "
+                   "written to a directory next to it, with a _files suffix"))
+property_int (tile_size, _("Tile size"), 254)
+    description (_("Width and height of the tiles, without overlap"))
+    value_range (1, 4096)
+property_int (overlap, _("Overlap"), 1)
+    description (_("Number of pixels tiles extend into their neighbours"))
+    value_range (0, 64)
+property_string (tile_format, _("Tile format"), "png")
+    description (_("File extension of the tiles, selecting the saver used "
+                   "for them, like png, jpg or webp"))
+property_int (quality, _("Quality"), 90)
+    description (_("Quality of lossy tile formats"))
+    value_range (1, 100)
+
+#else
+
+#define GEGL_OP_SINK
+#define GEGL_OP_NAME     dzi_save
+#define GEGL_OP_C_SOURCE dzi-save.c
+
+#include "gegl-op.h"
+
+typedef struct
+{
+  const gchar *handler;
+  gboolean     has_quality;
+  gint         quality;
+  const gchar *tile_format;
+  gchar       *directory;
+  gint         n_levels;
+} DziData;
+
+/* encodes a tile with the saver of the tile format, straight from the
+ * pixels fetched from the pyramid.  a tile that wasn't written stops the
+ * walk.
+ */
+static gboolean
+save_tile (const GeglPyramidTile *tile,
+           DziData               *data)
+{
+  GeglRectangle  extent = {0, 0, tile->rect.width, tile->rect.height};
+  GeglBuffer    *buffer;
+  GeglNode      *graph;
+  GeglNode      *source;
+  GeglNode      *save;
+  GError        *error = NULL;
+  gchar         *level;
+  gchar         *name;
+  gchar         *path;
+  gboolean       success;
+
+  buffer = gegl_buffer_linear_new_from_data (tile->data, tile->format,
+                                             &extent, tile->rowstride,
+                                             NULL, NULL);
+
+  /* deep zoom numbers levels from the smallest one up */
+  level = g_strdup_printf ("%d", data->n_levels - 1 - tile->level);
+  name  = g_strdup_printf ("%d_%d.%s",
+                           tile->column, tile->row, data->tile_format);
+  path  = g_build_filename (data->directory, level, name, NULL);
+
+  graph  = gegl_node_new ();
+  source = gegl_node_new_child (graph,
+                                "operation", "gegl:buffer-source",
+                                "buffer",    buffer,
+                                NULL);
+  save   = gegl_node_new_child (graph,
+                                "operation", data->handler,
+                                "path",      path,
+                                NULL);
+
+  if (data->has_quality)
+    gegl_node_set (save, "quality", data->quality, NULL);
+
+  gegl_node_link (source, save);
+  success = gegl_node_process_save (save, &error);
+
+  if (! success)
+    {
+      g_warning ("failed to save tile: %s", error->message);
+      g_clear_error (&error);
+    }
+
+  g_object_unref (graph);
+  g_object_unref (buffer);
+  g_free (path);
+  g_free (name);
+  g_free (level);
+
+  return success;
+}
+
+static gboolean
+save_descriptor (GeglProperties      *o,
+                 const GeglRectangle *result)
+{
+  GError   *error = NULL;
+  gchar    *descriptor;
+  gboolean  success;
+
+  descriptor = g_strdup_printf (
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\"\n"
+    "       Format=\"%s\" Overlap=\"%d\" TileSize=\"%d\">\n"
+    "  <Size Width=\"%d\" Height=\"%d\"/>\n"
+    "</Image>\n",
+    o->tile_format, o->overlap, o->tile_size,
+    result->width, result->height);
+
+  success = g_file_set_contents (o->path, descriptor, -1, &error);
+
+  if (! success)
+    {
+      g_warning ("%s", error->message);
+      g_clear_error (&error);
+    }
+
+  g_free (descriptor);
+
+  return success;
+}
+
+static gboolean
+process (GeglOperation       *operation,
+         GeglBuffer          *input,
+         const GeglRectangle *result,
+         gint                 level)
+{
+  GeglProperties *o = GEGL_PROPERTIES (operation);
+  DziData         data;
+  gchar          *extension;
+  gchar          *base;
+  gboolean        success = TRUE;
+  gint            i;
+
+  if (! o->path || ! *o->path || gegl_rectangle_is_empty (result))
+    return FALSE;
+
+  extension    = g_strconcat (".", o->tile_format, NULL);
+  data.handler = gegl_operation_handlers_get_saver (extension);
+  g_free (extension);
+
+  if (! data.handler)
+    {
+      g_warning ("no saver for tile format '%s'", o->tile_format);
+      return FALSE;
+    }
+
+  data.has_quality = gegl_operation_find_property (data.handler,
+                                                   "quality") != NULL;
+  data.quality     = o->quality;
+  data.tile_format = o->tile_format;
+  data.n_levels    = gegl_buffer_pyramid_get_n_levels (result, 1);
+
+  if (g_str_has_suffix (o->path, ".dzi"))
+    base = g_strndup (o->path, strlen (o->path) - strlen (".dzi"));
+  else
+    base = g_strdup (o->path);
+
+  data.directory = g_strconcat (base, "_files", NULL);
+  g_free (base);
+
+  for (i = 0; i < data.n_levels && success; i++)
+    {
+      gchar *name = g_strdup_printf ("%d", i);
+      gchar *path = g_build_filename (data.directory, name, NULL);
+
+      if (g_mkdir_with_parents (path, 0777))
+        {
+          g_warning ("failed to create '%s'", path);
+          success = FALSE;
+        }
+
+      g_free (path);
+      g_free (name);
+    }
+
+  /* the tiles are read from the mipmap levels of the input, so that each
+   * level is downscaled from the previous one, rather than rendered again.
+   */
+  if (success)
+    success = gegl_buffer_pyramid_foreach (input, result,
+                                           0, data.n_levels,
+                                           o->tile_size, o->overlap,
+                                           gegl_buffer_get_format (input),
+                                           (GeglPyramidTileFunc) save_tile,
+                                           &data);
+
+  if (success)
+    success = save_descriptor (o, result);
+
+  g_free (data.directory);
+
+  return success;
+}
+
+static void
+gegl_op_class_init (GeglOpClass *klass)
+{
+  GeglOperationClass     *operation_class;
+  GeglOperationSinkClass *sink_class;
+
+  operation_class = GEGL_OPERATION_CLASS (klass);
+  sink_class      = GEGL_OPERATION_SINK_CLASS (klass);
+
+  sink_class->process    = process;
+  sink_class->needs_full = TRUE;
+
+  gegl_operation_class_set_keys (operation_class,
+    "name"       , "gegl:dzi-save",
+    "title",       _("Deep Zoom Saver"),
+    "categories" , "output",
+    "description", _("Writes a Deep Zoom image: a descriptor, and a "
+                     "directory per resolution level of tiles in a "
+                     "regular image format, for web viewers."),
+    NULL);
+
+  gegl_operation_handlers_register_saver (
+    ".dzi", "gegl:dzi-save");
+}
+
+#endif
@@ -218,3 +218,417 @@ static inline void compute_envelopes (GeglBuffer       *buffer,
           min_envelope[c] = pixel[c] - relative_brightness * range;
       }
 }
+
+
+/* Above this many pixels, the area sampled for a chunk is not copied into a
+ * linear cache, and we sample through the sampler instead.
+ */
+#define ENVELOPES_MAX_CACHE (2048 * 2048)
+
+/* Size of the sample offset tables, the angle and radius tables are walked
+ * in lockstep like above.
+ */
+#define ENVELOPES_N_OFFSETS ANGLE_PRIME
+
+typedef struct
+{
+  GeglBuffer        *buffer;
+  GeglSampler       *sampler;
+  GeglSamplerGetFun  getfun;
+  const Babl        *format;
+  gint               radius;
+  gint               samples;
+  gint               iterations;
+  gdouble            rgamma;
+
+  /* linear RGBA copy of the sampled area, and the (du, dv, linear offset)
+   * triplets of the spray; NULL when sampling through the sampler.
+   */
+  GeglRectangle      rect;
+  gfloat            *pixels;
+  gint              *offsets;
+} Envelopes;
+
+static void
+envelopes_init (Envelopes           *envelopes,
+                GeglBuffer          *buffer,
+                const GeglRectangle *rect,
+                gint                 level,
+                gint                 radius,
+                gint                 samples,
+                gint                 iterations,
+                gdouble              rgamma,
+                const Babl          *format)
+{
+  const GeglRectangle *extent = gegl_buffer_get_extent (buffer);
+  gdouble              scale  = 1.0 / (1 << level);
+  GeglRectangle        valid;
+
+  envelopes->buffer     = buffer;
+  envelopes->sampler    = NULL;
+  envelopes->getfun     = NULL;
+  envelopes->format     = format;
+  envelopes->radius     = radius;
+  envelopes->samples    = samples;
+  envelopes->iterations = iterations;
+  envelopes->rgamma     = rgamma;
+  envelopes->pixels     = NULL;
+  envelopes->offsets    = NULL;
+
+  compute_luts (rgamma);
+
+  valid.x      = floor (extent->x * scale);
+  valid.y      = floor (extent->y * scale);
+  valid.width  = ceil ((extent->x + extent->width)  * scale) - valid.x;
+  valid.height = ceil ((extent->y + extent->height) * scale) - valid.y;
+
+  gegl_rectangle_intersect (&envelopes->rect, rect, &valid);
+
+  if ((gint64) envelopes->rect.width * envelopes->rect.height <=
+      ENVELOPES_MAX_CACHE)
+    {
+      gint i;
+
+      envelopes->pixels = g_new (gfloat, envelopes->rect.width *
+                                         envelopes->rect.height * 4);
+      gegl_buffer_get (buffer, &envelopes->rect, scale, format,
+                       envelopes->pixels,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+      envelopes->offsets = g_new (gint, ENVELOPES_N_OFFSETS * 3);
+      for (i = 0; i < ENVELOPES_N_OFFSETS; i++)
+        {
+          gfloat rmag = radiuses[i % RADIUS_PRIME] * radius;
+          gint   du   = floorf (rmag * lut_cos[i % ANGLE_PRIME] + 0.5f);
+          gint   dv   = floorf (rmag * lut_sin[i % ANGLE_PRIME] + 0.5f);
+
+          envelopes->offsets[i * 3 + 0] = du;
+          envelopes->offsets[i * 3 + 1] = dv;
+          envelopes->offsets[i * 3 + 2] = (du + dv * envelopes->rect.width) * 4;
+        }
+    }
+  else
+    {
+      envelopes->sampler = gegl_buffer_sampler_new_at_level (buffer, format,
+                                                             GEGL_SAMPLER_NEAREST,
+                                                             level);
+      envelopes->getfun  = gegl_sampler_get_fun (envelopes->sampler);
+    }
+}
+
+static void
+envelopes_cleanup (Envelopes *envelopes)
+{
+  g_clear_object (&envelopes->sampler);
+  g_clear_pointer (&envelopes->pixels, g_free);
+  g_clear_pointer (&envelopes->offsets, g_free);
+}
+
+static inline const gfloat *
+envelopes_cached_pixel (const Envelopes *envelopes,
+                        gint             x,
+                        gint             y)
+{
+  return envelopes->pixels +
+         ((y - envelopes->rect.y) * envelopes->rect.width +
+          (x - envelopes->rect.x)) * 4;
+}
+
+static inline void
+envelopes_get_pixel (const Envelopes *envelopes,
+                     gint             x,
+                     gint             y,
+                     gfloat          *pixel)
+{
+  if (envelopes->pixels)
+    memcpy (pixel, envelopes_cached_pixel (envelopes, x, y),
+            4 * sizeof (gfloat));
+  else
+    envelopes->getfun (envelopes->sampler, x, y, NULL, pixel,
+                       GEGL_ABYSS_CLAMP);
+}
+
+/* same as sample_min_max(), gathering the samples from the linear cache.
+ * the spray is walked from a position derived from the pixel coordinates,
+ * rather than from the global counters, so that results don't depend on
+ * the order in which pixels are processed.
+ */
+static inline void
+envelopes_sample_min_max (const Envelopes *envelopes,
+                          gint             x,
+                          gint             y,
+                          gint            *offset_no,
+                          const gfloat    *center,
+                          gfloat          *min,
+                          gfloat          *max)
+{
+  const GeglRectangle *rect    = &envelopes->rect;
+  const gint          *offsets = envelopes->offsets;
+  gint                 radius  = envelopes->radius;
+  gint                 samples = envelopes->samples;
+  gboolean             inside;
+  gfloat               best_min[4];
+  gfloat               best_max[4];
+  gint                 i, c;
+
+  /* pixels whose whole spray lies within the cache don't need their
+   * samples to be checked
+   */
+  inside = x - radius >= rect->x && x + radius < rect->x + rect->width &&
+           y - radius >= rect->y && y + radius < rect->y + rect->height;
+
+  for (c = 0; c < 4; c++)
+    {
+      best_min[c] = center[c];
+      best_max[c] = center[c];
+    }
+
+  for (i = 0; i < samples; i++)
+    {
+      const gint   *offset;
+      const gfloat *sample;
+      gint          max_retries = samples;
+
+retry:
+      if (++*offset_no == ENVELOPES_N_OFFSETS)
+        *offset_no = 0;
+
+      offset = offsets + *offset_no * 3;
+
+      if (! inside)
+        {
+          gint u = x + offset[0];
+          gint v = y + offset[1];
+
+          if (u <  rect->x                 ||
+              u >= rect->x + rect->width   ||
+              v <  rect->y                 ||
+              v >= rect->y + rect->height)
+            {
+              goto retry;
+            }
+        }
+
+      sample = center + offset[2];
+
+      if (sample[3] > 0.0) /* ignore fully transparent pixels */
+        {
+          for (c = 0; c < 4; c++)
+            {
+              best_min[c] = MIN (best_min[c], sample[c]);
+              best_max[c] = MAX (best_max[c], sample[c]);
+            }
+        }
+      else
+        {
+          max_retries--;
+          if (max_retries > 0)
+            goto retry;
+        }
+    }
+
+  for (c = 0; c < 3; c++)
+    {
+      min[c] = best_min[c];
+      max[c] = best_max[c];
+    }
+}
+
+/* computes the envelopes of a single pixel, like compute_envelopes() */
+static void
+envelopes_get (const Envelopes *envelopes,
+               gint             x,
+               gint             y,
+               gfloat          *min_envelope,
+               gfloat          *max_envelope,
+               gfloat          *pixel)
+{
+  const gfloat *center;
+  gfloat        range_sum[3]               = {0,0,0};
+  gfloat        relative_brightness_sum[3] = {0,0,0};
+  gint          offset_no;
+  gint          i, c;
+
+  if (! envelopes->pixels)
+    {
+      compute_envelopes (envelopes->buffer, envelopes->sampler,
+                         envelopes->getfun,
+                         x, y,
+                         envelopes->radius, envelopes->samples,
+                         envelopes->iterations,
+                         FALSE, /* same spray */
+                         envelopes->rgamma,
+                         min_envelope, max_envelope, pixel,
+                         envelopes->format);
+      return;
+    }
+
+  center = envelopes_cached_pixel (envelopes, x, y);
+  memcpy (pixel, center, 4 * sizeof (gfloat));
+
+  offset_no = ((guint) x * 73856093u ^ (guint) y * 19349663u) %
+              ENVELOPES_N_OFFSETS;
+
+  for (i = 0; i < envelopes->iterations; i++)
+    {
+      gfloat min[3], max[3];
+
+      envelopes_sample_min_max (envelopes, x, y, &offset_no, center,
+                                min, max);
+
+      for (c = 0; c < 3; c++)
+        {
+          gfloat range = max[c] - min[c];
+
+          if (range > 0.0)
+            relative_brightness_sum[c] += (pixel[c] - min[c]) / range;
+          else
+            relative_brightness_sum[c] += 0.5;
+
+          range_sum[c] += range;
+        }
+    }
+
+  for (c = 0; c < 3; c++)
+    {
+      gfloat relative_brightness = relative_brightness_sum[c] /
+                                   envelopes->iterations;
+      gfloat range               = range_sum[c] / envelopes->iterations;
+
+      if (max_envelope)
+        max_envelope[c] = pixel[c] + (1.0 - relative_brightness) * range;
+      if (min_envelope)
+        min_envelope[c] = pixel[c] - relative_brightness * range;
+    }
+}
+
+static inline gint
+envelopes_floor_div (gint a,
+                     gint b)
+{
+  return a >= 0 ? a / b : -((b - 1 - a) / b);
+}
+
+/* computes the envelopes and pixel values of all pixels in ROI, stored as
+ * 4 floats per pixel.  with a SUBSAMPLING above 1, the envelopes are only
+ * computed on a grid of pixels SUBSAMPLING apart, aligned to the origin so
+ * that results don't depend on how the output is divided into chunks, and
+ * bilinearly interpolated in between.  the grid reaches up to
+ * SUBSAMPLING - 1 pixels outside of ROI, which must be covered by the area
+ * the envelopes were initialized with.
+ */
+static void
+envelopes_get_area (const Envelopes     *envelopes,
+                    const GeglRectangle *roi,
+                    gint                 subsampling,
+                    gfloat              *min_envelope,
+                    gfloat              *max_envelope,
+                    gfloat              *pixel)
+{
+  const GeglRectangle *rect = &envelopes->rect;
+  gint                 grid_x0, grid_y0;
+  gint                 n_cols, n_rows;
+  gint                *grid_x, *grid_y;
+  gfloat              *grid_min, *grid_max;
+  gint                 x, y, i, j, c;
+
+  if (subsampling <= 1)
+    {
+      for (y = 0; y < roi->height; y++)
+        for (x = 0; x < roi->width; x++)
+          {
+            gint offset = (y * roi->width + x) * 4;
+
+            envelopes_get (envelopes, roi->x + x, roi->y + y,
+                           min_envelope ? min_envelope + offset : NULL,
+                           max_envelope ? max_envelope + offset : NULL,
+                           pixel + offset);
+          }
+
+      return;
+    }
+
+  grid_x0 = envelopes_floor_div (roi->x, subsampling);
+  grid_y0 = envelopes_floor_div (roi->y, subsampling);
+  n_cols  = envelopes_floor_div (roi->x + roi->width  - 1, subsampling) -
+            grid_x0 + 2;
+  n_rows  = envelopes_floor_div (roi->y + roi->height - 1, subsampling) -
+            grid_y0 + 2;
+
+  grid_x   = g_new (gint, n_cols);
+  grid_y   = g_new (gint, n_rows);
+  grid_min = g_new (gfloat, n_cols * n_rows * 4);
+  grid_max = g_new (gfloat, n_cols * n_rows * 4);
+
+  /* grid points outside the image are moved onto its edge */
+  for (i = 0; i < n_cols; i++)
+    grid_x[i] = CLAMP ((grid_x0 + i) * subsampling,
+                       rect->x, rect->x + rect->width - 1);
+  for (j = 0; j < n_rows; j++)
+    grid_y[j] = CLAMP ((grid_y0 + j) * subsampling,
+                       rect->y, rect->y + rect->height - 1);
+
+  for (j = 0; j < n_rows; j++)
+    for (i = 0; i < n_cols; i++)
+      {
+        gfloat grid_pixel[4];
+
+        envelopes_get (envelopes, grid_x[i], grid_y[j],
+                       grid_min + (j * n_cols + i) * 4,
+                       grid_max + (j * n_cols + i) * 4,
+                       grid_pixel);
+      }
+
+  for (y = 0; y < roi->height; y++)
+    {
+      gint   j0 = envelopes_floor_div (roi->y + y, subsampling) - grid_y0;
+      gfloat ty = 0.0;
+
+      if (grid_y[j0 + 1] > grid_y[j0])
+        ty = (gfloat) (roi->y + y - grid_y[j0]) /
+                      (grid_y[j0 + 1] - grid_y[j0]);
+      ty = CLAMP (ty, 0.0, 1.0);
+
+      for (x = 0; x < roi->width; x++)
+        {
+          gint          i0     = envelopes_floor_div (roi->x + x, subsampling) -
+                                 grid_x0;
+          gint          offset = (y * roi->width + x) * 4;
+          const gfloat *min00  = grid_min + (j0 * n_cols + i0) * 4;
+          const gfloat *max00  = grid_max + (j0 * n_cols + i0) * 4;
+          gfloat        tx     = 0.0;
+
+          if (grid_x[i0 + 1] > grid_x[i0])
+            tx = (gfloat) (roi->x + x - grid_x[i0]) /
+                          (grid_x[i0 + 1] - grid_x[i0]);
+          tx = CLAMP (tx, 0.0, 1.0);
+
+          envelopes_get_pixel (envelopes, roi->x + x, roi->y + y,
+                               pixel + offset);
+
+          for (c = 0; c < 3; c++)
+            {
+              gfloat p   = pixel[offset + c];
+              gfloat min = (1.0f - ty) * ((1.0f - tx) * min00[c] +
+                                          tx * min00[4 + c]) +
+                                   ty  * ((1.0f - tx) * min00[n_cols * 4 + c] +
+                                          tx * min00[n_cols * 4 + 4 + c]);
+              gfloat max = (1.0f - ty) * ((1.0f - tx) * max00[c] +
+                                          tx * max00[4 + c]) +
+                                   ty  * ((1.0f - tx) * max00[n_cols * 4 + c] +
+                                          tx * max00[n_cols * 4 + 4 + c]);
+
+              /* the envelopes of a pixel always enclose it */
+              if (min_envelope)
+                min_envelope[offset + c] = MIN (min, p);
+              if (max_envelope)
+                max_envelope[offset + c] = MAX (max, p);
+            }
+        }
+    }
+
+  g_free (grid_x);
+  g_free (grid_y);
+  g_free (grid_min);
+  g_free (grid_max);
+}
@@ -88,6 +88,17 @@ static const gint   MINIMUM_PYRAMID = 32;
 /* precision */
 #define EPS 1.0e-12
 
+/* cost of using an additional thread, relative to processing a single
+ * array element
+ */
+#define THREAD_COST (64 * 64 * 4)
+
+/* number of array elements in each partial sum of a dot product.  the
+ * partial sums are computed in parallel and added up in order, so the
+ * result doesn't depend on the number of threads.
+ */
+#define DOT_BLOCK_SIZE 4096
+
 static void
 linbcg (guint   rows,
         guint   cols,
@@ -141,28 +152,40 @@ fattal02_copy_array (const gfloat *input,
  * Full Multigrid Algorithm for solving partial differential equations
  */
 
+typedef struct
+{
+  const gfloat        *input;
+  const GeglRectangle *extent_i;
+  gfloat              *output;
+  const GeglRectangle *extent_o;
+} ResampleData;
+
+
 static void
-fattal02_restrict (const gfloat        *input,
-                   const GeglRectangle *extent_i,
-                   gfloat              *output,
-                   const GeglRectangle *extent_o)
+fattal02_restrict_range (gsize         offset,
+                         gsize         size,
+                         ResampleData *data)
 {
-  const guint inRows = extent_i->height,
-              inCols = extent_i->width;
+  const gfloat *input  = data->input;
+  gfloat       *output = data->output;
+
+  const guint inRows = data->extent_i->height,
+              inCols = data->extent_i->width;
 
-  const guint outRows = extent_o->height,
-              outCols = extent_o->width;
+  const guint outCols = data->extent_o->width;
 
   const gfloat dx = (gfloat)inCols / (gfloat)outCols,
-               dy = (gfloat)inRows / (gfloat)outRows;
+               dy = (gfloat)inRows / (gfloat)data->extent_o->height;
 
   const gfloat filterSize = 0.5;
 
-  gfloat sx, sy;
+  gfloat sx;
   guint   x,  y;
 
-  for (y = 0, sy = dy / 2 - 0.5; y < outRows; ++y, sy += dy)
+  for (y = offset; y < offset + size; ++y)
     {
+      const gfloat sy = dy / 2 - 0.5 + y * dy;
+
       for (x = 0, sx = dx / 2 - 0.5; x < outCols; ++x, sx += dx )
         {
           gfloat pixVal = 0;
@@ -189,27 +212,47 @@ fattal02_restrict (const gfloat        *input,
 
 
 static void
-fattal02_prolongate (const gfloat        *input,
-                     const GeglRectangle *extent_i,
-                     gfloat              *output,
-                     const GeglRectangle *extent_o)
+fattal02_restrict (const gfloat        *input,
+                   const GeglRectangle *extent_i,
+                   gfloat              *output,
+                   const GeglRectangle *extent_o)
 {
+  ResampleData data = { input, extent_i, output, extent_o };
+
+  gegl_parallel_distribute_range (
+    extent_o->height, (gdouble) THREAD_COST / extent_o->width,
+    (GeglParallelDistributeRangeFunc) fattal02_restrict_range,
+    &data);
+}
+
+
+static void
+fattal02_prolongate_range (gsize         offset,
+                           gsize         size,
+                           ResampleData *data)
+{
+  const GeglRectangle *extent_i = data->extent_i;
+  const GeglRectangle *extent_o = data->extent_o;
+  const gfloat        *input    = data->input;
+  gfloat              *output   = data->output;
+
   gfloat dx = (gfloat)extent_i->width  / (gfloat)extent_o->width,
          dy = (gfloat)extent_i->height / (gfloat)extent_o->height;
 
-  const guint outRows = extent_o->height,
-              outCols = extent_o->width;
+  const guint outCols = extent_o->width;
 
   const gfloat inRows = extent_i->height,
                inCols = extent_i->width;
 
   const float filterSize = 1;
 
-  gfloat sx, sy;
+  gfloat sx;
   guint   x,  y;
 
-  for (y = 0, sy = -dy / 2; y < outRows; ++y, sy += dy)
+  for (y = offset; y < offset + size; ++y)
     {
+      const gfloat sy = -dy / 2 + y * dy;
+
       for (x = 0, sx = -dx / 2; x < outCols; ++x, sx += dx )
         {
           gfloat pixVal = 0;
@@ -241,6 +284,21 @@ fattal02_prolongate (const gfloat        *input,
 }
 
 
+static void
+fattal02_prolongate (const gfloat        *input,
+                     const GeglRectangle *extent_i,
+                     gfloat              *output,
+                     const GeglRectangle *extent_o)
+{
+  ResampleData data = { input, extent_i, output, extent_o };
+
+  gegl_parallel_distribute_range (
+    extent_o->height, (gdouble) THREAD_COST / extent_o->width,
+    (GeglParallelDistributeRangeFunc) fattal02_prolongate_range,
+    &data);
+}
+
+
 static void
 fattal02_exact_solution (gfloat              *F,
                          const GeglRectangle *extent_f,
@@ -276,19 +334,34 @@ fattal02_smooth (gfloat              *U,
 }
 
 
+typedef struct
+{
+  gfloat              *D;
+  const GeglRectangle *extent_d;
+  const gfloat        *U;
+  const GeglRectangle *extent_u;
+  const gfloat        *F;
+  const GeglRectangle *extent_f;
+} DefectData;
+
+
 static void
-fattal02_calculate_defect (gfloat              *D,
-                           const GeglRectangle *extent_d,
-                           gfloat              *U,
-                           const GeglRectangle *extent_u,
-                           gfloat              *F,
-                           const GeglRectangle *extent_f)
+fattal02_calculate_defect_range (gsize       offset,
+                                 gsize       size,
+                                 DefectData *data)
 {
+  gfloat              *D        = data->D;
+  const gfloat        *U        = data->U;
+  const gfloat        *F        = data->F;
+  const GeglRectangle *extent_d = data->extent_d;
+  const GeglRectangle *extent_u = data->extent_u;
+  const GeglRectangle *extent_f = data->extent_f;
+
   guint sx = extent_f->width,
         sy = extent_f->height;
   guint x, y;
 
-  for (y = 0; y < sy; ++y)
+  for (y = offset; y < offset + size; ++y)
     {
       for (x = 0; x < sx; ++x)
         {
@@ -309,6 +382,23 @@ fattal02_calculate_defect (gfloat              *D,
 }
 
 
+static void
+fattal02_calculate_defect (gfloat              *D,
+                           const GeglRectangle *extent_d,
+                           gfloat              *U,
+                           const GeglRectangle *extent_u,
+                           gfloat              *F,
+                           const GeglRectangle *extent_f)
+{
+  DefectData data = { D, extent_d, U, extent_u, F, extent_f };
+
+  gegl_parallel_distribute_range (
+    extent_f->height, (gdouble) THREAD_COST / extent_f->width,
+    (GeglParallelDistributeRangeFunc) fattal02_calculate_defect_range,
+    &data);
+}
+
+
 static void
 fattal02_solve_pde_multigrid (gfloat              *F,
                               const GeglRectangle *extent_f,
@@ -475,16 +565,85 @@ fattal02_solve_pde_multigrid (gfloat              *F,
 }
 
 
+typedef struct
+{
+  const gfloat *b;
+  gfloat       *x;
+} AsolveData;
+
+static void
+asolve_range (gsize       offset,
+              gsize       size,
+              AsolveData *data)
+{
+  const gfloat *b = data->b + offset;
+  gfloat       *x = data->x + offset;
+  gsize         i;
+
+  for (i = 0; i < size; ++i)
+    x[i] = -4 * b[i];
+}
+
 static void
 asolve (gulong n,
         gfloat b[],
         gfloat x[],
         gint   itrnsp)
 {
-  guint i;
+  AsolveData data = { b, x };
 
-  for (i = 0; i < n; ++i)
-    x[i] = -4 * b[i];
+  gegl_parallel_distribute_range (
+    n, THREAD_COST,
+    (GeglParallelDistributeRangeFunc) asolve_range,
+    &data);
+}
+
+typedef struct
+{
+  guint         rows;
+  guint         cols;
+  const gfloat *x;
+  gfloat       *res;
+} AtimesData;
+
+static void
+atimes_range (gsize       offset,
+              gsize       size,
+              AtimesData *data)
+{
+  const guint rows = data->rows,
+              cols = data->cols;
+  guint       r, c;
+
+  for (r = offset; r < offset + size; ++r)
+    {
+      const gfloat *x   = data->x   + (gsize) r * cols;
+      gfloat       *res = data->res + (gsize) r * cols;
+
+      if (r > 0 && r < rows - 1)
+        {
+          const gfloat *n = x - cols,
+                       *s = x + cols;
+
+          for (c = 1; c < cols - 1; ++c)
+            res[c] = n[c] + s[c] + x[c - 1] + x[c + 1] - 4 * x[c];
+
+          res[0]        = n[0] + s[0] + x[1] - 3 * x[0];
+          res[cols - 1] = n[cols - 1] + s[cols - 1] + x[cols - 2] -
+                          3 * x[cols - 1];
+        }
+      else
+        {
+          /* the first and last rows only have one vertical neighbour */
+          const gfloat *v = (r == 0 ? x + cols : x - cols);
+
+          for (c = 1; c < cols - 1; ++c)
+            res[c] = v[c] + x[c - 1] + x[c + 1] - 3 * x[c];
+
+          res[0]        = v[0] + x[1] - 2 * x[0];
+          res[cols - 1] = v[cols - 1] + x[cols - 2] - 2 * x[cols - 1];
+        }
+    }
 }
 
 static void
@@ -494,57 +653,64 @@ atimes (guint  rows,
         gfloat res[],
         gint   itrnsp)
 {
-  guint r, c;
+  AtimesData data = { rows, cols, x, res };
 
-#define IDX(R,C) ((R) * cols + (C))
+  gegl_parallel_distribute_range (
+    rows, (gdouble) THREAD_COST / cols,
+    (GeglParallelDistributeRangeFunc) atimes_range,
+    &data);
+}
 
-  for (r = 1; r < rows - 1; ++r)
-    {
-      for (c = 1; c < cols - 1; ++c)
-        {
-          res[IDX (r,c)] = x[IDX (r-1,c)] + x[IDX (r+1,c)] +
-            x[IDX (r,c-1)] + x[IDX (r,c+1)] - 4*x[IDX (r,c)];
-        }
-    }
+typedef struct
+{
+  gsize         n;
+  const gfloat *a;
+  const gfloat *b;
+  gdouble      *partial;
+} DotData;
 
-  for (r = 1; r < rows - 1; ++r)
-    {
-      res[IDX (r, 0)] =     x[IDX (r - 1, 0)] +
-                            x[IDX (r + 1, 0)] +
-                            x[IDX (r    , 1)] -
-                        3 * x[IDX (r    , 0)];
-
-      res[IDX (r, cols - 1)] =     x[IDX (r - 1, cols - 1)] +
-                                   x[IDX (r + 1, cols - 1)] +
-                                   x[IDX (r    , cols - 2)] -
-                               3 * x[IDX (r    , cols - 1)];
-    }
+static void
+fattal02_dot_range (gsize    offset,
+                    gsize    size,
+                    DotData *data)
+{
+  gsize block;
 
-  for (c = 1; c < cols - 1; ++c)
+  for (block = offset; block < offset + size; ++block)
     {
-      res[IDX (0, c)] =     x[IDX (1, c    )] +
-                            x[IDX (0, c - 1)] +
-                            x[IDX (0, c + 1)] -
-                        3 * x[IDX (0, c     )];
-
-      res[IDX (rows - 1, c)] =     x[IDX (rows - 2, c    )] +
-                                   x[IDX (rows - 1, c - 1)] +
-                                   x[IDX (rows - 1, c + 1)] -
-                               3 * x[IDX (rows - 1, c    )];
+      const gsize start = block * DOT_BLOCK_SIZE;
+      const gsize end   = MIN (start + DOT_BLOCK_SIZE, data->n);
+      gdouble     sum   = 0.0;
+      gsize       i;
+
+      for (i = start; i < end; ++i)
+        sum += data->a[i] * data->b[i];
+
+      data->partial[block] = sum;
     }
+}
+
+static gfloat
+fattal02_dot (gsize         n,
+              const gfloat *a,
+              const gfloat *b)
+{
+  const gsize n_blocks = (n + DOT_BLOCK_SIZE - 1) / DOT_BLOCK_SIZE;
+  DotData     data     = { n, a, b, g_new (gdouble, n_blocks) };
+  gdouble     sum      = 0.0;
+  gsize       block;
+
+  gegl_parallel_distribute_range (
+    n_blocks, (gdouble) THREAD_COST / DOT_BLOCK_SIZE,
+    (GeglParallelDistributeRangeFunc) fattal02_dot_range,
+    &data);
+
+  for (block = 0; block < n_blocks; ++block)
+    sum += data.partial[block];
+
+  g_free (data.partial);
 
-  res[IDX (0       ,        0)] =     x[IDX (1       ,        0)] +
-                                      x[IDX (0       ,        1)] -
-                                  2 * x[IDX (0       ,        0)];
-  res[IDX (rows - 1,        0)] =     x[IDX (rows - 2,        0)] +
-                                      x[IDX (rows - 1,        1)] -
-                                  2 * x[IDX (rows - 1,        0)];
-  res[IDX (0       , cols - 1)] =     x[IDX (1       , cols - 1)] +
-                                      x[IDX (0       , cols - 2)] -
-                                  2 * x[IDX (0       , cols - 1)];
-  res[IDX (rows - 1, cols - 1)] =     x[IDX (rows - 2, cols - 1)] +
-                                      x[IDX (rows - 1, cols - 2)] -
-                                  2 * x[IDX (rows - 1, cols - 1)];
+  return sum;
 }
 
 static gfloat
@@ -556,10 +722,7 @@ snrm (gulong n,
 
   if (itol <= 3)
     {
-      gfloat ans = 0.0;
-      for (i = 0; i < n; ++i)
-          ans += sx[i] * sx[i];
-      return sqrtf (ans);
+      return sqrtf (fattal02_dot (n, sx, sx));
     }
   else
     {
@@ -572,9 +735,85 @@ snrm (gulong n,
 }
 
 
+typedef struct
+{
+  const gfloat *b;
+  gfloat       *x;
+  gfloat       *p;
+  gfloat       *pp;
+  gfloat       *r;
+  gfloat       *rr;
+  const gfloat *z;
+  const gfloat *zz;
+  gfloat        ak;
+  gfloat        bk;
+} LinbcgData;
+
+/* r = b - r, rr = r */
+static void
+linbcg_residual_range (gsize       offset,
+                       gsize       size,
+                       LinbcgData *data)
+{
+  gsize j;
+
+  for (j = offset; j < offset + size; ++j)
+    {
+       data->r[j] = data->b[j] - data->r[j];
+      data->rr[j] = data->r[j];
+    }
+}
+
+/* p = bk * p + z, pp = bk * pp + zz */
+static void
+linbcg_direction_range (gsize       offset,
+                        gsize       size,
+                        LinbcgData *data)
+{
+  const gfloat  bk = data->bk;
+  gfloat       *p  = data->p  + offset;
+  gfloat       *pp = data->pp + offset;
+  const gfloat *z  = data->z  + offset;
+  const gfloat *zz = data->zz + offset;
+  gsize         j;
+
+  for (j = 0; j < size; ++j)
+    {
+       p[j] = bk *  p[j] +  z[j];
+      pp[j] = bk * pp[j] + zz[j];
+    }
+}
+
+/* x += ak * p, r -= ak * z, rr -= ak * zz */
+static void
+linbcg_update_range (gsize       offset,
+                     gsize       size,
+                     LinbcgData *data)
+{
+  const gfloat  ak = data->ak;
+  gfloat       *x  = data->x  + offset;
+  gfloat       *r  = data->r  + offset;
+  gfloat       *rr = data->rr + offset;
+  const gfloat *p  = data->p  + offset;
+  const gfloat *z  = data->z  + offset;
+  const gfloat *zz = data->zz + offset;
+  gsize         j;
+
+  for (j = 0; j < size; ++j)
+    {
+       x[j] += ak *  p[j];
+       r[j] -= ak *  z[j];
+      rr[j] -= ak * zz[j];
+    }
+}
+
+
 /**
  * Biconjugate Gradient Method
  * from Numerical Recipes in C
+ *
+ * The vector operations and the dot products are distributed over the
+ * available threads.
  */
 static void
 linbcg (guint   rows,
@@ -589,9 +828,9 @@ linbcg (guint   rows,
 {
   guint  n = rows * cols;
 
-  gulong j;
   gfloat ak,akden,bk,bkden,bknum,bnrm,dxnrm,xnrm,zm1nrm,znrm;
   gfloat *p,*pp,*r,*rr,*z,*zz;
+  LinbcgData data;
 
   /* To remove warning about potetial uninitialized use */
   bkden = 1;
@@ -603,13 +842,21 @@ linbcg (guint   rows,
   z  = g_new (gfloat, n);
   zz = g_new (gfloat, n);
 
+  data.b  = b;
+  data.x  = x;
+  data.p  = p;
+  data.pp = pp;
+  data.r  = r;
+  data.rr = rr;
+  data.z  = z;
+  data.zz = zz;
+
   *iter=0;
   atimes (rows, cols, x, r, 0);
-  for (j = 0; j < n; ++j)
-    {
-       r[j] = b[j] - r[j];
-      rr[j] = r[j];
-    }
+  gegl_parallel_distribute_range (
+    n, THREAD_COST,
+    (GeglParallelDistributeRangeFunc) linbcg_residual_range,
+    &data);
 
   atimes (rows, cols, r, rr, 0);       /* minimum residual */
   znrm = 1.0;
@@ -643,47 +890,37 @@ linbcg (guint   rows,
 
       zm1nrm = znrm;
       asolve (n, rr, zz, 1);
-      for (bknum = 0.0, j = 0; j < n; ++j)
-        {
-          bknum += z[j] * rr[j];
-        }
+      bknum = fattal02_dot (n, z, rr);
 
       if (*iter == 1)
         {
-          for (j = 0; j < n; ++j)
-            {
-               p[j] =  z[j];
-              pp[j] = zz[j];
-            }
+          fattal02_copy_array (z,  n, p);
+          fattal02_copy_array (zz, n, pp);
         }
       else
         {
           bk = bknum / bkden;
 
-          for (j = 0; j < n; ++j)
-            {
-               p[j] = bk *  p[j] +  z[j];
-              pp[j] = bk * pp[j] + zz[j];
-            }
+          data.bk = bk;
+          gegl_parallel_distribute_range (
+            n, THREAD_COST,
+            (GeglParallelDistributeRangeFunc) linbcg_direction_range,
+            &data);
         }
 
       bkden = bknum;
       atimes (rows, cols, p, z, 0);
 
-      for (akden = 0.0, j = 0; j < n; ++j)
-        {
-          akden += z[j] * pp[j];
-        }
+      akden = fattal02_dot (n, z, pp);
 
       ak = bknum / akden;
       atimes (rows, cols, pp, zz, 1);
 
-      for (j = 0; j < n; ++j)
-        {
-           x[j] += ak *  p[j];
-           r[j] -= ak *  z[j];
-          rr[j] -= ak * zz[j];
-        }
+      data.ak = ak;
+      gegl_parallel_distribute_range (
+        n, THREAD_COST,
+        (GeglParallelDistributeRangeFunc) linbcg_update_range,
+        &data);
 
       asolve (n, r, z, 0);
 
@@ -1078,6 +1078,14 @@ gegl_gblur_1d_prepare (GeglOperation *operation)
 
   gegl_operation_set_format (operation, "input", babl_format_with_space (format, space));
   gegl_operation_set_format (operation, "output", babl_format_with_space (format, space));
+
+  /* the output is written a full row or column at a time, tiles elongated
+   * along the blur direction make each line touch fewer tiles
+   */
+  if (o->orientation == GEGL_ORIENTATION_HORIZONTAL)
+    gegl_operation_set_tile_size (operation, 256, 32);
+  else
+    gegl_operation_set_tile_size (operation, 32, 256);
 }
 
 static GeglRectangle
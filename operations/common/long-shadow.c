@@ -96,6 +96,7 @@ property_enum (composition, _("Composition"),
 #define GEGL_OP_C_SOURCE long-shadow.c
 
 #include "gegl-op.h"
+#include "gegl-config.h"
 
 /* virtual screen resolution, as a factor of the image resolution.  must be an
  * integer.
@@ -103,6 +104,11 @@ property_enum (composition, _("Composition"),
 #define SCREEN_RESOLUTION 16
 #define EPSILON           1e-6
 
+/* minimal number of rows per band, when processing infinite and fading
+ * shadows in parallel.
+ */
+#define MIN_BAND_HEIGHT   32
+
 #define SWAP(type, x, y) \
   G_STMT_START           \
     {                    \
@@ -577,21 +583,8 @@ init_fade (Context *ctx)
 }
 
 static void
-init_area (Context             *ctx,
-           GeglOperation       *operation,
-           const GeglRectangle *roi)
+update_area (Context *ctx)
 {
-  GeglRectangle *input_bounds;
-
-  input_bounds = gegl_operation_source_get_bounding_box (operation, "input");
-
-  if (input_bounds)
-    transform_rect_to_filter (ctx, input_bounds, &ctx->input_bounds, TRUE);
-  else
-    ctx->input_bounds = *GEGL_RECTANGLE (0, 0, 0, 0);
-
-  transform_rect_to_filter (ctx, roi, &ctx->roi, TRUE);
-
   get_affecting_screen_range (ctx,
                               ctx->roi.x, 0,
                               ctx->roi.y + ctx->roi.height - 1,
@@ -628,6 +621,25 @@ init_area (Context             *ctx,
     }
 }
 
+static void
+init_area (Context             *ctx,
+           GeglOperation       *operation,
+           const GeglRectangle *roi)
+{
+  GeglRectangle *input_bounds;
+
+  input_bounds = gegl_operation_source_get_bounding_box (operation, "input");
+
+  if (input_bounds)
+    transform_rect_to_filter (ctx, input_bounds, &ctx->input_bounds, TRUE);
+  else
+    ctx->input_bounds = *GEGL_RECTANGLE (0, 0, 0, 0);
+
+  transform_rect_to_filter (ctx, roi, &ctx->roi, TRUE);
+
+  update_area (ctx);
+}
+
 static void
 init_screen (Context *ctx)
 {
@@ -1502,6 +1514,216 @@ get_cached_region (GeglOperation       *operation,
     return get_bounding_box (operation);
 }
 
+static void
+process_rows (Context  *ctx,
+              gint      fy0,
+              gint      fy1,
+              gboolean  write_output)
+{
+  gint fx, fy;
+
+  for (fy = fy0; fy < fy1; fy++)
+    {
+      const gfloat *input_pixel;
+      gfloat       *output_pixel;
+      gint          u;
+
+      init_row (ctx, fy);
+
+      get_row (ctx, fy);
+
+      trim_shadow (ctx, fy);
+
+      input_pixel  = ctx->input_row0 +
+                     (ctx->row_fx0 - ctx->area.x) * ctx->row_step;
+      output_pixel = ctx->output_row0;
+
+      u = ctx->row_u0;
+
+      for (fx = ctx->row_fx0; fx < ctx->row_fx1; fx++)
+        {
+          add_shadow_at (ctx, u, fy, input_pixel[3]);
+
+          if (write_output && fy >= ctx->roi.y && fx >= ctx->roi.x)
+            {
+              set_output_pixel (ctx,
+                                input_pixel, output_pixel,
+                                get_shadow_at (ctx, u, fy));
+
+              output_pixel += ctx->row_step;
+            }
+
+          u += SCREEN_RESOLUTION;
+
+          input_pixel += ctx->row_step;
+        }
+
+      if (write_output && fy >= ctx->roi.y)
+        set_row (ctx, fy);
+    }
+}
+
+typedef struct
+{
+  const Context  *ctx;
+  GeglBuffer     *input;
+  GeglBuffer     *output;
+
+  gint            n_bands;
+  gint            band_height;
+  gfloat        **screens;
+} ThreadData;
+
+/* finite shadows: the output is split into strips along the filter-space
+ * x-axis.  each strip only depends on the input area above it, as given by
+ * update_area(), so the strips can be processed independently.
+ */
+static void
+process_strips_range (gsize             offset,
+                      gsize             size,
+                      const ThreadData *data)
+{
+  Context ctx = *data->ctx;
+
+  ctx.roi.x     += offset;
+  ctx.roi.width  = size;
+
+  update_area  (&ctx);
+  init_screen  (&ctx);
+  init_buffers (&ctx, data->input, data->output);
+
+  process_rows (&ctx, ctx.area.y, ctx.area.y + ctx.area.height, TRUE);
+
+  cleanup_buffers (&ctx);
+  cleanup_screen  (&ctx);
+}
+
+/* infinite and fading shadows: the rows are split into bands.  the screen
+ * state at the end of a band is the maximum of the band's own contribution,
+ * starting from an empty screen, and the (faded) state at the start of the
+ * band, so we first compute the contribution of each band in parallel, then
+ * combine them into the starting state of each band, and finally render the
+ * bands in parallel.
+ */
+static void
+get_band_rows (const ThreadData *data,
+               gint              band,
+               gint             *fy0,
+               gint             *fy1)
+{
+  const Context *ctx = data->ctx;
+
+  *fy0 = ctx->area.y + band * data->band_height;
+  *fy1 = MIN (*fy0 + data->band_height, ctx->area.y + ctx->area.height);
+}
+
+static void
+accumulate_bands_range (gsize             offset,
+                        gsize             size,
+                        const ThreadData *data)
+{
+  gint band;
+
+  for (band = offset; band < (gint) (offset + size); band++)
+    {
+      Context ctx = *data->ctx;
+      gint    fy0, fy1;
+
+      get_band_rows (data, band, &fy0, &fy1);
+
+      init_screen  (&ctx);
+      init_buffers (&ctx, data->input, data->output);
+
+      process_rows (&ctx, fy0, fy1, FALSE);
+
+      cleanup_buffers (&ctx);
+
+      data->screens[band] = ctx.screen;
+    }
+}
+
+static void
+combine_bands_range (gsize             offset,
+                     gsize             size,
+                     const ThreadData *data)
+{
+  const Context *ctx = data->ctx;
+  gint           u;
+
+  for (u = ctx->u0 + offset; u < ctx->u0 + (gint) (offset + size); u++)
+    {
+      gfloat value = 0.0f;
+      gint   band;
+
+      for (band = 0; band < data->n_bands - 1; band++)
+        {
+          gfloat band_value = data->screens[band][u];
+
+          data->screens[band][u] = value;
+
+          if (ctx->variant == VARIANT_FADING)
+            {
+              gint fy0, fy1;
+              gint fy;
+
+              get_band_rows (data, band, &fy0, &fy1);
+
+              for (fy = fy0; fy < fy1 && value; fy++)
+                {
+                  value *= ctx->fade_rate;
+
+                  if (value <= EPSILON)
+                    value = 0.0f;
+                }
+            }
+
+          value = MAX (value, band_value);
+        }
+
+      data->screens[data->n_bands - 1][u] = value;
+    }
+}
+
+static void
+render_bands_range (gsize             offset,
+                    gsize             size,
+                    const ThreadData *data)
+{
+  gint band;
+
+  for (band = offset; band < (gint) (offset + size); band++)
+    {
+      Context       ctx    = *data->ctx;
+      const gfloat *screen = data->screens[band];
+      gint          fy0, fy1;
+      gint          u;
+
+      get_band_rows (data, band, &fy0, &fy1);
+
+      ctx.pixel_size = sizeof (gfloat);
+      ctx.screen     = data->screens[band];
+
+      ctx.active_u0  = ctx.u1;
+      ctx.active_u1  = ctx.u0;
+
+      for (u = ctx.u0; u < ctx.u1; u++)
+        {
+          if (screen[u])
+            {
+              ctx.active_u0 = MIN (ctx.active_u0, u);
+              ctx.active_u1 = u + 1;
+            }
+        }
+
+      init_buffers (&ctx, data->input, data->output);
+
+      process_rows (&ctx, fy0, fy1, TRUE);
+
+      cleanup_buffers (&ctx);
+      cleanup_screen  (&ctx);
+    }
+}
+
 static gboolean
 process (GeglOperation       *operation,
          GeglBuffer          *input,
@@ -1511,60 +1733,85 @@ process (GeglOperation       *operation,
 {
   GeglProperties *o = GEGL_PROPERTIES (operation);
   Context         ctx;
-  gint            fx, fy;
+  ThreadData      data;
+  gboolean        threaded;
 
   init_options  (&ctx, o, level);
   init_geometry (&ctx);
   init_fade     (&ctx);
   init_area     (&ctx, operation, roi);
-  init_screen   (&ctx);
-  init_buffers  (&ctx, input, output);
 
-  for (fy = ctx.area.y; fy < ctx.area.y + ctx.area.height; fy++)
-    {
-      const gfloat *input_pixel;
-      gfloat       *output_pixel;
-      gint          u;
+  data.ctx    = &ctx;
+  data.input  = input;
+  data.output = output;
 
-      init_row (&ctx, fy);
+  threaded = gegl_config_threads () > 1 &&
+             (gdouble) ctx.roi.width * (gdouble) ctx.roi.height >=
+             2 * gegl_operation_get_pixels_per_thread (operation);
 
-      get_row (&ctx, fy);
+  if (threaded && ctx.is_finite)
+    {
+      /* the strips read input pixels outside of their own output, so we
+       * can't let them process the buffer in place.
+       */
+      if (input == output)
+        data.input = gegl_buffer_dup (input);
+
+      gegl_parallel_distribute_range (
+        ctx.roi.width,
+        gegl_operation_get_pixels_per_thread (operation) / ctx.area.height,
+        (GeglParallelDistributeRangeFunc) process_strips_range,
+        &data);
+
+      if (data.input != input)
+        g_object_unref (data.input);
+    }
+  else if (threaded && ctx.area.height >= 2 * MIN_BAND_HEIGHT)
+    {
+      Context last_band_ctx = ctx;
 
-      trim_shadow (&ctx, fy);
+      data.n_bands     = MIN (gegl_config_threads (),
+                              ctx.area.height / MIN_BAND_HEIGHT);
+      data.band_height = (ctx.area.height + data.n_bands - 1) / data.n_bands;
+      data.n_bands     = (ctx.area.height + data.band_height - 1) /
+                         data.band_height;
 
-      input_pixel  = ctx.input_row0 +
-                     (ctx.row_fx0 - ctx.area.x) * ctx.row_step;
-      output_pixel = ctx.output_row0;
+      data.screens = g_new (gfloat *, data.n_bands);
 
-      u = ctx.row_u0;
+      init_screen (&last_band_ctx);
+      data.screens[data.n_bands - 1] = last_band_ctx.screen;
 
-      for (fx = ctx.row_fx0; fx < ctx.row_fx1; fx++)
-        {
-          add_shadow_at (&ctx, u, fy, input_pixel[3]);
+      gegl_parallel_distribute_range (
+        data.n_bands - 1, 1,
+        (GeglParallelDistributeRangeFunc) accumulate_bands_range,
+        &data);
 
-          if (fy >= ctx.roi.y && fx >= ctx.roi.x)
-            {
-              set_output_pixel (&ctx,
-                                input_pixel, output_pixel,
-                                get_shadow_at (&ctx, u, fy));
+      gegl_parallel_distribute_range (
+        ctx.u1 - ctx.u0,
+        gegl_operation_get_pixels_per_thread (operation) / ctx.area.height,
+        (GeglParallelDistributeRangeFunc) combine_bands_range,
+        &data);
 
-              output_pixel += ctx.row_step;
-            }
+      gegl_parallel_distribute_range (
+        data.n_bands, 1,
+        (GeglParallelDistributeRangeFunc) render_bands_range,
+        &data);
 
-          u += SCREEN_RESOLUTION;
+      g_free (data.screens);
+    }
+  else
+    {
+      init_screen  (&ctx);
+      init_buffers (&ctx, input, output);
 
-          input_pixel += ctx.row_step;
-        }
+      process_rows (&ctx, ctx.area.y, ctx.area.y + ctx.area.height, TRUE);
 
-      if (fy >= ctx.roi.y)
-        set_row (&ctx, fy);
+      cleanup_buffers (&ctx);
+      cleanup_screen  (&ctx);
     }
 
   o->user_data = ctx.options.user_data;
 
-  cleanup_buffers (&ctx);
-  cleanup_screen  (&ctx);
-
   return TRUE;
 }
 
@@ -1632,9 +1879,8 @@ gegl_op_class_init (GeglOpClass *klass)
   operation_class->get_cached_region         = get_cached_region;
   operation_class->process                   = operation_process;
 
-  /* FIXME:  we want 'threaded == TRUE' for finite shadows, and
-   * 'threaded == FALSE' for infinite and fading shadows.  right now, there's
-   * no way to control this dynamically, so we settle for the latter.
+  /* process() distributes the work itself, since finite shadows and
+   * infinite/fading shadows have to be split differently.
    */
   operation_class->threaded                  = FALSE;
   operation_class->want_in_place             = TRUE;
@@ -77,6 +77,59 @@ typedef struct pyramid_s {
 #define PYRAMID_MIN_PIXELS 3
 #define LOOKUP_W_TO_R 107
 
+/* the solver kernels below are distributed with gegl_parallel; THREAD_COST
+ * is the cost of an extra thread measured in matrix elements.
+ */
+#define THREAD_COST (64 * 64 * 4)
+
+/* dot products are summed in blocks of this many elements, in a fixed
+ * order, so that they are reproducible regardless of the thread count.
+ */
+#define DOT_BLOCK_SIZE 4096
+
+typedef struct
+{
+  const gfloat *x;
+  gfloat       *y;
+  gfloat        alpha;
+  gfloat        beta;
+} VectorData;
+
+typedef struct
+{
+  gsize         n;
+  const gfloat *a;
+  const gfloat *b;
+  gdouble      *partial;
+} DotData;
+
+typedef struct
+{
+  gint          in_cols;
+  gint          in_rows;
+  gint          out_cols;
+  gint          out_rows;
+  const gfloat *in;
+  gfloat       *out;
+} ResampleData;
+
+typedef struct
+{
+  gint          cols;
+  gint          rows;
+  const gfloat *lum;
+  gfloat       *Gx;
+  gfloat       *Gy;
+} GradientData;
+
+typedef struct
+{
+  gint          cols;
+  const gfloat *Gx;
+  const gfloat *Gy;
+  gfloat       *divG;
+} DivergenceData;
+
 typedef int (*pfstmo_progress_callback)(int progress);
 
 
@@ -98,6 +151,11 @@ static void        mantiuk06_matrix_copy                      (const guint
 static void        mantiuk06_matrix_subtract                  (const guint                      n,
                                                                const gfloat *const              a,
                                                                gfloat *const                    b);
+static void        mantiuk06_matrix_scale_add                 (const guint                      n,
+                                                               const gfloat                     alpha,
+                                                               const gfloat *const              x,
+                                                               const gfloat                     beta,
+                                                               gfloat       *const              y);
 static void        mantiuk06_matrix_multiply_const            (const guint                      n,
                                                                gfloat       *const              a,
                                                                const gfloat                     val);
@@ -230,14 +288,17 @@ static gfloat R_table[] =
  * cols and rows are the dimmensions of the output matrix
  */
 static void
-mantiuk06_matrix_upsample (const gint          outCols,
-                           const gint          outRows,
-                           const gfloat *const in,
-                           gfloat       *const out)
+mantiuk06_matrix_upsample_range (gsize         offset,
+                                 gsize         size,
+                                 ResampleData *data)
 {
-  const int inRows = outRows/2;
-  const int inCols = outCols/2;
-  gint      x, y;
+  const gint          outCols = data->out_cols;
+  const gint          outRows = data->out_rows;
+  const gint          inRows  = data->in_rows;
+  const gint          inCols  = data->in_cols;
+  const gfloat *const in      = data->in;
+  gfloat       *const out     = data->out;
+  gint                x, y;
 
   /* Transpose of experimental downsampling matrix (theoretically the
    * correct thing to do)
@@ -253,8 +314,7 @@ mantiuk06_matrix_upsample (const gint          outCols,
                                          * best.
                                          */
 
-  _OMP (omp parallel for schedule(static))
-  for (y = 0; y < outRows; y++)
+  for (y = offset; y < offset + size; y++)
     {
       const gfloat sy  = y * dy;
       const gint   iy1 =      (  y   * inRows) / outRows;
@@ -275,17 +335,34 @@ mantiuk06_matrix_upsample (const gint          outCols,
     }
 }
 
+static void
+mantiuk06_matrix_upsample (const gint          outCols,
+                           const gint          outRows,
+                           const gfloat *const in,
+                           gfloat       *const out)
+{
+  ResampleData data = { outCols / 2, outRows / 2, outCols, outRows, in, out };
+
+  gegl_parallel_distribute_range (
+    outRows, (gdouble) THREAD_COST / outCols,
+    (GeglParallelDistributeRangeFunc) mantiuk06_matrix_upsample_range,
+    &data);
+}
+
 
 /* downsample the matrix */
 static void
-mantiuk06_matrix_downsample (const gint          inCols,
-                             const gint          inRows,
-                             const gfloat *const data,
-                             gfloat       *const res)
+mantiuk06_matrix_downsample_range (gsize         offset,
+                                   gsize         size,
+                                   ResampleData *rdata)
 {
-  const int outRows = inRows / 2;
-  const int outCols = inCols / 2;
-  gint      x, y, i, j;
+  const gint          inCols  = rdata->in_cols;
+  const gint          inRows  = rdata->in_rows;
+  const gint          outRows = rdata->out_rows;
+  const gint          outCols = rdata->out_cols;
+  const gfloat *const data    = rdata->in;
+  gfloat       *const res     = rdata->out;
+  gint                x, y, i, j;
 
   const gfloat dx = (gfloat)inCols / ((gfloat)outCols);
   const gfloat dy = (gfloat)inRows / ((gfloat)outRows);
@@ -308,8 +385,7 @@ mantiuk06_matrix_downsample (const gint          inCols,
    */
 
   const gfloat normalize = 1.0f/(dx*dy);
-  _OMP (omp parallel for schedule(static))
-  for (y = 0; y < outRows; y++)
+  for (y = offset; y < offset + size; y++)
     {
       const gint   iy1 = (  y   * inRows) / outRows;
       const gint   iy2 = ((y+1) * inRows) / outRows;
@@ -372,6 +448,33 @@ mantiuk06_matrix_downsample (const gint          inCols,
     }
 }
 
+static void
+mantiuk06_matrix_downsample (const gint          inCols,
+                             const gint          inRows,
+                             const gfloat *const data,
+                             gfloat       *const res)
+{
+  ResampleData rdata = { inCols, inRows, inCols / 2, inRows / 2, data, res };
+
+  gegl_parallel_distribute_range (
+    inRows / 2, (gdouble) THREAD_COST / inCols,
+    (GeglParallelDistributeRangeFunc) mantiuk06_matrix_downsample_range,
+    &rdata);
+}
+
+
+static void
+mantiuk06_matrix_subtract_range (gsize       offset,
+                                 gsize       size,
+                                 VectorData *data)
+{
+  const gfloat *const a = data->x + offset;
+  gfloat       *const b = data->y + offset;
+  gsize               i;
+
+  for (i = 0; i < size; i++)
+    b[i] = a[i] - b[i];
+}
 
 /* return = a - b */
 static inline void
@@ -379,11 +482,43 @@ mantiuk06_matrix_subtract (const guint         n,
                            const gfloat *const a,
                            gfloat       *const b)
 {
-  guint i;
+  VectorData data = { a, b, 0.0f, 0.0f };
 
-  _OMP (omp parallel for schedule(static))
-  for (i = 0; i < n; i++)
-    b[i] = a[i] - b[i];
+  gegl_parallel_distribute_range (
+    n, THREAD_COST,
+    (GeglParallelDistributeRangeFunc) mantiuk06_matrix_subtract_range,
+    &data);
+}
+
+static void
+mantiuk06_matrix_scale_add_range (gsize       offset,
+                                  gsize       size,
+                                  VectorData *data)
+{
+  const gfloat        alpha = data->alpha;
+  const gfloat        beta  = data->beta;
+  const gfloat *const x     = data->x + offset;
+  gfloat       *const y     = data->y + offset;
+  gsize               i;
+
+  for (i = 0; i < size; i++)
+    y[i] = alpha * x[i] + beta * y[i];
+}
+
+/* y = alpha * x + beta * y */
+static inline void
+mantiuk06_matrix_scale_add (const guint         n,
+                            const gfloat        alpha,
+                            const gfloat *const x,
+                            const gfloat        beta,
+                            gfloat       *const y)
+{
+  VectorData data = { x, y, alpha, beta };
+
+  gegl_parallel_distribute_range (
+    n, THREAD_COST,
+    (GeglParallelDistributeRangeFunc) mantiuk06_matrix_scale_add_range,
+    &data);
 }
 
 /* copy matix a to b, return = a  */
@@ -433,18 +568,47 @@ mantiuk06_matrix_free (gfloat *m)
   g_free (m);
 }
 
+static void
+mantiuk06_matrix_dot_product_range (gsize    offset,
+                                    gsize    size,
+                                    DotData *data)
+{
+  gsize block;
+
+  for (block = offset; block < offset + size; block++)
+    {
+      const gsize start = block * DOT_BLOCK_SIZE;
+      const gsize end   = MIN (start + DOT_BLOCK_SIZE, data->n);
+      gdouble     val   = 0.0;
+      gsize       j;
+
+      for (j = start; j < end; j++)
+        val += data->a[j] * data->b[j];
+
+      data->partial[block] = val;
+    }
+}
+
 /* multiply vector by vector (each vector should have one dimension equal to 1) */
 static inline gfloat
 mantiuk06_matrix_dot_product (const guint         n,
                               const gfloat *const a,
                               const gfloat *const b)
 {
-  gfloat val = 0;
-  guint j;
+  const gsize n_blocks = (n + DOT_BLOCK_SIZE - 1) / DOT_BLOCK_SIZE;
+  DotData     data     = { n, a, b, g_new (gdouble, n_blocks) };
+  gdouble     val      = 0.0;
+  gsize       block;
 
-  _OMP (omp parallel for reduction(+:val) schedule(static))
-  for (j = 0; j < n; j++)
-    val += a[j] * b[j];
+  gegl_parallel_distribute_range (
+    n_blocks, (gdouble) THREAD_COST / DOT_BLOCK_SIZE,
+    (GeglParallelDistributeRangeFunc) mantiuk06_matrix_dot_product_range,
+    &data);
+
+  for (block = 0; block < n_blocks; block++)
+    val += data.partial[block];
+
+  g_free (data.partial);
 
   return val;
 }
@@ -460,17 +624,18 @@ mantiuk06_matrix_zero (guint   n,
 /* calculate divergence of two gradient maps (Gx and Gy)
  * divG(x,y) = Gx(x,y) - Gx(x-1,y) + Gy(x,y) - Gy(x,y-1)
  */
-static inline void
-mantiuk06_calculate_and_add_divergence (const gint          cols,
-                                        const gint          rows,
-                                        const gfloat *const Gx,
-                                        const gfloat *const Gy,
-                                        gfloat       *const divG)
+static void
+mantiuk06_calculate_and_add_divergence_range (gsize           offset,
+                                              gsize           size,
+                                              DivergenceData *data)
 {
-  gint ky, kx;
+  const gint          cols = data->cols;
+  const gfloat *const Gx   = data->Gx;
+  const gfloat *const Gy   = data->Gy;
+  gfloat       *const divG = data->divG;
+  gint                ky, kx;
 
-  _OMP (omp parallel for schedule(static))
-  for (ky = 0; ky < rows; ky++)
+  for (ky = offset; ky < offset + size; ky++)
     {
       for (kx = 0; kx<cols; kx++)
         {
@@ -492,6 +657,22 @@ mantiuk06_calculate_and_add_divergence (const gint          cols,
     }
 }
 
+static inline void
+mantiuk06_calculate_and_add_divergence (const gint          cols,
+                                        const gint          rows,
+                                        const gfloat *const Gx,
+                                        const gfloat *const Gy,
+                                        gfloat       *const divG)
+{
+  DivergenceData data = { cols, Gx, Gy, divG };
+
+  gegl_parallel_distribute_range (
+    rows, (gdouble) THREAD_COST / cols,
+    (GeglParallelDistributeRangeFunc)
+      mantiuk06_calculate_and_add_divergence_range,
+    &data);
+}
+
 /* calculate the sum of divergences for the all pyramid level. the smaller
  * divergence map is upsamled and added to the divergence map for the higher
  * level of pyramid.
@@ -611,15 +792,30 @@ mantiuk06_pyramid_calculate_scale_factor (pyramid_t *pyramid,
 /* Scale gradient (Gx and Gy) by C (Cx and Cy)
  * G = G / C
  */
+static void
+mantiuk06_scale_gradient_range (gsize       offset,
+                                gsize       size,
+                                VectorData *data)
+{
+  const gfloat *const C = data->x + offset;
+  gfloat       *const G = data->y + offset;
+  gsize               i;
+
+  for (i = 0; i < size; i++)
+    G[i] *= C[i];
+}
+
 static inline void
 mantiuk06_scale_gradient (const gint          n,
                           gfloat       *const G,
                           const gfloat *const C)
 {
-  gint i;
-  _OMP (omp parallel for schedule(static))
-  for (i = 0; i < n; i++)
-    G[i] *= C[i];
+  VectorData data = { C, G, 0.0f, 0.0f };
+
+  gegl_parallel_distribute_range (
+    n, THREAD_COST,
+    (GeglParallelDistributeRangeFunc) mantiuk06_scale_gradient_range,
+    &data);
 }
 
 /* scale gradients for the whole one pyramid with the use of (Cx,Cy) from the
@@ -697,17 +893,19 @@ mantiuk06_pyramid_allocate (int cols,
 
 
 /* calculate gradients */
-static inline void
-mantiuk06_calculate_gradient (const gint          cols,
-                              const gint          rows,
-                              const gfloat *const lum,
-                              gfloat       *const Gx,
-                              gfloat       *const Gy)
+static void
+mantiuk06_calculate_gradient_range (gsize         offset,
+                                    gsize         size,
+                                    GradientData *data)
 {
-  gint ky, kx;
-
-  _OMP (omp parallel for schedule(static))
-  for (ky = 0; ky < rows; ky++)
+  const gint          cols = data->cols;
+  const gint          rows = data->rows;
+  const gfloat *const lum  = data->lum;
+  gfloat       *const Gx   = data->Gx;
+  gfloat       *const Gy   = data->Gy;
+  gint                ky, kx;
+
+  for (ky = offset; ky < offset + size; ky++)
     {
       for (kx = 0; kx < cols; kx++)
         {
@@ -726,6 +924,21 @@ mantiuk06_calculate_gradient (const gint          cols,
     }
 }
 
+static inline void
+mantiuk06_calculate_gradient (const gint          cols,
+                              const gint          rows,
+                              const gfloat *const lum,
+                              gfloat       *const Gx,
+                              gfloat       *const Gy)
+{
+  GradientData data = { cols, rows, lum, Gx, Gy };
+
+  gegl_parallel_distribute_range (
+    rows, (gdouble) THREAD_COST / cols,
+    (GeglParallelDistributeRangeFunc) mantiuk06_calculate_gradient_range,
+    &data);
+}
+
 
 /* calculate gradients for the pyramid
  * lum_temp gets overwritten!
@@ -770,17 +983,31 @@ mantiuk06_pyramid_calculate_gradient (pyramid_t *pyramid,
 }
 
 
+static void
+mantiuk06_solveX_range (gsize       offset,
+                        gsize       size,
+                        VectorData *data)
+{
+  const gfloat *const b = data->x + offset;
+  gfloat       *const x = data->y + offset;
+  gsize               i;
+
+  for (i = 0; i < size; i++)
+    x[i] = -0.25f * b[i];
+}
+
 /* x = -0.25 * b */
 static inline void
 mantiuk06_solveX (const gint          n,
                   const gfloat *const b,
                   gfloat       *const x)
 {
-  gint i;
+  VectorData data = { b, x, 0.0f, 0.0f };
 
-  _OMP (omp parallel for schedule(static))
-  for (i = 0; i < n; i++)
-    x[i] = -0.25f * b[i];
+  gegl_parallel_distribute_range (
+    n, THREAD_COST,
+    (GeglParallelDistributeRangeFunc) mantiuk06_solveX_range,
+    &data);
 }
 
 /* divG_sum = A * x = sum (divG (x))
@@ -848,7 +1075,6 @@ mantiuk06_linbcg (pyramid_t           *pyramid,
 
   for (; iter < itmax; iter++)
     {
-      guint i;
       gfloat bknum, ak, old_err2;
 
       if (progress_cb != NULL)
@@ -869,12 +1095,8 @@ mantiuk06_linbcg (pyramid_t           *pyramid,
         {
           const gfloat bk = bknum / bkden; /* beta = ...  */
 
-          _OMP (omp parallel for schedule(static))
-          for (i = 0; i < n; i++)
-            {
-              p[i]  =  z[i] + bk *  p[i];
-              pp[i] = zz[i] + bk * pp[i];
-            }
+          mantiuk06_matrix_scale_add (n, 1.0f,  z, bk,  p); /*  p =  z + bk *  p */
+          mantiuk06_matrix_scale_add (n, 1.0f, zz, bk, pp); /* pp = zz + bk * pp */
         }
 
       bkden = bknum; /* numerator becomes the dominator for the next iteration */
@@ -884,12 +1106,8 @@ mantiuk06_linbcg (pyramid_t           *pyramid,
 
       ak = bknum / mantiuk06_matrix_dot_product (n, z, pp); /* alfa = ...   */
 
-      _OMP (omp parallel for schedule(static))
-      for (i = 0 ; i < n ; i++ )
-        {
-          r[i]  -= ak *  z[i];  /*  r =  r - alfa *  z  */
-          rr[i] -= ak * zz[i];  /* rr = rr - alfa * zz  */
-        }
+      mantiuk06_matrix_scale_add (n, -ak,  z, 1.0f,  r); /*  r =  r - alfa *  z */
+      mantiuk06_matrix_scale_add (n, -ak, zz, 1.0f, rr); /* rr = rr - alfa * zz */
 
       old_err2 = err2;
       err2 = mantiuk06_matrix_dot_product (n, r, r);
@@ -911,9 +1129,7 @@ mantiuk06_linbcg (pyramid_t           *pyramid,
           num_backwards = 0;
         }
 
-      _OMP (omp parallel for schedule(static))
-      for (i = 0 ; i < n ; i++ )
-        x[i] += ak * p[i];      /* x =  x + alfa * p */
+      mantiuk06_matrix_scale_add (n, ak, p, 1.0f, x); /* x = x + alfa * p */
 
       if (num_backwards > num_backwards_ceiling)
         {
@@ -1021,7 +1237,6 @@ mantiuk06_lincg (pyramid_t           *pyramid,
   percent_sf = 100.0f / logf (tol2 * bnrm2 / irdotr);
   for (; iter < itmax; iter++)
     {
-      gint  i;
       gfloat alpha, old_rdotr;
 
       if (progress_cb != NULL) {
@@ -1037,9 +1252,7 @@ mantiuk06_lincg (pyramid_t           *pyramid,
       alpha = rdotr / mantiuk06_matrix_dot_product (n, p, Ap);
 
       /* r = r - alpha Ap */
-      _OMP (omp parallel for schedule(static))
-      for (i = 0; i < n; i++)
-        r[i] -= alpha * Ap[i];
+      mantiuk06_matrix_scale_add (n, -alpha, Ap, 1.0f, r);
 
       /* rdotr = r.r */
       old_rdotr = rdotr;
@@ -1063,9 +1276,7 @@ mantiuk06_lincg (pyramid_t           *pyramid,
         }
 
       /* x = x + alpha p */
-      _OMP (omp parallel for schedule(static))
-      for (i = 0; i < n; i++)
-        x[i] += alpha * p[i];
+      mantiuk06_matrix_scale_add (n, alpha, p, 1.0f, x);
 
 
       /* Exit if we're done */
@@ -1096,9 +1307,7 @@ mantiuk06_lincg (pyramid_t           *pyramid,
           /* p = r + beta p */
           const gfloat beta = rdotr/old_rdotr;
 
-          _OMP (omp parallel for schedule(static))
-          for (i = 0; i < n; i++)
-            p[i] = r[i] + beta*p[i];
+          mantiuk06_matrix_scale_add (n, 1.0f, r, beta, p);
         }
     }
 
@@ -72,6 +72,13 @@ property_boolean (high_precision, _("High precision"), FALSE)
 #define MAX_CHUNK_WIDTH  128
 #define MAX_CHUNK_HEIGHT 128
 
+/* column histograms (see process_column_histograms()) are used for square
+ * neighborhoods, with quantized values, starting at this radius.
+ */
+#define MIN_COLUMN_HISTOGRAM_RADIUS 8
+#define N_COARSE_BINS               16
+#define N_FINE_BINS                 (DEFAULT_N_BINS / N_COARSE_BINS)
+
 #define SAFE_CLAMP(x, min, max) ((x) > (min) ? (x) < (max) ? (x) : (max) : (min))
 
 static gfloat        default_bin_values[DEFAULT_N_BINS];
@@ -108,6 +115,13 @@ typedef struct
   gint                n_color_components;
 } Histogram;
 
+typedef struct
+{
+  gint coarse[N_COARSE_BINS];
+  gint fine[DEFAULT_N_BINS];
+  gint fine_x[N_COARSE_BINS];
+} KernelHistogram;
+
 typedef enum
 {
   LEFT_TO_RIGHT,
@@ -433,6 +447,300 @@ histogram_update (Histogram                  *hist,
     }
 }
 
+/* Perreault and Hebert's constant-time median filter, for square
+ * neighborhoods and DEFAULT_N_BINS quantized values.  we keep a
+ * two-level (coarse/fine) histogram for each column of the source, covering
+ * the rows of the current window, and a kernel histogram which is the sum of
+ * the 2 * radius + 1 column histograms of the current window.  moving the
+ * window right only updates the coarse kernel bins; fine kernel bins are
+ * brought up to date lazily, only for the coarse bin containing the median.
+ */
+static inline gboolean
+use_column_histograms (GeglProperties *o,
+                       UserData       *data)
+{
+  return data->quantize                                        &&
+         o->neighborhood == GEGL_MEDIAN_BLUR_NEIGHBORHOOD_SQUARE &&
+         abs (o->radius) >= MIN_COLUMN_HISTOGRAM_RADIUS;
+}
+
+static inline void
+column_histograms_modify_val (gint         *coarse,
+                              gint         *fine,
+                              const gint32 *src,
+                              const gint   *alpha_values,
+                              gint          diff,
+                              gint          n_color_components,
+                              gboolean      has_alpha)
+{
+  gint alpha = diff;
+  gint c;
+
+  if (has_alpha)
+    alpha *= alpha_values[src[n_color_components]];
+
+  for (c = 0; c < n_color_components; c++)
+    {
+      gint bin = src[c];
+
+      coarse[c * N_COARSE_BINS + bin / N_FINE_BINS] += alpha;
+      fine[c * DEFAULT_N_BINS + bin]                 += alpha;
+    }
+
+  if (has_alpha)
+    {
+      gint bin = src[n_color_components];
+
+      coarse[c * N_COARSE_BINS + bin / N_FINE_BINS] += diff;
+      fine[c * DEFAULT_N_BINS + bin]                 += diff;
+    }
+}
+
+static inline void
+column_histograms_modify_row (gint         *coarse,
+                              gint         *fine,
+                              const gint32 *src,
+                              const gint   *alpha_values,
+                              gint          n_columns,
+                              gint          diff,
+                              gint          n_components,
+                              gint          n_color_components)
+{
+  gboolean has_alpha = n_color_components < n_components;
+  gint     x;
+
+  for (x = 0; x < n_columns; x++)
+    {
+      column_histograms_modify_val (coarse, fine, src, alpha_values,
+                                    diff, n_color_components, has_alpha);
+
+      src    += n_components;
+      coarse += n_components * N_COARSE_BINS;
+      fine   += n_components * DEFAULT_N_BINS;
+    }
+}
+
+static inline void
+kernel_histogram_add_bins (gint       *bins,
+                           const gint *column_bins,
+                           gint        diff)
+{
+  gint i;
+
+  /* N_COARSE_BINS == N_FINE_BINS, so this serves both levels */
+  for (i = 0; i < N_COARSE_BINS; i++)
+    bins[i] += diff * column_bins[i];
+}
+
+static inline gfloat
+kernel_histogram_get_median (KernelHistogram *kernel,
+                             const gint      *column_fine,
+                             gint             column_stride,
+                             gint             kx,
+                             gint             diameter,
+                             gint             count,
+                             gdouble          percentile)
+{
+  gint sum = 0;
+  gint b;
+  gint i;
+
+  if (count == 0)
+    return 0.0f;
+
+  count = (gint) ceil (count * percentile);
+  count = MAX (count, 1);
+
+  for (b = 0; b < N_COARSE_BINS - 1; b++)
+    {
+      if (sum + kernel->coarse[b] >= count)
+        break;
+
+      sum += kernel->coarse[b];
+    }
+
+  /* bring the fine bins of the coarse bin up to date */
+  if (kernel->fine_x[b] < 0 || 2 * (kx - kernel->fine_x[b]) > diameter)
+    {
+      gint *fine = &kernel->fine[b * N_FINE_BINS];
+      gint  x;
+
+      memset (fine, 0, N_FINE_BINS * sizeof (gint));
+
+      for (x = kx; x < kx + diameter; x++)
+        {
+          kernel_histogram_add_bins (fine,
+                                     &column_fine[x * column_stride +
+                                                  b * N_FINE_BINS],
+                                     +1);
+        }
+    }
+  else
+    {
+      gint *fine = &kernel->fine[b * N_FINE_BINS];
+      gint  x;
+
+      for (x = kernel->fine_x[b]; x < kx; x++)
+        {
+          kernel_histogram_add_bins (fine,
+                                     &column_fine[x * column_stride +
+                                                  b * N_FINE_BINS],
+                                     -1);
+          kernel_histogram_add_bins (fine,
+                                     &column_fine[(x + diameter) *
+                                                  column_stride +
+                                                  b * N_FINE_BINS],
+                                     +1);
+        }
+    }
+
+  kernel->fine_x[b] = kx;
+
+  for (i = b * N_FINE_BINS; i < (b + 1) * N_FINE_BINS - 1; i++)
+    {
+      sum += kernel->fine[i];
+
+      if (sum >= count)
+        break;
+    }
+
+  return default_bin_values[i];
+}
+
+static void
+process_column_histograms (const gint32        *src_buf,
+                           gfloat              *dst_buf,
+                           const GeglRectangle *roi,
+                           gint                 radius,
+                           gint                 n_components,
+                           gint                 n_color_components,
+                           const gint          *alpha_values,
+                           gdouble              percentile,
+                           gdouble              alpha_percentile)
+{
+  gboolean         has_alpha     = n_color_components < n_components;
+  gint             diameter      = 2 * radius + 1;
+  gint             n_columns     = roi->width + 2 * radius;
+  gint             src_stride    = n_columns * n_components;
+  gint             coarse_stride = n_components * N_COARSE_BINS;
+  gint             fine_stride   = n_components * DEFAULT_N_BINS;
+  gint             size          = diameter * diameter;
+  gint            *column_coarse;
+  gint            *column_fine;
+  KernelHistogram *kernels;
+  gfloat          *dst           = dst_buf;
+  gint             x, y;
+  gint             c;
+
+  column_coarse = g_new0 (gint, n_columns * coarse_stride);
+  column_fine   = g_new0 (gint, n_columns * fine_stride);
+  kernels       = g_new (KernelHistogram, n_components);
+
+  for (y = 0; y < diameter - 1; y++)
+    {
+      column_histograms_modify_row (column_coarse, column_fine,
+                                    src_buf + y * src_stride, alpha_values,
+                                    n_columns, +1,
+                                    n_components, n_color_components);
+    }
+
+  for (y = 0; y < roi->height; y++)
+    {
+      /* slide the column histograms down to the current row */
+      if (y > 0)
+        {
+          column_histograms_modify_row (column_coarse, column_fine,
+                                        src_buf + (y - 1) * src_stride,
+                                        alpha_values,
+                                        n_columns, -1,
+                                        n_components, n_color_components);
+        }
+
+      column_histograms_modify_row (column_coarse, column_fine,
+                                    src_buf + (y + diameter - 1) * src_stride,
+                                    alpha_values,
+                                    n_columns, +1,
+                                    n_components, n_color_components);
+
+      for (c = 0; c < n_components; c++)
+        {
+          KernelHistogram *kernel = &kernels[c];
+
+          memset (kernel->coarse, 0, sizeof (kernel->coarse));
+
+          for (x = 0; x < diameter; x++)
+            {
+              kernel_histogram_add_bins (kernel->coarse,
+                                         &column_coarse[x * coarse_stride +
+                                                        c * N_COARSE_BINS],
+                                         +1);
+            }
+
+          for (x = 0; x < N_COARSE_BINS; x++)
+            kernel->fine_x[x] = -1;
+        }
+
+      for (x = 0; x < roi->width; x++)
+        {
+          gint count = 0;
+          gint i;
+
+          if (x > 0)
+            {
+              for (c = 0; c < n_components; c++)
+                {
+                  gint *coarse = kernels[c].coarse;
+
+                  kernel_histogram_add_bins (
+                    coarse,
+                    &column_coarse[(x - 1) * coarse_stride + c * N_COARSE_BINS],
+                    -1);
+                  kernel_histogram_add_bins (
+                    coarse,
+                    &column_coarse[(x + diameter - 1) * coarse_stride +
+                                   c * N_COARSE_BINS],
+                    +1);
+                }
+            }
+
+          if (has_alpha)
+            {
+              for (i = 0; i < N_COARSE_BINS; i++)
+                count += kernels[0].coarse[i];
+            }
+          else
+            {
+              count = size;
+            }
+
+          for (c = 0; c < n_color_components; c++)
+            {
+              dst[c] = kernel_histogram_get_median (&kernels[c],
+                                                    column_fine +
+                                                    c * DEFAULT_N_BINS,
+                                                    fine_stride,
+                                                    x, diameter,
+                                                    count, percentile);
+            }
+          if (has_alpha)
+            {
+              dst[c] = kernel_histogram_get_median (&kernels[c],
+                                                    column_fine +
+                                                    c * DEFAULT_N_BINS,
+                                                    fine_stride,
+                                                    x, diameter,
+                                                    size, alpha_percentile);
+            }
+
+          dst += n_components;
+        }
+    }
+
+  g_free (kernels);
+  g_free (column_fine);
+  g_free (column_coarse);
+}
+
 static void
 init_neighborhood_outline (GeglMedianBlurNeighborhood  neighborhood,
                            gint                        radius,
@@ -759,6 +1067,24 @@ get_abyss_policy (GeglOperation *operation,
   g_return_val_if_reached (GEGL_ABYSS_NONE);
 }
 
+static GeglSplitStrategy
+get_split_strategy (GeglOperation        *operation,
+                    GeglOperationContext *context,
+                    const gchar          *output_prop,
+                    const GeglRectangle  *result,
+                    gint                  level)
+{
+  GeglProperties *o = GEGL_PROPERTIES (operation);
+
+  /* give each thread a tall strip, so that the column histograms are
+   * initialized once, and then reused along many rows.
+   */
+  if (use_column_histograms (o, o->user_data))
+    return GEGL_SPLIT_STRATEGY_VERTICAL;
+
+  return GEGL_SPLIT_STRATEGY_AUTO;
+}
+
 static gboolean
 process (GeglOperation       *operation,
          GeglBuffer          *input,
@@ -853,93 +1179,103 @@ process (GeglOperation       *operation,
                    GEGL_AUTO_ROWSTRIDE, get_abyss_policy (operation, "input"));
   convert_values_to_bins (hist, src_buf, n_src_pixels, data->quantize);
 
-  src = src_buf + radius * (src_rect.width + 1) * n_components;
-  dst = dst_buf;
+  if (use_column_histograms (o, data))
+    {
+      process_column_histograms (src_buf, dst_buf, roi, radius,
+                                 n_components, n_color_components,
+                                 hist->alpha_values,
+                                 percentile, alpha_percentile);
+    }
+  else
+    {
+      src = src_buf + radius * (src_rect.width + 1) * n_components;
+      dst = dst_buf;
 
-  /* compute the first window */
+      /* compute the first window */
 
-  for (i = -radius; i <= radius; i++)
-    {
-      histogram_modify_vals (hist, src, src_stride,
-                             i, -neighborhood_outline[abs (i)],
-                             i, +neighborhood_outline[abs (i)],
-                             +1);
+      for (i = -radius; i <= radius; i++)
+        {
+          histogram_modify_vals (hist, src, src_stride,
+                                 i, -neighborhood_outline[abs (i)],
+                                 i, +neighborhood_outline[abs (i)],
+                                 +1);
 
-      hist->size += 2 * neighborhood_outline[abs (i)] + 1;
-    }
+          hist->size += 2 * neighborhood_outline[abs (i)] + 1;
+        }
 
-  for (c = 0; c < n_color_components; c++)
-    dst[c] = histogram_get_median (hist, c, percentile);
-  if (has_alpha)
-    dst[c] = histogram_get_median (hist, c, alpha_percentile);
+      for (c = 0; c < n_color_components; c++)
+        dst[c] = histogram_get_median (hist, c, percentile);
+      if (has_alpha)
+        dst[c] = histogram_get_median (hist, c, alpha_percentile);
 
-  dst_x = 0;
-  dst_y = 0;
+      dst_x = 0;
+      dst_y = 0;
 
-  n_dst_pixels--;
-  dir = LEFT_TO_RIGHT;
+      n_dst_pixels--;
+      dir = LEFT_TO_RIGHT;
 
-  while (n_dst_pixels--)
-    {
-      /* move the src coords based on current direction and positions */
-      if (dir == LEFT_TO_RIGHT)
-        {
-          if (dst_x != roi->width - 1)
-            {
-              dst_x++;
-              src += n_components;
-              dst += n_components;
-            }
-          else
-            {
-              dst_y++;
-              src += src_stride;
-              dst += dst_stride;
-              dir = TOP_TO_BOTTOM;
-            }
-        }
-      else if (dir == TOP_TO_BOTTOM)
+      while (n_dst_pixels--)
         {
-          if (dst_x == 0)
+          /* move the src coords based on current direction and positions */
+          if (dir == LEFT_TO_RIGHT)
             {
-              dst_x++;
-              src += n_components;
-              dst += n_components;
-              dir = LEFT_TO_RIGHT;
-            }
-          else
-            {
-              dst_x--;
-              src -= n_components;
-              dst -= n_components;
-              dir = RIGHT_TO_LEFT;
+              if (dst_x != roi->width - 1)
+                {
+                  dst_x++;
+                  src += n_components;
+                  dst += n_components;
+                }
+              else
+                {
+                  dst_y++;
+                  src += src_stride;
+                  dst += dst_stride;
+                  dir = TOP_TO_BOTTOM;
+                }
             }
-        }
-      else if (dir == RIGHT_TO_LEFT)
-        {
-          if (dst_x != 0)
+          else if (dir == TOP_TO_BOTTOM)
             {
-              dst_x--;
-              src -= n_components;
-              dst -= n_components;
+              if (dst_x == 0)
+                {
+                  dst_x++;
+                  src += n_components;
+                  dst += n_components;
+                  dir = LEFT_TO_RIGHT;
+                }
+              else
+                {
+                  dst_x--;
+                  src -= n_components;
+                  dst -= n_components;
+                  dir = RIGHT_TO_LEFT;
+                }
             }
-          else
+          else if (dir == RIGHT_TO_LEFT)
             {
-              dst_y++;
-              src += src_stride;
-              dst += dst_stride;
-              dir = TOP_TO_BOTTOM;
+              if (dst_x != 0)
+                {
+                  dst_x--;
+                  src -= n_components;
+                  dst -= n_components;
+                }
+              else
+                {
+                  dst_y++;
+                  src += src_stride;
+                  dst += dst_stride;
+                  dir = TOP_TO_BOTTOM;
+                }
             }
-        }
 
-      histogram_update (hist, src, src_stride,
-                        o->neighborhood, radius, neighborhood_outline,
-                        dir);
+          histogram_update (hist, src, src_stride,
+                            o->neighborhood, radius, neighborhood_outline,
+                            dir);
 
-      for (c = 0; c < n_color_components; c++)
-        dst[c] = histogram_get_median (hist, c, percentile);
-      if (has_alpha)
-        dst[c] = histogram_get_median (hist, c, alpha_percentile);
+          for (c = 0; c < n_color_components; c++)
+            dst[c] = histogram_get_median (hist, c, percentile);
+          if (has_alpha)
+            dst[c] = histogram_get_median (hist, c, alpha_percentile);
+        }
     }
 
   gegl_buffer_set (output, roi, 0, format, dst_buf, GEGL_AUTO_ROWSTRIDE);
@@ -994,6 +1330,7 @@ gegl_op_class_init (GeglOpClass *klass)
 
   object_class->finalize            = finalize;
   filter_class->process             = process;
+  filter_class->get_split_strategy  = get_split_strategy;
   operation_class->prepare          = prepare;
   operation_class->get_bounding_box = get_bounding_box;
   area_class->get_abyss_policy      = get_abyss_policy;
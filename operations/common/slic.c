@@ -50,14 +50,34 @@ property_int (iterations, _("Iterations"), 1)
 
 #define POW2(x) ((x)*(x))
 
+#define BLOCK_SIZE 64
+
 typedef struct
 {
   gfloat        center[5];
-  gfloat        sum[5];
+  gdouble       sum[5];
   glong         n_pixels;
   GeglRectangle search_window;
 } Cluster;
 
+typedef struct
+{
+  GArray  *indices;
+  gdouble *sums;
+} Block;
+
+typedef struct
+{
+  const GeglRectangle *extent;
+  gfloat              *pixels;
+  guint32             *labels;
+  GArray              *clusters;
+  gint                 cluster_size;
+  gint                 compactness;
+  gint                 n_blocks_x;
+  Block               *blocks;
+} AssignData;
+
 
 static inline gfloat
 get_distance (gfloat *c1,
@@ -157,114 +177,188 @@ init_clusters (GeglBuffer     *input,
   return clusters;
 }
 
+/* the image is divided into BLOCK_SIZE x BLOCK_SIZE blocks, processed in
+ * parallel.  each block only considers the clusters whose search window
+ * intersects it, and sums its pixels separately; the sums are then added
+ * up in block order, so the result doesn't depend on the number of threads.
+ */
 static void
-assign_labels (GeglBuffer *labels,
-               GeglBuffer *input,
-               GArray     *clusters,
-               gint        cluster_size,
-               gint        compactness,
-               const Babl *format)
+assign_labels_range (gsize       offset,
+                     gsize       size,
+                     AssignData *data)
 {
-  GeglBufferIterator *iter;
-  GArray  *clusters_index;
-
-  clusters_index = g_array_sized_new (FALSE, FALSE, sizeof (guint), 9);
+  const GeglRectangle *extent = data->extent;
+  gsize                b;
 
-  iter = gegl_buffer_iterator_new (input, NULL, 0, format,
-                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 2);
-
-  gegl_buffer_iterator_add (iter, labels, NULL, 0,
-                            babl_format_n (babl_type ("u32"), 1),
-                            GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
+  for (b = offset; b < offset + size; b++)
+    {
+      Block         *block = &data->blocks[b];
+      GeglRectangle  roi;
+      guint          n_indices;
+      guint          i;
+      gint           x, y;
 
-  while (gegl_buffer_iterator_next (iter))
-   {
-      GeglRectangle *roi = &iter->items[0].roi;
-      gfloat  *pixel = iter->items[0].data;
-      guint32 *label = iter->items[1].data;
-      glong    n_pixels = iter->length;
-      gint     x, y;
-      guint    i;
+      roi.x      = extent->x + (b % data->n_blocks_x) * BLOCK_SIZE;
+      roi.y      = extent->y + (b / data->n_blocks_x) * BLOCK_SIZE;
+      roi.width  = BLOCK_SIZE;
+      roi.height = BLOCK_SIZE;
 
-      x = roi->x;
-      y = roi->y;
+      gegl_rectangle_intersect (&roi, &roi, extent);
 
       /* construct an array of clusters index for which search_window
        * intersect with the current roi
        */
 
-      for (i = 0; i < clusters->len ; i++)
+      block->indices = g_array_sized_new (FALSE, FALSE, sizeof (guint), 9);
+
+      for (i = 0; i < data->clusters->len ; i++)
         {
-          Cluster *c = &g_array_index (clusters, Cluster, i);
+          Cluster *c = &g_array_index (data->clusters, Cluster, i);
 
-          if (gegl_rectangle_intersect (NULL, &c->search_window, roi))
-            g_array_append_val (clusters_index, i);
+          if (gegl_rectangle_intersect (NULL, &c->search_window, &roi))
+            g_array_append_val (block->indices, i);
         }
 
-      if (!clusters_index->len)
+      n_indices = block->indices->len;
+
+      if (!n_indices)
         {
-          g_printerr ("no clusters for roi %d,%d,%d,%d\n", roi->x, roi->y, roi->width, roi->height);
+          g_printerr ("no clusters for roi %d,%d,%d,%d\n", roi.x, roi.y, roi.width, roi.height);
           continue;
         }
 
-      while (n_pixels--)
-        {
-          Cluster *c;
-          gfloat feature[5] = {pixel[0], pixel[1], pixel[2],
-                               (gfloat) x, (gfloat) y};
-
-          /* find the nearest cluster */
+      /* one more set of sums, for the pixels that fall outside of all
+       * search windows and end up in the first cluster
+       */
+      block->sums = g_new0 (gdouble, (n_indices + 1) * 6);
 
-          gfloat  min_distance = G_MAXFLOAT;
-          guint   best_cluster = 0;
+      for (y = roi.y; y < roi.y + roi.height; y++)
+        {
+          glong    row   = (glong) (y - extent->y) * extent->width +
+                           (roi.x - extent->x);
+          gfloat  *pixel = data->pixels + row * 3;
+          guint32 *label = data->labels + row;
 
-          for (i = 0; i < clusters_index->len ; i++)
+          for (x = roi.x; x < roi.x + roi.width; x++)
             {
-              gfloat distance;
-              guint index = g_array_index (clusters_index, guint, i);
-              Cluster *tmp = &g_array_index (clusters, Cluster, index);
+              gfloat   feature[5] = {pixel[0], pixel[1], pixel[2],
+                                     (gfloat) x, (gfloat) y};
+              gdouble *sum;
 
-              if (x < tmp->search_window.x ||
-                  y < tmp->search_window.y ||
-                  x >= tmp->search_window.x + tmp->search_window.width ||
-                  y >= tmp->search_window.y + tmp->search_window.height)
-                continue;
+              /* find the nearest cluster */
 
-              distance = get_distance (tmp->center, feature,
-                                       cluster_size, compactness);
+              gfloat  min_distance = G_MAXFLOAT;
+              guint   best_index   = n_indices;
 
-              if (distance < min_distance)
+              for (i = 0; i < n_indices ; i++)
                 {
-                  min_distance = distance;
-                  best_cluster = index;
+                  gfloat distance;
+                  guint index = g_array_index (block->indices, guint, i);
+                  Cluster *tmp = &g_array_index (data->clusters, Cluster, index);
+
+                  if (x < tmp->search_window.x ||
+                      y < tmp->search_window.y ||
+                      x >= tmp->search_window.x + tmp->search_window.width ||
+                      y >= tmp->search_window.y + tmp->search_window.height)
+                    continue;
+
+                  distance = get_distance (tmp->center, feature,
+                                           data->cluster_size,
+                                           data->compactness);
+
+                  if (distance < min_distance)
+                    {
+                      min_distance = distance;
+                      best_index   = i;
+                    }
                 }
-            }
 
-          c = &g_array_index (clusters, Cluster, best_cluster);
-          c->sum[0] += pixel[0];
-          c->sum[1] += pixel[1];
-          c->sum[2] += pixel[2];
-          c->sum[3] += (gfloat) x;
-          c->sum[4] += (gfloat) y;
-          c->n_pixels++;
-
-          *label = best_cluster;
+              sum = block->sums + best_index * 6;
+              sum[0] += pixel[0];
+              sum[1] += pixel[1];
+              sum[2] += pixel[2];
+              sum[3] += (gfloat) x;
+              sum[4] += (gfloat) y;
+              sum[5] += 1.0;
+
+              if (best_index < n_indices)
+                *label = g_array_index (block->indices, guint, best_index);
+              else
+                *label = 0;
+
+              pixel += 3;
+              label++;
+            }
+        }
+    }
+}
 
-          pixel += 3;
-          label++;
+static void
+assign_labels (GeglOperation       *operation,
+               const GeglRectangle *extent,
+               gfloat              *pixels,
+               guint32             *labels,
+               GArray              *clusters,
+               gint                 cluster_size,
+               gint                 compactness)
+{
+  AssignData data;
+  gint       n_blocks_y;
+  gint       n_blocks;
+  gint       b;
+  guint      i;
+
+  data.extent       = extent;
+  data.pixels       = pixels;
+  data.labels       = labels;
+  data.clusters     = clusters;
+  data.cluster_size = cluster_size;
+  data.compactness  = compactness;
+  data.n_blocks_x   = (extent->width  + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  n_blocks_y        = (extent->height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  n_blocks          = data.n_blocks_x * n_blocks_y;
+  data.blocks       = g_new0 (Block, n_blocks);
+
+  gegl_parallel_distribute_range (
+    n_blocks,
+    gegl_operation_get_pixels_per_thread (operation) /
+    (BLOCK_SIZE * BLOCK_SIZE),
+    (GeglParallelDistributeRangeFunc) assign_labels_range,
+    &data);
+
+  for (b = 0; b < n_blocks; b++)
+    {
+      Block *block = &data.blocks[b];
 
-          x++;
-          if (x >= roi->x + roi->width)
+      if (block->sums)
+        {
+          for (i = 0; i <= block->indices->len; i++)
             {
-              y++;
-              x = roi->x;
+              const gdouble *sum = block->sums + i * 6;
+              guint          index;
+              Cluster       *c;
+
+              if (i < block->indices->len)
+                index = g_array_index (block->indices, guint, i);
+              else
+                index = 0;
+
+              c = &g_array_index (clusters, Cluster, index);
+              c->sum[0]   += sum[0];
+              c->sum[1]   += sum[1];
+              c->sum[2]   += sum[2];
+              c->sum[3]   += sum[3];
+              c->sum[4]   += sum[4];
+              c->n_pixels += (glong) sum[5];
             }
         }
 
-      clusters_index->len = 0;
-   }
+      g_free (block->sums);
+      if (block->indices)
+        g_array_free (block->indices, TRUE);
+    }
 
-  g_array_free (clusters_index, TRUE);
+  g_free (data.blocks);
 }
 
 static gboolean
@@ -283,11 +377,11 @@ update_clusters (GArray *clusters,
       c->center[3] = c->sum[3] / c->n_pixels;
       c->center[4] = c->sum[4] / c->n_pixels;
 
-      c->sum[0] = 0.0f;
-      c->sum[1] = 0.0f;
-      c->sum[2] = 0.0f;
-      c->sum[3] = 0.0f;
-      c->sum[4] = 0.0f;
+      c->sum[0] = 0.0;
+      c->sum[1] = 0.0;
+      c->sum[2] = 0.0;
+      c->sum[3] = 0.0;
+      c->sum[4] = 0.0;
 
       c->n_pixels = 0;
 
@@ -299,39 +393,26 @@ update_clusters (GArray *clusters,
 }
 
 static void
-set_output (GeglBuffer *output,
-            GeglBuffer *labels,
-            GArray     *clusters,
-            const Babl *format)
+set_output (GeglBuffer          *output,
+            const GeglRectangle *extent,
+            gfloat              *pixels,
+            const guint32       *labels,
+            GArray              *clusters,
+            const Babl          *format)
 {
-  GeglBufferIterator *iter;
-
-  iter = gegl_buffer_iterator_new (output, NULL, 0,
-                                   format,
-                                   GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE, 2);
-
-  gegl_buffer_iterator_add (iter, labels, NULL, 0,
-                            babl_format_n (babl_type ("u32"), 1),
-                            GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+  glong n_pixels = (glong) extent->width * extent->height;
+  glong i;
 
-  while (gegl_buffer_iterator_next (iter))
+  for (i = 0; i < n_pixels; i++)
     {
-      gfloat  *pixel    = iter->items[0].data;
-      guint32 *label    = iter->items[1].data;
-      glong    n_pixels = iter->length;
-
-      while (n_pixels--)
-        {
-          Cluster *c = &g_array_index (clusters, Cluster, *label);
+      Cluster *c = &g_array_index (clusters, Cluster, labels[i]);
 
-          pixel[0] = c->center[0];
-          pixel[1] = c->center[1];
-          pixel[2] = c->center[2];
-
-          pixel += 3;
-          label++;
-        }
+      pixels[i * 3 + 0] = c->center[0];
+      pixels[i * 3 + 1] = c->center[1];
+      pixels[i * 3 + 2] = c->center[2];
     }
+
+  gegl_buffer_set (output, extent, 0, format, pixels, GEGL_AUTO_ROWSTRIDE);
 }
 
 static void
@@ -380,7 +461,8 @@ process (GeglOperation       *operation,
   GeglProperties *o = GEGL_PROPERTIES (operation);
   const Babl *format = gegl_operation_get_format (operation, "output");
   const GeglRectangle *src_region = gegl_buffer_get_extent (input);
-  GeglBuffer *labels;
+  gfloat     *pixels;
+  guint32    *labels;
   GArray     *clusters;
   gint        max_dim;
   gint        cluster_size;
@@ -389,7 +471,11 @@ process (GeglOperation       *operation,
 
   gegl_operation_progress (operation, 0.0, "");
 
-  labels = gegl_buffer_new (src_region, babl_format_n (babl_type ("u32"), 1));
+  pixels = g_new (gfloat, (gsize) src_region->width * src_region->height * 3);
+  labels = g_new0 (guint32, (gsize) src_region->width * src_region->height);
+
+  gegl_buffer_get (input, src_region, 1.0, format, pixels,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
   /* restrict cluster size to the maximum buffer dimension */
 
@@ -406,12 +492,13 @@ process (GeglOperation       *operation,
 
   for (i = 0; i < n_iterations; i++)
     {
-      assign_labels (labels,
-                     input,
+      assign_labels (operation,
+                     src_region,
+                     pixels,
+                     labels,
                      clusters,
                      cluster_size,
-                     o->compactness,
-                     format);
+                     o->compactness);
 
       update_clusters (clusters, cluster_size);
 
@@ -422,11 +509,12 @@ process (GeglOperation       *operation,
 
   /* apply clusters colors to output */
 
-  set_output (output, labels, clusters, format);
+  set_output (output, src_region, pixels, labels, clusters, format);
 
   gegl_operation_progress (operation, 1.0, "");
 
-  g_object_unref (labels);
+  g_free (pixels);
+  g_free (labels);
   g_array_free (clusters, TRUE);
 
   return TRUE;
@@ -44,6 +44,11 @@ property_int (iterations, _("Iterations"), 5)
 property_boolean (enhance_shadows, _("Enhance Shadows"), FALSE)
     description(_("When enabled also enhances shadow regions - when disabled a more natural result is yielded"))
 
+property_int (subsampling, _("Subsampling"), 1)
+    description(_("Compute the envelopes for one in this many pixels along each axis only, interpolating in between; faster, at the cost of detail"))
+    value_range (1, 16)
+    ui_range    (1, 8)
+
 /*
 
 property_double (rgamma, _("Radial Gamma"), 0.0, 8.0, 2.0,
@@ -74,6 +79,7 @@ static void stress (GeglBuffer          *src,
                     gint                 radius,
                     gint                 samples,
                     gint                 iterations,
+                    gint                 subsampling,
                     gdouble              rgamma,
                     gboolean             enhance_shadows,
                     gint                 level,
@@ -85,100 +91,71 @@ static void stress (GeglBuffer          *src,
   {
     GeglBufferIterator *i = gegl_buffer_iterator_new (dst, dst_rect, 0, babl_format_with_space ("RaGaBaA float", space),
                                                       GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE, 1);
-    GeglSampler *sampler = gegl_buffer_sampler_new_at_level (src, format, GEGL_SAMPLER_NEAREST, level);
-    GeglSamplerGetFun getfun = gegl_sampler_get_fun (sampler);
+    Envelopes envelopes;
+    gfloat   *min = NULL;
+    gfloat   *max = NULL;
+    gfloat   *pixels = NULL;
+    gint      n_pixels = 0;
+
+    envelopes_init (&envelopes, src, src_rect, level,
+                    radius, samples, iterations, rgamma, format);
 
     while (gegl_buffer_iterator_next (i))
     {
-      gint x,y;
-      gint    dst_offset=0;
+      gint    n;
       gfloat *dst_buf = i->items[0].data;
       GeglRectangle *roi = &i->items[0].roi;
 
-      if (enhance_shadows)
-      {
-        for (y=roi->y; y < roi->y + roi->height; y++)
-          for (x=roi->x; x < roi->x + roi->width; x++)
+      if (roi->width * roi->height > n_pixels)
+        {
+          n_pixels = roi->width * roi->height;
+          min    = g_renew (gfloat, min,    n_pixels * 4);
+          max    = g_renew (gfloat, max,    n_pixels * 4);
+          pixels = g_renew (gfloat, pixels, n_pixels * 4);
+        }
+
+      envelopes_get_area (&envelopes, roi, subsampling,
+                          enhance_shadows ? min : NULL, max, pixels);
+
+      for (n = 0; n < roi->width * roi->height; n++)
+        {
+          gfloat *pixel = pixels + n * 4;
+          gint    c;
+
+          for (c=0;c<3;c++)
             {
-              gfloat  min[4];
-              gfloat  max[4];
-              gfloat  pixel[4];
-
-              compute_envelopes (src, sampler, getfun,
-                                 x, y,
-                                 radius, samples,
-                                 iterations,
-                                 FALSE, /* same spray */
-                                 rgamma,
-                                 min, max, pixel, format);
-              {
-                /* this should be replaced with a better/faster projection of
-                 * pixel onto the vector spanned by min -> max, currently
-                 * computed by comparing the distance to min with the sum
-                 * of the distance to min/max.
-                 */
-
-              gint c;
-              for (c=0;c<3;c++)
+              gfloat delta;
+              gfloat value;
+
+              if (enhance_shadows)
+                {
+                  delta = max[n * 4 + c] - min[n * 4 + c];
+                  value = pixel[c] - min[n * 4 + c];
+                }
+              else
                 {
-                  gfloat delta = max[c]-min[c];
-                  if (delta != 0)
-                    {
-                      dst_buf[dst_offset+c] = (pixel[c]-min[c])/delta;
-                    }
-                  else
-                    {
-                      dst_buf[dst_offset+c] = 0.5;
-                    }
+                  delta = max[n * 4 + c];
+                  value = pixel[c];
                 }
 
-                dst_buf[dst_offset+3] = pixel[3];
-                dst_offset+=4;
-              }
-            }
-      }
-      else
-      {
-        for (y=roi->y; y < roi->y + roi->height; y++)
-          for (x=roi->x; x < roi->x + roi->width; x++)
-            {
-              gfloat  max[4];
-              gfloat  pixel[4];
-
-              compute_envelopes (src, sampler, getfun,
-                                 x, y,
-                                 radius, samples,
-                                 iterations,
-                                 FALSE, /* same spray */
-                                 rgamma,
-                                 NULL, max, pixel, format);
-              {
-                /* this should be replaced with a better/faster projection of
-                 * pixel onto the vector spanned by min -> max, currently
-                 * computed by comparing the distance to min with the sum
-                 * of the distance to min/max.
-                 */
-
-              gint c;
-              for (c=0;c<3;c++)
+              if (delta != 0)
                 {
-                  gfloat delta = max[c];
-                  if (delta != 0)
-                    {
-                      dst_buf[dst_offset+c] = (pixel[c])/delta;
-                    }
-                  else
-                    {
-                      dst_buf[dst_offset+c] = 0.5;
-                    }
+                  dst_buf[n * 4 + c] = value/delta;
+                }
+              else
+                {
+                  dst_buf[n * 4 + c] = 0.5;
                 }
-                dst_buf[dst_offset+3] = pixel[3];
-                dst_offset+=4;
-              }
             }
-      }
+
+          dst_buf[n * 4 + 3] = pixel[3];
+        }
     }
-    g_object_unref (sampler);
+
+    g_free (min);
+    g_free (max);
+    g_free (pixels);
+    envelopes_cleanup (&envelopes);
   }
 }
 
@@ -186,8 +163,10 @@ static void prepare (GeglOperation *operation)
 {
   const Babl *space = gegl_operation_get_source_space (operation, "input");
   GeglOperationAreaFilter *area = GEGL_OPERATION_AREA_FILTER (operation);
+  /* the envelope grid of subsampling reaches further out */
   area->left = area->right = area->top = area->bottom =
-      ceil (GEGL_PROPERTIES (operation)->radius);
+      ceil (GEGL_PROPERTIES (operation)->radius) +
+      GEGL_PROPERTIES (operation)->subsampling;
 
   gegl_operation_set_format (operation, "output",
                              babl_format_with_space ("RaGaBaA float", space));
@@ -220,6 +199,7 @@ process (GeglOperation       *operation,
           o->radius,
           o->samples,
           o->iterations,
+          o->subsampling,
           RGAMMA /*o->rgamma,*/,
           o->enhance_shadows,
           level,
@@ -38,81 +38,77 @@ property_format (flag, _("flag"), NULL)
 
 #include "gegl-op.h"
 
-typedef struct _PixelCoords
-{
-  gint x;
-  gint y;
-} PixelCoords;
-
+/* hierarchical queue of pixel indices.  each level is a FIFO backed by a
+ * growing array; every pixel is queued at most once, so the arrays are
+ * reset whenever a level runs empty instead of being used as rings.
+ */
 typedef struct _HQ
 {
-  GQueue  *queues[256];
-  GQueue  *lowest_non_empty;
+  GArray  *queues[256];
+  guint    heads[256];
   gint     lowest_non_empty_level;
 } HQ;
 
+#define HQ_EMPTY 256
+
 static void
 HQ_init (HQ *hq)
 {
   gint i;
 
   for (i = 0; i < 256; i++)
-    hq->queues[i] = g_queue_new ();
+    {
+      hq->queues[i] = g_array_new (FALSE, FALSE, sizeof (guint));
+      hq->heads[i]  = 0;
+    }
 
-  hq->lowest_non_empty       = NULL;
-  hq->lowest_non_empty_level = 255;
+  hq->lowest_non_empty_level = HQ_EMPTY;
 }
 
 static gboolean
 HQ_is_empty (HQ *hq)
 {
-  if (hq->lowest_non_empty == NULL)
-    return TRUE;
-
-  return FALSE;
+  return hq->lowest_non_empty_level == HQ_EMPTY;
 }
 
 static inline void
-HQ_push (HQ      *hq,
-         guint8   level,
-         gpointer data)
+HQ_push (HQ     *hq,
+         guint8  level,
+         guint   index)
 {
-  g_queue_push_head (hq->queues[level], data);
+  g_array_append_val (hq->queues[level], index);
 
-  if (level <= hq->lowest_non_empty_level)
-    {
-      hq->lowest_non_empty_level = level;
-      hq->lowest_non_empty       = hq->queues[level];
-    }
+  if (level < hq->lowest_non_empty_level)
+    hq->lowest_non_empty_level = level;
 }
 
-static inline gpointer
+static inline guint
 HQ_pop (HQ *hq)
 {
-  gint i, level;
-  gpointer data = NULL;
+  gint    level = hq->lowest_non_empty_level;
+  GArray *queue = hq->queues[level];
+  guint   index;
+
+  index = g_array_index (queue, guint, hq->heads[level]++);
 
-  if (hq->lowest_non_empty != NULL)
+  if (hq->heads[level] == queue->len)
     {
-      data = g_queue_pop_tail (hq->lowest_non_empty);
+      gint i;
 
-      if (g_queue_is_empty (hq->lowest_non_empty))
-        {
-          level = hq->lowest_non_empty_level;
-          hq->lowest_non_empty_level = 255;
-          hq->lowest_non_empty       = NULL;
+      g_array_set_size (queue, 0);
+      hq->heads[level] = 0;
 
-          for (i = level + 1; i < 256; i++)
-            if (!g_queue_is_empty (hq->queues[i]))
-              {
-                hq->lowest_non_empty_level = i;
-                hq->lowest_non_empty       = hq->queues[i];
-                break;
-              }
-        }
+      hq->lowest_non_empty_level = HQ_EMPTY;
+
+      for (i = level + 1; i < 256; i++)
+        if (hq->queues[i]->len)
+          {
+            hq->lowest_non_empty_level = i;
+            break;
+          }
     }
 
-  return data;
+  return index;
 }
 
 static void
@@ -121,12 +117,7 @@ HQ_clean (HQ *hq)
   gint i;
 
   for (i = 0; i < 256; i++)
-    {
-      if (!g_queue_is_empty (hq->queues[i]))
-        g_printerr ("queue %u is not empty!\n", i);
-      else
-        g_queue_free (hq->queues[i]);
-    }
+    g_array_free (hq->queues[i], TRUE);
 }
 
 static void
@@ -220,12 +211,12 @@ process (GeglOperation       *operation,
          gint                 flag_idx)
 {
   HQ      hq;
-  guint8  square3x3[72];
   gint    i;
   gint    j;
   gint    x, y;
+  guint8 *labels;
+  guint8 *gradient = NULL;
   GeglBufferIterator  *iter;
-  GeglSampler         *gradient_sampler = NULL;
   const GeglRectangle *extent = gegl_buffer_get_extent (input);
 
   const Babl  *gradient_format = babl_format ("Y u8");
@@ -237,16 +228,26 @@ process (GeglOperation       *operation,
                                  {-1, 0},         {1, 0},
                                  {-1, 1}, {0, 1}, {1, 1}};
 
+  /* the flood reads and writes the labels of single pixels, in an order
+   * that can't be predicted; keep the labels, and the priority map, in
+   * memory while flooding.
+   */
+  labels = g_new (guint8, (gsize) extent->width * extent->height * bpp);
+
+  if (aux)
+    {
+      gradient = g_new0 (guint8, (gsize) extent->width * extent->height);
+
+      gegl_buffer_get (aux, extent, 1.0, gradient_format, gradient,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+    }
+
   /* initialize hierarchical queues */
 
   HQ_init (&hq);
 
   iter = gegl_buffer_iterator_new (input, extent, 0, labels_format,
-                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE,
-                                   aux ? 11 : 10);
-
-  gegl_buffer_iterator_add (iter, output, extent, 0, labels_format,
-                            GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 9);
 
   /* Add 8 neighbours. */
   gegl_buffer_iterator_add (iter, input,
@@ -273,32 +274,28 @@ process (GeglOperation       *operation,
   gegl_buffer_iterator_add (iter, input,
                             GEGL_RECTANGLE (1, 1, extent->width, extent->height),
                             0, labels_format, GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
-  /* Priority map: lower is higher priority. */
-  if (aux)
-    gegl_buffer_iterator_add (iter, aux, extent, 0, gradient_format,
-                              GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
 
   while (gegl_buffer_iterator_next (iter))
     {
       GeglRectangle *roi      = &iter->items[0].roi;
       guint8        *label    = iter->items[0].data;
-      guint8        *outlabel = iter->items[1].data;
       guint8        *n[8]     =
         {
+          iter->items[1].data,
           iter->items[2].data,
           iter->items[3].data,
           iter->items[4].data,
           iter->items[5].data,
           iter->items[6].data,
           iter->items[7].data,
-          iter->items[8].data,
-          iter->items[9].data
+          iter->items[8].data
         };
-      guint8        *prio    = aux ? iter->items[10].data : NULL;
 
       for (y = roi->y; y < roi->y + roi->height; y++)
         for (x = roi->x; x < roi->x + roi->width; x++)
           {
+            guint    index   = (y - extent->y) * extent->width +
+                               (x - extent->x);
             gboolean flagged = TRUE;
 
             for (i = 0; i < bpc; i++)
@@ -335,57 +332,39 @@ process (GeglOperation       *operation,
                     /* This pixel is not flagged and has at least one flagged
                      * neighbour.
                      */
-                    PixelCoords *p = g_new (PixelCoords, 1);
-                    p->x = x;
-                    p->y = y;
-
-                    HQ_push (&hq, prio ? *prio : 0, p);
+                    HQ_push (&hq, gradient ? gradient[index] : 0, index);
                   }
               }
 
-            for (i = 0; i < bpp; i++)
-              outlabel[i] = label[i];
+            memcpy (labels + (gsize) index * bpp, label, bpp);
 
-            if (prio)
-              prio++;
             label    += bpp;
-            outlabel += bpp;
             for (j = 0; j < 8; j++)
               n[j] += bpp;
           }
     }
 
-  if (aux)
-    gradient_sampler = gegl_buffer_sampler_new_at_level (aux,
-                                                         gradient_format,
-                                                         GEGL_SAMPLER_NEAREST,
-                                                         level);
   while (!HQ_is_empty (&hq))
     {
-      PixelCoords *p = (PixelCoords *) HQ_pop (&hq);
-      guint8       label[bpp];
-
-      GeglRectangle square_rect = {p->x - 1, p->y - 1, 3, 3};
-
-      gegl_buffer_get (output, &square_rect, 1.0, labels_format,
-                       square3x3,
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-      for (i = 0; i < bpp; i++)
-        label[i] = square3x3[4 * bpp + i];
+      guint         index = HQ_pop (&hq);
+      gint          px    = index % extent->width;
+      gint          py    = index / extent->width;
+      const guint8 *label = labels + (gsize) index * bpp;
 
       /* compute neighbors coordinate */
       for (j = 0; j < 8; j++)
         {
           guint8   *neighbor_label;
-          gint      nx = p->x + neighbors_coords[j][0];
-          gint      ny = p->y + neighbors_coords[j][1];
+          guint     n_index;
+          gint      nx = px + neighbors_coords[j][0];
+          gint      ny = py + neighbors_coords[j][1];
           gboolean  flagged = TRUE;
 
           if (nx < 0 || nx >= extent->width || ny < 0 || ny >= extent->height)
             continue;
 
-          neighbor_label = square3x3 + ((neighbors_coords[j][0] + 1) + (neighbors_coords[j][1] + 1) * 3) * bpp;
+          n_index        = ny * extent->width + nx;
+          neighbor_label = labels + (gsize) n_index * bpp;
 
           for (i = 0; i < bpc; i++)
             if (neighbor_label[flag_idx * bpc + i] != (flag ? flag[i] : 0))
@@ -395,33 +374,18 @@ process (GeglOperation       *operation,
               }
           if (flagged)
             {
-              guint8 gradient_value = 0;
-              GeglRectangle n_rect = {nx, ny, 1, 1};
-              PixelCoords *n = g_new (PixelCoords, 1);
-              n->x = nx;
-              n->y = ny;
-
-              if (gradient_sampler)
-                gegl_sampler_get (gradient_sampler,
-                                  (gdouble) nx,
-                                  (gdouble) ny,
-                                  NULL, &gradient_value, GEGL_ABYSS_NONE);
-
-              HQ_push (&hq, gradient_value, n);
-
-              for (i = 0; i < bpp; i++)
-                neighbor_label[i] = label[i];
-
-              gegl_buffer_set (output, &n_rect,
-                               0, labels_format,
-                               neighbor_label, GEGL_AUTO_ROWSTRIDE);
+              HQ_push (&hq, gradient ? gradient[n_index] : 0, n_index);
+
+              memcpy (neighbor_label, label, bpp);
             }
         }
-
-      g_free (p);
     }
-  if (gradient_sampler)
-    g_object_unref (gradient_sampler);
+
+  gegl_buffer_set (output, extent, 0, labels_format, labels,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  g_free (gradient);
+  g_free (labels);
 
   HQ_clean (&hq);
   return  TRUE;
@@ -46,6 +46,18 @@ property_double (frame_rate, _("frame-rate"), 0)
    value_range (0, G_MAXINT)
    ui_range (0, 10000)
 
+property_int (thread_count, _("Thread count"), 0)
+   description (_("Number of threads the video codec decodes with, 0 picks a count based on the number of processors."))
+   value_range (0, 64)
+
+property_int (frame_cache_size, _("Frame cache size"), 8)
+   description (_("Number of decoded frames kept in memory, so that revisiting recent frames, as temporal filters and scrubbing do, doesn't seek and decode again."))
+   value_range (0, 1024)
+   ui_range (0, 64)
+
+property_boolean (read_ahead, _("Read ahead"), TRUE)
+   description (_("When frames are requested in order, decode the next frame in the background."))
+
 property_string (video_codec, _("video-codec"), "")
 property_string (audio_codec, _("audio-codec"), "")
 
@@ -70,6 +82,13 @@ property_audio_fragment (audio, _("audio"), 0)
 #include <libswscale/swscale.h>
 
 
+typedef struct
+{
+  glong    frame;
+  gdouble  pts;     /* timestamp in seconds */
+  guchar  *pixels;  /* R'G'B' u8 */
+} CachedFrame;
+
 typedef struct
 {
   gint             width;
@@ -98,10 +117,27 @@ typedef struct
   AVCodecContext  *audio_ctx;
   const AVCodec   *video_codec;
   AVFrame         *lavc_frame;
-  AVFrame         *rgb_frame;
+  struct SwsContext *sws_ctx;
   glong            prevframe;      /* previously decoded frame number */
+  gboolean         draining;       /* end of file reached, the decoder is
+                                      returning its delayed frames */
   gdouble          prevpts;        /* timestamp in seconds of last decoded frame */
 
+  /* the decoder state above is only touched with decoder_mutex held, the
+   * frame cache and read-ahead request with cache_mutex held; when both are
+   * needed, decoder_mutex is locked first.
+   */
+  GMutex           decoder_mutex;
+  GMutex           cache_mutex;
+  GQueue           frame_cache;    /* CachedFrame, most recently used first */
+  gint             frame_cache_size;
+  glong            prevrequest;    /* frame previously requested by process */
+
+  GThread         *read_ahead_thread;
+  GCond            read_ahead_cond;
+  glong            read_ahead_frame; /* frame to decode in the background, or -1 */
+  gboolean         read_ahead_quit;
+
 } Priv;
 
 static void
@@ -137,12 +173,49 @@ clear_audio_track (GeglProperties *o)
   p->prevapts = 0.0;
 }
 
+static void
+cached_frame_free (CachedFrame *cached)
+{
+  g_free (cached->pixels);
+  g_slice_free (CachedFrame, cached);
+}
+
+static void
+clear_frame_cache (Priv *p)
+{
+  g_mutex_lock (&p->cache_mutex);
+  while (! g_queue_is_empty (&p->frame_cache))
+    cached_frame_free (g_queue_pop_head (&p->frame_cache));
+  p->read_ahead_frame = -1;
+  g_mutex_unlock (&p->cache_mutex);
+}
+
+static void
+stop_read_ahead (Priv *p)
+{
+  if (! p->read_ahead_thread)
+    return;
+
+  g_mutex_lock (&p->cache_mutex);
+  p->read_ahead_quit = TRUE;
+  g_cond_signal (&p->read_ahead_cond);
+  g_mutex_unlock (&p->cache_mutex);
+
+  g_thread_join (p->read_ahead_thread);
+
+  p->read_ahead_thread = NULL;
+  p->read_ahead_quit   = FALSE;
+}
+
 static void
 ff_cleanup (GeglProperties *o)
 {
   Priv *p = (Priv*)o->user_data;
   if (p)
     {
+      /* the read-ahead thread uses the decoder, stop it first */
+      stop_read_ahead (p);
+      clear_frame_cache (p);
       clear_audio_track (o);
       g_free (p->loadedfilename);
       avcodec_free_context (&p->video_ctx);
@@ -151,15 +224,15 @@ ff_cleanup (GeglProperties *o)
         avformat_close_input(&p->video_fcontext);
       if (p->audio_fcontext)
         avformat_close_input(&p->audio_fcontext);
-      if (p->rgb_frame)
-        av_free (p->rgb_frame);
       if (p->lavc_frame)
         av_free (p->lavc_frame);
+      if (p->sws_ctx)
+        sws_freeContext (p->sws_ctx);
 
       p->video_fcontext = NULL;
       p->audio_fcontext = NULL;
       p->lavc_frame = NULL;
-      p->rgb_frame = NULL;
+      p->sws_ctx = NULL;
       p->loadedfilename = NULL;
     }
 }
@@ -173,6 +246,12 @@ init (GeglProperties *o)
     {
       p = g_new0 (Priv, 1);
       o->user_data = (void*) p;
+
+      g_mutex_init (&p->decoder_mutex);
+      g_mutex_init (&p->cache_mutex);
+      g_cond_init (&p->read_ahead_cond);
+      g_queue_init (&p->frame_cache);
+      p->read_ahead_frame = -1;
     }
 
   p->width = 320;
@@ -349,7 +428,10 @@ decode_frame (GeglOperation *operation,
     if (av_seek_frame (p->video_fcontext, p->video_index, seek_target, (AVSEEK_FLAG_BACKWARD )) < 0)
       fprintf (stderr, "video seek error!\n");
     else
-      avcodec_flush_buffers (p->video_ctx);
+      {
+        avcodec_flush_buffers (p->video_ctx);
+        p->draining = FALSE;
+      }
 
     prevframe = -1;
   }
@@ -362,23 +444,35 @@ decode_frame (GeglOperation *operation,
           int       ret;
           AVPacket  pkt = {0,};
 
-          do
-          {
-            av_packet_unref (&pkt);
-            if (av_read_frame (p->video_fcontext, &pkt) < 0)
+          if (p->draining)
             {
-              av_packet_unref (&pkt);
-              return -1;
+              /* only frames still held by the decoder remain */
+              ret = 0;
             }
-          }
-          while (pkt.stream_index != p->video_index);
-
-          ret = avcodec_send_packet (p->video_ctx, &pkt);
-          if (ret < 0)
+          else
             {
-              fprintf (stderr, "avcodec_send_packet failed for %s\n",
-                       o->path);
-              return -1;
+              do
+              {
+                av_packet_unref (&pkt);
+                if (av_read_frame (p->video_fcontext, &pkt) < 0)
+                {
+                  /* send an empty packet, to receive the frames still held
+                   * by the (possibly frame-threaded) decoder
+                   */
+                  av_packet_unref (&pkt);
+                  p->draining = TRUE;
+                  break;
+                }
+              }
+              while (pkt.stream_index != p->video_index);
+
+              ret = avcodec_send_packet (p->video_ctx, &pkt);
+              if (ret < 0)
+                {
+                  fprintf (stderr, "avcodec_send_packet failed for %s\n",
+                           o->path);
+                  return -1;
+                }
             }
           while (ret == 0)
             {
@@ -391,6 +485,11 @@ decode_frame (GeglOperation *operation,
                   ret = 0;
                   break;
                 }
+              else if (ret == AVERROR_EOF)
+                {
+                  av_packet_unref (&pkt);
+                  return -1;
+                }
               else if (ret < 0)
                 {
                   fprintf (stderr, "avcodec_receive_frame failed for %s\n",
@@ -398,6 +497,14 @@ decode_frame (GeglOperation *operation,
                   break;
                 }
               got_picture = 1;
+              /* use the timestamps of the packet the frame was decoded
+               * from, which, with frame threading, isn't the packet we just
+               * sent
+               */
+              if (p->lavc_frame->pkt_dts != AV_NOPTS_VALUE)
+                pkt.dts = p->lavc_frame->pkt_dts;
+              if (p->lavc_frame->pts != AV_NOPTS_VALUE)
+                pkt.pts = p->lavc_frame->pts;
               if ((pkt.dts == pkt.pts) || (p->lavc_frame->key_frame!=0))
                 {
                   // cur_dts and first_dts are moved to libavformat/internal.h
@@ -434,11 +541,218 @@ decode_frame (GeglOperation *operation,
   return 0;
 }
 
+/* call with cache_mutex held */
+static CachedFrame *
+find_cached_frame (Priv  *p,
+                   glong  frame)
+{
+  GList *iter;
+
+  for (iter = p->frame_cache.head; iter; iter = iter->next)
+    {
+      CachedFrame *cached = iter->data;
+
+      if (cached->frame == frame)
+        return cached;
+    }
+
+  return NULL;
+}
+
+/* converts the frame just decoded to R'G'B' u8 and adds it to the cache,
+ * call with decoder_mutex held
+ */
+static void
+cache_decoded_frame (GeglProperties *o,
+                     glong           frame)
+{
+  Priv        *p         = (Priv*)o->user_data;
+  gint         rowstride = p->width * 3;
+  CachedFrame *cached    = NULL;
+
+  /* recycle the least recently used frames; the frame being added is kept
+   * even when the cache is disabled, since process reads it from there
+   */
+  g_mutex_lock (&p->cache_mutex);
+  while (g_queue_get_length (&p->frame_cache) >= (guint) MAX (p->frame_cache_size, 1))
+    {
+      if (cached)
+        cached_frame_free (cached);
+      cached = g_queue_pop_tail (&p->frame_cache);
+    }
+  g_mutex_unlock (&p->cache_mutex);
+
+  if (! cached)
+    {
+      cached = g_slice_new (CachedFrame);
+      cached->pixels = g_malloc ((gsize) rowstride * p->height);
+    }
+
+  cached->frame = frame;
+  cached->pts   = p->prevpts;
+
+  if (p->video_ctx->pix_fmt == AV_PIX_FMT_RGB24)
+    {
+      gint y;
+
+      for (y = 0; y < p->height; y++)
+        memcpy (cached->pixels + (gsize) y * rowstride,
+                p->lavc_frame->data[0] + (gsize) y * p->lavc_frame->linesize[0],
+                rowstride);
+    }
+  else
+    {
+      uint8_t *dst[4]        = {cached->pixels};
+      int      dst_stride[4] = {rowstride};
+
+      p->sws_ctx = sws_getCachedContext (p->sws_ctx,
+                                         p->width, p->height, p->video_ctx->pix_fmt,
+                                         p->width, p->height, AV_PIX_FMT_RGB24,
+                                         SWS_BICUBIC, NULL, NULL, NULL);
+      sws_scale (p->sws_ctx, (void*)p->lavc_frame->data,
+                 p->lavc_frame->linesize, 0, p->height, dst, dst_stride);
+    }
+
+  g_mutex_lock (&p->cache_mutex);
+  g_queue_push_head (&p->frame_cache, cached);
+  g_mutex_unlock (&p->cache_mutex);
+}
+
+/* writes frame to output, from the cache when possible, decoding it
+ * otherwise.  returns FALSE when the frame can't be decoded.
+ */
+static gboolean
+load_frame (GeglOperation *operation,
+            glong          frame,
+            GeglBuffer    *output,
+            gdouble       *pts)
+{
+  GeglProperties *o = GEGL_PROPERTIES (operation);
+  Priv           *p = (Priv*)o->user_data;
+  CachedFrame    *cached;
+  gboolean        decoding;
+
+  g_mutex_lock (&p->cache_mutex);
+  decoding = ! find_cached_frame (p, frame);
+  g_mutex_unlock (&p->cache_mutex);
+
+  if (decoding)
+    {
+      g_mutex_lock (&p->decoder_mutex);
+
+      /* the read-ahead thread might have decoded it meanwhile */
+      g_mutex_lock (&p->cache_mutex);
+      cached = find_cached_frame (p, frame);
+      g_mutex_unlock (&p->cache_mutex);
+
+      if (! cached && ! decode_frame (operation, frame))
+        cache_decoded_frame (o, frame);
+    }
+
+  g_mutex_lock (&p->cache_mutex);
+  cached = find_cached_frame (p, frame);
+  if (cached)
+    {
+      GeglRectangle extent = {0, 0, p->width, p->height};
+
+      g_queue_remove (&p->frame_cache, cached);
+      g_queue_push_head (&p->frame_cache, cached);
+
+      gegl_buffer_set (output, &extent, 0, babl_format ("R'G'B' u8"),
+                       cached->pixels, p->width * 3);
+      *pts = cached->pts;
+    }
+  g_mutex_unlock (&p->cache_mutex);
+
+  if (decoding)
+    g_mutex_unlock (&p->decoder_mutex);
+
+  return cached != NULL;
+}
+
+static gpointer
+read_ahead_thread_func (GeglOperation *operation)
+{
+  GeglProperties *o = GEGL_PROPERTIES (operation);
+  Priv           *p = (Priv*)o->user_data;
+
+  g_mutex_lock (&p->cache_mutex);
+
+  while (! p->read_ahead_quit)
+    {
+      glong    frame = p->read_ahead_frame;
+      gboolean cached;
+
+      if (frame < 0)
+        {
+          g_cond_wait (&p->read_ahead_cond, &p->cache_mutex);
+          continue;
+        }
+
+      p->read_ahead_frame = -1;
+      g_mutex_unlock (&p->cache_mutex);
+
+      g_mutex_lock (&p->decoder_mutex);
+
+      g_mutex_lock (&p->cache_mutex);
+      cached = find_cached_frame (p, frame) != NULL;
+      g_mutex_unlock (&p->cache_mutex);
+
+      if (! cached && ! decode_frame (operation, frame))
+        cache_decoded_frame (o, frame);
+
+      g_mutex_unlock (&p->decoder_mutex);
+
+      g_mutex_lock (&p->cache_mutex);
+    }
+
+  g_mutex_unlock (&p->cache_mutex);
+
+  return NULL;
+}
+
+/* when frames are requested in order, decode the one following frame in the
+ * background, while frame is being processed further down the graph.
+ */
+static void
+read_ahead (GeglOperation *operation,
+            glong          frame)
+{
+  GeglProperties *o = GEGL_PROPERTIES (operation);
+  Priv           *p = (Priv*)o->user_data;
+  gboolean        sequential;
+
+  sequential     = frame == p->prevrequest + 1;
+  p->prevrequest = frame;
+
+  if (! o->read_ahead || ! sequential || frame + 1 >= o->frames)
+    return;
+
+  g_mutex_lock (&p->cache_mutex);
+
+  if (! find_cached_frame (p, frame + 1))
+    {
+      p->read_ahead_frame = frame + 1;
+
+      if (! p->read_ahead_thread)
+        {
+          p->read_ahead_thread = g_thread_new ("ff-load read-ahead",
+                                               (GThreadFunc) read_ahead_thread_func,
+                                               operation);
+        }
+
+      g_cond_signal (&p->read_ahead_cond);
+    }
+
+  g_mutex_unlock (&p->cache_mutex);
+}
+
 static void
 prepare (GeglOperation *operation)
 {
   GeglProperties *o = GEGL_PROPERTIES (operation);
   Priv       *p = (Priv*)o->user_data;
+  gboolean    rewind;
 
   if (p == NULL)
     init (o);
@@ -448,10 +762,22 @@ prepare (GeglOperation *operation)
 
   gegl_operation_set_format (operation, "output", babl_format ("R'G'B' u8"));
 
+  g_mutex_lock (&p->cache_mutex);
+  p->frame_cache_size = o->frame_cache_size;
+  rewind = ! find_cached_frame (p, o->frame);
+  g_mutex_unlock (&p->cache_mutex);
+
+  if (rewind)
+    {
+      g_mutex_lock (&p->decoder_mutex);
+      rewind = p->prevframe > o->frame;
+      g_mutex_unlock (&p->decoder_mutex);
+    }
+
   if (o->path &&
       (!p->loadedfilename ||
       strcmp (p->loadedfilename, o->path) ||
-       p->prevframe > o->frame  /* a bit heavy handed, but improves consistency */
+       rewind  /* a bit heavy handed, but improves consistency */
       ))
     {
       gint i;
@@ -522,6 +848,8 @@ prepare (GeglOperation *operation)
                                                     AV_EF_BITSTREAM |
                                                     AV_EF_BUFFER;
           p->video_ctx->workaround_bugs = FF_BUG_AUTODETECT;
+          p->video_ctx->thread_count = o->thread_count;
+          p->video_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
 
 
           if (avcodec_open2 (p->video_ctx, p->video_codec, NULL) < 0)
@@ -580,6 +908,8 @@ prepare (GeglOperation *operation)
       p->loadedfilename = g_strdup (o->path);
       p->prevframe = -1;
       p->a_prevframe = -1;
+      p->draining = FALSE;
+      p->prevrequest = -1;
 
       if (p->video_stream)
         {
@@ -725,27 +1055,6 @@ static void get_sample_data (Priv *p, long sample_no, float *left, float *right)
   *right = 0;
 }
 
-static AVFrame *
-alloc_picture (int pix_fmt, int width, int height)
-{
-  AVFrame  *picture;
-  uint8_t  *picture_buf;
-  int       size;
-
-  picture = av_frame_alloc ();
-  if (!picture)
-    return NULL;
-  size = av_image_get_buffer_size (pix_fmt, width + 1, height + 1, 16);
-  picture_buf = malloc (size);
-  if (!picture_buf)
-    {
-      av_free (picture);
-      return NULL;
-    }
-  av_image_fill_arrays (picture->data, picture->linesize, picture_buf, pix_fmt, width, height, 1);
-  return picture;
-}
-
 static gboolean
 process (GeglOperation       *operation,
          GeglBuffer          *output,
@@ -754,72 +1063,56 @@ process (GeglOperation       *operation,
 {
   GeglProperties *o = GEGL_PROPERTIES (operation);
   Priv       *p = (Priv*)o->user_data;
+  glong       frame = o->frame;
+  gdouble     pts;
 
-  {
-    if (o->path && p->video_fcontext && !decode_frame (operation, o->frame))
-      {
-        long sample_start = 0;
+  if (!o->path || !p->video_fcontext)
+    return TRUE;
 
-        if (p->audio_stream)
-        {
-          int sample_count;
-          gegl_audio_fragment_set_sample_rate (o->audio, p->audio_stream->codecpar->sample_rate);
-          gegl_audio_fragment_set_channels    (o->audio, 2);
-          gegl_audio_fragment_set_channel_layout    (o->audio, GEGL_CH_LAYOUT_STEREO);
-          samples_per_frame (o->frame,
-               o->frame_rate, p->audio_stream->codecpar->sample_rate,
-               &sample_count,
-               &sample_start);
-
-          gegl_audio_fragment_set_sample_count (o->audio, sample_count);
-
-          if (p->video_stream != NULL)
-          {
-            /* if we got video stream
-               request audio to be decoded between prevpts and 5s into future*/
-            decode_audio (operation, p->prevpts, p->prevpts + 5.0);
+  if (frame < 0)
+    frame = 0;
+  else if (frame >= o->frames)
+    frame = o->frames - 1;
 
-          }
-          else
-          {
-            decode_audio (operation, o->frame / o->frame_rate, o->frame / o->frame_rate + 5);
-          }
+  if (p->video_stream)
+    {
+      if (!load_frame (operation, frame, output, &pts))
+        return TRUE;
 
-          {
-            int i;
-            for (i = 0; i < sample_count; i++)
-            {
-              get_sample_data (p, sample_start + i, &o->audio->data[0][i],
-                                  &o->audio->data[1][i]);
-            }
-          }
-        }
+      read_ahead (operation, frame);
+    }
+  else
+    {
+      pts = o->frame / o->frame_rate;
+    }
 
-        if (p->video_stream == NULL)
-          return TRUE;
+  if (p->audio_stream)
+    {
+      long sample_start = 0;
+      int  sample_count;
+      int  i;
 
-        if (p->video_ctx->pix_fmt == AV_PIX_FMT_RGB24)
-        {
-          GeglRectangle extent = {0,0,p->width,p->height};
-          gegl_buffer_set (output, &extent, 0, babl_format("R'G'B' u8"), p->lavc_frame->data[0], GEGL_AUTO_ROWSTRIDE);
-        }
-        else
+      gegl_audio_fragment_set_sample_rate (o->audio, p->audio_stream->codecpar->sample_rate);
+      gegl_audio_fragment_set_channels    (o->audio, 2);
+      gegl_audio_fragment_set_channel_layout    (o->audio, GEGL_CH_LAYOUT_STEREO);
+      samples_per_frame (o->frame,
+           o->frame_rate, p->audio_stream->codecpar->sample_rate,
+           &sample_count,
+           &sample_start);
+
+      gegl_audio_fragment_set_sample_count (o->audio, sample_count);
+
+      /* request audio to be decoded between the frame's timestamp and 5s
+         into the future */
+      decode_audio (operation, pts, pts + 5.0);
+
+      for (i = 0; i < sample_count; i++)
         {
-          struct SwsContext *img_convert_ctx;
-          GeglRectangle extent = {0,0,p->width,p->height};
-
-          img_convert_ctx = sws_getContext(p->width, p->height, p->video_ctx->pix_fmt,
-                                           p->width, p->height, AV_PIX_FMT_RGB24,
-                                           SWS_BICUBIC, NULL, NULL, NULL);
-          if (!p->rgb_frame)
-            p->rgb_frame = alloc_picture (AV_PIX_FMT_RGB24, p->width, p->height);
-          sws_scale (img_convert_ctx, (void*)p->lavc_frame->data,
-                     p->lavc_frame->linesize, 0, p->height, p->rgb_frame->data, p->rgb_frame->linesize);
-          gegl_buffer_set (output, &extent, 0, babl_format("R'G'B' u8"), p->rgb_frame->data[0], GEGL_AUTO_ROWSTRIDE);
-          sws_freeContext (img_convert_ctx);
+          get_sample_data (p, sample_start + i, &o->audio->data[0][i],
+                              &o->audio->data[1][i]);
         }
-      }
-  }
+    }
+
   return TRUE;
 }
 
@@ -834,6 +1127,10 @@ finalize (GObject *object)
       ff_cleanup (o);
       g_free (p->loadedfilename);
 
+      g_mutex_clear (&p->decoder_mutex);
+      g_mutex_clear (&p->cache_mutex);
+      g_cond_clear (&p->read_ahead_cond);
+
       g_clear_pointer (&o->user_data, g_free);
     }
 
@@ -50,6 +50,10 @@ property_int (video_bufsize, _("Video bufsize"), 0)
 property_string (container_format, _("Container format"), "auto")
    description (_("Container format to use, or auto to autodetect based on file extension."))
 
+property_int (thread_count, _("Thread count"), 0)
+   description (_("Number of threads the video codec encodes with, 0 picks a count based on the number of processors."))
+   value_range (0, 64)
+
 #ifdef USE_FINE_GRAINED_FFMPEG
 property_int (global_quality, _("global quality"), 0)
 
@@ -695,6 +699,10 @@ open_video (GeglProperties *o, AVFormatContext * oc, AVStream * st)
   if (p->oc->oformat->flags & AVFMT_GLOBALHEADER)
     c->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
+  /* let the encoder work on several frames, or slices, at once */
+  c->thread_count = o->thread_count;
+  c->thread_type  = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
 #if 0
   if (o->video_preset[0])
     av_dict_set (&codec_options, "preset", o->video_preset, 0);
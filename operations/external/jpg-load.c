@@ -237,11 +237,17 @@ gegl_jpg_load_query_jpg (GInputStream *stream,
   return status;
 }
 
+/* Decodes the rows of @roi (in full resolution coordinates) at mipmap
+ * @level into @gegl_buffer.  libjpeg scales in the IDCT by up to 1/8, so
+ * levels past 3 are written at level 3, and derived from it by the buffer.
+ */
 static gint
-gegl_jpg_load_buffer_import_jpg (GeglBuffer   *gegl_buffer,
-                                 GInputStream *stream,
-                                 gint          dest_x,
-                                 gint          dest_y)
+gegl_jpg_load_buffer_import_jpg (GeglBuffer          *gegl_buffer,
+                                 GInputStream        *stream,
+                                 gint                 dest_x,
+                                 gint                 dest_y,
+                                 const GeglRectangle *roi,
+                                 gint                 level)
 {
   gint row_stride;
   struct jpeg_decompress_struct  cinfo;
@@ -250,6 +256,8 @@ gegl_jpg_load_buffer_import_jpg (GeglBuffer   *gegl_buffer,
   JSAMPARRAY                     buffer;
   const Babl                    *format;
   GeglRectangle                  write_rect;
+  gint                           first_row;
+  gint                           last_row;
   GioSource gio_source = { stream, NULL, 1024 };
 
   cinfo.err = jpeg_std_error (&jerr);
@@ -266,6 +274,10 @@ gegl_jpg_load_buffer_import_jpg (GeglBuffer   *gegl_buffer,
    */
   cinfo.dct_method = JDCT_FLOAT;
 
+  level = CLAMP (level, 0, 3);
+  cinfo.scale_num   = 1;
+  cinfo.scale_denom = 1 << level;
+
   (void) jpeg_start_decompress (&cinfo);
 
   format = babl_from_jpeg_colorspace(cinfo.out_color_space,
@@ -287,26 +299,44 @@ gegl_jpg_load_buffer_import_jpg (GeglBuffer   *gegl_buffer,
   buffer = (*cinfo.mem->alloc_sarray)
     ((j_common_ptr) &cinfo, JPOOL_IMAGE, row_stride, 1);
 
-  write_rect.x = dest_x;
-  write_rect.y = dest_y;
+  write_rect.x = dest_x >> level;
+  write_rect.y = dest_y >> level;
   write_rect.width  = cinfo.output_width;
   write_rect.height = 1;
 
+  /* the scaled rows covering roi */
+  first_row = MAX (roi->y - dest_y, 0) >> level;
+  last_row  = MIN ((roi->y - dest_y + roi->height + (1 << level) - 1) >> level,
+                   (gint) cinfo.output_height);
+
+#ifdef LIBJPEG_TURBO_VERSION_NUMBER
+  /* rows above roi are only entropy decoded */
+  if (first_row > 0 && first_row < last_row)
+    jpeg_skip_scanlines (&cinfo, first_row);
+#endif
+
   // Most CMYK JPEG files are produced by Adobe Photoshop. Each component is stored where 0 means 100% ink
   // However this might not be case for all. Gory details: https://bugzilla.mozilla.org/show_bug.cgi?id=674619
   //
   // inverted cmyks are however how babl now expects jpgs so we're good
 
-  while (cinfo.output_scanline < cinfo.output_height)
+  while ((gint) cinfo.output_scanline < last_row)
     {
+      gint row = cinfo.output_scanline;
+
       jpeg_read_scanlines (&cinfo, buffer, 1);
 
-      gegl_buffer_set (gegl_buffer, &write_rect, 0,
+      if (row < first_row)
+        continue;
+
+      write_rect.y = (dest_y >> level) + row;
+      gegl_buffer_set (gegl_buffer, &write_rect, level,
                        format, buffer[0],
                        GEGL_AUTO_ROWSTRIDE);
-      write_rect.y += 1;
     }
 
+  /* any rows below roi are left undecoded */
+
   jpeg_destroy_decompress (&cinfo);
 
   return 0;
@@ -352,7 +382,7 @@ gegl_jpg_load_process (GeglOperation       *operation,
   GInputStream *stream = gegl_gio_open_input_stream(o->uri, o->path, &file, &err);
   if (!stream)
     return FALSE;
-  status = gegl_jpg_load_buffer_import_jpg(output, stream, 0, 0);
+  status = gegl_jpg_load_buffer_import_jpg(output, stream, 0, 0, result, level);
   g_input_stream_close(stream, NULL, NULL);
 
   if (err)
@@ -371,7 +401,19 @@ static GeglRectangle
 gegl_jpg_load_get_cached_region (GeglOperation       *operation,
                                  const GeglRectangle *roi)
 {
-  return gegl_jpg_load_get_bounding_box (operation);
+  GeglRectangle bounds = gegl_jpg_load_get_bounding_box (operation);
+  GeglRectangle result;
+
+  /* decoding proceeds along whole rows, from the top, so decode everything
+   * from the first row of roi down in one go; rows above it are skipped,
+   * and later requests below it are served from the cache.
+   */
+  gegl_rectangle_set (&result,
+                      bounds.x, roi->y,
+                      bounds.width, bounds.y + bounds.height - roi->y);
+  gegl_rectangle_intersect (&result, &result, &bounds);
+
+  return result;
 }
 
 static void
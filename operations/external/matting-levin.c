@@ -58,16 +58,6 @@ property_int    (active_levels, _("Active levels"), 2)
 #include <stdlib.h>
 #include <stdio.h>
 
-/* XXX: We have two options for the two common installation locations of
- * UMFPACK. Ideally this would be sorted out purely in autoconf; see
- * configure.ac for the issues.
- */
-#if defined(HAVE_UMFPACK_H)
-#include <umfpack.h>
-#elif defined (HAVE_SUITESPARSE_UMFPACK_H)
-#include <suitesparse/umfpack.h>
-#endif
-
 #include "matting-levin-cblas.h"
 
 
@@ -83,19 +73,21 @@ property_int    (active_levels, _("Active levels"), 2)
 #define CONVOLVE_RADIUS   2
 #define CONVOLVE_LEN     ((CONVOLVE_RADIUS * 2) + 1)
 
+#define THREAD_COST      (64 * 64 * 4)
+#define DOT_BLOCK_SIZE   4096
 
-/* A simple structure holding a compressed column sparse matrix. Data fields
- * correspond directly to the expected format used by UMFPACK. This restricts
- * us to using square matrices.
+
+/* A simple structure holding a square, compressed row sparse matrix. Rows
+ * correspond to image pixels, and the column indices within each row are
+ * strictly ascending. The matting laplacian is symmetric, so this is also
+ * its compressed column form.
  */
 typedef struct
 {
-  guint             elems,
-                    columns,
-                    rows;
-  SuiteSparse_long *col_idx,
-                   *row_idx;
-  gdouble          *values;
+  gint     rows;
+  gsize   *row_ptr;
+  gint    *col_idx;
+  gdouble *values;
 } sparse_t;
 
 
@@ -103,7 +95,7 @@ typedef struct
  * and larger; it's much more convenient:
  *   - Input R'G'B' needs to be converted into doubles later when calculating
  *     the matting laplacian, as the extra precision is actually useful here,
- *     and UMFPACK requires doubles.
+ *     and the solver works in doubles.
  *   - AUX Y' is easier to use as a double when dealing with the matting
  *     laplacian which is already in doubles.
  */
@@ -132,6 +124,19 @@ static const gdouble TRIMAP_ALPHA_THRESHOLD = 0.01;
 static const gint MIN_LEVEL_DIAMETER = 30;
 
 
+/* Termination criteria of the conjugate gradient solver: the residual norm,
+ * relative to the norm of the right hand side, and an iteration limit.
+ */
+static const gdouble SOLVER_TOLERANCE      = 1e-6;
+static const gint    SOLVER_MAX_ITERATIONS = 2000;
+
+
+/* The minimal height of the bands of window centers which are accumulated
+ * into the laplacian concurrently (see matting_get_laplacian).
+ */
+static const gint LAPLACIAN_BAND_HEIGHT = 16;
+
+
 /* Round upwards with performing `x / y' */
 static guint
 ceil_div (gint x, gint y)
@@ -182,49 +187,6 @@ trimap_masked (const gdouble       *restrict trimap,
 }
 
 
-static const char*
-matting_umf_error_to_string (guint err)
-{
-
-  switch (err)
-    {
-      case UMFPACK_OK:
-          return "UMFPACK_OK";
-      case UMFPACK_WARNING_singular_matrix:
-          return "UMFPACK_WARNING_singular_matrix";
-      case UMFPACK_WARNING_determinant_underflow:
-          return "UMFPACK_WARNING_determinant_underflow";
-      case UMFPACK_WARNING_determinant_overflow:
-          return "UMFPACK_WARNING_determinant_overflow";
-      case UMFPACK_ERROR_out_of_memory:
-          return "UMFPACK_ERROR_out_of_memory";
-      case UMFPACK_ERROR_invalid_Numeric_object:
-          return "UMFPACK_ERROR_invalid_Numeric_object";
-      case UMFPACK_ERROR_invalid_Symbolic_object:
-          return "UMFPACK_ERROR_invalid_Symbolic_object";
-      case UMFPACK_ERROR_argument_missing:
-          return "UMFPACK_ERROR_argument_missing";
-      case UMFPACK_ERROR_n_nonpositive:
-          return "UMFPACK_ERROR_n_nonpositive";
-      case UMFPACK_ERROR_invalid_matrix:
-          return "UMFPACK_ERROR_invalid_matrix";
-      case UMFPACK_ERROR_different_pattern:
-          return "UMFPACK_ERROR_different_pattern";
-      case UMFPACK_ERROR_invalid_system:
-          return "UMFPACK_ERROR_invalid_system";
-      case UMFPACK_ERROR_invalid_permutation:
-          return "UMFPACK_ERROR_invalid_permutation";
-      case UMFPACK_ERROR_internal_error:
-          return "UMFPACK_ERROR_internal_error";
-      case UMFPACK_ERROR_file_IO:
-          return "UMFPACK_ERROR_file_IO";
-
-      default:
-          g_return_val_if_reached ("Unknown UMFPACK error");
-    }
-}
-
-
 static void
 matting_prepare (GeglOperation *operation)
 {
@@ -555,22 +517,29 @@ matting_fill_borders (gdouble             *restrict image,
 }
 
 
-/* Calculate the coefficients needed to upsample a previously computed output
- * alpha map. Returns a surface of 4*doubles which correspond to:
- *    red * out[0] + green * out[1] + blue * out[2] + out[3]
- */
-static gdouble *
-matting_get_linear_coefficients (const gdouble       *restrict image,
-                                 const gdouble       *restrict alpha,
-                                 const GeglRectangle *restrict rect,
-                                 const gdouble        epsilon,
-                                 const gint           radius)
+typedef struct
+{
+  const gdouble       *image;
+  const gdouble       *alpha;
+  const GeglRectangle *rect;
+  gdouble              epsilon;
+  gint                 radius;
+  gdouble             *coeffs;
+} CoefficientsData;
+
+
+static void
+matting_get_linear_coefficients_range (gsize                   first_row,
+                                       gsize                   n_rows,
+                                       const CoefficientsData *data)
 {
-  gint     diameter     = radius * 2 + 1,
-           window_elems = diameter * diameter,
-           image_elems  = rect->width * rect->height;
-  gdouble *coeffs       = g_new0 (gdouble, image_elems * (COMPONENTS_INPUT + 1));
-  gint     x, y, i, j;
+  const gdouble       *image        = data->image;
+  const gdouble       *alpha        = data->alpha;
+  const GeglRectangle *rect         = data->rect;
+  gint                 radius       = data->radius;
+  gint                 diameter     = radius * 2 + 1,
+                       window_elems = diameter * diameter;
+  gint                 x, y, i, j;
 
   gdouble window  [window_elems + COMPONENTS_INPUT][COMPONENTS_INPUT + 1],
           winprod [COMPONENTS_INPUT + 1][COMPONENTS_INPUT + 1],
@@ -578,29 +547,20 @@ matting_get_linear_coefficients (const gdouble       *restrict image,
           invprod [COMPONENTS_INPUT + 1][window_elems + COMPONENTS_INPUT],
           alphmat [window_elems + COMPONENTS_INPUT][1];
 
-  g_return_val_if_fail (image, NULL);
-  g_return_val_if_fail (alpha, NULL);
-  g_return_val_if_fail (rect,  NULL);
-
-  g_return_val_if_fail (epsilon != 0.0, NULL);
-  g_return_val_if_fail (radius   > 0,   NULL);
-
-  g_return_val_if_fail (COMPONENTS_INPUT + 1 == COMPONENTS_COEFF, NULL);
-
   /* Zero out the main window matrix, and pre-set the lower window identity
    * matrix, ones, and zeroes.
    */
   memset (window,  0, sizeof (window));
   memset (alphmat, 0, sizeof (alphmat));
   for (i = 0; i < COMPONENTS_INPUT; ++i)
-    window[window_elems + i][i] = sqrtf (epsilon);
+    window[window_elems + i][i] = sqrtf (data->epsilon);
   for (i = 0; i < window_elems; ++i)
     window[i][COMPONENTS_INPUT] = 1.0;
 
   /* Calculate window's coefficients */
-  for (x = radius; x < rect->width - radius; ++x)
+  for (y = radius + first_row; y < (gint) (radius + first_row + n_rows); ++y)
     {
-      for (y = radius; y < rect->height - radius; ++y)
+      for (x = radius; x < rect->width - radius; ++x)
         {
           /*          / I_r, I_g, I_b, 1 \
            *          | ...  ...  ...  1 |
@@ -658,12 +618,51 @@ matting_get_linear_coefficients (const gdouble       *restrict image,
                        window_elems + COMPONENTS_INPUT, 1.0,
                        (gdouble *)invprod, window_elems + COMPONENTS_INPUT,
                        (gdouble *)alphmat, 1,
-                       0.0, coeffs + offset (x, y, rect, COMPONENTS_INPUT + 1), 1);
+                       0.0,
+                       data->coeffs + offset (x, y, rect, COMPONENTS_INPUT + 1),
+                       1);
         }
     }
+}
+
+
+/* Calculate the coefficients needed to upsample a previously computed output
+ * alpha map. Returns a surface of 4*doubles which correspond to:
+ *    red * out[0] + green * out[1] + blue * out[2] + out[3]
+ */
+static gdouble *
+matting_get_linear_coefficients (const gdouble       *restrict image,
+                                 const gdouble       *restrict alpha,
+                                 const GeglRectangle *restrict rect,
+                                 const gdouble        epsilon,
+                                 const gint           radius)
+{
+  gint             image_elems = rect->width * rect->height;
+  CoefficientsData data;
 
-  matting_fill_borders (coeffs, rect, COMPONENTS_COEFF, radius);
-  return coeffs;
+  g_return_val_if_fail (image, NULL);
+  g_return_val_if_fail (alpha, NULL);
+  g_return_val_if_fail (rect,  NULL);
+
+  g_return_val_if_fail (epsilon != 0.0, NULL);
+  g_return_val_if_fail (radius   > 0,   NULL);
+
+  g_return_val_if_fail (COMPONENTS_INPUT + 1 == COMPONENTS_COEFF, NULL);
+
+  data.image   = image;
+  data.alpha   = alpha;
+  data.rect    = rect;
+  data.epsilon = epsilon;
+  data.radius  = radius;
+  data.coeffs  = g_new0 (gdouble, image_elems * (COMPONENTS_INPUT + 1));
+
+  gegl_parallel_distribute_range (
+    rect->height - 2 * radius, THREAD_COST / rect->width,
+    (GeglParallelDistributeRangeFunc) matting_get_linear_coefficients_range,
+    &data);
+
+  matting_fill_borders (data.coeffs, rect, COMPONENTS_COEFF, radius);
+  return data.coeffs;
 }
 
 
@@ -865,15 +864,19 @@ cleanup:
 }
 
 
+/* Creates a square sparse matrix, taking ownership of the ROW_PTR array of
+ * ROWS + 1 offsets. Column indices are allocated but left uninitialised,
+ * values are zeroed.
+ */
 static sparse_t *
-matting_sparse_new (guint cols, guint rows, guint elems)
+matting_sparse_new (gint   rows,
+                    gsize *row_ptr)
 {
   sparse_t *s = g_new (sparse_t, 1);
-  s->columns  = cols;
   s->rows     = rows;
-  s->col_idx  = g_new  (SuiteSparse_long, cols + 1);
-  s->row_idx  = g_new  (SuiteSparse_long, elems);
-  s->values   = g_new0 (gdouble, elems);
+  s->row_ptr  = row_ptr;
+  s->col_idx  = g_new  (gint,    row_ptr[rows]);
+  s->values   = g_new0 (gdouble, row_ptr[rows]);
 
   return s;
 }
@@ -885,22 +888,22 @@ matting_sparse_free (sparse_t *s)
   if (!s)
       return;
 
-  g_free (s->row_idx);
+  g_free (s->row_ptr);
   g_free (s->col_idx);
   g_free (s->values);
   g_free (s);
 }
 
 
-static guint
+static gsize
 matting_sparse_elems (const sparse_t *s)
 {
-  return s->col_idx[s->columns];
+  return s->row_ptr[s->rows];
 }
 
 
 /* Debugging function which ensures the sparse matrix fields are consistent
- * with what UMFPACK, and the matting algorithm, would expect.
+ * with what the solver, and the matting algorithm, would expect.
  *
  * Returns FALSE, using glib debugging routines, if there is an error. Else,
  * returns TRUE.
@@ -908,58 +911,333 @@ matting_sparse_elems (const sparse_t *s)
 static gboolean
 matting_verify (const sparse_t *s)
 {
-  guint     i, j;
-  gboolean *rows;
+  gint  i;
+  gsize j;
 
-  /* Must be a square matrix */
-  g_return_val_if_fail (s->columns == s->rows, FALSE);
-  g_return_val_if_fail (s->col_idx[0] == 0,    FALSE);
+  g_return_val_if_fail (s->row_ptr[0] == 0, FALSE);
+  g_return_val_if_fail (matting_sparse_elems (s) >= (gsize) s->rows, FALSE);
 
-  for (i = 1; i < s->columns; ++i)
+  for (i = 0; i < s->rows; ++i)
     {
-      /* Strictly ascending column indices */
-      guint col = s->col_idx[i];
-      g_return_val_if_fail (s->col_idx[i - 1] <= col, FALSE);
+      /* We expect to have entries for each row in the matrix (at the very
+       * least the diagonal). Note: this is not a requirement of the format;
+       * rather, something we expect of the matrix from the matting
+       * algorithm.
+       */
+      g_return_val_if_fail (s->row_ptr[i] < s->row_ptr[i + 1], FALSE);
 
-      for (j = s->col_idx[i] + 1; j < s->col_idx[i + 1]; ++j)
+      for (j = s->row_ptr[i]; j < s->row_ptr[i + 1]; ++j)
         {
-          /* Strictly ascending row indices, within a column */
-          guint row = s->row_idx[j];
-          g_return_val_if_fail (s->row_idx[j - 1] < row, FALSE);
-          g_return_val_if_fail (row < s->rows,           FALSE);
+          /* Strictly ascending column indices, within a row */
+          g_return_val_if_fail (s->col_idx[j] >= 0,      FALSE);
+          g_return_val_if_fail (s->col_idx[j] < s->rows, FALSE);
+          g_return_val_if_fail (j == s->row_ptr[i] ||
+                                s->col_idx[j - 1] < s->col_idx[j], FALSE);
         }
     }
 
-  /* We expect to have entries for each column in the matrix. Note: this is
-   * not a requirement of the UMFPACK format; rather, something we expect of
-   * the matrix from the matting algorithm.
-   */
-  rows = g_new (gboolean, s->rows);
+  return TRUE;
+}
 
-  for (i = 0; i < s->rows; ++i)
-    rows [i] = FALSE;
-  for (i = 0; i < matting_sparse_elems (s); ++i)
+
+typedef struct
+{
+  const gdouble       *image;
+  const gdouble       *trimap;
+  const GeglRectangle *roi;
+  gint                 radius;
+  gdouble              epsilon;
+  gdouble              lambda;
+  gint                 band_height;
+  gint                 phase;
+  guchar              *touched;
+  gsize               *row_ptr;
+  sparse_t            *laplacian;
+} LaplacianData;
+
+
+/* Returns TRUE if the pixel at (X, Y) lies within the window of a masked
+ * pixel, and hence has off-diagonal entries in the laplacian.
+ */
+static gboolean
+matting_laplacian_touched (const LaplacianData *data,
+                           gint                 x,
+                           gint                 y)
+{
+  const GeglRectangle *roi    = data->roi;
+  gint                 radius = data->radius;
+  gint                 i, j;
+
+  for (j = MAX (y - radius, radius);
+       j <= MIN (y + radius, roi->height - radius - 1);
+       ++j)
     {
-      guint row = s->row_idx[i];
-      if (!(row < s->rows))
+      for (i = MAX (x - radius, radius);
+           i <= MIN (x + radius, roi->width - radius - 1);
+           ++i)
         {
-          g_free (rows);
-          g_return_val_if_reached (FALSE);
+          if (trimap_masked (data->trimap, i, j, roi))
+            return TRUE;
         }
-      rows[row] = TRUE;
     }
-  for (i = 0; i < s->rows; ++i)
+
+  return FALSE;
+}
+
+
+/* Rows of pixels touched by a window hold the full (clipped) stencil of
+ * pixels within twice the radius, other rows hold only the diagonal. The
+ * number of entries of each row is stored into ROW_PTR[row + 1].
+ */
+static void
+matting_laplacian_count_range (gsize                first_row,
+                               gsize                n_rows,
+                               const LaplacianData *data)
+{
+  const GeglRectangle *roi    = data->roi;
+  gint                 reach  = 2 * data->radius;
+  gint                 x, y;
+
+  for (y = first_row; y < (gint) (first_row + n_rows); ++y)
     {
-      if (!rows[i])
+      gint y0 = MAX (y - reach, 0),
+           y1 = MIN (y + reach, roi->height - 1);
+
+      for (x = 0; x < roi->width; ++x)
         {
-          g_free (rows);
-          g_return_val_if_reached (FALSE);
+          gint a = x + y * roi->width;
+
+          data->touched[a] = matting_laplacian_touched (data, x, y);
+
+          if (data->touched[a])
+            {
+              gint x0 = MAX (x - reach, 0),
+                   x1 = MIN (x + reach, roi->width - 1);
+
+              data->row_ptr[a + 1] = (x1 - x0 + 1) * (y1 - y0 + 1);
+            }
+          else
+            {
+              data->row_ptr[a + 1] = 1;
+            }
         }
-      }
+    }
+}
 
-  g_free (rows);
 
-  return TRUE;
+static void
+matting_laplacian_columns_range (gsize                first_row,
+                                 gsize                n_rows,
+                                 const LaplacianData *data)
+{
+  const GeglRectangle *roi       = data->roi;
+  sparse_t            *laplacian = data->laplacian;
+  gint                 reach     = 2 * data->radius;
+  gint                 x, y, i, j;
+
+  for (y = first_row; y < (gint) (first_row + n_rows); ++y)
+    {
+      gint y0 = MAX (y - reach, 0),
+           y1 = MIN (y + reach, roi->height - 1);
+
+      for (x = 0; x < roi->width; ++x)
+        {
+          gint  a      = x + y * roi->width;
+          gint *col    = laplacian->col_idx + laplacian->row_ptr[a];
+
+          if (data->touched[a])
+            {
+              gint x0 = MAX (x - reach, 0),
+                   x1 = MIN (x + reach, roi->width - 1);
+
+              for (j = y0; j <= y1; ++j)
+                for (i = x0; i <= x1; ++i)
+                  *col++ = i + j * roi->width;
+            }
+          else
+            {
+              *col = a;
+            }
+        }
+    }
+}
+
+
+/* Accumulates the contribution of each masked window, whose centers lie
+ * within the given bands of rows. Only every second band is processed in
+ * each phase, so concurrently processed bands never write to the same rows
+ * of the matrix.
+ */
+static void
+matting_laplacian_accumulate_range (gsize                first_band,
+                                    gsize                n_bands,
+                                    const LaplacianData *data)
+{
+  const gdouble       *image     = data->image;
+  const GeglRectangle *roi       = data->roi;
+  sparse_t            *laplacian = data->laplacian;
+  gint                 radius    = data->radius;
+  gdouble              epsilon   = data->epsilon;
+  gint                 diameter     = radius * 2 + 1,
+                       window_elems = diameter * diameter,
+                       reach        = radius * 2;
+  gint                 band, i, j, k, x, y;
+
+  gdouble       mean[COMPONENTS_INPUT],
+         mean_matrix[COMPONENTS_INPUT][COMPONENTS_INPUT],
+          covariance[COMPONENTS_INPUT][COMPONENTS_INPUT],
+             inverse[COMPONENTS_INPUT][COMPONENTS_INPUT],
+              window[COMPONENTS_INPUT][window_elems],
+             winxinv[COMPONENTS_INPUT][window_elems],
+                  values[window_elems][window_elems];
+
+  for (band = first_band; band < (gint) (first_band + n_bands); ++band)
+    {
+      gint band_y0 = radius + (2 * band + data->phase) * data->band_height,
+           band_y1 = MIN (band_y0 + data->band_height, roi->height - radius);
+
+      for (j = band_y0; j < band_y1; ++j)
+        {
+          for (i = radius; i < roi->width - radius; ++i)
+            {
+              /* Skip if the pixel is valid in the the trimap */
+              if (!trimap_masked (data->trimap, i, j, roi))
+                continue;
+
+              /* Calculate window's component means, and their vector
+               * product (which we will use later to calculate the
+               * covariance matrix). Store the values into the window matrix
+               * as we go.
+               */
+              mean[0] = mean[1] = mean[2] = 0.0;
+              k = 0;
+              for (y = j - radius; y <= j + radius; ++y)
+                for (x = i - radius; x <= i + radius; ++x)
+                  {
+                    mean[0] += window[0][k] = image[(x + y * roi->width) * COMPONENTS_INPUT + 0];
+                    mean[1] += window[1][k] = image[(x + y * roi->width) * COMPONENTS_INPUT + 1];
+                    mean[2] += window[2][k] = image[(x + y * roi->width) * COMPONENTS_INPUT + 2];
+                    ++k;
+                  }
+
+              mean[0] /= window_elems;
+              mean[1] /= window_elems;
+              mean[2] /= window_elems;
+
+              matting_vector3_self_product (mean, mean_matrix);
+
+              /*
+               * Calculate inverse covariance matrix.
+               */
+
+              /* Multiply the 'component x window' matrix with its transpose
+               * to form a 3x3 matrix which is the first component of the
+               * covariance matrix.
+               */
+              cblas_dgemm (CblasRowMajor, CblasNoTrans, CblasTrans,
+                           COMPONENTS_INPUT, COMPONENTS_INPUT, window_elems,
+                           1.0 / window_elems,
+                           (gdouble *)window, window_elems,
+                           (gdouble *)window, window_elems,
+                           0.0,  (gdouble *)covariance, COMPONENTS_INPUT);
+
+              /* Subtract the mean to create the covariance matrix, then add
+               * the epsilon term and invert.
+               */
+              matting_matrix3_matrix3_sub (covariance, mean_matrix, covariance);
+              covariance[0][0] += epsilon / window_elems;
+              covariance[1][1] += epsilon / window_elems;
+              covariance[2][2] += epsilon / window_elems;
+              matting_matrix3_inverse     (covariance, inverse);
+
+              /* Subtract each component's mean from the pixels */
+              for (k = 0; k < window_elems; ++k)
+                {
+                  window[0][k] -= mean[0];
+                  window[1][k] -= mean[1];
+                  window[2][k] -= mean[2];
+                }
+
+              /* Calculate the values for the matting matrix */
+              cblas_dgemm (CblasRowMajor, CblasNoTrans, CblasNoTrans,
+                           COMPONENTS_INPUT, window_elems, COMPONENTS_INPUT,
+                           1.0,
+                           (gdouble *)inverse, COMPONENTS_INPUT,
+                           (gdouble *) window, window_elems,
+                           0.0, (gdouble *)winxinv, window_elems);
+
+              cblas_dgemm (CblasRowMajor, CblasTrans, CblasNoTrans,
+                           window_elems, window_elems, COMPONENTS_INPUT,
+                           1.0,
+                           (gdouble *) window, window_elems,
+                           (gdouble *)winxinv, window_elems,
+                           0.0, (gdouble *)values, window_elems);
+
+              /* Accumulate the values into the stencil of each row */
+              for (y = 0; y < window_elems; ++y)
+                {
+                  gint     ax  = i - radius + y % diameter,
+                           ay  = j - radius + y / diameter,
+                           x0  = MAX (ax - reach, 0),
+                           y0  = MAX (ay - reach, 0),
+                           nx  = MIN (ax + reach, roi->width - 1) - x0 + 1;
+                  gdouble *row = laplacian->values +
+                                 laplacian->row_ptr[ax + ay * roi->width];
+
+                  for (x = 0; x < window_elems; ++x)
+                    {
+                      gint bx = i - radius + x % diameter,
+                           by = j - radius + x / diameter;
+
+                      row[(by - y0) * nx + (bx - x0)] +=
+                        (1.0 + values[y][x]) / window_elems;
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+/* Negates each entry of the given rows, and sets the diagonal such that the
+ * sum of the row equals `lambda' if the trimap entry is valid, or zero
+ * otherwise.
+ */
+static void
+matting_laplacian_finalize_range (gsize                first_row,
+                                  gsize                n_rows,
+                                  const LaplacianData *data)
+{
+  sparse_t *laplacian = data->laplacian;
+  gint      a;
+  gsize     k;
+
+  for (a = first_row; a < (gint) (first_row + n_rows); ++a)
+    {
+      gdouble row_sum  = 0.0;
+      gsize   diagonal = laplacian->row_ptr[a];
+
+      for (k = laplacian->row_ptr[a]; k < laplacian->row_ptr[a + 1]; ++k)
+        {
+          if (laplacian->col_idx[k] == a)
+            diagonal = k;
+
+          row_sum += laplacian->values[k];
+          laplacian->values[k] = -laplacian->values[k];
+        }
+
+      laplacian->values[diagonal] += row_sum;
+      if (!trimap_masked (data->trimap, a, 0, data->roi))
+        laplacian->values[diagonal] += data->lambda;
+
+      /* Double check that the row equals either 0.0 or lambda */
+      row_sum = 0.0;
+      for (k = laplacian->row_ptr[a]; k < laplacian->row_ptr[a + 1]; ++k)
+        row_sum += laplacian->values[k];
+
+      g_warn_if_fail (float_cmp (row_sum, 0.0) ||
+                      float_cmp (row_sum, data->lambda));
+    }
 }
 
 
@@ -967,10 +1245,10 @@ matting_verify (const sparse_t *s)
  * We accumulate entries in a sparse banded matrix, for a radius around each
  * pixel in the image.
  *
- * We construct a triplet form of the matrix initially, then transform to
- * compressed column. This is much simpler than directly constructing the
- * compressed column form, and does not appear to cause a performance
- * bottleneck (though does consume additional memory).
+ * The compressed row layout is fixed up front: every row touched by a
+ * window reserves the full stencil of pixels within twice the radius (some
+ * of which will remain zero), which lets the windows accumulate their
+ * values in place rather than through an intermediate triplet form.
  */
 static sparse_t*
 matting_get_laplacian (const gdouble       *restrict image,
@@ -980,209 +1258,233 @@ matting_get_laplacian (const gdouble       *restrict image,
                        const gdouble        epsilon,
                        const gdouble        lambda)
 {
-  gint      diameter     = radius * 2 + 1,
-            window_elems = diameter * diameter,
-            image_elems  = roi->width * roi->height,
-            i, j, k, x, y,
-            status;
-  SuiteSparse_long *trip_col,
-                   *trip_row;
-  glong     trip_nz = 0,
-            trip_cursor = 0,
-            trip_masked = 0;
-  gdouble  *trip_val;
-  sparse_t *laplacian;
-
-  gdouble       mean[COMPONENTS_INPUT],
-         mean_matrix[COMPONENTS_INPUT][COMPONENTS_INPUT],
-          covariance[COMPONENTS_INPUT][COMPONENTS_INPUT],
-             inverse[COMPONENTS_INPUT][COMPONENTS_INPUT],
-              window[COMPONENTS_INPUT][window_elems],
-             winxinv[COMPONENTS_INPUT][window_elems],
-                  values[window_elems][window_elems];
+  gint          image_elems = roi->width * roi->height,
+                n_bands,
+                i;
+  LaplacianData data;
 
   g_return_val_if_fail (radius > 0, NULL);
   g_return_val_if_fail (COMPONENTS_INPUT == 3, NULL);
 
-  for (j = radius; j < roi->height - radius; ++j)
+  data.image       = image;
+  data.trimap      = trimap;
+  data.roi         = roi;
+  data.radius      = radius;
+  data.epsilon     = epsilon;
+  data.lambda      = lambda;
+  data.band_height = MAX (LAPLACIAN_BAND_HEIGHT, 2 * radius);
+  data.touched     = g_new (guchar, image_elems);
+  data.row_ptr     = g_new (gsize,  image_elems + 1);
+
+  /* Lay out the rows of the matrix */
+  gegl_parallel_distribute_range (
+    roi->height, THREAD_COST / roi->width,
+    (GeglParallelDistributeRangeFunc) matting_laplacian_count_range,
+    &data);
+
+  data.row_ptr[0] = 0;
+  for (i = 0; i < image_elems; ++i)
+    data.row_ptr[i + 1] += data.row_ptr[i];
+
+  data.laplacian = matting_sparse_new (image_elems, data.row_ptr);
+
+  gegl_parallel_distribute_range (
+    roi->height, THREAD_COST / roi->width,
+    (GeglParallelDistributeRangeFunc) matting_laplacian_columns_range,
+    &data);
+
+  /* Compute the contribution of each window in the image to the laplacian */
+  n_bands = ceil_div (MAX (roi->height - 2 * radius, 0), data.band_height);
+
+  for (data.phase = 0; data.phase < 2; ++data.phase)
     {
-      for (i = radius; i < roi->width - radius; ++i)
+      gint n_phase_bands = (n_bands - data.phase + 1) / 2;
+
+      if (n_phase_bands > 0)
         {
-          if (trimap_masked (trimap, i, j, roi))
-            trip_masked++;
+          gegl_parallel_distribute_range (
+            n_phase_bands, 0.0,
+            (GeglParallelDistributeRangeFunc) matting_laplacian_accumulate_range,
+            &data);
         }
     }
 
-  trip_nz   = trip_masked * window_elems * window_elems;
-  trip_nz  += image_elems; // Sparse diagonal and row summing at conclusion
+  gegl_parallel_distribute_range (
+    image_elems, THREAD_COST,
+    (GeglParallelDistributeRangeFunc) matting_laplacian_finalize_range,
+    &data);
+
+  g_free (data.touched);
+
+  return data.laplacian;
+}
 
-  trip_col  = g_new  (SuiteSparse_long, trip_nz);
-  trip_row  = g_new  (SuiteSparse_long, trip_nz);
-  trip_val  = g_new0 (gdouble, trip_nz);
 
-  /* Compute the contribution of each pixel in the image to the laplacian */
-  for (i = radius; i < roi->width - radius; ++i)
+typedef struct
+{
+  const sparse_t *matrix;
+  const gdouble  *rhs;
+  const gdouble  *inv_diag;
+  gdouble        *x;
+  gdouble        *r;
+  gdouble        *z;
+  gdouble        *p;
+  gdouble        *q;
+  gdouble         alpha;
+  gdouble         beta;
+  gint            n_blocks;
+  /* Per block partial dot products */
+  gdouble        *pq;
+  gdouble        *rz;
+  gdouble        *rr;
+  gdouble        *bb;
+} SolverData;
+
+
+/* Dot products are accumulated per fixed size block, and the partial sums
+ * then added in order, so the result doesn't depend on the number of
+ * threads.
+ */
+static gdouble
+matting_solver_sum (const gdouble *partials,
+                    gint           n_blocks)
+{
+  gdouble sum = 0.0;
+  gint    i;
+
+  for (i = 0; i < n_blocks; ++i)
+    sum += partials[i];
+
+  return sum;
+}
+
+
+/* q = A p, pq = p . q */
+static void
+matting_solver_spmv_range (gsize       first_block,
+                           gsize       n_blocks,
+                           SolverData *data)
+{
+  const sparse_t *matrix = data->matrix;
+  gsize           block;
+
+  for (block = first_block; block < first_block + n_blocks; ++block)
     {
-      for (j = radius; j < roi->height - radius; ++j)
+      gint    a0 = block * DOT_BLOCK_SIZE,
+              a1 = MIN (a0 + DOT_BLOCK_SIZE, matrix->rows),
+              a;
+      gdouble pq = 0.0;
+
+      for (a = a0; a < a1; ++a)
         {
-          /* Skip if the pixel is valid in the the trimap */
-          if (!trimap_masked (trimap, i, j, roi))
-            continue;
-          trip_masked--;
-          g_return_val_if_fail (trip_masked >= 0, FALSE);
+          gdouble sum = 0.0;
+          gsize   k;
 
-          /* Calculate window's component means, and their vector product
-           * (which we will use later to calculate the covariance matrix).
-           * Store the values into the window matrix as we go.
-           */
-          mean[0] = mean[1] = mean[2] = 0.0;
-          k = 0;
-          for (y = j - radius; y <= j + radius; ++y)
-            for (x = i - radius; x <= i + radius; ++x)
-              {
-                mean[0] += window[0][k] = image[(x + y * roi->width) * COMPONENTS_INPUT + 0];
-                mean[1] += window[1][k] = image[(x + y * roi->width) * COMPONENTS_INPUT + 1];
-                mean[2] += window[2][k] = image[(x + y * roi->width) * COMPONENTS_INPUT + 2];
-                ++k;
-              }
+          for (k = matrix->row_ptr[a]; k < matrix->row_ptr[a + 1]; ++k)
+            sum += matrix->values[k] * data->p[matrix->col_idx[k]];
 
-          mean[0] /= window_elems;
-          mean[1] /= window_elems;
-          mean[2] /= window_elems;
+          data->q[a] = sum;
+          pq        += data->p[a] * sum;
+        }
 
-          matting_vector3_self_product (mean, mean_matrix);
+      data->pq[block] = pq;
+    }
+}
 
-          /*
-           * Calculate inverse covariance matrix.
-           */
 
-          /* Multiply the 'component x window' matrix with its transpose to
-           * form a 3x3 matrix which is the first component of the covariance
-           * matrix.
-           */
-          cblas_dgemm (CblasRowMajor, CblasNoTrans, CblasTrans,
-                       COMPONENTS_INPUT, COMPONENTS_INPUT, window_elems,
-                       1.0 / window_elems,
-                       (gdouble *)window, window_elems,
-                       (gdouble *)window, window_elems,
-                       0.0,  (gdouble *)covariance, COMPONENTS_INPUT);
-
-          /* Subtract the mean to create the covariance matrix, then add the
-           * epsilon term and invert.
-           */
-          matting_matrix3_matrix3_sub (covariance, mean_matrix, covariance);
-          covariance[0][0] += epsilon / window_elems;
-          covariance[1][1] += epsilon / window_elems;
-          covariance[2][2] += epsilon / window_elems;
-          matting_matrix3_inverse     (covariance, inverse);
-
-          /* Subtract each component's mean from the pixels */
-          for (k = 0; k < window_elems; ++k)
-            {
-              window[0][k] -= mean[0];
-              window[1][k] -= mean[1];
-              window[2][k] -= mean[2];
-            }
+/* r = b - q, z = M^-1 r, p = z, where q holds A x0 */
+static void
+matting_solver_init_range (gsize       first_block,
+                           gsize       n_blocks,
+                           SolverData *data)
+{
+  gsize block;
 
-          /* Calculate the values for the matting matrix */
-          cblas_dgemm (CblasRowMajor, CblasNoTrans, CblasNoTrans,
-                       COMPONENTS_INPUT, window_elems, COMPONENTS_INPUT,
-                       1.0,
-                       (gdouble *)inverse, COMPONENTS_INPUT,
-                       (gdouble *) window, window_elems,
-                       0.0, (gdouble *)winxinv, window_elems);
+  for (block = first_block; block < first_block + n_blocks; ++block)
+    {
+      gint    a0 = block * DOT_BLOCK_SIZE,
+              a1 = MIN (a0 + DOT_BLOCK_SIZE, data->matrix->rows),
+              a;
+      gdouble rz = 0.0,
+              rr = 0.0,
+              bb = 0.0;
+
+      for (a = a0; a < a1; ++a)
+        {
+          data->r[a] = data->rhs[a] - data->q[a];
+          data->z[a] = data->inv_diag[a] * data->r[a];
 
-          cblas_dgemm (CblasRowMajor, CblasTrans, CblasNoTrans,
-                       window_elems, window_elems, COMPONENTS_INPUT,
-                       1.0,
-                       (gdouble *) window, window_elems,
-                       (gdouble *)winxinv, window_elems,
-                       0.0, (gdouble *)values, window_elems);
-
-          /* Store the values and coordinates */
-          for (y = 0; y < window_elems; ++y)
-            for (x = 0; x < window_elems; ++x)
-              {
-                SuiteSparse_long yx = y % diameter,
-                                 yy = y / diameter,
-                                 xx = x % diameter,
-                                 xy = x / diameter;
-
-                g_return_val_if_fail (trip_cursor < trip_nz, FALSE);
-                trip_col[trip_cursor] = (i - radius + yx) + (j - radius + yy) * roi->width,
-                trip_row[trip_cursor] = (i - radius + xx) + (j - radius + xy) * roi->width,
-                trip_val[trip_cursor] = (1.0 + values[y][x]) / window_elems;
-                ++trip_cursor;
-              }
+          rz += data->r[a]   * data->z[a];
+          rr += data->r[a]   * data->r[a];
+          bb += data->rhs[a] * data->rhs[a];
         }
+
+      data->rz[block] = rz;
+      data->rr[block] = rr;
+      data->bb[block] = bb;
     }
+}
 
-  {
-    gdouble *row_sum = g_new (gdouble, image_elems);
-
-    /* Calculate the sum of all the elements in each row */
-    for (i = 0; i < image_elems; ++i)
-      row_sum[i] = 0.0;
-    for (i = 0; i < trip_cursor; ++i)
-      row_sum[trip_row[i]]  += trip_val[i];
-
-    /* Negate each entry of the matrix. This partially implements a
-     * subtraction from the diagonal matrix:
-     *    [lambda + sum, lambda + sum, ..., lambda + sum]
-     */
-    for (i = 0; i < trip_cursor; ++i)
-      trip_val[i] = -trip_val[i];
-
-    /* Set the diagonal such that the sum of the row equals `lambda' if the
-     * trimap entry is valid
-     */
-    for (i = 0; i < image_elems; ++i)
-      {
-        trip_col[trip_cursor] = i;
-        trip_row[trip_cursor] = i;
-        trip_val[trip_cursor] = row_sum[i];
-
-        if (!trimap_masked (trimap, i, 0, roi))
-          trip_val[trip_cursor] += lambda;
-        trip_cursor++;
-      }
-
-    /* Double check that each row equals either 0.0 or lambda */
-    for (i = 0; i < image_elems; ++i)
-      row_sum[i] = 0.0;
-    for (i = 0; i < trip_cursor; ++i)
-      row_sum[trip_row[i]]  += trip_val[i];
-    for (i = 0; i < image_elems; ++i)
-      {
-        g_warn_if_fail (float_cmp (row_sum [i], 0.0) ||
-                        float_cmp (row_sum [i], lambda));
-      }
-
-    g_free (row_sum);
-  }
 
-  g_warn_if_fail (trip_cursor == trip_nz);
-
-  /* Convert to the compressed column format expected by UMFPACK */
-  laplacian = matting_sparse_new (image_elems, image_elems, trip_cursor);
-  status    = umfpack_dl_triplet_to_col (laplacian->rows,
-                                         laplacian->columns,
-                                         trip_cursor,
-                                         trip_row, trip_col, trip_val,
-                                         laplacian->col_idx,
-                                         laplacian->row_idx,
-                                         laplacian->values,
-                                         NULL);
-
-  g_free (trip_col);
-  g_free (trip_row);
-  g_free (trip_val);
-
-  g_return_val_if_fail (status == UMFPACK_OK, FALSE);
-  return laplacian;
+/* x += alpha p, r -= alpha q, z = M^-1 r */
+static void
+matting_solver_update_range (gsize       first_block,
+                             gsize       n_blocks,
+                             SolverData *data)
+{
+  gsize block;
+
+  for (block = first_block; block < first_block + n_blocks; ++block)
+    {
+      gint    a0 = block * DOT_BLOCK_SIZE,
+              a1 = MIN (a0 + DOT_BLOCK_SIZE, data->matrix->rows),
+              a;
+      gdouble rz = 0.0,
+              rr = 0.0;
+
+      for (a = a0; a < a1; ++a)
+        {
+          data->x[a] += data->alpha * data->p[a];
+          data->r[a] -= data->alpha * data->q[a];
+          data->z[a]  = data->inv_diag[a] * data->r[a];
+
+          rz += data->r[a] * data->z[a];
+          rr += data->r[a] * data->r[a];
+        }
+
+      data->rz[block] = rz;
+      data->rr[block] = rr;
+    }
 }
 
 
+/* p = z + beta p */
+static void
+matting_solver_direction_range (gsize       first_block,
+                                gsize       n_blocks,
+                                SolverData *data)
+{
+  gsize block;
+
+  for (block = first_block; block < first_block + n_blocks; ++block)
+    {
+      gint a0 = block * DOT_BLOCK_SIZE,
+           a1 = MIN (a0 + DOT_BLOCK_SIZE, data->matrix->rows),
+           a;
+
+      for (a = a0; a < a1; ++a)
+        data->p[a] = data->z[a] + data->beta * data->p[a];
+    }
+}
+
+
+/* Solves the matting laplacian using a jacobi preconditioned conjugate
+ * gradient method. `solution' must hold the initial guess, which is refined
+ * in place. The laplacian is symmetric and positive semi-definite, with the
+ * trimap weighting lying on the diagonal, so this converges towards the same
+ * result as a direct solver; while being trivially parallel and benefitting
+ * from a good initial guess from coarser levels.
+ */
 static gboolean
 matting_solve_laplacian (gdouble             *restrict trimap,
                          sparse_t            *restrict laplacian,
@@ -1190,13 +1492,12 @@ matting_solve_laplacian (gdouble             *restrict trimap,
                          const GeglRectangle *restrict roi,
                          gdouble              lambda)
 {
-  void    *symbolic = NULL,
-          *numeric  = NULL;
-  gint     status;
-  guint    image_elems, i;
-  gboolean success = FALSE;
-  gdouble  umfcontrol[UMFPACK_CONTROL],
-           umfinfo[UMFPACK_INFO];
+  SolverData data;
+  gdouble   *rhs,
+            *inv_diag;
+  gdouble    rz, rr, bb;
+  gint       image_elems, i, iteration;
+  gdouble    block_cost;
 
   g_return_val_if_fail (trimap,    FALSE);
   g_return_val_if_fail (laplacian, FALSE);
@@ -1206,84 +1507,132 @@ matting_solve_laplacian (gdouble             *restrict trimap,
   g_return_val_if_fail (!gegl_rectangle_is_empty (roi), FALSE);
   image_elems = roi->width * roi->height;
 
-  g_return_val_if_fail (laplacian->columns == image_elems, FALSE);
-  g_return_val_if_fail (laplacian->rows    == image_elems, FALSE);
+  g_return_val_if_fail (laplacian->rows == image_elems, FALSE);
+
+  if (!matting_verify (laplacian))
+    return FALSE;
 
-  matting_verify (laplacian);
+  rhs      = g_new (gdouble, image_elems);
+  inv_diag = g_new (gdouble, image_elems);
 
-  umfpack_di_defaults (umfcontrol);
-  /* Pre-process the matrix */
-  if ((status = umfpack_dl_symbolic (laplacian->rows,
-                                     laplacian->columns,
-                                     laplacian->col_idx,
-                                     laplacian->row_idx,
-                                     laplacian->values,
-                                     &symbolic,
-                                     umfcontrol, umfinfo)) < 0)
+  for (i = 0; i < image_elems; ++i)
     {
-      symbolic = NULL;
-      goto cleanup;
+      gsize k;
+
+      if (trimap_masked (trimap, i, 0, roi))
+        rhs[i] = 0;
+      else
+        rhs[i] = lambda * trimap[i * COMPONENTS_AUX + AUX_VALUE];
+
+      inv_diag[i] = 0.0;
+      for (k = laplacian->row_ptr[i]; k < laplacian->row_ptr[i + 1]; ++k)
+        {
+          if (laplacian->col_idx[k] == i && laplacian->values[k] > 0.0)
+            inv_diag[i] = 1.0 / laplacian->values[k];
+        }
     }
 
-  if ((status = umfpack_dl_numeric (laplacian->col_idx,
-                                    laplacian->row_idx,
-                                    laplacian->values,
-                                    symbolic, &numeric,
-                                    umfcontrol, umfinfo)) < 0)
+  data.matrix   = laplacian;
+  data.rhs      = rhs;
+  data.inv_diag = inv_diag;
+  data.x        = solution;
+  data.r        = g_new (gdouble, image_elems);
+  data.z        = g_new (gdouble, image_elems);
+  data.p        = solution;
+  data.q        = g_new (gdouble, image_elems);
+  data.n_blocks = ceil_div (image_elems, DOT_BLOCK_SIZE);
+  data.pq       = g_new (gdouble, data.n_blocks);
+  data.rz       = g_new (gdouble, data.n_blocks);
+  data.rr       = g_new (gdouble, data.n_blocks);
+  data.bb       = g_new (gdouble, data.n_blocks);
+
+  block_cost = (gdouble) THREAD_COST / DOT_BLOCK_SIZE;
+
+  /* r0 = b - A x0 */
+  gegl_parallel_distribute_range (
+    data.n_blocks, block_cost,
+    (GeglParallelDistributeRangeFunc) matting_solver_spmv_range,
+    &data);
+  gegl_parallel_distribute_range (
+    data.n_blocks, block_cost,
+    (GeglParallelDistributeRangeFunc) matting_solver_init_range,
+    &data);
+
+  data.p = g_new (gdouble, image_elems);
+  memcpy (data.p, data.z, sizeof (gdouble) * image_elems);
+
+  rz = matting_solver_sum (data.rz, data.n_blocks);
+  rr = matting_solver_sum (data.rr, data.n_blocks);
+  bb = matting_solver_sum (data.bb, data.n_blocks);
+
+  /* A zero right hand side is solved exactly by a zero alpha */
+  if (bb == 0.0)
+    memset (solution, 0, sizeof (solution[0]) * image_elems);
+
+  for (iteration = 0;
+       iteration < SOLVER_MAX_ITERATIONS &&
+       bb > 0.0 &&
+       rr > SOLVER_TOLERANCE * SOLVER_TOLERANCE * bb;
+       ++iteration)
     {
-      numeric = NULL;
-      goto cleanup;
+      gdouble pq;
+
+      gegl_parallel_distribute_range (
+        data.n_blocks, block_cost,
+        (GeglParallelDistributeRangeFunc) matting_solver_spmv_range,
+        &data);
+
+      pq = matting_solver_sum (data.pq, data.n_blocks);
+      if (!(pq > 0.0))
+        break;
+
+      data.alpha = rz / pq;
+
+      gegl_parallel_distribute_range (
+        data.n_blocks, block_cost,
+        (GeglParallelDistributeRangeFunc) matting_solver_update_range,
+        &data);
+
+      data.beta = rz;
+      rz = matting_solver_sum (data.rz, data.n_blocks);
+      rr = matting_solver_sum (data.rr, data.n_blocks);
+      data.beta = rz / data.beta;
+
+      gegl_parallel_distribute_range (
+        data.n_blocks, block_cost,
+        (GeglParallelDistributeRangeFunc) matting_solver_direction_range,
+        &data);
     }
 
-  /* Solve and exit */
-  {
-    gdouble *residual = g_new (gdouble, image_elems);
-    for (i = 0; i < image_elems; ++i) 
-      {
-        if (trimap_masked (trimap, i, 0, roi))
-          residual[i] = 0;
-        else
-          residual[i] = lambda * trimap[i * COMPONENTS_AUX + AUX_VALUE];
-      }
-
-    status = umfpack_dl_solve (UMFPACK_A,
-                               laplacian->col_idx,
-                               laplacian->row_idx,
-                               laplacian->values,
-                               solution,
-                               residual,
-                               numeric,
-                               umfcontrol, umfinfo);
-
-    /* Positive numbers are warnings. We don't care if the matrix is
-     * singular, as the computed result is still usable, so just check for
-     * errors.
-     */
-    g_free (residual);
-    if (status < 0)
-      goto cleanup;
-  }
+  GEGL_NOTE (GEGL_DEBUG_PROCESS,
+             "solved %dx%d laplacian (%" G_GSIZE_FORMAT " entries) "
+             "in %d iterations, residual %g\n",
+             roi->width, roi->height, matting_sparse_elems (laplacian),
+             iteration,
+             bb > 0.0 ? sqrt (rr / bb) : 0.0);
+
+  /* The solution is still the best estimate we have, so it is used */
+  if (bb > 0.0 && rr > SOLVER_TOLERANCE * SOLVER_TOLERANCE * bb)
+    g_warning ("matting-levin: the %dx%d laplacian didn't converge in %d "
+               "iterations, relative residual %g",
+               roi->width, roi->height, iteration, sqrt (rr / bb));
 
   /* Courtesy clamping of the solution to normal alpha range */
   for (i = 0; i < image_elems; ++i)
     solution[i] = CLAMP (solution[i], 0.0, 1.0);
 
-  success = TRUE;
-cleanup:
-  /* Singular matrices appear to work correctly, provided that we clamp the
-   * results (which needs to be done regardless). I'm not sure if this is a
-   * result of an incorrect implementation of the algorithm, or if it's
-   * inherent to the design; either way it seems to work.
-   */
-  if (status != UMFPACK_OK && status != UMFPACK_WARNING_singular_matrix)
-    g_warning ("%s", matting_umf_error_to_string (status));
-
-  if (numeric)
-    umfpack_dl_free_numeric  (&numeric);
-  if (symbolic)
-    umfpack_dl_free_symbolic (&symbolic);
+  g_free (rhs);
+  g_free (inv_diag);
+  g_free (data.r);
+  g_free (data.z);
+  g_free (data.p);
+  g_free (data.q);
+  g_free (data.pq);
+  g_free (data.rz);
+  g_free (data.rr);
+  g_free (data.bb);
 
-  return success;
+  return TRUE;
 }
 
 
@@ -1349,6 +1698,13 @@ matting_solve_level (gdouble             *restrict pixels,
                                          levels - 1, radius, epsilon,
                                          lambda, threshold);
 
+      if (!small_alpha)
+        {
+          g_free (small_pixels);
+          g_free (small_trimap);
+          return NULL;
+        }
+
       new_alpha = matting_upsample_alpha (small_pixels, pixels, small_alpha,
                                           &small_region, region, epsilon,
                                           radius);
@@ -1385,17 +1741,40 @@ matting_solve_level (gdouble             *restrict pixels,
   if (active_levels >= levels || levels == 0)
     {
       sparse_t *laplacian;
-      g_free (new_alpha);
 
       if (!(laplacian = matting_get_laplacian (pixels, trimap, region,
               radius, epsilon, lambda)))
         {
           g_warning ("unable to construct laplacian matrix");
+          g_free (new_alpha);
+          return NULL;
+        }
+
+      /* Start the solver from the upsampled coarser solution if we have one,
+       * otherwise from the trimap values (and an undecided alpha for the
+       * masked pixels).
+       */
+      if (!new_alpha)
+        {
+          new_alpha = g_new (gdouble, region->width * region->height);
+          for (i = 0; i < region->width * region->height; ++i)
+            {
+              if (trimap_masked (trimap, i, 0, region))
+                new_alpha[i] = 0.5;
+              else
+                new_alpha[i] = trimap[i * COMPONENTS_AUX + AUX_VALUE];
+            }
+        }
+
+      if (!matting_solve_laplacian (trimap, laplacian, new_alpha, region,
+                                    lambda))
+        {
+          g_warning ("unable to solve laplacian matrix");
+          matting_sparse_free (laplacian);
+          g_free (new_alpha);
           return NULL;
         }
 
-      new_alpha = g_new (gdouble, region->width * region->height);
-      matting_solve_laplacian (trimap, laplacian, new_alpha, region, lambda);
       matting_sparse_free (laplacian);
     }
 
@@ -1441,10 +1820,14 @@ matting_process (GeglOperation       *operation,
                                 MIN (o->active_levels, o->levels), o->levels,
                                 o->radius, powf (10, o->epsilon), o->lambda,
                                 o->threshold);
-  gegl_buffer_set (output_buf, result, 0, babl_format (FORMAT_OUTPUT), output,
-                   GEGL_AUTO_ROWSTRIDE);
 
-  success = TRUE;
+  if (output)
+    {
+      gegl_buffer_set (output_buf, result, 0, babl_format (FORMAT_OUTPUT),
+                       output, GEGL_AUTO_ROWSTRIDE);
+
+      success = TRUE;
+    }
 
   g_free (input);
   g_free (trimap);
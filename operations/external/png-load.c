@@ -279,6 +279,7 @@ gegl_buffer_import_png (GeglBuffer  *gegl_buffer,
                         gint        *ret_height,
                         const Babl  *format, // can be NULL
                         GeglMetadata *metadata, // can be NULL
+                        const GeglRectangle *roi, // can be NULL
                         GError **err)
 {
   gint           width;
@@ -295,6 +296,8 @@ gegl_buffer_import_png (GeglBuffer  *gegl_buffer,
 
 
   unsigned   int i;
+  unsigned   int first_row;
+  unsigned   int last_row;
   png_bytep  *row_p = NULL;
 
   g_return_val_if_fail(stream, -1);
@@ -456,28 +459,43 @@ gegl_buffer_import_png (GeglBuffer  *gegl_buffer,
 
   pixels = g_malloc0 (width*bpp);
 
+  /* the rows to store; interlaced images are refined over the whole image
+   * in each pass, so they are always loaded entirely.
+   */
+  first_row = 0;
+  last_row  = h;
+
+  if (roi && number_of_passes == 1)
+    {
+      first_row = CLAMP (roi->y, 0, (gint) h);
+      last_row  = CLAMP (roi->y + roi->height, (gint) first_row, (gint) h);
+    }
+
   {
     gint           pass;
     GeglRectangle  rect;
 
     for (pass=0; pass<number_of_passes; pass++)
       {
-        for(i=0; i<h; i++)
+        for(i=0; i<last_row; i++)
           {
             gegl_rectangle_set (&rect, 0, i, width, 1);
 
             if (pass != 0)
               gegl_buffer_get (gegl_buffer, &rect, 1.0, format, pixels, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
+            /* rows above roi still have to be inflated, but aren't stored */
             png_read_rows (load_png_ptr, &pixels, NULL, 1);
-            gegl_buffer_set (gegl_buffer, &rect, 0, format, pixels,
-                             GEGL_AUTO_ROWSTRIDE);
+            if (i >= first_row)
+              gegl_buffer_set (gegl_buffer, &rect, 0, format, pixels,
+                               GEGL_AUTO_ROWSTRIDE);
           }
       }
   }
 
-
-  png_read_end (load_png_ptr, NULL);
+  /* rows below roi are left unread */
+  if (last_row == h)
+    png_read_end (load_png_ptr, NULL);
   png_destroy_read_struct (&load_png_ptr, &load_info_ptr, NULL);
 
   g_free (pixels);
@@ -491,6 +509,7 @@ static gint query_png (GInputStream *stream,
                        gint        *width,
                        gint        *height,
                        const Babl  **format,
+                       gboolean    *interlaced, // can be NULL
                        GError **err)
 {
   png_uint_32   w;
@@ -536,6 +555,7 @@ static gint query_png (GInputStream *stream,
   {
     int bit_depth;
     int color_type;
+    int interlace_type;
     const Babl *f;
 
     png_get_IHDR (load_png_ptr,
@@ -543,9 +563,12 @@ static gint query_png (GInputStream *stream,
                   &w, &h,
                   &bit_depth,
                   &color_type,
-                  NULL, NULL, NULL);
+                  &interlace_type,
+                  NULL, NULL);
     *width = w;
     *height = h;
+    if (interlaced)
+      *interlaced = interlace_type == PNG_INTERLACE_ADAM7;
 
     if (png_get_valid (load_png_ptr, load_info_ptr, PNG_INFO_tRNS))
       color_type |= PNG_COLOR_MASK_ALPHA;
@@ -579,7 +602,7 @@ get_bounding_box (GeglOperation *operation)
   GInputStream *stream = gegl_gio_open_input_stream(o->uri, o->path, &infile, &err);
   WARN_IF_ERROR(err);
   if (!stream) return result;
-  status = query_png(stream, &width, &height, &format, &err);
+  status = query_png(stream, &width, &height, &format, NULL, &err);
   WARN_IF_ERROR(err);
   g_input_stream_close(stream, NULL, NULL);
 
@@ -613,7 +636,8 @@ process (GeglOperation       *operation,
   GInputStream *stream = gegl_gio_open_input_stream(o->uri, o->path, &infile, &err);
   WARN_IF_ERROR(err);
   problem = gegl_buffer_import_png (output, stream, 0, 0,
-                                    &width, &height, format, GEGL_METADATA (o->metadata), &err);
+                                    &width, &height, format, GEGL_METADATA (o->metadata),
+                                    result, &err);
   WARN_IF_ERROR(err);
   g_input_stream_close(stream, NULL, NULL);
 
@@ -634,7 +658,41 @@ static GeglRectangle
 get_cached_region (GeglOperation       *operation,
                    const GeglRectangle *roi)
 {
-  return get_bounding_box (operation);
+  GeglProperties *o = GEGL_PROPERTIES (operation);
+  GeglRectangle   result = {0,0,0,0};
+  gint            width, height;
+  gint            status;
+  const Babl     *format;
+  gboolean        interlaced;
+  GError         *err = NULL;
+  GFile          *infile = NULL;
+
+  GInputStream *stream = gegl_gio_open_input_stream(o->uri, o->path, &infile, &err);
+  WARN_IF_ERROR(err);
+  if (!stream) return result;
+  status = query_png(stream, &width, &height, &format, &interlaced, &err);
+  WARN_IF_ERROR(err);
+  g_input_stream_close(stream, NULL, NULL);
+  g_clear_object(&infile);
+  g_object_unref(stream);
+
+  if (status)
+    return result;
+
+  result.width  = width;
+  result.height = height;
+
+  /* rows are decompressed from the top, so load everything from the first
+   * row of roi down in one go; rows above it aren't stored, and later
+   * requests below it are served from the cache.
+   */
+  if (!interlaced && roi->y > 0)
+    {
+      result.y      = MIN (roi->y, height);
+      result.height = height - result.y;
+    }
+
+  return result;
 }
 
 static void
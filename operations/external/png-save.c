@@ -43,6 +43,40 @@ property_object(metadata, _("Metadata"), GEGL_TYPE_METADATA)
 #include <gegl-op.h>
 #include <gegl-gio-private.h>
 #include <png.h>
+#include <zlib.h>
+#include "gegl-config.h"
+
+/* the approximate amount of filtered image data compressed at once by each
+ * thread, when writing in parallel.
+ */
+#define BLOCK_SIZE  (1 << 20)
+
+#define THREAD_COST 65536.0
+
+typedef struct
+{
+  guchar *data;
+  gsize   size;
+  uLong   adler;
+  gsize   length;
+} PngBlock;
+
+typedef struct
+{
+  GeglBuffer          *input;
+  const GeglRectangle *result;
+  const Babl          *format;
+  gint                 bit_depth;
+  gint                 compression;
+  gsize                rowbytes;
+  gint                 bpp;
+  gint                 rows_per_block;
+  gint                 n_blocks;
+
+  gint                 first_block;
+  PngBlock            *blocks;
+  gboolean             success;
+} EncodeData;
 
 static void
 png_format_timestamp (const GValue *src_value, GValue *dest_value)
@@ -118,6 +152,312 @@ clear_png_text (gpointer data)
   g_free (text->text);
 }
 
+static inline guint
+paeth (guint a,
+       guint b,
+       guint c)
+{
+  gint p  = (gint) a + b - c;
+  gint pa = abs (p - (gint) a);
+  gint pb = abs (p - (gint) b);
+  gint pc = abs (p - (gint) c);
+
+  if (pa <= pb && pa <= pc)
+    return a;
+  else if (pb <= pc)
+    return b;
+  else
+    return c;
+}
+
+/* filters row with each PNG filter type, and returns the one whose output
+ * has the smallest sum of absolute values, the same heuristic libpng uses.
+ * the result, prefixed by the filter type, is stored in one of buffers.
+ */
+static const guchar *
+filter_row (const guchar *row,
+            const guchar *prev,
+            gsize         rowbytes,
+            gsize         bpp,
+            guchar       *buffers[2])
+{
+  guint64 best_sum = G_MAXUINT64;
+  gint    best     = 0;
+  gint    current  = 0;
+  gint    filter;
+
+  for (filter = PNG_FILTER_VALUE_NONE; filter < PNG_FILTER_VALUE_LAST; filter++)
+    {
+      guchar  *out = buffers[current] + 1;
+      guint64  sum = 0;
+      gsize    i;
+
+      buffers[current][0] = filter;
+
+      switch (filter)
+        {
+        case PNG_FILTER_VALUE_NONE:
+          memcpy (out, row, rowbytes);
+          break;
+
+        case PNG_FILTER_VALUE_SUB:
+          for (i = 0; i < bpp; i++)
+            out[i] = row[i];
+          for (; i < rowbytes; i++)
+            out[i] = row[i] - row[i - bpp];
+          break;
+
+        case PNG_FILTER_VALUE_UP:
+          for (i = 0; i < rowbytes; i++)
+            out[i] = row[i] - prev[i];
+          break;
+
+        case PNG_FILTER_VALUE_AVG:
+          for (i = 0; i < bpp; i++)
+            out[i] = row[i] - (prev[i] >> 1);
+          for (; i < rowbytes; i++)
+            out[i] = row[i] - ((row[i - bpp] + prev[i]) >> 1);
+          break;
+
+        case PNG_FILTER_VALUE_PAETH:
+          for (i = 0; i < bpp; i++)
+            out[i] = row[i] - prev[i];
+          for (; i < rowbytes; i++)
+            out[i] = row[i] - paeth (row[i - bpp], prev[i], prev[i - bpp]);
+          break;
+        }
+
+      for (i = 0; i < rowbytes; i++)
+        sum += out[i] < 128 ? out[i] : 256 - out[i];
+
+      if (sum < best_sum)
+        {
+          best_sum = sum;
+          best     = current;
+          current  = 1 - current;
+        }
+    }
+
+  return buffers[best];
+}
+
+static void
+encode_blocks_range (gsize       first,
+                     gsize       n,
+                     EncodeData *data)
+{
+  const GeglRectangle *result   = data->result;
+  gsize                rowbytes = data->rowbytes;
+  guchar              *pixels;
+  guchar              *filtered;
+  guchar              *zero;
+  guchar              *buffers[2];
+  gsize                i;
+
+  pixels      = gegl_scratch_alloc (rowbytes * (data->rows_per_block + 1));
+  filtered    = gegl_scratch_alloc ((rowbytes + 1) * data->rows_per_block);
+  zero        = gegl_scratch_alloc0 (rowbytes);
+  buffers[0]  = gegl_scratch_alloc (rowbytes + 1);
+  buffers[1]  = gegl_scratch_alloc (rowbytes + 1);
+
+  for (i = first; i < first + n; i++)
+    {
+      PngBlock      *block  = &data->blocks[i];
+      gint           index  = data->first_block + i;
+      gint           y      = index * data->rows_per_block;
+      gint           height = MIN (data->rows_per_block, result->height - y);
+      gint           above  = y > 0;
+      gboolean       last   = index == data->n_blocks - 1;
+      GeglRectangle  rect;
+      const guchar  *prev;
+      const guchar  *row;
+      guchar        *out;
+      gsize          size;
+      z_stream       stream = {};
+      gint           status;
+      gint           r;
+
+      /* fetch the row above the block too, which the filters refer to */
+      gegl_rectangle_set (&rect, result->x, result->y + y - above,
+                          result->width, height + above);
+
+      gegl_buffer_get (data->input, &rect, 1.0, data->format, pixels,
+                       rowbytes, GEGL_ABYSS_NONE);
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+      if (data->bit_depth > 8)
+        {
+          guint16 *samples   = (guint16 *) pixels;
+          gsize    n_samples = rowbytes / 2 * rect.height;
+          gsize    j;
+
+          for (j = 0; j < n_samples; j++)
+            samples[j] = GUINT16_TO_BE (samples[j]);
+        }
+#endif
+
+      prev = above ? pixels : zero;
+      row  = pixels + above * rowbytes;
+      out  = filtered;
+
+      for (r = 0; r < height; r++)
+        {
+          memcpy (out, filter_row (row, prev, rowbytes, data->bpp, buffers),
+                  rowbytes + 1);
+
+          out  += rowbytes + 1;
+          prev  = row;
+          row  += rowbytes;
+        }
+
+      size = (rowbytes + 1) * height;
+
+      block->adler  = adler32 (adler32 (0, NULL, 0), filtered, size);
+      block->length = size;
+
+      /* each block is an independent raw deflate stream, ending on a byte
+       * boundary thanks to the sync flush, so that the blocks can be
+       * concatenated; only the last one is marked final.
+       */
+      if (deflateInit2 (&stream, data->compression, Z_DEFLATED, -15, 8,
+                        Z_FILTERED) != Z_OK)
+        {
+          data->success = FALSE;
+          continue;
+        }
+
+      /* leave room for the zlib header and trailer */
+      block->size = deflateBound (&stream, size) + 16;
+      block->data = g_try_malloc (block->size + 2 + 4);
+
+      if (block->data == NULL)
+        {
+          deflateEnd (&stream);
+          data->success = FALSE;
+          continue;
+        }
+
+      stream.next_in   = filtered;
+      stream.avail_in  = size;
+      stream.next_out  = block->data + 2;
+      stream.avail_out = block->size;
+
+      status = deflate (&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+
+      if (stream.avail_in > 0 || stream.avail_out == 0 ||
+          status != (last ? Z_STREAM_END : Z_OK))
+        {
+          data->success = FALSE;
+        }
+
+      block->size = stream.total_out;
+
+      deflateEnd (&stream);
+    }
+
+  gegl_scratch_free (buffers[1]);
+  gegl_scratch_free (buffers[0]);
+  gegl_scratch_free (zero);
+  gegl_scratch_free (filtered);
+  gegl_scratch_free (pixels);
+}
+
+/* writes the image data of result, compressing blocks of rows in parallel,
+ * like pigz does: the blocks are filtered and deflated independently, and
+ * their streams are concatenated into a single zlib stream, split into one
+ * IDAT chunk per block.  also writes IEND, in place of png_write_end().
+ */
+static gint
+write_image_parallel (png_structp          png,
+                      GeglBuffer          *input,
+                      const GeglRectangle *result,
+                      const Babl          *format,
+                      gint                 compression,
+                      gint                 bit_depth)
+{
+  EncodeData data;
+  gint       batch_size;
+  gint       first;
+  guint      cmf = 0x78;
+  guint      flg;
+  uLong      adler = adler32 (0, NULL, 0);
+
+  data.input          = input;
+  data.result         = result;
+  data.format         = format;
+  data.bit_depth      = bit_depth;
+  data.compression    = compression;
+  data.bpp            = babl_format_get_bytes_per_pixel (format);
+  data.rowbytes       = (gsize) result->width * data.bpp;
+  data.rows_per_block = MAX (BLOCK_SIZE / data.rowbytes, 1);
+  data.n_blocks       = (result->height + data.rows_per_block - 1) /
+                        data.rows_per_block;
+  data.success        = TRUE;
+
+  /* keep a couple of blocks per thread in flight, so that memory use stays
+   * bounded for large images.
+   */
+  batch_size  = MIN (2 * gegl_config_threads (), data.n_blocks);
+  data.blocks = g_new0 (PngBlock, batch_size);
+
+  /* the zlib header: deflate with a 32K window, and the compression level */
+  flg  = (compression < 2 ? 0 : compression < 6 ? 1 : compression == 6 ? 2 : 3)
+         << 6;
+  flg += 31 - (cmf * 256 + flg) % 31;
+
+  for (first = 0; first < data.n_blocks && data.success; first += batch_size)
+    {
+      gint n = MIN (batch_size, data.n_blocks - first);
+      gint i;
+
+      data.first_block = first;
+
+      gegl_parallel_distribute_range (
+        n, THREAD_COST / ((gdouble) data.rowbytes * data.rows_per_block),
+        (GeglParallelDistributeRangeFunc) encode_blocks_range,
+        &data);
+
+      for (i = 0; i < n && data.success; i++)
+        {
+          PngBlock *block  = &data.blocks[i];
+          guchar   *chunk  = block->data + 2;
+          gsize     length = block->size;
+
+          adler = adler32_combine (adler, block->adler, block->length);
+
+          if (first + i == 0)
+            {
+              chunk    -= 2;
+              length   += 2;
+              chunk[0]  = cmf;
+              chunk[1]  = flg;
+            }
+
+          if (first + i == data.n_blocks - 1)
+            {
+              chunk[length++] = adler >> 24;
+              chunk[length++] = adler >> 16;
+              chunk[length++] = adler >> 8;
+              chunk[length++] = adler;
+            }
+
+          png_write_chunk (png, (png_const_bytep) "IDAT", chunk, length);
+        }
+
+      for (i = 0; i < n; i++)
+        g_clear_pointer (&data.blocks[i].data, g_free);
+    }
+
+  g_free (data.blocks);
+
+  if (! data.success)
+    return -1;
+
+  png_write_chunk (png, (png_const_bytep) "IEND", NULL, 0);
+
+  return 0;
+}
+
 static gint
 export_png (GeglOperation       *operation,
             GeglBuffer          *input,
@@ -138,6 +478,7 @@ export_png (GeglOperation       *operation,
   const Babl    *space = babl_format_get_space (babl);
   const Babl    *format;
   GArray        *itxt = NULL;
+  gint           status = 0;
 
   src_x = result->x;
   src_y = result->y;
@@ -315,33 +656,46 @@ export_png (GeglOperation       *operation,
 
   png_write_info (png, info);
 
+  /* large images are compressed in parallel, bypassing libpng for the image
+   * data.
+   */
+  if (gegl_config_threads () > 1 &&
+      (gsize) width * babl_format_get_bytes_per_pixel (format) * height >
+      BLOCK_SIZE)
+    {
+      status = write_image_parallel (png, input, result, format,
+                                     compression, bit_depth);
+    }
+  else
+    {
 #if BYTE_ORDER == LITTLE_ENDIAN
-  if (bit_depth > 8)
-    png_set_swap (png);
+      if (bit_depth > 8)
+        png_set_swap (png);
 #endif
-  pixels = g_malloc0 (width * babl_format_get_bytes_per_pixel (format));
+      pixels = g_malloc0 (width * babl_format_get_bytes_per_pixel (format));
 
-  for (i=0; i< height; i++)
-    {
-      GeglRectangle rect;
+      for (i=0; i< height; i++)
+        {
+          GeglRectangle rect;
 
-      rect.x = src_x;
-      rect.y = src_y+i;
-      rect.width = width;
-      rect.height = 1;
+          rect.x = src_x;
+          rect.y = src_y+i;
+          rect.width = width;
+          rect.height = 1;
 
-      gegl_buffer_get (input, &rect, 1.0, format, pixels, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+          gegl_buffer_get (input, &rect, 1.0, format, pixels, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
-      png_write_rows (png, &pixels, 1);
-    }
+          png_write_rows (png, &pixels, 1);
+        }
 
-  png_write_end (png, info);
+      png_write_end (png, info);
 
-  g_free (pixels);
+      g_free (pixels);
+    }
 
   if (itxt != NULL)
     g_array_unref (itxt);
-  return 0;
+  return status;
 }
 
 static gboolean
@@ -51,12 +51,29 @@ property_object(metadata, _("Metadata"), GEGL_TYPE_METADATA)
 #include <glib/gprintf.h>
 #include <tiffio.h>
 
+/* the cost of a thread, relative to that of loading one pixel */
+#define THREAD_COST 65536.0
+
 typedef enum {
   TIFF_LOADING_RGBA,
   TIFF_LOADING_CONTIGUOUS,
   TIFF_LOADING_SEPARATED
 } LoadingMode;
 
+/* an image stored in the file: the full resolution image of the directory,
+ * or a reduced resolution version of it, which can serve a mipmap level.
+ */
+typedef struct
+{
+  toff_t offset;         /* of the IFD */
+  gint level;
+  gint width;
+  gint height;
+  gboolean tiled;
+  guint32 block_width;   /* of tiles, or strips */
+  guint32 block_height;
+} TiffImage;
+
 typedef struct
 {
   GFile *file;
@@ -77,8 +94,16 @@ typedef struct
 
   gint width;
   gint height;
+
+  toff_t ifd_offset;     /* of the current directory of tiff */
+  GArray *images;        /* TiffImage, the full resolution one first, then
+                            by increasing level */
+  GSList *readers;       /* idle handles, for loading in parallel */
 } Priv;
 
+/* protects the readers of all instances */
+static GMutex readers_mutex;
+
 #ifdef HAVE_STRPTIME
 /* Parse the TIFF timestamp format - requires strptime() */
 static void
@@ -121,6 +146,15 @@ static const GeglMetadataMap tiff_load_metadata[] =
   { "Software",             "software",     NULL },
 };
 
+static void
+close_reader(Priv *reader)
+{
+  /* closing the TIFF closes the stream */
+  TIFFClose(reader->tiff);
+  g_clear_object (&reader->file);
+  g_free(reader);
+}
+
 static void
 cleanup(GeglOperation *operation)
 {
@@ -129,6 +163,11 @@ cleanup(GeglOperation *operation)
 
   if (p != NULL)
     {
+      g_slist_free_full(p->readers, (GDestroyNotify) close_reader);
+      p->readers = NULL;
+
+      g_clear_pointer(&p->images, g_array_unref);
+
       if (p->tiff != NULL)
         TIFFClose(p->tiff);
       else if (p->stream != NULL)
@@ -716,150 +755,471 @@ load_RGBA(GeglOperation *operation,
   return 0;
 }
 
-static gint
-load_contiguous(GeglOperation *operation,
-                GeglBuffer    *output)
+static Priv *
+open_reader(Priv *p)
 {
-  GeglProperties *o = GEGL_PROPERTIES(operation);
-  Priv *p = (Priv*) o->user_data;
-  guint32 tile_width = (guint32) p->width;
-  guint32 tile_height = 1;
-  guchar *buffer;
-  gint x, y;
-
-  g_return_val_if_fail(p->tiff != NULL, -1);
+  GError *error = NULL;
+  GFileInputStream *stream;
+  Priv *reader;
 
-  if (!TIFFIsTiled(p->tiff))
-      buffer = g_try_new(guchar, TIFFScanlineSize(p->tiff));
-  else
+  stream = g_file_read(p->file, NULL, &error);
+  if (stream == NULL)
     {
-      TIFFGetField(p->tiff, TIFFTAG_TILEWIDTH, &tile_width);
-      TIFFGetField(p->tiff, TIFFTAG_TILELENGTH, &tile_height);
+      if (error)
+        {
+          g_warning("%s", error->message);
+          g_error_free(error);
+        }
+      return NULL;
+    }
 
-      buffer = g_try_new(guchar, TIFFTileSize(p->tiff));
+  reader = g_new0(Priv, 1);
+  reader->file = g_object_ref(p->file);
+  reader->stream = G_INPUT_STREAM(stream);
+  reader->can_seek = TRUE;
+
+  reader->tiff = TIFFClientOpen("GEGL-tiff-load", "r", (thandle_t) reader,
+                                read_from_stream, write_to_stream,
+                                seek_in_stream, close_stream,
+                                get_file_size, NULL, NULL);
+  if (reader->tiff == NULL)
+    {
+      close_stream((thandle_t) reader);
+      g_clear_object(&reader->file);
+      g_free(reader);
+      return NULL;
     }
 
-  g_assert(buffer != NULL);
+  reader->ifd_offset = TIFFCurrentDirOffset(reader->tiff);
 
-  for (y = 0; y < p->height; y += tile_height)
+  return reader;
+}
+
+static Priv *
+acquire_reader(Priv *p)
+{
+  Priv *reader = NULL;
+
+  g_mutex_lock(&readers_mutex);
+  if (p->readers != NULL)
     {
-      for (x = 0; x < p->width; x += tile_width)
-        {
-          GeglRectangle tile = { x, y, tile_width, tile_height };
+      reader = p->readers->data;
+      p->readers = g_slist_delete_link(p->readers, p->readers);
+    }
+  g_mutex_unlock(&readers_mutex);
 
-          if (TIFFIsTiled(p->tiff))
-            TIFFReadTile(p->tiff, buffer, x, y, 0, 0);
-          else
-            TIFFReadScanline(p->tiff, buffer, y, 0);
+  if (reader == NULL)
+    reader = open_reader(p);
 
-          gegl_buffer_set(output, &tile, 0, p->format,
-                          (guchar *) buffer,
-                          GEGL_AUTO_ROWSTRIDE);
-        }
+  return reader;
+}
+
+static void
+release_reader(Priv *p,
+               Priv *reader)
+{
+  g_mutex_lock(&readers_mutex);
+  p->readers = g_slist_prepend(p->readers, reader);
+  g_mutex_unlock(&readers_mutex);
+}
+
+static void
+get_image_layout(TIFF *tiff,
+                 guint16 layout[6])
+{
+  memset(layout, 0, 6 * sizeof(guint16));
+
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &layout[0]);
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &layout[1]);
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLEFORMAT, &layout[2]);
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &layout[3]);
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_COMPRESSION, &layout[4]);
+  TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &layout[5]);
+
+  /* the compression doesn't matter, as long as libtiff decodes it */
+  layout[4] = 0;
+}
+
+static gboolean
+get_image(TIFF *tiff,
+          TiffImage *image)
+{
+  guint32 width, height;
+
+  if (!TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width) ||
+      !TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height))
+    return FALSE;
+
+  image->offset = TIFFCurrentDirOffset(tiff);
+  image->width = (gint) width;
+  image->height = (gint) height;
+  image->tiled = TIFFIsTiled(tiff);
+
+  if (image->tiled)
+    {
+      TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &image->block_width);
+      TIFFGetField(tiff, TIFFTAG_TILELENGTH, &image->block_height);
+    }
+  else
+    {
+      image->block_width = width;
+      TIFFGetFieldDefaulted(tiff, TIFFTAG_ROWSPERSTRIP, &image->block_height);
+      image->block_height = MIN(image->block_height, height);
     }
 
-  g_free(buffer);
-  return 0;
+  return image->block_width > 0 && image->block_height > 0;
 }
 
 static gint
-load_separated(GeglOperation *operation,
-               GeglBuffer    *output)
+compare_images(const TiffImage *a,
+               const TiffImage *b)
 {
-  GeglProperties *o = GEGL_PROPERTIES(operation);
-  Priv *p = (Priv*) o->user_data;
-  guint32 tile_width = (guint32) p->width;
-  guint32 tile_height = 1;
-  gint output_bytes_per_pixel;
-  gint nb_components, offset = 0;
-  guchar *buffer;
-  gint i;
+  return a->level - b->level;
+}
 
-  g_return_val_if_fail(p->tiff != NULL, -1);
+/* finds the reduced resolution versions of the current directory, stored
+ * either as its SubIFDs, or as the directories following it.
+ */
+static void
+query_images(Priv *p)
+{
+  guint16 layout[6];
+  toff_t *offsets = NULL;
+  guint16 n_offsets = 0;
+  GArray *candidates;
+  TiffImage image = { 0, };
+  guint i;
 
-  if (!TIFFIsTiled(p->tiff))
-    buffer = g_try_new(guchar, TIFFScanlineSize(p->tiff));
-  else
+  if (p->images == NULL)
+    p->images = g_array_new(FALSE, FALSE, sizeof(TiffImage));
+  g_array_set_size(p->images, 0);
+
+  p->ifd_offset = TIFFCurrentDirOffset(p->tiff);
+
+  if (!get_image(p->tiff, &image))
+    return;
+
+  g_array_append_val(p->images, image);
+
+  /* the RGBA loader always loads the whole image */
+  if (p->mode == TIFF_LOADING_RGBA)
+    return;
+
+  get_image_layout(p->tiff, layout);
+
+  candidates = g_array_new(FALSE, FALSE, sizeof(toff_t));
+
+  if (TIFFGetField(p->tiff, TIFFTAG_SUBIFD, &n_offsets, &offsets))
+    g_array_append_vals(candidates, offsets, n_offsets);
+
+  while (TIFFReadDirectory(p->tiff))
     {
-      TIFFGetField(p->tiff, TIFFTAG_TILEWIDTH, &tile_width);
-      TIFFGetField(p->tiff, TIFFTAG_TILELENGTH, &tile_height);
+      guint32 subfile_type = 0;
+      toff_t offset;
+
+      TIFFGetField(p->tiff, TIFFTAG_SUBFILETYPE, &subfile_type);
+      if (!(subfile_type & FILETYPE_REDUCEDIMAGE))
+        break;
 
-      buffer = g_try_new(guchar, TIFFTileSize(p->tiff));
+      offset = TIFFCurrentDirOffset(p->tiff);
+      g_array_append_val(candidates, offset);
     }
 
-  g_assert(buffer != NULL);
+  for (i = 0; i < candidates->len; i++)
+    {
+      guint16 reduced_layout[6];
+      gint level;
+
+      if (!TIFFSetSubDirectory(p->tiff, g_array_index(candidates, toff_t, i)) ||
+          !get_image(p->tiff, &image))
+        continue;
+
+      get_image_layout(p->tiff, reduced_layout);
+      if (memcmp(layout, reduced_layout, sizeof(layout)))
+        continue;
+
+      /* only images matching a mipmap level, rounded either way, are used */
+      for (level = 1; level < 16; level++)
+        {
+          gint scale = 1 << level;
+
+          if ((image.width == p->width / scale ||
+               image.width == (p->width + scale - 1) / scale) &&
+              (image.height == p->height / scale ||
+               image.height == (p->height + scale - 1) / scale))
+            {
+              image.level = level;
+              g_array_append_val(p->images, image);
+              break;
+            }
+        }
+    }
 
-  nb_components = babl_format_get_n_components(p->format);
-  output_bytes_per_pixel = babl_format_get_bytes_per_pixel(p->format);
+  g_array_free(candidates, TRUE);
 
-  for (i = 0; i < nb_components; i++)
+  if (p->images->len > 2)
     {
-      const Babl *plane_format;
-      const Babl *component_type;
-      gint plane_bytes_per_pixel;
-      gint x, y;
+      g_array_sort(p->images, (GCompareFunc) compare_images);
+    }
+
+  TIFFSetSubDirectory(p->tiff, p->ifd_offset);
+}
 
-      component_type = babl_format_get_type(p->format, i);
+/* the image used for mipmap level, the smallest one at least as detailed */
+static const TiffImage *
+get_image_for_level(Priv *p,
+                    gint level)
+{
+  const TiffImage *image = &g_array_index(p->images, TiffImage, 0);
+  guint i;
 
-      plane_format = babl_format_n(component_type, 1);
+  for (i = 1; i < p->images->len; i++)
+    {
+      const TiffImage *reduced = &g_array_index(p->images, TiffImage, i);
 
-      plane_bytes_per_pixel = babl_format_get_bytes_per_pixel(plane_format);
+      if (reduced->level <= level)
+        image = reduced;
+    }
 
-      for (y = 0; y < p->height; y += tile_height)
+  return image;
+}
+
+typedef struct
+{
+  GeglOperation *operation;
+  GeglBuffer *output;
+  const TiffImage *image;
+  GeglRectangle blocks;  /* in blocks of image */
+  gboolean parallel;
+  gboolean success;
+} LoadData;
+
+static gboolean
+load_block(Priv *p,
+           TIFF *tiff,
+           const TiffImage *image,
+           GeglBuffer *output,
+           const GeglRectangle *rect,
+           guchar *buffer,
+           guchar *pixels)
+{
+  if (p->mode == TIFF_LOADING_CONTIGUOUS)
+    {
+      tmsize_t rowstride;
+
+      if (image->tiled)
+        {
+          if (TIFFReadTile(tiff, buffer, rect->x, rect->y, 0, 0) < 0)
+            return FALSE;
+          rowstride = TIFFTileRowSize(tiff);
+        }
+      else
         {
-          for (x = 0; x < p->width; x += tile_width)
+          if (TIFFReadEncodedStrip(tiff, TIFFComputeStrip(tiff, rect->y, 0),
+                                   buffer, -1) < 0)
+            return FALSE;
+          rowstride = TIFFScanlineSize(tiff);
+        }
+
+      gegl_buffer_set(output, rect, image->level, p->format,
+                      buffer, rowstride);
+    }
+  else
+    {
+      gint output_bytes_per_pixel = babl_format_get_bytes_per_pixel(p->format);
+      gint nb_components = babl_format_get_n_components(p->format);
+      gint offset = 0;
+      gint i;
+
+      for (i = 0; i < nb_components; i++)
+        {
+          const Babl *plane_format;
+          gint plane_bytes_per_pixel;
+          tmsize_t plane_rowstride;
+          gint x, y;
+
+          plane_format = babl_format_n(babl_format_get_type(p->format, i), 1);
+          plane_bytes_per_pixel = babl_format_get_bytes_per_pixel(plane_format);
+
+          if (image->tiled)
             {
-              GeglRectangle output_tile = { x, y, tile_width, tile_height };
-              GeglRectangle plane_tile = { 0, 0, tile_width, tile_height };
-              GeglBufferIterator *iterator;
-              GeglBuffer *linear;
-
-              if (TIFFIsTiled(p->tiff))
-                TIFFReadTile(p->tiff, buffer, x, y, 0, i);
-              else
-                TIFFReadScanline(p->tiff, buffer, y, i);
-
-              linear = gegl_buffer_linear_new_from_data(buffer, plane_format,
-                                                        &plane_tile,
-                                                        GEGL_AUTO_ROWSTRIDE,
-                                                        NULL, NULL);
-
-              iterator = gegl_buffer_iterator_new(linear, &plane_tile,
-                                                  0, NULL,
-                                                  GEGL_ACCESS_READ,
-                                                  GEGL_ABYSS_NONE, 2);
-
-              gegl_buffer_iterator_add(iterator, output, &output_tile,
-                                       0, p->format,
-                                       GEGL_ACCESS_READWRITE,
-                                       GEGL_ABYSS_NONE);
-
-              while (gegl_buffer_iterator_next(iterator))
-                {
-                  guchar *plane_buffer = iterator->items[0].data;
-                  guchar *output_buffer = iterator->items[1].data;
-                  gint nb_pixels = iterator->length;
+              if (TIFFReadTile(tiff, buffer, rect->x, rect->y, 0, i) < 0)
+                return FALSE;
+              plane_rowstride = TIFFTileRowSize(tiff);
+            }
+          else
+            {
+              if (TIFFReadEncodedStrip(tiff, TIFFComputeStrip(tiff, rect->y, i),
+                                       buffer, -1) < 0)
+                return FALSE;
+              plane_rowstride = TIFFScanlineSize(tiff);
+            }
 
-                  output_buffer += offset;
+          for (y = 0; y < rect->height; y++)
+            {
+              guchar *plane_buffer = buffer + y * plane_rowstride;
+              guchar *output_buffer = pixels +
+                                      (y * rect->width) * output_bytes_per_pixel +
+                                      offset;
 
-                  while (nb_pixels--)
-                  {
-                    memcpy(output_buffer, plane_buffer, plane_bytes_per_pixel);
+              for (x = 0; x < rect->width; x++)
+                {
+                  memcpy(output_buffer, plane_buffer, plane_bytes_per_pixel);
 
-                    output_buffer += output_bytes_per_pixel;
-                    plane_buffer += plane_bytes_per_pixel;
-                  }
+                  output_buffer += output_bytes_per_pixel;
+                  plane_buffer += plane_bytes_per_pixel;
                 }
-
-              g_object_unref(linear);
             }
+
+          offset += plane_bytes_per_pixel;
         }
 
-      offset += plane_bytes_per_pixel;
+      gegl_buffer_set(output, rect, image->level, p->format,
+                      pixels, GEGL_AUTO_ROWSTRIDE);
+    }
+
+  return TRUE;
+}
+
+static void
+load_blocks_range(gsize first,
+                  gsize n,
+                  LoadData *data)
+{
+  GeglProperties *o = GEGL_PROPERTIES(data->operation);
+  Priv *p = (Priv*) o->user_data;
+  const TiffImage *image = data->image;
+  Priv *reader;
+  guchar *buffer;
+  guchar *pixels = NULL;
+  gsize i;
+
+  /* libtiff handles aren't thread safe, each thread reads through its own */
+  reader = data->parallel ? acquire_reader(p) : p;
+  if (reader == NULL)
+    {
+      data->success = FALSE;
+      return;
+    }
+
+  if (reader->ifd_offset != image->offset)
+    {
+      if (!TIFFSetSubDirectory(reader->tiff, image->offset))
+        {
+          data->success = FALSE;
+          if (data->parallel)
+            release_reader(p, reader);
+          return;
+        }
+      reader->ifd_offset = image->offset;
     }
 
+  if (image->tiled)
+    buffer = g_try_malloc(TIFFTileSize(reader->tiff));
+  else
+    buffer = g_try_malloc(TIFFStripSize(reader->tiff));
+
+  if (p->mode == TIFF_LOADING_SEPARATED)
+    pixels = g_try_malloc((gsize) image->block_width * image->block_height *
+                          babl_format_get_bytes_per_pixel(p->format));
+
+  g_assert(buffer != NULL);
+  g_assert(p->mode != TIFF_LOADING_SEPARATED || pixels != NULL);
+
+  for (i = first; i < first + n; i++)
+    {
+      GeglRectangle rect;
+      gint x = (data->blocks.x + (gint) (i % data->blocks.width)) *
+               (gint) image->block_width;
+      gint y = (data->blocks.y + (gint) (i / data->blocks.width)) *
+               (gint) image->block_height;
+
+      gegl_rectangle_set(&rect, x, y,
+                         MIN((gint) image->block_width, image->width - x),
+                         MIN((gint) image->block_height, image->height - y));
+
+      if (!load_block(p, reader->tiff, image, data->output, &rect,
+                      buffer, pixels))
+        data->success = FALSE;
+    }
+
+  g_free(pixels);
   g_free(buffer);
-  return 0;
+
+  if (data->parallel)
+    release_reader(p, reader);
+}
+
+/* loads the tiles or strips intersecting roi, from the image best suited
+ * for level.
+ */
+static gint
+load_blocks(GeglOperation *operation,
+            GeglBuffer    *output,
+            const GeglRectangle *roi,
+            gint level)
+{
+  GeglProperties *o = GEGL_PROPERTIES(operation);
+  Priv *p = (Priv*) o->user_data;
+  const TiffImage *image;
+  GeglRectangle bounds = { 0, 0, p->width, p->height };
+  GeglRectangle area;
+  LoadData data;
+  gint scale;
+  gint x1, y1;
+
+  g_return_val_if_fail(p->tiff != NULL, -1);
+
+  if (!gegl_rectangle_intersect(&area, roi, &bounds))
+    return 0;
+
+  image = get_image_for_level(p, level);
+  scale = 1 << image->level;
+
+  /* the area in the coordinates of image */
+  x1 = MIN((area.x + area.width + scale - 1) / scale, image->width);
+  y1 = MIN((area.y + area.height + scale - 1) / scale, image->height);
+  area.x /= scale;
+  area.y /= scale;
+
+  if (area.x >= x1 || area.y >= y1)
+    return 0;
+
+  data.operation = operation;
+  data.output = output;
+  data.image = image;
+  data.success = TRUE;
+
+  data.blocks.x = area.x / (gint) image->block_width;
+  data.blocks.y = area.y / (gint) image->block_height;
+  data.blocks.width = (x1 - 1) / (gint) image->block_width - data.blocks.x + 1;
+  data.blocks.height = (y1 - 1) / (gint) image->block_height - data.blocks.y + 1;
+
+  /* reading in parallel requires opening the file again, for each thread */
+  data.parallel = p->file != NULL && p->can_seek &&
+                  data.blocks.width * data.blocks.height > 1;
+
+  if (data.parallel)
+    {
+      gegl_parallel_distribute_range(
+        data.blocks.width * data.blocks.height,
+        THREAD_COST / ((gdouble) image->block_width * image->block_height),
+        (GeglParallelDistributeRangeFunc) load_blocks_range,
+        &data);
+    }
+  else
+    {
+      load_blocks_range(0, data.blocks.width * data.blocks.height, &data);
+
+      /* the main handle stays on the full resolution image */
+      if (p->ifd_offset != g_array_index(p->images, TiffImage, 0).offset)
+        {
+          p->ifd_offset = g_array_index(p->images, TiffImage, 0).offset;
+          TIFFSetSubDirectory(p->tiff, p->ifd_offset);
+        }
+    }
+
+  return data.success ? 0 : -1;
 }
 
 static void
@@ -936,6 +1296,8 @@ prepare(GeglOperation *operation)
           return;
         }
 
+      query_images(p);
+
         p->directory = o->directory;
     }
 
@@ -977,12 +1339,8 @@ process(GeglOperation *operation,
         break;
 
       case TIFF_LOADING_CONTIGUOUS:
-        if (!load_contiguous(operation, output))
-          return TRUE;
-        break;
-
       case TIFF_LOADING_SEPARATED:
-        if (!load_separated(operation, output))
+        if (!load_blocks(operation, output, result, level))
           return TRUE;
         break;
 
@@ -998,7 +1356,36 @@ static GeglRectangle
 get_cached_region(GeglOperation       *operation,
                   const GeglRectangle *roi)
 {
-  return get_bounding_box(operation);
+  GeglProperties *o = GEGL_PROPERTIES(operation);
+  Priv *p = (Priv*) o->user_data;
+  GeglRectangle result = get_bounding_box(operation);
+  const TiffImage *image;
+  gint block_width, block_height;
+  gint x1, y1;
+
+  if (p->tiff == NULL || p->mode == TIFF_LOADING_RGBA ||
+      p->images == NULL || p->images->len == 0)
+    return result;
+
+  /* whole tiles or strips of the full resolution image are loaded, so
+   * cache those around roi
+   */
+  image = &g_array_index(p->images, TiffImage, 0);
+  block_width = image->block_width;
+  block_height = image->block_height;
+
+  if (!gegl_rectangle_intersect(&result, &result, roi))
+    return result;
+
+  x1 = (result.x + result.width + block_width - 1) / block_width * block_width;
+  y1 = (result.y + result.height + block_height - 1) / block_height * block_height;
+
+  result.x = result.x / block_width * block_width;
+  result.y = result.y / block_height * block_height;
+  result.width = MIN(x1, p->width) - result.x;
+  result.height = MIN(y1, p->height) - result.y;
+
+  return result;
 }
 
 static void
@@ -31,6 +31,23 @@ property_int (fp, _("use floating point"), -1)
   description (_("floating point -1 means auto, 0 means integer, 1 means float."))
   value_range (-1, 1)
 
+enum_start (gegl_tiff_save_compression)
+  enum_value (GEGL_TIFF_SAVE_COMPRESSION_NONE, "none", N_("None"))
+  enum_value (GEGL_TIFF_SAVE_COMPRESSION_DEFLATE, "deflate", N_("Deflate"))
+  enum_value (GEGL_TIFF_SAVE_COMPRESSION_LZW, "lzw", N_("LZW"))
+enum_end (GeglTiffSaveCompression)
+
+property_enum (compression, _("Compression"),
+               GeglTiffSaveCompression, gegl_tiff_save_compression,
+               GEGL_TIFF_SAVE_COMPRESSION_NONE)
+  description (_("Strip or tile compression; deflate strips and tiles are compressed in parallel"))
+
+property_boolean (pyramid, _("Pyramid"), FALSE)
+  description (_("Write a tiled image, followed by reduced resolution levels down to a single tile, for viewers of pyramidal TIFF"))
+property_int (tile_size, _("Tile size"), 256)
+  description (_("Width and height of the tiles of pyramids, rounded up to a multiple of 16"))
+  value_range (16, 4096)
+
 property_object(metadata, _("Metadata"), GEGL_TYPE_METADATA)
   description (_("Object to receive image metadata"))
 
@@ -44,6 +61,13 @@ property_object(metadata, _("Metadata"), GEGL_TYPE_METADATA)
 #include <gegl-gio-private.h>
 #include <glib/gprintf.h>
 #include <tiffio.h>
+#include <zlib.h>
+#include "gegl-config.h"
+
+/* the approximate size of deflated strips, before compression */
+#define DEFLATE_STRIP_SIZE 262144
+
+#define THREAD_COST 65536.0
 
 typedef struct
 {
@@ -397,6 +421,325 @@ save_contiguous(GeglOperation *operation,
   return 0;
 }
 
+typedef struct
+{
+  GeglBuffer *input;
+  const GeglRectangle *result;
+  const Babl *format;
+  gint rows_per_strip;
+  gint bytes_per_row;
+  gint bytes_per_sample;
+  gint samples_per_pixel;
+  gboolean predictor;
+
+  gint first_strip;
+  guchar **strips;
+  uLongf *strip_sizes;
+  gboolean success;
+} DeflateData;
+
+/* horizontal differencing (predictor 2), in place, on a row of unsigned
+ * samples.
+ */
+static void
+apply_predictor(guchar *row,
+                gint n_samples,
+                gint samples_per_pixel,
+                gint bytes_per_sample)
+{
+  gint i;
+
+  switch (bytes_per_sample)
+    {
+    case 1:
+      {
+        guint8 *samples = (guint8 *) row;
+
+        for (i = n_samples - 1; i >= samples_per_pixel; i--)
+          samples[i] -= samples[i - samples_per_pixel];
+      }
+      break;
+
+    case 2:
+      {
+        guint16 *samples = (guint16 *) row;
+
+        for (i = n_samples - 1; i >= samples_per_pixel; i--)
+          samples[i] -= samples[i - samples_per_pixel];
+      }
+      break;
+
+    case 4:
+      {
+        guint32 *samples = (guint32 *) row;
+
+        for (i = n_samples - 1; i >= samples_per_pixel; i--)
+          samples[i] -= samples[i - samples_per_pixel];
+      }
+      break;
+    }
+}
+
+static void
+deflate_strips_range(gsize first,
+                     gsize n,
+                     DeflateData *data)
+{
+  const GeglRectangle *result = data->result;
+  guchar *buffer;
+  gsize i;
+
+  buffer = gegl_scratch_alloc((gsize) data->bytes_per_row *
+                              data->rows_per_strip);
+
+  for (i = first; i < first + n; i++)
+    {
+      gint y = (data->first_strip + (gint) i) * data->rows_per_strip;
+      GeglRectangle rect;
+      uLong size;
+      uLongf compressed_size;
+
+      gegl_rectangle_set(&rect, result->x, result->y + y, result->width,
+                         MIN(data->rows_per_strip, result->height - y));
+
+      gegl_buffer_get(data->input, &rect, 1.0, data->format, buffer,
+                      data->bytes_per_row, GEGL_ABYSS_NONE);
+
+      if (data->predictor)
+        {
+          gint row;
+
+          for (row = 0; row < rect.height; row++)
+            {
+              apply_predictor(buffer + (gsize) data->bytes_per_row * row,
+                              rect.width * data->samples_per_pixel,
+                              data->samples_per_pixel,
+                              data->bytes_per_sample);
+            }
+        }
+
+      size = (uLong) data->bytes_per_row * rect.height;
+      compressed_size = compressBound(size);
+
+      data->strips[i] = g_try_malloc(compressed_size);
+
+      if (data->strips[i] == NULL ||
+          compress2(data->strips[i], &compressed_size,
+                    buffer, size, Z_DEFAULT_COMPRESSION) != Z_OK)
+        {
+          data->success = FALSE;
+          continue;
+        }
+
+      data->strip_sizes[i] = compressed_size;
+    }
+
+  gegl_scratch_free(buffer);
+}
+
+/* compresses batches of strips in parallel, with zlib, and writes them in
+ * order, bypassing libtiff's codec.
+ */
+static gint
+save_deflate(GeglOperation *operation,
+             GeglBuffer    *input,
+             const GeglRectangle *result,
+             const Babl *format,
+             glong rows_per_strip,
+             gboolean predictor)
+{
+  GeglProperties *o = GEGL_PROPERTIES(operation);
+  Priv *p = (Priv*) o->user_data;
+  DeflateData data;
+  gint n_strips;
+  gint batch_size;
+  gint first;
+
+  g_return_val_if_fail(p->tiff != NULL, -1);
+
+  data.input = input;
+  data.result = result;
+  data.format = format;
+  data.rows_per_strip = rows_per_strip;
+  data.bytes_per_row = babl_format_get_bytes_per_pixel(format) * result->width;
+  data.bytes_per_sample = babl_format_get_bytes_per_pixel(format) /
+                          babl_format_get_n_components(format);
+  data.samples_per_pixel = babl_format_get_n_components(format);
+  data.predictor = predictor;
+  data.success = TRUE;
+
+  n_strips = (result->height + rows_per_strip - 1) / rows_per_strip;
+
+  /* keep a couple of strips per thread in flight, so that memory use stays
+   * bounded for large images.
+   */
+  batch_size = MIN(2 * gegl_config_threads(), n_strips);
+
+  data.strips = g_new0(guchar *, batch_size);
+  data.strip_sizes = g_new0(uLongf, batch_size);
+
+  for (first = 0; first < n_strips && data.success; first += batch_size)
+    {
+      gint n = MIN(batch_size, n_strips - first);
+      gint i;
+
+      data.first_strip = first;
+
+      gegl_parallel_distribute_range(
+        n, THREAD_COST / ((gdouble) data.bytes_per_row * rows_per_strip),
+        (GeglParallelDistributeRangeFunc) deflate_strips_range,
+        &data);
+
+      for (i = 0; i < n; i++)
+        {
+          if (data.success &&
+              TIFFWriteRawStrip(p->tiff, first + i, data.strips[i],
+                                data.strip_sizes[i]) < 0)
+            {
+              g_critical("failed a strip write on strip %d", first + i);
+              data.success = FALSE;
+            }
+
+          g_clear_pointer(&data.strips[i], g_free);
+        }
+    }
+
+  g_free(data.strip_sizes);
+  g_free(data.strips);
+
+  return data.success ? 0 : -1;
+}
+
+typedef struct
+{
+  TIFF *tiff;
+  GMutex mutex;
+  gint tile_size;
+  gint bytes_per_sample;
+  gint samples_per_pixel;
+  gboolean deflate;
+  gboolean predictor;
+} TiledData;
+
+/* called in parallel for each tile of a level.  tiles at the right and
+ * bottom edges are padded to the full tile size, as TIFF requires.  deflate
+ * tiles are compressed before taking the lock, other codecs are left to
+ * libtiff.
+ */
+static gboolean
+save_tile(const GeglPyramidTile *tile,
+          TiledData *data)
+{
+  gint bpp = babl_format_get_bytes_per_pixel(tile->format);
+  gint bytes_per_row = bpp * data->tile_size;
+  uLong size = (uLong) bytes_per_row * data->tile_size;
+  uLongf compressed_size = 0;
+  guchar *buffer;
+  guchar *compressed = NULL;
+  gboolean success = TRUE;
+  ttile_t index;
+  gint row;
+
+  buffer = gegl_scratch_alloc(size);
+
+  if (tile->rect.width < data->tile_size || tile->rect.height < data->tile_size)
+    memset(buffer, 0, size);
+
+  for (row = 0; row < tile->rect.height; row++)
+    {
+      memcpy(buffer + (gsize) bytes_per_row * row,
+             tile->data + (gsize) tile->rowstride * row,
+             (gsize) bpp * tile->rect.width);
+
+      if (data->deflate && data->predictor)
+        apply_predictor(buffer + (gsize) bytes_per_row * row,
+                        data->tile_size * data->samples_per_pixel,
+                        data->samples_per_pixel,
+                        data->bytes_per_sample);
+    }
+
+  if (data->deflate)
+    {
+      compressed_size = compressBound(size);
+      compressed = g_try_malloc(compressed_size);
+
+      success = compressed != NULL &&
+                compress2(compressed, &compressed_size,
+                          buffer, size, Z_DEFAULT_COMPRESSION) == Z_OK;
+    }
+
+  if (success)
+    {
+      g_mutex_lock(&data->mutex);
+
+      index = TIFFComputeTile(data->tiff,
+                              tile->column * data->tile_size,
+                              tile->row * data->tile_size, 0, 0);
+
+      if (data->deflate)
+        success = TIFFWriteRawTile(data->tiff, index,
+                                   compressed, compressed_size) >= 0;
+      else
+        success = TIFFWriteEncodedTile(data->tiff, index, buffer, size) >= 0;
+
+      g_mutex_unlock(&data->mutex);
+
+      if (!success)
+        g_critical("failed a tile write on tile %d", (gint) index);
+    }
+
+  g_free(compressed);
+  gegl_scratch_free(buffer);
+
+  return success;
+}
+
+/* TIFF requires the width and height of tiles to be multiples of 16 */
+static gint
+get_tile_size(GeglProperties *o)
+{
+  return (o->tile_size + 15) & ~15;
+}
+
+/* writes a level of a pyramid as tiles, which are read from the mipmap
+ * level of the input.
+ */
+static gint
+save_tiled(GeglOperation *operation,
+           GeglBuffer    *input,
+           const GeglRectangle *result,
+           gint level,
+           const Babl *format,
+           gboolean deflate,
+           gboolean predictor)
+{
+  GeglProperties *o = GEGL_PROPERTIES(operation);
+  Priv *p = (Priv*) o->user_data;
+  TiledData data;
+  gboolean success;
+
+  g_return_val_if_fail(p->tiff != NULL, -1);
+
+  data.tiff = p->tiff;
+  data.tile_size = get_tile_size(o);
+  data.samples_per_pixel = babl_format_get_n_components(format);
+  data.bytes_per_sample = babl_format_get_bytes_per_pixel(format) /
+                          data.samples_per_pixel;
+  data.deflate = deflate;
+  data.predictor = predictor;
+
+  g_mutex_init(&data.mutex);
+
+  success = gegl_buffer_pyramid_foreach(input, result, level, 1,
+                                        data.tile_size, 0, format,
+                                        (GeglPyramidTileFunc) save_tile,
+                                        &data);
+
+  g_mutex_clear(&data.mutex);
+
+  return success ? 0 : -1;
+}
+
 static void
 SetFieldString (TIFF *tiff, guint tag, GeglMetadata *metadata, const gchar *name)
 {
@@ -415,7 +758,8 @@ SetFieldString (TIFF *tiff, guint tag, GeglMetadata *metadata, const gchar *name
 static int
 export_tiff (GeglOperation *operation,
              GeglBuffer *input,
-             const GeglRectangle *result)
+             const GeglRectangle *result,
+             gint level)
 {
   const Babl *space;
   GeglProperties *o = GEGL_PROPERTIES(operation);
@@ -428,17 +772,22 @@ export_tiff (GeglOperation *operation,
   gushort extra_types[1];
   glong rows_per_stripe = 1;
   gint bytes_per_row;
+  gint strip_size;
   const Babl *type, *model;
   gchar format_string[32];
   const Babl *format;
+  GeglRectangle level_rect;
 
   g_return_val_if_fail(p->tiff != NULL, -1);
 
-  TIFFSetField(p->tiff, TIFFTAG_SUBFILETYPE, 0);
+  gegl_buffer_pyramid_get_level_rect(result, level, &level_rect);
+
+  TIFFSetField(p->tiff, TIFFTAG_SUBFILETYPE,
+               level > 0 ? FILETYPE_REDUCEDIMAGE : 0);
   TIFFSetField(p->tiff, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
 
-  TIFFSetField(p->tiff, TIFFTAG_IMAGEWIDTH, result->width);
-  TIFFSetField(p->tiff, TIFFTAG_IMAGELENGTH, result->height);
+  TIFFSetField(p->tiff, TIFFTAG_IMAGEWIDTH, level_rect.width);
+  TIFFSetField(p->tiff, TIFFTAG_IMAGELENGTH, level_rect.height);
 
   format = gegl_buffer_get_format(input);
   model = babl_format_get_model(format);
@@ -581,14 +930,6 @@ export_tiff (GeglOperation *operation,
       TIFFSetField(p->tiff, TIFFTAG_EXTRASAMPLES, 1, extra_types);
     }
 
-  if (predictor != 0)
-    {
-      if (compression == COMPRESSION_LZW)
-        TIFFSetField(p->tiff, TIFFTAG_PREDICTOR, predictor);
-      else if (compression == COMPRESSION_ADOBE_DEFLATE)
-        TIFFSetField(p->tiff, TIFFTAG_PREDICTOR, predictor);
-    }
-
   if (type == babl_type("u8"))
     {
       sample_format = SAMPLEFORMAT_UINT;
@@ -657,6 +998,27 @@ export_tiff (GeglOperation *operation,
   TIFFSetField(p->tiff, TIFFTAG_BITSPERSAMPLE, bits_per_sample);
   TIFFSetField(p->tiff, TIFFTAG_SAMPLEFORMAT, sample_format);
 
+  switch (o->compression)
+    {
+    case GEGL_TIFF_SAVE_COMPRESSION_DEFLATE:
+      compression = COMPRESSION_ADOBE_DEFLATE;
+      break;
+    case GEGL_TIFF_SAVE_COMPRESSION_LZW:
+      compression = COMPRESSION_LZW;
+      break;
+    default:
+      compression = COMPRESSION_NONE;
+      break;
+    }
+
+  /* the predictor tag is only known once a codec using it is configured */
+  if (compression != COMPRESSION_NONE && !TIFFIsCODECConfigured(compression))
+    {
+      g_warning("libtiff lacks support for the requested compression, "
+                "saving uncompressed");
+      compression = COMPRESSION_NONE;
+    }
+
   TIFFSetField(p->tiff, TIFFTAG_COMPRESSION, compression);
 
   if ((compression == COMPRESSION_CCITTFAX3 ||
@@ -692,16 +1054,43 @@ export_tiff (GeglOperation *operation,
 
   format = babl_format_with_space (format_string, space);
 
-  /* "Choose RowsPerStrip such that each strip is about 8K bytes." */
+  /* we only implement horizontal differencing of integer samples for the
+   * deflate strips we compress ourselves.
+   */
+  if (compression == COMPRESSION_ADOBE_DEFLATE &&
+      (sample_format != SAMPLEFORMAT_UINT || bits_per_sample > 32))
+    predictor = 0;
+
+  if (predictor != 0)
+    {
+      if (compression == COMPRESSION_LZW)
+        TIFFSetField(p->tiff, TIFFTAG_PREDICTOR, predictor);
+      else if (compression == COMPRESSION_ADOBE_DEFLATE)
+        TIFFSetField(p->tiff, TIFFTAG_PREDICTOR, predictor);
+    }
+
+  if (o->pyramid)
+    {
+      TIFFSetField(p->tiff, TIFFTAG_TILEWIDTH, get_tile_size(o));
+      TIFFSetField(p->tiff, TIFFTAG_TILELENGTH, get_tile_size(o));
+    }
+
+  /* "Choose RowsPerStrip such that each strip is about 8K bytes."  strips
+   * we deflate ourselves are compressed in parallel, and made larger so
+   * that each one is worth a thread, and compresses well.
+   */
+  strip_size = compression == COMPRESSION_ADOBE_DEFLATE ? DEFLATE_STRIP_SIZE
+                                                        : 8192;
   bytes_per_row = babl_format_get_bytes_per_pixel(format) * result->width;
-  while (bytes_per_row * rows_per_stripe <= 8192)
+  while (bytes_per_row * rows_per_stripe <= strip_size)
     rows_per_stripe++;
 
   rows_per_stripe = MIN(rows_per_stripe, result->height);
 
-  TIFFSetField(p->tiff, TIFFTAG_ROWSPERSTRIP, rows_per_stripe);
+  if (!o->pyramid)
+    TIFFSetField(p->tiff, TIFFTAG_ROWSPERSTRIP, rows_per_stripe);
 
-  if (o->metadata != NULL)
+  if (o->metadata != NULL && level == 0)
     {
       GeglResolutionUnit unit;
       gfloat xres, yres;
@@ -752,6 +1141,15 @@ export_tiff (GeglOperation *operation,
       gegl_metadata_unregister_map (GEGL_METADATA (o->metadata));
     }
 
+  if (o->pyramid)
+    return save_tiled(operation, input, result, level, format,
+                      compression == COMPRESSION_ADOBE_DEFLATE,
+                      predictor != 0);
+
+  if (compression == COMPRESSION_ADOBE_DEFLATE)
+    return save_deflate(operation, input, result, format,
+                        rows_per_stripe, predictor != 0);
+
   return save_contiguous(operation, input, result, format);
 }
 
@@ -765,6 +1163,8 @@ process(GeglOperation *operation,
   Priv *p = g_new0(Priv, 1);
   gboolean status = TRUE;
   GError *error = NULL;
+  gint n_levels;
+  gint i;
 
   g_assert(p != NULL);
 
@@ -794,11 +1194,28 @@ process(GeglOperation *operation,
       goto cleanup;
     }
 
-  if (export_tiff(operation, input, result))
+  /* the reduced levels of a pyramid follow the image, each in a directory
+   * of its own.
+   */
+  n_levels = o->pyramid ? gegl_buffer_pyramid_get_n_levels(result,
+                                                           get_tile_size(o))
+                        : 1;
+
+  for (i = 0; i < n_levels; i++)
     {
-      status = FALSE;
-      g_warning("could not export TIFF file");
-      goto cleanup;
+      if (i > 0 && !TIFFWriteDirectory(p->tiff))
+        {
+          status = FALSE;
+          g_warning("failed to write a TIFF directory");
+          goto cleanup;
+        }
+
+      if (export_tiff(operation, input, result, i))
+        {
+          status = FALSE;
+          g_warning("could not export TIFF file");
+          goto cleanup;
+        }
     }
 
 cleanup:
@@ -38,6 +38,18 @@ property_int (quality, _("Quality"), 90)
 #include <gegl-op.h>
 #include <gegl-gio-private.h>
 #include <webp/encode.h>
+#include "gegl-config.h"
+
+#define THREAD_COST 4096.0
+
+typedef struct
+{
+  GeglBuffer          *input;
+  const GeglRectangle *result;
+  const Babl          *format;
+  uint8_t             *buffer;
+  gint                 bytes_per_row;
+} FetchData;
 
 static int
 write_to_stream (const uint8_t*     data,
@@ -64,6 +76,22 @@ write_to_stream (const uint8_t*     data,
   return 1;
 }
 
+static void
+fetch_rows_range (gsize      first_row,
+                  gsize      n_rows,
+                  FetchData *data)
+{
+  GeglRectangle rect;
+
+  gegl_rectangle_set (&rect,
+                      data->result->x, data->result->y + first_row,
+                      data->result->width, n_rows);
+
+  gegl_buffer_get (data->input, &rect, 1.0, data->format,
+                   data->buffer + (gsize) data->bytes_per_row * first_row,
+                   data->bytes_per_row, GEGL_ABYSS_NONE);
+}
+
 static gint
 save_RGBA (WebPPicture         *picture,
            GeglBuffer          *input,
@@ -72,16 +100,26 @@ save_RGBA (WebPPicture         *picture,
 {
   gint bytes_per_pixel, bytes_per_row;
   uint8_t *buffer;
+  FetchData data;
 
   bytes_per_pixel = babl_format_get_bytes_per_pixel (format);
   bytes_per_row = bytes_per_pixel * result->width;
 
-  buffer = g_try_new (uint8_t, bytes_per_row * result->height);
+  buffer = g_try_new (uint8_t, (gsize) bytes_per_row * result->height);
 
   g_assert (buffer != NULL);
 
-  gegl_buffer_get (input, result, 1.0, format, buffer,
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  data.input = input;
+  data.result = result;
+  data.format = format;
+  data.buffer = buffer;
+  data.bytes_per_row = bytes_per_row;
+
+  /* fetching and converting the pixels is ours to parallelize */
+  gegl_parallel_distribute_range (
+    result->height, THREAD_COST / result->width,
+    (GeglParallelDistributeRangeFunc) fetch_rows_range,
+    &data);
 
   WebPPictureImportRGBA (picture, buffer, bytes_per_row);
 
@@ -115,6 +153,9 @@ export_webp (GeglOperation       *operation,
       return FALSE;
     }
 
+  /* let libwebp run the parts of the encoder it can in a separate thread */
+  config.thread_level = gegl_config_threads () > 1;
+
   picture.width = result->width;
   picture.height = result->height;
 
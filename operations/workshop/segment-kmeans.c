@@ -45,16 +45,34 @@ property_seed (seed, _("Random seed"), rand)
 #include "gegl-op.h"
 
 #define MAX_PIXELS 100000
+#define CHUNK_SIZE 4096   /* pixels per partial sum of the assignment step */
 
 #define POW2(x) ((x)*(x))
 
 typedef struct
 {
-  gfloat center[3];
-  gfloat sum[3];
-  glong  count;
+  gfloat  center[3];
+  gdouble sum[3];
+  glong   count;
 } Cluster;
 
+typedef struct
+{
+  const gfloat  *pixels;
+  glong          n_pixels;
+  const Cluster *clusters;
+  gint           n_clusters;
+  gdouble       *partial;
+} AssignData;
+
+typedef struct
+{
+  GeglBuffer    *input;
+  GeglBuffer    *output;
+  const Cluster *clusters;
+  gint           n_clusters;
+} OutputData;
+
 static void
 downsample_buffer (GeglBuffer  *input,
                    GeglBuffer **downsampled)
@@ -101,7 +119,7 @@ downsample_buffer (GeglBuffer  *input,
 }
 
 static inline gfloat
-get_distance (gfloat *c1, gfloat *c2)
+get_distance (const gfloat *c1, const gfloat *c2)
 {
   return POW2(c2[0] - c1[0]) +
          POW2(c2[1] - c1[1]) +
@@ -109,9 +127,9 @@ get_distance (gfloat *c1, gfloat *c2)
 }
 
 static inline gint
-find_nearest_cluster (gfloat  *pixel,
-                      Cluster *clusters,
-                      gint     n_clusters)
+find_nearest_cluster (const gfloat  *pixel,
+                      const Cluster *clusters,
+                      gint           n_clusters)
 {
   gfloat min_distance = G_MAXFLOAT;
   gint   min_cluster  = 0;
@@ -157,9 +175,9 @@ init_clusters (GeglBuffer     *input,
       c->center[0] = color[0];
       c->center[1] = color[1];
       c->center[2] = color[2];
-      c->sum[0] = 0.0f;
-      c->sum[1] = 0.0f;
-      c->sum[2] = 0.0f;
+      c->sum[0] = 0.0;
+      c->sum[1] = 0.0;
+      c->sum[2] = 0.0;
       c->count = 0;
     }
 
@@ -168,35 +186,82 @@ init_clusters (GeglBuffer     *input,
   return clusters;
 }
 
+/* each chunk of CHUNK_SIZE pixels is summed separately, and the partial
+ * sums are added up in order, so that the result doesn't depend on the
+ * number of threads.
+ */
 static void
-assign_pixels_to_clusters (GeglBuffer *input,
-                           Cluster    *clusters,
-                           gint        n_clusters)
+assign_pixels_to_clusters_range (gsize       offset,
+                                 gsize       size,
+                                 AssignData *data)
 {
-  GeglBufferIterator *iter;
+  gsize chunk;
 
-  iter = gegl_buffer_iterator_new (input, NULL, 0, babl_format ("CIE Lab float"),
-                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 1);
-
-  while (gegl_buffer_iterator_next (iter))
+  for (chunk = offset; chunk < offset + size; chunk++)
     {
-      gfloat *pixel = iter->items[0].data;
-      glong   n_pixels = iter->length;
+      gdouble      *sums     = data->partial + chunk * data->n_clusters * 4;
+      glong         first    = chunk * CHUNK_SIZE;
+      glong         n_pixels = MIN (CHUNK_SIZE, data->n_pixels - first);
+      const gfloat *pixel    = data->pixels + first * 3;
+
+      memset (sums, 0, data->n_clusters * 4 * sizeof (gdouble));
 
       while (n_pixels--)
         {
-          gint index = find_nearest_cluster (pixel, clusters, n_clusters);
+          gint     index = find_nearest_cluster (pixel, data->clusters,
+                                                 data->n_clusters);
+          gdouble *sum   = sums + index * 4;
 
-          clusters[index].sum[0] += pixel[0];
-          clusters[index].sum[1] += pixel[1];
-          clusters[index].sum[2] += pixel[2];
-          clusters[index].count++;
+          sum[0] += pixel[0];
+          sum[1] += pixel[1];
+          sum[2] += pixel[2];
+          sum[3] += 1.0;
 
           pixel += 3;
         }
     }
 }
 
+static void
+assign_pixels_to_clusters (GeglOperation *operation,
+                           const gfloat  *pixels,
+                           glong          n_pixels,
+                           Cluster       *clusters,
+                           gint           n_clusters)
+{
+  AssignData data;
+  gsize      n_chunks = (n_pixels + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  gsize      chunk;
+  gint       i;
+
+  data.pixels     = pixels;
+  data.n_pixels   = n_pixels;
+  data.clusters   = clusters;
+  data.n_clusters = n_clusters;
+  data.partial    = g_new (gdouble, n_chunks * n_clusters * 4);
+
+  gegl_parallel_distribute_range (
+    n_chunks,
+    gegl_operation_get_pixels_per_thread (operation) / CHUNK_SIZE,
+    (GeglParallelDistributeRangeFunc) assign_pixels_to_clusters_range,
+    &data);
+
+  for (chunk = 0; chunk < n_chunks; chunk++)
+    {
+      const gdouble *sums = data.partial + chunk * n_clusters * 4;
+
+      for (i = 0; i < n_clusters; i++)
+        {
+          clusters[i].sum[0] += sums[i * 4 + 0];
+          clusters[i].sum[1] += sums[i * 4 + 1];
+          clusters[i].sum[2] += sums[i * 4 + 2];
+          clusters[i].count  += (glong) sums[i * 4 + 3];
+        }
+    }
+
+  g_free (data.partial);
+}
+
 static gboolean
 update_clusters (Cluster  *clusters,
                  gint      n_clusters)
@@ -223,9 +288,9 @@ update_clusters (Cluster  *clusters,
       clusters[i].center[0] = new_center[0];
       clusters[i].center[1] = new_center[1];
       clusters[i].center[2] = new_center[2];
-      clusters[i].sum[0] = 0.0f;
-      clusters[i].sum[1] = 0.0f;
-      clusters[i].sum[2] = 0.0f;
+      clusters[i].sum[0] = 0.0;
+      clusters[i].sum[1] = 0.0;
+      clusters[i].sum[2] = 0.0;
       clusters[i].count  = 0;
     }
 
@@ -233,17 +298,19 @@ update_clusters (Cluster  *clusters,
 }
 
 static void
-set_output (GeglBuffer *input,
-            GeglBuffer *output,
-            Cluster    *clusters,
-            gint        n_clusters)
+set_output_area (const GeglRectangle *area,
+                 OutputData          *data)
 {
   GeglBufferIterator *iter;
+  const Cluster      *clusters   = data->clusters;
+  gint                n_clusters = data->n_clusters;
 
-  iter = gegl_buffer_iterator_new (output, NULL, 0, babl_format ("CIE Lab float"),
+  iter = gegl_buffer_iterator_new (data->output, area, 0,
+                                   babl_format ("CIE Lab float"),
                                    GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE, 2);
 
-  gegl_buffer_iterator_add (iter, input, NULL, 0, babl_format ("CIE Lab float"),
+  gegl_buffer_iterator_add (iter, data->input, area, 0,
+                            babl_format ("CIE Lab float"),
                             GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
 
   while (gegl_buffer_iterator_next (iter))
@@ -266,6 +333,23 @@ set_output (GeglBuffer *input,
     }
 }
 
+static void
+set_output (GeglOperation *operation,
+            GeglBuffer    *input,
+            GeglBuffer    *output,
+            Cluster       *clusters,
+            gint           n_clusters)
+{
+  OutputData data = { input, output, clusters, n_clusters };
+
+  gegl_parallel_distribute_area (
+    gegl_buffer_get_extent (output),
+    gegl_operation_get_pixels_per_thread (operation),
+    GEGL_SPLIT_STRATEGY_AUTO,
+    (GeglParallelDistributeAreaFunc) set_output_area,
+    &data);
+}
+
 static void
 prepare (GeglOperation *operation)
 {
@@ -312,6 +396,8 @@ process (GeglOperation       *operation,
   gint            iterations = o->max_iterations;
   Cluster    *clusters;
   GeglBuffer *source;
+  gfloat     *pixels;
+  glong       n_pixels;
 
   /* if pixels count of input buffer > MAX_PIXELS, compute a smaller buffer */
 
@@ -321,11 +407,23 @@ process (GeglOperation       *operation,
 
   clusters = init_clusters (source, o);
 
+  /* the (downsampled) source is small, so keep it in memory for all
+   * iterations
+   */
+
+  n_pixels = (glong) gegl_buffer_get_width (source) *
+                     gegl_buffer_get_height (source);
+  pixels   = g_new (gfloat, n_pixels * 3);
+
+  gegl_buffer_get (source, NULL, 1.0, babl_format ("CIE Lab float"),
+                   pixels, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
   /* perform segmentation */
 
   while (iterations--)
     {
-      assign_pixels_to_clusters (source, clusters, o->n_clusters);
+      assign_pixels_to_clusters (operation, pixels, n_pixels,
+                                 clusters, o->n_clusters);
 
       if (!update_clusters (clusters, o->n_clusters))
         break;
@@ -333,8 +431,9 @@ process (GeglOperation       *operation,
 
   /* apply cluster colors to output */
 
-  set_output (input, output, clusters, o->n_clusters);
+  set_output (operation, input, output, clusters, o->n_clusters);
 
+  g_free (pixels);
   g_free (clusters);
 
   if (source != input)
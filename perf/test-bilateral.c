@@ -0,0 +1,104 @@
+#include "test-common.h"
+
+#define SIZE   256
+#define RADIUS 20.0
+
+void bilateral_exact (GeglBuffer *buffer);
+void bilateral_fast (GeglBuffer *buffer);
+
+/* looks up a value of the mode property by its nick */
+static gint
+mode_value (const gchar *nick)
+{
+  GParamSpec *pspec = gegl_operation_find_property ("gegl:bilateral-filter",
+                                                    "mode");
+
+  return g_enum_get_value_by_nick (G_PARAM_SPEC_ENUM (pspec)->enum_class,
+                                   nick)->value;
+}
+
+static GeglBuffer *
+bilateral (GeglBuffer  *buffer,
+           const gchar *mode)
+{
+  GeglBuffer *buffer2;
+  GeglNode   *gegl, *source, *node, *sink;
+
+  gegl = gegl_node_new ();
+  source = gegl_node_new_child (gegl, "operation", "gegl:buffer-source", "buffer", buffer, NULL);
+  node = gegl_node_new_child (gegl, "operation", "gegl:bilateral-filter",
+                                    "blur-radius", RADIUS,
+                                    "mode",        mode_value (mode),
+                                    NULL);
+  sink = gegl_node_new_child (gegl, "operation", "gegl:buffer-sink", "buffer", &buffer2, NULL);
+
+  gegl_node_link_many (source, node, sink, NULL);
+  gegl_node_process (sink);
+  g_object_unref (gegl);
+
+  return buffer2;
+}
+
+/* prints the mean and maximal absolute difference between the exact filter
+ * and the approximation
+ */
+static void
+compare (GeglBuffer *buffer)
+{
+  GeglBuffer *exact = bilateral (buffer, "exact");
+  GeglBuffer *fast  = bilateral (buffer, "fast");
+  gfloat     *a     = g_new (gfloat, SIZE * SIZE * 4);
+  gfloat     *b     = g_new (gfloat, SIZE * SIZE * 4);
+  gdouble     sum   = 0.0;
+  gdouble     max   = 0.0;
+  gint        i;
+
+  gegl_buffer_get (exact, NULL, 1.0, babl_format ("RGBA float"), a,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  gegl_buffer_get (fast,  NULL, 1.0, babl_format ("RGBA float"), b,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (i = 0; i < SIZE * SIZE * 4; i++)
+    {
+      gdouble diff = fabs (a[i] - b[i]);
+
+      sum += diff;
+      max  = MAX (max, diff);
+    }
+
+  g_print ("bilateral-filter fast vs exact: mean error %f, max error %f\n",
+           sum / (SIZE * SIZE * 4), max);
+
+  g_free (a);
+  g_free (b);
+  g_object_unref (exact);
+  g_object_unref (fast);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GeglBuffer *buffer;
+
+  gegl_init (&argc, &argv);
+
+  buffer = test_buffer (SIZE, SIZE, babl_format ("RGBA float"));
+  compare (buffer);
+  bench ("bilateral-filter (exact)", buffer, &bilateral_exact);
+  bench ("bilateral-filter (fast)", buffer, &bilateral_fast);
+  g_object_unref (buffer);
+
+  gegl_exit ();
+  return 0;
+}
+
+void bilateral_exact (GeglBuffer *buffer)
+{
+  g_object_unref (bilateral (buffer, "exact"));
+}
+
+void bilateral_fast (GeglBuffer *buffer)
+{
+  g_object_unref (bilateral (buffer, "fast"));
+}
@@ -0,0 +1,94 @@
+#include "test-common.h"
+
+#define SIZE        256
+#define RADIUS      100
+#define SUBSAMPLING 4
+
+void c2g_full (GeglBuffer *buffer);
+void c2g_subsampled (GeglBuffer *buffer);
+
+static GeglBuffer *
+c2g (GeglBuffer *buffer,
+     gint        subsampling)
+{
+  GeglBuffer *buffer2;
+  GeglNode   *gegl, *source, *node, *sink;
+
+  gegl = gegl_node_new ();
+  source = gegl_node_new_child (gegl, "operation", "gegl:buffer-source", "buffer", buffer, NULL);
+  node = gegl_node_new_child (gegl, "operation", "gegl:c2g",
+                                    "radius",      RADIUS,
+                                    "subsampling", subsampling,
+                                    NULL);
+  sink = gegl_node_new_child (gegl, "operation", "gegl:buffer-sink", "buffer", &buffer2, NULL);
+
+  gegl_node_link_many (source, node, sink, NULL);
+  gegl_node_process (sink);
+  g_object_unref (gegl);
+
+  return buffer2;
+}
+
+/* prints the mean and maximal absolute difference between rendering with
+ * subsampled envelopes and with full resolution ones
+ */
+static void
+compare (GeglBuffer *buffer)
+{
+  GeglBuffer *full       = c2g (buffer, 1);
+  GeglBuffer *subsampled = c2g (buffer, SUBSAMPLING);
+  gfloat     *a          = g_new (gfloat, SIZE * SIZE);
+  gfloat     *b          = g_new (gfloat, SIZE * SIZE);
+  gdouble     sum        = 0.0;
+  gdouble     max        = 0.0;
+  gint        i;
+
+  gegl_buffer_get (full,       NULL, 1.0, babl_format ("Y float"), a,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  gegl_buffer_get (subsampled, NULL, 1.0, babl_format ("Y float"), b,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (i = 0; i < SIZE * SIZE; i++)
+    {
+      gdouble diff = fabs (a[i] - b[i]);
+
+      sum += diff;
+      max  = MAX (max, diff);
+    }
+
+  g_print ("c2g subsampling %d vs full: mean error %f, max error %f\n",
+           SUBSAMPLING, sum / (SIZE * SIZE), max);
+
+  g_free (a);
+  g_free (b);
+  g_object_unref (full);
+  g_object_unref (subsampled);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GeglBuffer *buffer;
+
+  gegl_init (&argc, &argv);
+
+  buffer = test_buffer (SIZE, SIZE, babl_format ("RGBA float"));
+  compare (buffer);
+  bench ("c2g", buffer, &c2g_full);
+  bench ("c2g (subsampled)", buffer, &c2g_subsampled);
+  g_object_unref (buffer);
+
+  gegl_exit ();
+  return 0;
+}
+
+void c2g_full (GeglBuffer *buffer)
+{
+  g_object_unref (c2g (buffer, 1));
+}
+
+void c2g_subsampled (GeglBuffer *buffer)
+{
+  g_object_unref (c2g (buffer, SUBSAMPLING));
+}
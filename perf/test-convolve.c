@@ -0,0 +1,119 @@
+#include "test-common.h"
+
+#define SIZE   512
+#define RADIUS 25
+
+void convolve_box (GeglBuffer *buffer);
+void box_blur (GeglBuffer *buffer);
+
+/* convolves with a uniform square kernel, which should match box-blur */
+static GeglBuffer *
+convolve (GeglBuffer *buffer)
+{
+  GeglBuffer *buffer2;
+  GeglNode   *gegl, *source, *color, *crop, *node, *sink;
+  GeglColor  *white = gegl_color_new ("white");
+
+  gegl = gegl_node_new ();
+  source = gegl_node_new_child (gegl, "operation", "gegl:buffer-source", "buffer", buffer, NULL);
+  color = gegl_node_new_child (gegl, "operation", "gegl:color", "value", white, NULL);
+  crop = gegl_node_new_child (gegl, "operation", "gegl:crop",
+                                    "width",  (gdouble) (2 * RADIUS + 1),
+                                    "height", (gdouble) (2 * RADIUS + 1),
+                                    NULL);
+  node = gegl_node_new_child (gegl, "operation", "gegl:convolve", NULL);
+  sink = gegl_node_new_child (gegl, "operation", "gegl:buffer-sink", "buffer", &buffer2, NULL);
+
+  gegl_node_link_many (color, crop, NULL);
+  gegl_node_connect (crop, "output", node, "aux");
+  gegl_node_link_many (source, node, sink, NULL);
+  gegl_node_process (sink);
+  g_object_unref (gegl);
+  g_object_unref (white);
+
+  return buffer2;
+}
+
+static GeglBuffer *
+box (GeglBuffer *buffer)
+{
+  GeglBuffer *buffer2;
+  GeglNode   *gegl, *source, *node, *sink;
+
+  gegl = gegl_node_new ();
+  source = gegl_node_new_child (gegl, "operation", "gegl:buffer-source", "buffer", buffer, NULL);
+  node = gegl_node_new_child (gegl, "operation", "gegl:box-blur",
+                                    "radius", RADIUS,
+                                    NULL);
+  sink = gegl_node_new_child (gegl, "operation", "gegl:buffer-sink", "buffer", &buffer2, NULL);
+
+  gegl_node_link_many (source, node, sink, NULL);
+  gegl_node_process (sink);
+  g_object_unref (gegl);
+
+  return buffer2;
+}
+
+/* prints the mean and maximal absolute difference between convolving with a
+ * square kernel and box-blur
+ */
+static void
+compare (GeglBuffer *buffer)
+{
+  GeglBuffer *convolved = convolve (buffer);
+  GeglBuffer *blurred   = box (buffer);
+  gfloat     *a         = g_new (gfloat, SIZE * SIZE * 4);
+  gfloat     *b         = g_new (gfloat, SIZE * SIZE * 4);
+  gdouble     sum       = 0.0;
+  gdouble     max       = 0.0;
+  gint        i;
+
+  gegl_buffer_get (convolved, NULL, 1.0, babl_format ("RaGaBaA float"), a,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  gegl_buffer_get (blurred,   NULL, 1.0, babl_format ("RaGaBaA float"), b,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (i = 0; i < SIZE * SIZE * 4; i++)
+    {
+      gdouble diff = fabs (a[i] - b[i]);
+
+      sum += diff;
+      max  = MAX (max, diff);
+    }
+
+  g_print ("convolve vs box-blur: mean error %f, max error %f\n",
+           sum / (SIZE * SIZE * 4), max);
+
+  g_free (a);
+  g_free (b);
+  g_object_unref (convolved);
+  g_object_unref (blurred);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GeglBuffer *buffer;
+
+  gegl_init (&argc, &argv);
+
+  buffer = test_buffer (SIZE, SIZE, babl_format ("RGBA float"));
+  compare (buffer);
+  bench ("convolve", buffer, &convolve_box);
+  bench ("box-blur", buffer, &box_blur);
+  g_object_unref (buffer);
+
+  gegl_exit ();
+  return 0;
+}
+
+void convolve_box (GeglBuffer *buffer)
+{
+  g_object_unref (convolve (buffer));
+}
+
+void box_blur (GeglBuffer *buffer)
+{
+  g_object_unref (box (buffer));
+}
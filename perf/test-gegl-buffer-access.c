@@ -118,6 +118,34 @@ main (gint    argc,
   }
   test_end ("bilinear 0.333", 1.0 * bound2.width * bound2.height * ITERATIONS * 4);
 
+  {
+      GeglBuffer *buffer = gegl_buffer_new (&bound, format);
+      gegl_buffer_set (buffer, &bound, 0, NULL, sbuf, GEGL_AUTO_ROWSTRIDE);
+  test_start ();
+  for (i=0;i<ITERATIONS && converged < BAIL_COUNT;i++)
+    {
+      test_start_iter ();
+      gegl_buffer_get (buffer, &bound2, 0.666, babl_format ("R'G'B'A u8"), buf, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE|GEGL_BUFFER_FILTER_BOX);
+      test_end_iter ();
+     }
+      g_object_unref (buffer);
+  }
+  test_end ("float to 8bit box 0.666", 1.0 * bound2.width * bound2.height * ITERATIONS * 4);
+
+  {
+      GeglBuffer *buffer = gegl_buffer_new (&bound, format);
+      gegl_buffer_set (buffer, &bound, 0, NULL, sbuf, GEGL_AUTO_ROWSTRIDE);
+  test_start ();
+  for (i=0;i<ITERATIONS && converged < BAIL_COUNT;i++)
+    {
+      test_start_iter ();
+      gegl_buffer_get (buffer, &bound2, 0.666, babl_format ("R'G'B'A u8"), buf, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE|GEGL_BUFFER_FILTER_BILINEAR);
+      test_end_iter ();
+     }
+      g_object_unref (buffer);
+  }
+  test_end ("float to 8bit bilinear 0.666", 1.0 * bound2.width * bound2.height * ITERATIONS * 4);
+
   test_start ();
   for (i=0;i<ITERATIONS && converged < BAIL_COUNT;i++)
     {
@@ -0,0 +1,110 @@
+#include "test-common.h"
+
+/* compares building the same graph repeatedly by parsing its description,
+ * by instantiating a template compiled from it once, and by resetting the
+ * properties of an existing instance.
+ */
+
+#define GRAPHS 1000
+
+static const gchar *chain =
+  "gegl:crop x=0 y=0 width=512 height=512 "
+  "gegl:gaussian-blur std-dev-x=2.5 std-dev-y=2.5 "
+  "gegl:brightness-contrast contrast=1.2 brightness=0.1 "
+  "gegl:unsharp-mask std-dev=1.5 scale=0.8 "
+  "gegl:color-overlay value=rgba(0.2,0.4,0.8,0.5) "
+  "gegl:opacity value=0.75";
+
+static void
+report (const gchar *id,
+        long         ticks)
+{
+  g_print ("@ %s: %.2f graphs/second\n",
+           id, GRAPHS / (ticks / 1000000.0));
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GeglGraphTemplate *graph_template;
+  GeglNode          *graph;
+  GeglNode          *blur = NULL;
+  GSList            *children;
+  GSList            *iter;
+  GError            *error = NULL;
+  gint               i;
+
+  gegl_init (&argc, &argv);
+
+  graph_template = gegl_graph_template_new_from_chain (chain, 0, NULL,
+                                                       &error);
+
+  if (! graph_template)
+    {
+      g_printerr ("%s\n", error->message);
+      g_clear_error (&error);
+      return 1;
+    }
+
+  test_start ();
+
+  for (i = 0; i < GRAPHS; i++)
+    {
+      GeglNode *input;
+      GeglNode *output;
+
+      graph  = gegl_node_new ();
+      input  = gegl_node_get_input_proxy (graph, "input");
+      output = gegl_node_get_output_proxy (graph, "output");
+
+      gegl_node_link (input, output);
+      gegl_create_chain (chain, input, output, 0.0, 0, NULL, &error);
+
+      g_object_unref (graph);
+    }
+
+  report ("graph-parse", babl_ticks () - ticks_start);
+
+  test_start ();
+
+  for (i = 0; i < GRAPHS; i++)
+    {
+      graph = gegl_graph_template_instantiate (graph_template);
+
+      g_object_unref (graph);
+    }
+
+  report ("graph-instantiate", babl_ticks () - ticks_start);
+
+  graph = gegl_graph_template_instantiate (graph_template);
+
+  children = gegl_node_get_children (graph);
+
+  for (iter = children; iter; iter = g_slist_next (iter))
+    {
+      if (! g_strcmp0 (gegl_node_get_operation (iter->data),
+                       "gegl:gaussian-blur"))
+        blur = iter->data;
+    }
+
+  g_slist_free (children);
+
+  test_start ();
+
+  for (i = 0; i < GRAPHS; i++)
+    {
+      gegl_node_set (blur, "std-dev-x", (gdouble) i, NULL);
+
+      gegl_graph_template_reset (graph_template, graph);
+    }
+
+  report ("graph-reset", babl_ticks () - ticks_start);
+
+  g_object_unref (graph);
+  g_object_unref (graph_template);
+
+  gegl_exit ();
+
+  return 0;
+}
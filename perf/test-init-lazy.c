@@ -0,0 +1,192 @@
+#include "test-common.h"
+#include <string.h>
+#include <glib/gstdio.h>
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#endif
+#include "geglmoduledb.h"
+
+/* compares gegl_init() followed by the first use of a few operations, when
+ * all modules are loaded at init time, and when they are loaded on demand
+ * from a manifest.  each measurement runs in a fresh process.
+ */
+
+static const gchar *operations[] =
+{
+  "gegl:color",
+  "gegl:gaussian-blur",
+  "gegl:crop",
+  NULL
+};
+
+static gint
+write_manifest (gint    argc,
+                gchar **argv)
+{
+  GeglModuleDB *db;
+  GError       *error = NULL;
+  const gchar  *directory = argv[2];
+
+  gegl_init (&argc, &argv);
+
+  db = gegl_module_db_new (FALSE);
+
+  if (! gegl_module_db_write_manifest (db, directory, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_clear_error (&error);
+      return 1;
+    }
+
+  gegl_exit ();
+  return 0;
+}
+
+static gint
+time_init (gint    argc,
+           gchar **argv)
+{
+  GeglNode      *gegl;
+  GeglNode      *node = NULL;
+  GeglRectangle  rect = {0, 0, 64, 64};
+  guchar        *buf;
+  long           ticks;
+  gint           i;
+
+  test_start ();
+  gegl_init (&argc, &argv);
+
+  gegl = gegl_node_new ();
+
+  for (i = 0; operations[i]; i++)
+    {
+      GeglNode *child = gegl_node_new_child (gegl,
+                                             "operation", operations[i],
+                                             NULL);
+
+      if (node)
+        gegl_node_link (node, child);
+
+      node = child;
+    }
+
+  gegl_node_set (node, "width", 64.0, "height", 64.0, NULL);
+
+  buf = g_malloc (rect.width * rect.height * 4);
+  gegl_node_blit (node, 1.0, &rect, babl_format ("R'G'B'A u8"), buf,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+  g_free (buf);
+
+  g_object_unref (gegl);
+  gegl_exit ();
+
+  ticks = babl_ticks ()-ticks_start;
+  g_print ("@ %s: %.2f seconds\n", argv[2], (ticks / 1000000.0));
+  return 0;
+}
+
+#ifdef G_OS_UNIX
+static gboolean
+run (const gchar *self,
+     const gchar *mode,
+     const gchar *arg,
+     const gchar *gegl_path)
+{
+  const gchar  *child_argv[] = {self, mode, arg, NULL};
+  gchar       **envp = g_get_environ ();
+  gint          status;
+  gboolean      success;
+
+  envp = g_environ_setenv (envp, "GEGL_PATH", gegl_path, TRUE);
+
+  success = g_spawn_sync (NULL, (gchar **) child_argv, envp, 0,
+                          NULL, NULL, NULL, NULL, &status, NULL) &&
+            g_spawn_check_exit_status (status, NULL);
+
+  g_strfreev (envp);
+  return success;
+}
+
+static gint
+compare_init (const gchar *self,
+              const gchar *gegl_path)
+{
+  GDir        *dir;
+  const gchar *name;
+  gchar       *directory;
+  gint         result = 1;
+
+  /* index a copy of the module directory, so that other tests keep loading
+   * all modules.
+   */
+  directory = g_dir_make_tmp ("gegl-init-lazy-XXXXXX", NULL);
+
+  if (! directory)
+    return 1;
+
+  dir = g_dir_open (gegl_path, 0, NULL);
+
+  while (dir && (name = g_dir_read_name (dir)))
+    {
+      gchar *target = g_build_filename (gegl_path, name, NULL);
+      gchar *path   = g_build_filename (directory, name, NULL);
+
+      if (symlink (target, path))
+        g_printerr ("failed to link '%s'\n", target);
+
+      g_free (path);
+      g_free (target);
+    }
+
+  if (dir)
+    g_dir_close (dir);
+
+  if (run (self, "--write-manifest", directory,    "")        &&
+      run (self, "--time",           "init-eager", gegl_path) &&
+      run (self, "--time",           "init-lazy",  directory))
+    {
+      result = 0;
+    }
+
+  /* removes the links and the manifest */
+  dir = g_dir_open (directory, 0, NULL);
+
+  while (dir && (name = g_dir_read_name (dir)))
+    {
+      gchar *path = g_build_filename (directory, name, NULL);
+
+      g_unlink (path);
+      g_free (path);
+    }
+
+  if (dir)
+    g_dir_close (dir);
+
+  g_rmdir (directory);
+  g_free (directory);
+
+  return result;
+}
+#endif
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  if (argc == 3 && ! strcmp (argv[1], "--write-manifest"))
+    return write_manifest (argc, argv);
+  else if (argc == 3 && ! strcmp (argv[1], "--time"))
+    return time_init (argc, argv);
+
+  if (! g_getenv ("GEGL_PATH"))
+    {
+      g_printerr ("GEGL_PATH has to point to the modules\n");
+      return 1;
+    }
+
+#ifdef G_OS_UNIX
+  return compare_init (argv[0], g_getenv ("GEGL_PATH"));
+#else
+  return 0;
+#endif
+}
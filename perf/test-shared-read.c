@@ -0,0 +1,57 @@
+#include "test-common.h"
+
+#define SIZE      1024
+#define CHUNK     32
+#define N_PASSES  4
+
+void shared_read (GeglBuffer *buffer);
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GeglBuffer *buffer;
+
+  gegl_init (&argc, &argv);
+
+  buffer = test_buffer (SIZE, SIZE, babl_format ("RGBA float"));
+  do_bench ("shared read", buffer, &shared_read, FALSE);
+  g_object_unref (buffer);
+
+  gegl_exit ();
+  return 0;
+}
+
+/* every thread reads the entire buffer, in small chunks, like many workers
+ * sampling the same source do; since all of the buffer's tiles stay cached,
+ * this should scale with the number of threads.
+ */
+static void
+shared_read_thread (gint     i,
+                    gint     n,
+                    gpointer user_data)
+{
+  GeglBuffer *buffer = user_data;
+  gfloat     *chunk  = g_new (gfloat, CHUNK * CHUNK * 4);
+  gint        pass;
+  gint        x, y;
+
+  for (pass = 0; pass < N_PASSES; pass++)
+    {
+      for (y = 0; y < SIZE; y += CHUNK)
+        for (x = 0; x < SIZE; x += CHUNK)
+          {
+            GeglRectangle rect = {x, y, CHUNK, CHUNK};
+
+            gegl_buffer_get (buffer, &rect, 1.0, babl_format ("RGBA float"),
+                             chunk, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+          }
+    }
+
+  g_free (chunk);
+}
+
+void shared_read (GeglBuffer *buffer)
+{
+  gegl_parallel_distribute (-1, shared_read_thread, buffer);
+}
@@ -0,0 +1,95 @@
+#include "test-common.h"
+
+#define SIZE 1024
+
+void rows (GeglBuffer *buffer);
+void columns (GeglBuffer *buffer);
+
+static GeglBuffer *
+tile_buffer (gint tile_width,
+             gint tile_height)
+{
+  GeglBuffer *buffer;
+  GeglBuffer *source = test_buffer (SIZE, SIZE, babl_format ("RGBA float"));
+
+  buffer = g_object_new (GEGL_TYPE_BUFFER,
+                         "x",           0,
+                         "y",           0,
+                         "width",       SIZE,
+                         "height",      SIZE,
+                         "format",      babl_format ("RGBA float"),
+                         "tile-width",  tile_width,
+                         "tile-height", tile_height,
+                         NULL);
+  gegl_buffer_copy (source, NULL, GEGL_ABYSS_NONE, buffer, NULL);
+  g_object_unref (source);
+
+  return buffer;
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GeglBuffer *buffer;
+
+  gegl_init (&argc, &argv);
+
+  buffer = tile_buffer (128, 64);
+  do_bench ("rows (128x64 tiles)", buffer, &rows, FALSE);
+  do_bench ("columns (128x64 tiles)", buffer, &columns, FALSE);
+  g_object_unref (buffer);
+
+  buffer = tile_buffer (256, 32);
+  do_bench ("rows (256x32 tiles)", buffer, &rows, FALSE);
+  g_object_unref (buffer);
+
+  buffer = tile_buffer (32, 256);
+  do_bench ("columns (32x256 tiles)", buffer, &columns, FALSE);
+  g_object_unref (buffer);
+
+  gegl_exit ();
+  return 0;
+}
+
+/* read and write back one row at a time, like gegl:gblur-1d does for
+ * horizontal blurs
+ */
+void rows (GeglBuffer *buffer)
+{
+  gfloat *line = g_new (gfloat, SIZE * 4);
+  gint    y;
+
+  for (y = 0; y < SIZE; y++)
+    {
+      GeglRectangle row = {0, y, SIZE, 1};
+
+      gegl_buffer_get (buffer, &row, 1.0, babl_format ("RGBA float"), line,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+      gegl_buffer_set (buffer, &row, 0, babl_format ("RGBA float"), line,
+                       GEGL_AUTO_ROWSTRIDE);
+    }
+
+  g_free (line);
+}
+
+/* read and write back one column at a time, like gegl:gblur-1d does for
+ * vertical blurs
+ */
+void columns (GeglBuffer *buffer)
+{
+  gfloat *line = g_new (gfloat, SIZE * 4);
+  gint    x;
+
+  for (x = 0; x < SIZE; x++)
+    {
+      GeglRectangle col = {x, 0, 1, SIZE};
+
+      gegl_buffer_get (buffer, &col, 1.0, babl_format ("RGBA float"), line,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+      gegl_buffer_set (buffer, &col, 0, babl_format ("RGBA float"), line,
+                       GEGL_AUTO_ROWSTRIDE);
+    }
+
+  g_free (line);
+}
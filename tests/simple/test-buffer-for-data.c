@@ -0,0 +1,382 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gegl.h"
+#include "gegl-buffer-backend.h"
+
+#define SUCCESS 0
+#define FAILURE -1
+
+#define WIDTH   256
+#define HEIGHT  200
+#define PADDING 0xab
+
+#define FRAME_WIDTH  1920
+#define FRAME_HEIGHT 1080
+
+static void
+fill (guchar *data,
+      gint    width,
+      gint    height,
+      gint    rowstride,
+      gint    bpp)
+{
+  gint x, y;
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width * bpp; x++)
+      data[y * rowstride + x] = (x * 7 + y * 13) & 255;
+}
+
+/* reads @buffer back, writes a pattern through it, and checks that @data,
+ * including the padding past each row, ends up as expected.
+ */
+static gboolean
+round_trip (GeglBuffer *buffer,
+            guchar     *data,
+            gint        width,
+            gint        height,
+            gint        rowstride,
+            gint        bpp)
+{
+  const Babl *format = gegl_buffer_get_format (buffer);
+  guchar     *pixels;
+  gint        x, y;
+  gboolean    success = TRUE;
+
+  pixels = g_new (guchar, width * height * bpp);
+
+  gegl_buffer_get (buffer, NULL, 1.0, format, pixels,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (y = 0; y < height && success; y++)
+    success = ! memcmp (pixels + y * width * bpp, data + y * rowstride,
+                        width * bpp);
+
+  if (! success)
+    {
+      printf ("reading doesn't match the data\n");
+      g_free (pixels);
+
+      return FALSE;
+    }
+
+  for (x = 0; x < width * height * bpp; x++)
+    pixels[x] = 255 - pixels[x];
+
+  gegl_buffer_set (buffer, NULL, 0, format, pixels, GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_flush (buffer);
+
+  for (y = 0; y < height && success; y++)
+    {
+      success = ! memcmp (pixels + y * width * bpp, data + y * rowstride,
+                          width * bpp);
+
+      for (x = width * bpp; x < rowstride && success; x++)
+        success = data[y * rowstride + x] == PADDING;
+    }
+
+  if (! success)
+    printf ("writing doesn't match the data\n");
+
+  g_free (pixels);
+
+  return success;
+}
+
+static gint
+test_buffer_for_data (gint         width,
+                      gint         rowstride,
+                      gint         offset,
+                      const gchar *format_name)
+{
+  const Babl *format = babl_format (format_name);
+  gint        bpp    = babl_format_get_bytes_per_pixel (format);
+  GeglBuffer *buffer;
+  guchar     *allocation;
+  guchar     *data;
+  gint        result = SUCCESS;
+
+  allocation = g_malloc ((gsize) rowstride * HEIGHT + offset);
+  data       = allocation + offset;
+
+  memset (data, PADDING, (gsize) rowstride * HEIGHT);
+  fill (data, width, HEIGHT, rowstride, bpp);
+
+  buffer = gegl_buffer_new_for_data (data, format,
+                                     GEGL_RECTANGLE (0, 0, width, HEIGHT),
+                                     rowstride, NULL, NULL);
+
+  if (! round_trip (buffer, data, width, HEIGHT, rowstride, bpp))
+    {
+      printf ("%dx%d %s, rowstride %d, offset %d\n",
+              width, HEIGHT, format_name, rowstride, offset);
+
+      result = FAILURE;
+    }
+
+  g_object_unref (buffer);
+  g_free (allocation);
+
+  return result;
+}
+
+/* the tiles of a wide frame, too wide for tiles of many rows, have to point
+ * into the data rather than be copies of it.
+ */
+static gint
+test_buffer_for_data_wide (void)
+{
+  const Babl *format    = babl_format ("R'G'B'A u8");
+  gint        rowstride = FRAME_WIDTH * 4;
+  GeglBuffer *buffer;
+  guchar     *data;
+  guchar      pixel[4];
+  gint        tile_width;
+  gint        tile_height;
+  gint        y;
+  gint        result    = SUCCESS;
+
+  data   = g_new0 (guchar, (gsize) rowstride * FRAME_HEIGHT);
+  buffer = gegl_buffer_new_for_data (data, format,
+                                     GEGL_RECTANGLE (0, 0,
+                                                     FRAME_WIDTH, FRAME_HEIGHT),
+                                     0, NULL, NULL);
+
+  g_object_get (buffer,
+                "tile-width",  &tile_width,
+                "tile-height", &tile_height,
+                NULL);
+
+  if (tile_width != FRAME_WIDTH || tile_height % 2)
+    {
+      printf ("wide frame: %dx%d tiles\n", tile_width, tile_height);
+
+      result = FAILURE;
+    }
+
+  for (y = 0; result == SUCCESS && (y + 1) * tile_height <= FRAME_HEIGHT; y++)
+    {
+      GeglTile *tile = gegl_buffer_get_tile (buffer, 0, y, 0);
+
+      if (gegl_tile_get_data (tile) !=
+          data + (gsize) y * tile_height * rowstride)
+        {
+          printf ("wide frame: tile %d is a copy\n", y);
+
+          result = FAILURE;
+        }
+
+      gegl_tile_unref (tile);
+    }
+
+  /* with tiles pointing into the data, changes made to it behind GEGL's
+   * back show up right away, even in cached tiles.
+   */
+  if (result == SUCCESS)
+    {
+      data[(gsize) 3 * rowstride + 5 * 4] = 42;
+
+      gegl_buffer_get (buffer, GEGL_RECTANGLE (5, 3, 1, 1), 1.0, format,
+                       pixel, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+      if (pixel[0] != 42)
+        {
+          printf ("wide frame: a change to the data isn't seen\n");
+
+          result = FAILURE;
+        }
+    }
+
+  g_object_unref (buffer);
+  g_free (data);
+
+  return result;
+}
+
+static void
+count_destroy (gint *n_destroyed)
+{
+  (*n_destroyed)++;
+}
+
+static gint
+test_buffer_for_data_destroy (void)
+{
+  GeglBuffer *buffer;
+  guchar     *data;
+  gint        n_destroyed = 0;
+
+  data   = g_new0 (guchar, WIDTH * HEIGHT * 4);
+  buffer = gegl_buffer_new_for_data (data, babl_format ("R'G'B'A u8"),
+                                     GEGL_RECTANGLE (0, 0, WIDTH, HEIGHT),
+                                     0, (GDestroyNotify) count_destroy,
+                                     &n_destroyed);
+
+  g_object_unref (buffer);
+  g_free (data);
+
+  if (n_destroyed != 1)
+    {
+      printf ("destroy_fn called %d times\n", n_destroyed);
+
+      return FAILURE;
+    }
+
+  return SUCCESS;
+}
+
+/* mipmap levels of a borrowed buffer have to match the ones of a buffer
+ * holding the same pixels.
+ */
+static gint
+test_buffer_for_data_scaled (void)
+{
+  const Babl *format = babl_format ("R'G'B'A u8");
+  GeglBuffer *borrowed;
+  GeglBuffer *ram;
+  guchar     *data;
+  guchar     *scaled_borrowed;
+  guchar     *scaled_ram;
+  gint        n      = (WIDTH / 2) * (HEIGHT / 2) * 4;
+  gint        max    = 0;
+  gint        i;
+
+  data            = g_new (guchar, WIDTH * HEIGHT * 4);
+  scaled_borrowed = g_new0 (guchar, n);
+  scaled_ram      = g_new0 (guchar, n);
+
+  fill (data, WIDTH, HEIGHT, WIDTH * 4, 4);
+
+  borrowed = gegl_buffer_new_for_data (data, format,
+                                       GEGL_RECTANGLE (0, 0, WIDTH, HEIGHT),
+                                       0, NULL, NULL);
+  ram      = gegl_buffer_new (GEGL_RECTANGLE (0, 0, WIDTH, HEIGHT), format);
+
+  gegl_buffer_set (ram, NULL, 0, format, data, GEGL_AUTO_ROWSTRIDE);
+
+  gegl_buffer_get (borrowed, GEGL_RECTANGLE (0, 0, WIDTH / 2, HEIGHT / 2),
+                   0.5, format, scaled_borrowed, GEGL_AUTO_ROWSTRIDE,
+                   GEGL_ABYSS_NONE);
+  gegl_buffer_get (ram, GEGL_RECTANGLE (0, 0, WIDTH / 2, HEIGHT / 2),
+                   0.5, format, scaled_ram, GEGL_AUTO_ROWSTRIDE,
+                   GEGL_ABYSS_NONE);
+
+  for (i = 0; i < n; i++)
+    max = MAX (max, abs (scaled_borrowed[i] - scaled_ram[i]));
+
+  g_object_unref (borrowed);
+  g_object_unref (ram);
+  g_free (data);
+  g_free (scaled_borrowed);
+  g_free (scaled_ram);
+
+  if (max > 1)
+    {
+      printf ("scaled: maximal difference %d\n", max);
+
+      return FAILURE;
+    }
+
+  return SUCCESS;
+}
+
+/* GEGL_BLIT_TILED renders into the destination through a borrowed buffer,
+ * and has to match a plain blit.
+ */
+static gint
+test_blit_tiled (void)
+{
+  const Babl *format = babl_format ("R'G'B'A float");
+  GeglNode   *graph;
+  GeglNode   *noise;
+  gfloat     *tiled;
+  gfloat     *expected;
+  gint        result = SUCCESS;
+
+  tiled    = g_new0 (gfloat, 300 * HEIGHT * 4);
+  expected = g_new0 (gfloat, 300 * HEIGHT * 4);
+
+  graph = gegl_node_new ();
+  noise = gegl_node_new_child (graph,
+                               "operation", "gegl:noise-simplex",
+                               "scale",     0.1,
+                               NULL);
+
+  gegl_node_blit (noise, 1.0, GEGL_RECTANGLE (-10, 20, 300, HEIGHT),
+                  format, tiled, GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_TILED);
+  gegl_node_blit (noise, 1.0, GEGL_RECTANGLE (-10, 20, 300, HEIGHT),
+                  format, expected, GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  if (memcmp (tiled, expected, 300 * HEIGHT * 4 * sizeof (gfloat)))
+    {
+      printf ("tiled blit doesn't match a default blit\n");
+
+      result = FAILURE;
+    }
+
+  g_object_unref (graph);
+  g_free (tiled);
+  g_free (expected);
+
+  return result;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gint result = SUCCESS;
+
+  gegl_init (&argc, &argv);
+
+  /* tiles pointing into the data */
+  if (result == SUCCESS)
+    result = test_buffer_for_data (WIDTH, WIDTH * 4, 0, "R'G'B'A u8");
+
+  /* padded rows */
+  if (result == SUCCESS)
+    result = test_buffer_for_data (100, 128 * 4, 0, "R'G'B'A u8");
+
+  /* an unaligned pointer falls back to copied tiles */
+  if (result == SUCCESS)
+    result = test_buffer_for_data (WIDTH, WIDTH * 16, 1, "RGBA float");
+
+  /* an odd rowstride falls back to copied tiles */
+  if (result == SUCCESS)
+    result = test_buffer_for_data (101, 101 * 4, 0, "R'G'B'A u8");
+
+  if (result == SUCCESS)
+    result = test_buffer_for_data_wide ();
+
+  if (result == SUCCESS)
+    result = test_buffer_for_data_destroy ();
+
+  if (result == SUCCESS)
+    result = test_buffer_for_data_scaled ();
+
+  if (result == SUCCESS)
+    result = test_blit_tiled ();
+
+  gegl_exit ();
+
+  return result;
+}
@@ -0,0 +1,197 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#include "gegl.h"
+#include "gegl-plugin.h"
+
+#define SUCCESS 0
+#define FAILURE -1
+
+#define WIDTH     100
+#define HEIGHT    70
+#define TILE_SIZE 32
+#define OVERLAP   1
+
+typedef struct
+{
+  gint     n_tiles;
+  gint     max_tiles;
+  gboolean valid;
+} CountData;
+
+static gboolean
+count_tile (const GeglPyramidTile *tile,
+            CountData             *data)
+{
+  GeglRectangle roi = {0, 0, WIDTH, HEIGHT};
+  GeglRectangle level_rect;
+  GeglRectangle clipped;
+
+  gegl_buffer_pyramid_get_level_rect (&roi, tile->level, &level_rect);
+  gegl_rectangle_intersect (&clipped, &tile->rect, &level_rect);
+
+  if (! gegl_rectangle_equal (&clipped, &tile->rect)        ||
+      tile->rect.width  > TILE_SIZE + 2 * OVERLAP           ||
+      tile->rect.height > TILE_SIZE + 2 * OVERLAP           ||
+      tile->rowstride   < tile->rect.width *
+                          babl_format_get_bytes_per_pixel (tile->format))
+    {
+      data->valid = FALSE;
+    }
+
+  return g_atomic_int_add (&data->n_tiles, 1) + 1 < data->max_tiles;
+}
+
+static gint
+test_buffer_pyramid_n_levels (void)
+{
+  gint n_levels;
+
+  /* 1000x600, 500x300, 250x150 */
+  n_levels = gegl_buffer_pyramid_get_n_levels (
+    GEGL_RECTANGLE (0, 0, 1000, 600), 256);
+
+  if (n_levels != 3)
+    {
+      printf ("expected 3 levels, got %d\n", n_levels);
+
+      return FAILURE;
+    }
+
+  /* down to a single pixel */
+  n_levels = gegl_buffer_pyramid_get_n_levels (
+    GEGL_RECTANGLE (0, 0, 5, 3), 1);
+
+  if (n_levels != 4)
+    {
+      printf ("expected 4 levels, got %d\n", n_levels);
+
+      return FAILURE;
+    }
+
+  return SUCCESS;
+}
+
+/* level rectangles round outward, also for negative coordinates */
+static gint
+test_buffer_pyramid_level_rect (void)
+{
+  GeglRectangle roi = {-3, 5, 11, 7};
+  GeglRectangle level_rect;
+
+  gegl_buffer_pyramid_get_level_rect (&roi, 0, &level_rect);
+
+  if (! gegl_rectangle_equal (&level_rect, &roi))
+    return FAILURE;
+
+  gegl_buffer_pyramid_get_level_rect (&roi, 1, &level_rect);
+
+  if (! gegl_rectangle_equal (&level_rect, GEGL_RECTANGLE (-2, 2, 6, 4)))
+    {
+      printf ("level 1: %d,%d %dx%d\n", level_rect.x, level_rect.y,
+              level_rect.width, level_rect.height);
+
+      return FAILURE;
+    }
+
+  gegl_buffer_pyramid_get_level_rect (&roi, 2, &level_rect);
+
+  if (! gegl_rectangle_equal (&level_rect, GEGL_RECTANGLE (-1, 1, 3, 2)))
+    {
+      printf ("level 2: %d,%d %dx%d\n", level_rect.x, level_rect.y,
+              level_rect.width, level_rect.height);
+
+      return FAILURE;
+    }
+
+  return SUCCESS;
+}
+
+static gint
+test_buffer_pyramid_foreach (void)
+{
+  GeglRectangle  roi = {0, 0, WIDTH, HEIGHT};
+  GeglBuffer    *buffer;
+  CountData      data;
+  gint           n_levels;
+  gint           result = SUCCESS;
+
+  buffer   = gegl_buffer_new (&roi, babl_format ("R'G'B'A u8"));
+  n_levels = gegl_buffer_pyramid_get_n_levels (&roi, TILE_SIZE);
+
+  /* 100x70 in 4x3 tiles, 50x35 in 2x2 tiles, and 25x18 in a single one */
+  data.n_tiles   = 0;
+  data.max_tiles = G_MAXINT;
+  data.valid     = TRUE;
+
+  if (n_levels != 3 ||
+      ! gegl_buffer_pyramid_foreach (buffer, &roi, 0, n_levels,
+                                     TILE_SIZE, OVERLAP,
+                                     babl_format ("R'G'B'A u8"),
+                                     (GeglPyramidTileFunc) count_tile,
+                                     &data) ||
+      data.n_tiles != 12 + 4 + 1 || ! data.valid)
+    {
+      printf ("%d levels, %d tiles\n", n_levels, data.n_tiles);
+
+      result = FAILURE;
+    }
+
+  /* the walk stops when a callback fails */
+  data.n_tiles   = 0;
+  data.max_tiles = 1;
+
+  if (result == SUCCESS &&
+      gegl_buffer_pyramid_foreach (buffer, &roi, 0, n_levels,
+                                   TILE_SIZE, OVERLAP,
+                                   babl_format ("R'G'B'A u8"),
+                                   (GeglPyramidTileFunc) count_tile,
+                                   &data))
+    {
+      printf ("a failed callback didn't stop the walk\n");
+
+      result = FAILURE;
+    }
+
+  g_object_unref (buffer);
+
+  return result;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gint result = SUCCESS;
+
+  gegl_init (&argc, &argv);
+
+  if (result == SUCCESS)
+    result = test_buffer_pyramid_n_levels ();
+
+  if (result == SUCCESS)
+    result = test_buffer_pyramid_level_rect ();
+
+  if (result == SUCCESS)
+    result = test_buffer_pyramid_foreach ();
+
+  gegl_exit ();
+
+  return result;
+}
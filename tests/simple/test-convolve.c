@@ -0,0 +1,200 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "gegl.h"
+
+#define SUCCESS   0
+#define FAILURE   -1
+
+#define SIZE      64
+#define RADIUS    5
+#define TOLERANCE 1e-4
+
+static GeglNode *
+create_input (GeglNode *graph)
+{
+  return gegl_node_new_child (graph,
+                              "operation", "gegl:noise-simplex",
+                              "scale",     0.1,
+                              NULL);
+}
+
+/* connects a white square of @size pixels to the aux pad of @convolve */
+static void
+connect_kernel (GeglNode *graph,
+                GeglNode *convolve,
+                gint      size)
+{
+  GeglColor *white = gegl_color_new ("white");
+  GeglNode  *color;
+  GeglNode  *crop;
+
+  color = gegl_node_new_child (graph,
+                               "operation", "gegl:color",
+                               "value",     white,
+                               NULL);
+  crop  = gegl_node_new_child (graph,
+                               "operation", "gegl:crop",
+                               "width",     (gdouble) size,
+                               "height",    (gdouble) size,
+                               NULL);
+
+  gegl_node_link (color, crop);
+  gegl_node_connect (crop, "output", convolve, "aux");
+
+  g_object_unref (white);
+}
+
+static gboolean
+compare (const gfloat *a,
+         const gfloat *b,
+         gint          n,
+         const gchar  *name)
+{
+  gdouble max = 0.0;
+  gint    i;
+
+  for (i = 0; i < n; i++)
+    max = MAX (max, fabs (a[i] - b[i]));
+
+  if (max > TOLERANCE)
+    {
+      printf ("%s: maximal difference %g\n", name, max);
+
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* a uniform square kernel has to match box-blur */
+static gint
+test_convolve_box (void)
+{
+  const Babl *format = babl_format ("RaGaBaA float");
+  GeglNode   *graph;
+  GeglNode   *input;
+  GeglNode   *convolve;
+  GeglNode   *blur;
+  gfloat     *convolved;
+  gfloat     *blurred;
+  gint        result = SUCCESS;
+
+  convolved = g_new (gfloat, SIZE * SIZE * 4);
+  blurred   = g_new (gfloat, SIZE * SIZE * 4);
+
+  graph    = gegl_node_new ();
+  input    = create_input (graph);
+  convolve = gegl_node_new_child (graph,
+                                  "operation", "gegl:convolve",
+                                  NULL);
+  blur     = gegl_node_new_child (graph,
+                                  "operation", "gegl:box-blur",
+                                  "radius",    RADIUS,
+                                  NULL);
+
+  connect_kernel (graph, convolve, 2 * RADIUS + 1);
+  gegl_node_link (input, convolve);
+  gegl_node_link (input, blur);
+
+  gegl_node_blit (convolve, 1.0, GEGL_RECTANGLE (0, 0, SIZE, SIZE),
+                  format, convolved, GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+  gegl_node_blit (blur, 1.0, GEGL_RECTANGLE (0, 0, SIZE, SIZE),
+                  format, blurred, GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  if (! compare (convolved, blurred, SIZE * SIZE * 4, "box kernel"))
+    result = FAILURE;
+
+  g_object_unref (graph);
+  g_free (convolved);
+  g_free (blurred);
+
+  return result;
+}
+
+/* a single pixel kernel has to leave the input unchanged, including when
+ * rendering at a reduced level.
+ */
+static gint
+test_convolve_identity (gdouble scale)
+{
+  const Babl *format = babl_format ("RaGaBaA float");
+  GeglNode   *graph;
+  GeglNode   *input;
+  GeglNode   *convolve;
+  gfloat     *convolved;
+  gfloat     *expected;
+  gchar      *name;
+  gint        result = SUCCESS;
+
+  convolved = g_new (gfloat, SIZE * SIZE * 4);
+  expected  = g_new (gfloat, SIZE * SIZE * 4);
+
+  graph    = gegl_node_new ();
+  input    = create_input (graph);
+  convolve = gegl_node_new_child (graph,
+                                  "operation", "gegl:convolve",
+                                  NULL);
+
+  connect_kernel (graph, convolve, 1);
+  gegl_node_link (input, convolve);
+
+  gegl_node_blit (convolve, scale, GEGL_RECTANGLE (0, 0, SIZE, SIZE),
+                  format, convolved, GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+  gegl_node_blit (input, scale, GEGL_RECTANGLE (0, 0, SIZE, SIZE),
+                  format, expected, GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  name = g_strdup_printf ("identity kernel at scale %g", scale);
+
+  if (! compare (convolved, expected, SIZE * SIZE * 4, name))
+    result = FAILURE;
+
+  g_free (name);
+  g_object_unref (graph);
+  g_free (convolved);
+  g_free (expected);
+
+  return result;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gint result = SUCCESS;
+
+  gegl_init (&argc, &argv);
+  g_object_set (G_OBJECT (gegl_config ()),
+                "use-opencl", FALSE,
+                NULL);
+
+  if (result == SUCCESS)
+    result = test_convolve_box ();
+
+  if (result == SUCCESS)
+    result = test_convolve_identity (1.0);
+
+  if (result == SUCCESS)
+    result = test_convolve_identity (0.5);
+
+  gegl_exit ();
+
+  return result;
+}
@@ -0,0 +1,75 @@
+#!/bin/sh
+
+# Set by the test environment in tests/meson.build
+abs_top_srcdir=$ABS_TOP_SRCDIR
+abs_top_builddir=$ABS_TOP_BUILDDIR
+
+gegl=$abs_top_builddir/bin/gegl
+data=$abs_top_srcdir/tests/compositions/data
+out=$abs_top_builddir/tests/simple/gegl-server
+
+if [ ! -x $gegl ]; then
+  echo "Skipping test-gegl-server due to lack of gegl executable"
+  exit 77
+fi
+
+rm -rf $out
+mkdir -p $out
+
+# an output that a failing job must leave alone
+printf 'old' > $out/kept.unknown-format
+
+replies=$($gegl --server <<EOF
+{"id": "ok", "input": "$data/duck.png", "output": "$out/duck.png", "scale": 0.5}
+{"id": "missing", "input": "$out/missing.png", "output": "$out/missing-out.png"}
+{"id": "unsaved", "input": "$data/duck.png", "output": "$out/kept.unknown-format"}
+{"id": "no-output", "input": "$data/duck.png"}
+{"command": "quit"}
+{"id": "after-quit", "input": "$data/duck.png", "output": "$out/after-quit.png"}
+EOF
+)
+
+returncode=0
+
+fail ()
+{
+  echo "FAIL: $1"
+  returncode=1
+}
+
+expect_reply ()
+{
+  echo "$replies" | grep -F -q "{\"id\":\"$1\",\"status\":\"$2\"" ||
+    fail "job '$1' wasn't answered with status '$2'"
+}
+
+echo "$replies"
+
+expect_reply ok        ok
+expect_reply missing   error
+expect_reply unsaved   error
+expect_reply no-output error
+
+echo "$replies" | grep -F -q '"id":"missing","status":"error","message":"failed to load' ||
+  fail "the missing input wasn't reported as a failed load"
+
+[ $(echo "$replies" | wc -l) -eq 4 ] ||
+  fail "expected one reply per job before the quit command"
+
+[ -s $out/duck.png ] ||
+  fail "duck.png wasn't written"
+
+[ ! -e $out/missing-out.png ] && [ ! -e $out/after-quit.png ] ||
+  fail "an output was written for a failed or unprocessed job"
+
+[ "$(cat $out/kept.unknown-format)" = "old" ] ||
+  fail "a failed job replaced an earlier output"
+
+[ -z "$(ls -A $out | grep '^\.gegl-')" ] ||
+  fail "a temporary output was left behind"
+
+if [ $returncode -eq 0 ]; then
+  rm -rf $out
+fi
+
+exit $returncode
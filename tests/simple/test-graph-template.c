@@ -0,0 +1,292 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gegl.h"
+
+#define SUCCESS 0
+#define FAILURE -1
+
+#define SIZE    32
+#define CHAIN   "gegl:gaussian-blur std-dev-x=3 std-dev-y=3 gegl:invert"
+
+static GeglNode *
+create_input (GeglNode *graph)
+{
+  return gegl_node_new_child (graph,
+                              "operation", "gegl:noise-simplex",
+                              "scale",     0.1,
+                              NULL);
+}
+
+static GeglNode *
+find_child (GeglNode    *graph,
+            const gchar *operation)
+{
+  GSList   *children = gegl_node_get_children (graph);
+  GSList   *list;
+  GeglNode *found    = NULL;
+
+  for (list = children; list && ! found; list = g_slist_next (list))
+    {
+      const gchar *name = gegl_node_get_operation (list->data);
+
+      if (name && ! strcmp (name, operation))
+        found = list->data;
+    }
+
+  g_slist_free (children);
+
+  return found;
+}
+
+/* an instance of the template has to render like the chain it was
+ * created from.
+ */
+static gint
+test_graph_template_instantiate (void)
+{
+  const Babl        *format = babl_format ("R'G'B'A float");
+  GeglGraphTemplate *graph_template;
+  GeglNode          *graph;
+  GeglNode          *input;
+  GeglNode          *instance;
+  GeglNode          *blur;
+  GeglNode          *invert;
+  gfloat            *instantiated;
+  gfloat            *expected;
+  GError            *error  = NULL;
+  gint               result = SUCCESS;
+
+  graph_template = gegl_graph_template_new_from_chain (CHAIN, 0, NULL,
+                                                       &error);
+
+  if (! graph_template)
+    {
+      printf ("failed to create template: %s\n", error->message);
+      g_clear_error (&error);
+
+      return FAILURE;
+    }
+
+  instantiated = g_new0 (gfloat, SIZE * SIZE * 4);
+  expected     = g_new0 (gfloat, SIZE * SIZE * 4);
+
+  graph    = gegl_node_new ();
+  input    = create_input (graph);
+  instance = gegl_graph_template_instantiate (graph_template);
+  blur     = gegl_node_new_child (graph,
+                                  "operation", "gegl:gaussian-blur",
+                                  "std-dev-x", 3.0,
+                                  "std-dev-y", 3.0,
+                                  NULL);
+  invert   = gegl_node_new_child (graph,
+                                  "operation", "gegl:invert",
+                                  NULL);
+
+  gegl_node_add_child (graph, instance);
+  g_object_unref (instance);
+
+  gegl_node_link (input, instance);
+  gegl_node_link_many (input, blur, invert, NULL);
+
+  gegl_node_blit (instance, 1.0, GEGL_RECTANGLE (0, 0, SIZE, SIZE),
+                  format, instantiated, GEGL_AUTO_ROWSTRIDE,
+                  GEGL_BLIT_DEFAULT);
+  gegl_node_blit (invert, 1.0, GEGL_RECTANGLE (0, 0, SIZE, SIZE),
+                  format, expected, GEGL_AUTO_ROWSTRIDE,
+                  GEGL_BLIT_DEFAULT);
+
+  if (memcmp (instantiated, expected, SIZE * SIZE * 4 * sizeof (gfloat)))
+    {
+      printf ("instance doesn't match the chain\n");
+
+      result = FAILURE;
+    }
+
+  g_object_unref (graph);
+  g_object_unref (graph_template);
+  g_free (instantiated);
+  g_free (expected);
+
+  return result;
+}
+
+/* the template has to keep what it needs of the operations it captured
+ * once their nodes are gone: an instance is created and rendered before
+ * any other node of those operations exists.
+ */
+static gint
+test_graph_template_outlive_nodes (void)
+{
+  const Babl        *format = babl_format ("R'G'B'A float");
+  GeglGraphTemplate *graph_template;
+  GeglNode          *graph;
+  GeglNode          *input;
+  GeglNode          *instance;
+  GeglNode          *blur;
+  GeglNode          *invert;
+  gfloat            *instantiated;
+  gfloat            *expected;
+  gint               result = SUCCESS;
+
+  graph_template = gegl_graph_template_new_from_chain (CHAIN, 0, NULL, NULL);
+
+  if (! graph_template)
+    return FAILURE;
+
+  instantiated = g_new0 (gfloat, SIZE * SIZE * 4);
+  expected     = g_new0 (gfloat, SIZE * SIZE * 4);
+
+  graph    = gegl_node_new ();
+  input    = create_input (graph);
+  instance = gegl_graph_template_instantiate (graph_template);
+
+  g_object_unref (graph_template);
+
+  gegl_node_add_child (graph, instance);
+  g_object_unref (instance);
+
+  gegl_node_link (input, instance);
+
+  gegl_node_blit (instance, 1.0, GEGL_RECTANGLE (0, 0, SIZE, SIZE),
+                  format, instantiated, GEGL_AUTO_ROWSTRIDE,
+                  GEGL_BLIT_DEFAULT);
+
+  blur   = gegl_node_new_child (graph,
+                                "operation", "gegl:gaussian-blur",
+                                "std-dev-x", 3.0,
+                                "std-dev-y", 3.0,
+                                NULL);
+  invert = gegl_node_new_child (graph,
+                                "operation", "gegl:invert",
+                                NULL);
+
+  gegl_node_link_many (input, blur, invert, NULL);
+
+  gegl_node_blit (invert, 1.0, GEGL_RECTANGLE (0, 0, SIZE, SIZE),
+                  format, expected, GEGL_AUTO_ROWSTRIDE,
+                  GEGL_BLIT_DEFAULT);
+
+  if (memcmp (instantiated, expected, SIZE * SIZE * 4 * sizeof (gfloat)))
+    {
+      printf ("instance created after its nodes were destroyed doesn't "
+              "match the chain\n");
+
+      result = FAILURE;
+    }
+
+  g_object_unref (graph);
+  g_free (instantiated);
+  g_free (expected);
+
+  return result;
+}
+
+/* resetting an instance has to restore changed properties and
+ * pass-through, and to detect changed connections.
+ */
+static gint
+test_graph_template_reset (void)
+{
+  GeglGraphTemplate *graph_template;
+  GeglNode          *instance;
+  GeglNode          *blur;
+  gdouble            std_dev_x;
+  gint               result = SUCCESS;
+
+  graph_template = gegl_graph_template_new_from_chain (CHAIN, 0, NULL, NULL);
+
+  if (! graph_template)
+    return FAILURE;
+
+  instance = gegl_graph_template_instantiate (graph_template);
+  blur     = find_child (instance, "gegl:gaussian-blur");
+
+  if (! blur)
+    {
+      printf ("no gegl:gaussian-blur in the instance\n");
+
+      result = FAILURE;
+    }
+
+  if (result == SUCCESS)
+    {
+      gegl_node_set (blur, "std-dev-x", 10.0, NULL);
+      gegl_node_set_passthrough (blur, TRUE);
+
+      if (! gegl_graph_template_reset (graph_template, instance))
+        {
+          printf ("failed to reset an unchanged graph\n");
+
+          result = FAILURE;
+        }
+    }
+
+  if (result == SUCCESS)
+    {
+      gegl_node_get (blur, "std-dev-x", &std_dev_x, NULL);
+
+      if (std_dev_x != 3.0 || gegl_node_get_passthrough (blur))
+        {
+          printf ("reset didn't restore the node\n");
+
+          result = FAILURE;
+        }
+    }
+
+  if (result == SUCCESS)
+    {
+      gegl_node_disconnect (blur, "input");
+
+      if (gegl_graph_template_reset (graph_template, instance))
+        {
+          printf ("reset didn't detect a changed connection\n");
+
+          result = FAILURE;
+        }
+    }
+
+  g_object_unref (instance);
+  g_object_unref (graph_template);
+
+  return result;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gint result = SUCCESS;
+
+  gegl_init (&argc, &argv);
+
+  if (result == SUCCESS)
+    result = test_graph_template_instantiate ();
+
+  if (result == SUCCESS)
+    result = test_graph_template_outlive_nodes ();
+
+  if (result == SUCCESS)
+    result = test_graph_template_reset ();
+
+  gegl_exit ();
+
+  return result;
+}
@@ -0,0 +1,133 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gegl.h"
+
+#define SUCCESS 0
+#define FAILURE -1
+
+#define SIZE    64
+
+/* a gradient of the values just below 1.0, which round up past the end of
+ * the lookup table of the fused float to u8 resamplers.
+ */
+static GeglBuffer *
+create_gradient (void)
+{
+  GeglBuffer *buffer;
+  gfloat     *pixels;
+  gint        i;
+
+  buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, SIZE, SIZE),
+                            babl_format ("RGBA float"));
+  pixels = g_new (gfloat, SIZE * SIZE * 4);
+
+  for (i = 0; i < SIZE * SIZE; i++)
+    {
+      gfloat value = 1.0f - 0.0002f * i / (SIZE * SIZE);
+
+      if (value >= 1.0f)
+        value = nextafterf (1.0f, 0.0f);
+
+      pixels[i * 4 + 0] = value;
+      pixels[i * 4 + 1] = value;
+      pixels[i * 4 + 2] = value;
+      pixels[i * 4 + 3] = 1.0f;
+    }
+
+  gegl_buffer_set (buffer, NULL, 0, babl_format ("RGBA float"),
+                   pixels, GEGL_AUTO_ROWSTRIDE);
+
+  g_free (pixels);
+
+  return buffer;
+}
+
+/* compares a fused resample to a float resample converted afterwards */
+static gint
+test_resample_fused (GeglBuffer  *buffer,
+                     gdouble      scale,
+                     gint         filter,
+                     const gchar *name)
+{
+  const Babl    *u8     = babl_format ("R'G'B'A u8");
+  const Babl    *fl     = babl_format ("RGBA float");
+  GeglRectangle  rect   = {0, 0, SIZE * scale, SIZE * scale};
+  gint           n      = rect.width * rect.height;
+  guchar        *fused;
+  guchar        *expected;
+  gfloat        *sampled;
+  gint           max    = 0;
+  gint           i;
+
+  fused    = g_new0 (guchar, n * 4);
+  expected = g_new0 (guchar, n * 4);
+  sampled  = g_new0 (gfloat, n * 4);
+
+  gegl_buffer_get (buffer, &rect, scale, u8, fused,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE | filter);
+  gegl_buffer_get (buffer, &rect, scale, fl, sampled,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE | filter);
+
+  babl_process (babl_fish (fl, u8), sampled, expected, n);
+
+  for (i = 0; i < n * 4; i++)
+    max = MAX (max, abs (fused[i] - expected[i]));
+
+  g_free (fused);
+  g_free (expected);
+  g_free (sampled);
+
+  if (max > 1)
+    {
+      printf ("%s: maximal difference %d\n", name, max);
+
+      return FAILURE;
+    }
+
+  return SUCCESS;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  GeglBuffer *buffer;
+  gint        result = SUCCESS;
+
+  gegl_init (&argc, &argv);
+
+  buffer = create_gradient ();
+
+  if (result == SUCCESS)
+    result = test_resample_fused (buffer, 0.5, GEGL_BUFFER_FILTER_BOX,
+                                  "box filter");
+
+  if (result == SUCCESS)
+    result = test_resample_fused (buffer, 0.75, GEGL_BUFFER_FILTER_BILINEAR,
+                                  "bilinear");
+
+  g_object_unref (buffer);
+
+  gegl_exit ();
+
+  return result;
+}
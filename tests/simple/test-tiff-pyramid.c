@@ -0,0 +1,207 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib/gstdio.h>
+
+#include "gegl.h"
+
+#define SUCCESS   0
+#define FAILURE   -1
+
+#define WIDTH     200
+#define HEIGHT    150
+/* not a multiple of 16, so that tiff-save has to round it */
+#define TILE_SIZE 40
+#define TOLERANCE 2
+
+static GeglBuffer *
+create_input (void)
+{
+  GeglBuffer *buffer;
+  guchar     *pixels;
+  gint        x, y, c;
+
+  buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, WIDTH, HEIGHT),
+                            babl_format ("R'G'B'A u8"));
+  pixels = g_new (guchar, WIDTH * HEIGHT * 4);
+
+  for (y = 0; y < HEIGHT; y++)
+    for (x = 0; x < WIDTH; x++)
+      for (c = 0; c < 4; c++)
+        pixels[(y * WIDTH + x) * 4 + c] = c == 3 ? 255 :
+                                          (x * 7 + y * 13 + c * 50) & 255;
+
+  gegl_buffer_set (buffer, NULL, 0, babl_format ("R'G'B'A u8"),
+                   pixels, GEGL_AUTO_ROWSTRIDE);
+
+  g_free (pixels);
+
+  return buffer;
+}
+
+static gboolean
+save (GeglBuffer  *buffer,
+      const gchar *path)
+{
+  GeglNode *graph;
+  GeglNode *source;
+  GeglNode *save;
+  GError   *error = NULL;
+  gboolean  success;
+
+  graph  = gegl_node_new ();
+  source = gegl_node_new_child (graph,
+                                "operation", "gegl:buffer-source",
+                                "buffer",    buffer,
+                                NULL);
+  save   = gegl_node_new_child (graph,
+                                "operation", "gegl:tiff-save",
+                                "path",      path,
+                                "pyramid",   TRUE,
+                                "tile-size", TILE_SIZE,
+                                NULL);
+
+  gegl_node_link (source, save);
+
+  success = gegl_node_process_save (save, &error);
+
+  if (! success)
+    {
+      printf ("%s\n", error->message);
+      g_clear_error (&error);
+    }
+
+  g_object_unref (graph);
+
+  return success;
+}
+
+/* compares a level loaded from the file to the same level of the input */
+static gint
+compare_level (GeglBuffer  *input,
+               const gchar *path,
+               gint         level)
+{
+  const Babl    *format = babl_format ("R'G'B'A u8");
+  gdouble        scale  = 1.0 / (1 << level);
+  GeglRectangle  rect   = {0, 0, (WIDTH  + (1 << level) - 1) >> level,
+                                 (HEIGHT + (1 << level) - 1) >> level};
+  GeglNode      *graph;
+  GeglNode      *load;
+  guchar        *loaded;
+  guchar        *expected;
+  gint           max    = 0;
+  gint           i;
+
+  loaded   = g_new0 (guchar, rect.width * rect.height * 4);
+  expected = g_new0 (guchar, rect.width * rect.height * 4);
+
+  graph = gegl_node_new ();
+  load  = gegl_node_new_child (graph,
+                               "operation", "gegl:tiff-load",
+                               "path",      path,
+                               NULL);
+
+  gegl_node_blit (load, scale, &rect, format, loaded,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+  gegl_buffer_get (input, &rect, scale, format, expected,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (i = 0; i < rect.width * rect.height * 4; i++)
+    max = MAX (max, abs (loaded[i] - expected[i]));
+
+  g_object_unref (graph);
+  g_free (loaded);
+  g_free (expected);
+
+  if (max > TOLERANCE)
+    {
+      printf ("level %d: maximal difference %d\n", level, max);
+
+      return FAILURE;
+    }
+
+  return SUCCESS;
+}
+
+/* a pyramid written by tiff-save has to load back, at full resolution and
+ * from its reduced images.
+ */
+static gint
+test_tiff_pyramid (void)
+{
+  GeglBuffer *input;
+  GError     *error = NULL;
+  gchar      *path  = NULL;
+  gint        result = SUCCESS;
+  gint        level;
+  gint        fd;
+
+  fd = g_file_open_tmp ("gegl-test-tiff-pyramid-XXXXXX.tif", &path, &error);
+
+  if (fd < 0)
+    {
+      printf ("failed to create a temporary file: %s\n", error->message);
+      g_clear_error (&error);
+
+      return FAILURE;
+    }
+
+  g_close (fd, NULL);
+
+  input = create_input ();
+
+  if (! save (input, path))
+    {
+      printf ("failed to save '%s'\n", path);
+
+      result = FAILURE;
+    }
+
+  /* tiles of 48 pixels give 200x150, 100x75, 50x38 and 25x19 images */
+  for (level = 0; level < 4 && result == SUCCESS; level++)
+    result = compare_level (input, path, level);
+
+  g_unlink (path);
+  g_free (path);
+  g_object_unref (input);
+
+  return result;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gint result = SUCCESS;
+
+  gegl_init (&argc, &argv);
+
+  /* tiff-save and tiff-load are only built with libtiff */
+  if (gegl_has_operation ("gegl:tiff-save") &&
+      gegl_has_operation ("gegl:tiff-load"))
+    {
+      result = test_tiff_pyramid ();
+    }
+
+  gegl_exit ();
+
+  return result;
+}
@@ -0,0 +1,125 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* writes the manifests gegl_init() uses to register the operations of
+ * installed modules without loading them.  run at install time, with the
+ * module directories to index as arguments, or without arguments to index
+ * the default module directories.
+ */
+
+#include "config.h"
+
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gegl-plugin.h>
+
+#include "gegl-init-private.h"
+#include "geglmoduledb.h"
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GeglModuleDB *db;
+  GSList       *paths = NULL;
+  GSList       *list;
+  const gchar  *destdir;
+  gboolean      verbose = FALSE;
+  gint          status  = EXIT_SUCCESS;
+  gint          i;
+
+  for (i = 1; i < argc; i++)
+    {
+      if (! strcmp (argv[i], "-v") || ! strcmp (argv[i], "--verbose"))
+        {
+          verbose = TRUE;
+        }
+      else if (! strcmp (argv[i], "-h") || ! strcmp (argv[i], "--help"))
+        {
+          g_print ("usage: %s [-v] [DIRECTORY...]\n", argv[0]);
+          return EXIT_SUCCESS;
+        }
+      else
+        {
+          paths = g_slist_append (paths, g_strdup (argv[i]));
+        }
+    }
+
+  if (! paths)
+    paths = gegl_get_default_module_paths ();
+
+  /* the modules are loaded explicitly below; don't let gegl_init() load
+   * them, or index a stale manifest.
+   */
+  g_setenv ("GEGL_PATH", "", TRUE);
+
+  /* gegl_module_db_write_manifest() switches to the C locale itself, but
+   * gegl_init() can already initialize the classes of core operations.
+   */
+  setlocale (LC_ALL, "C");
+
+  gegl_init (&argc, &argv);
+
+  /* list the operations of all licenses; the loading application's license
+   * filters them again.
+   */
+  g_object_set (gegl_config (),
+                "application-license", "GPL3+",
+                NULL);
+
+  /* meson runs install scripts with the install prefix in the environment,
+   * which has to be prepended to the directories when staging an install.
+   */
+  destdir = g_getenv ("MESON_INSTALL_DESTDIR_PREFIX");
+
+  db = gegl_module_db_new (verbose);
+
+  for (list = paths; list; list = g_slist_next (list))
+    {
+      gchar  *directory = list->data;
+      GError *error     = NULL;
+
+      if (destdir && ! g_path_is_absolute (directory))
+        directory = g_build_filename (destdir, directory, NULL);
+      else
+        directory = g_strdup (directory);
+
+      if (! g_file_test (directory, G_FILE_TEST_IS_DIR))
+        {
+          g_free (directory);
+          continue;
+        }
+
+      if (! gegl_module_db_write_manifest (db, directory, &error))
+        {
+          g_printerr ("%s: %s\n", argv[0], error->message);
+          g_clear_error (&error);
+
+          status = EXIT_FAILURE;
+        }
+
+      g_free (directory);
+    }
+
+  g_object_unref (db);
+  g_slist_free_full (paths, g_free);
+
+  gegl_exit ();
+
+  return status;
+}
@@ -43,6 +43,7 @@ static GList *gegl_operations (void)
   static GList *operations = NULL;
   if (!operations)
     {
+      gegl_load_deferred_operations ();
       operations = gegl_operations_build (NULL, GEGL_TYPE_OPERATION);
       operations = g_list_sort (operations, compare_operation_names);
     }